@@ -16,8 +16,16 @@ fi
 echo "Chọn chế độ test:"
 echo "1. Test code chính (main.cpp)"
 echo "2. Test UART cơ bản (test-uart-basic.cpp)"
+echo "3. Test enroll với sensor giả lập (test-enroll-sim.cpp)"
+echo "4. Test lịch poll vân tay với đồng hồ ảo (test-scan-sim.cpp)"
+echo "5. Test trên máy, không cần ESP32 (test/native, cần cmake + g++)"
+echo "6. Benchmark offline queue trên LittleFS (test-queue-bench.cpp, xóa /queue)"
+echo "7. Test độ trễ access decision với stub server chậm (test-attendance-latency.cpp)"
+echo "8. Benchmark HTTP keep-alive với stub server (test-http-keepalive.cpp)"
+echo "9. Benchmark restore template với server + sensor giả lập (test-restore-sim.cpp)"
+echo "10. Test slot cache LRU + preload với 2 tuần check-in giả lập (test-slot-sim.cpp)"
 echo ""
-read -p "Chọn (1/2): " choice
+read -p "Chọn (1/2/3/4/5/6/7/8/9/10): " choice
 
 case $choice in
     1)
@@ -39,6 +47,79 @@ case $choice in
         cp test/test-uart-basic.cpp src/main.cpp
         echo "✓ Đã chuyển sang test-uart-basic.cpp"
         ;;
+    3)
+        echo ""
+        echo "→ Chuyển sang code test enroll (sensor giả lập, không cần R307)..."
+        if [ ! -f "src/main.cpp.bak" ]; then
+            cp src/main.cpp src/main.cpp.bak
+        fi
+        cp test/test-enroll-sim.cpp src/main.cpp
+        echo "✓ Đã chuyển sang test-enroll-sim.cpp"
+        ;;
+    4)
+        echo ""
+        echo "→ Chuyển sang code test lịch poll (đồng hồ ảo, không cần R307)..."
+        if [ ! -f "src/main.cpp.bak" ]; then
+            cp src/main.cpp src/main.cpp.bak
+        fi
+        cp test/test-scan-sim.cpp src/main.cpp
+        echo "✓ Đã chuyển sang test-scan-sim.cpp"
+        ;;
+    5)
+        echo ""
+        echo "→ Build và chạy test native (codec R307, UpChar với sensor giả lập)..."
+        cmake -S test/native -B .pio/native-test && \
+            cmake --build .pio/native-test && \
+            ctest --test-dir .pio/native-test --output-on-failure
+        exit $?
+        ;;
+    6)
+        echo ""
+        echo "→ Chuyển sang benchmark offline queue (xóa record offline trên thiết bị)..."
+        if [ ! -f "src/main.cpp.bak" ]; then
+            cp src/main.cpp src/main.cpp.bak
+        fi
+        cp test/test-queue-bench.cpp src/main.cpp
+        echo "✓ Đã chuyển sang test-queue-bench.cpp"
+        ;;
+    7)
+        echo ""
+        echo "→ Chuyển sang test độ trễ access decision..."
+        echo "  Cần chạy trước: python3 test/directus-http-stub.py (DIRECTUS_URL trỏ tới máy này)"
+        if [ ! -f "src/main.cpp.bak" ]; then
+            cp src/main.cpp src/main.cpp.bak
+        fi
+        cp test/test-attendance-latency.cpp src/main.cpp
+        echo "✓ Đã chuyển sang test-attendance-latency.cpp"
+        ;;
+    8)
+        echo ""
+        echo "→ Chuyển sang benchmark HTTP keep-alive..."
+        echo "  Cần chạy trước: python3 test/directus-http-stub.py (DIRECTUS_URL trỏ tới máy này)"
+        if [ ! -f "src/main.cpp.bak" ]; then
+            cp src/main.cpp src/main.cpp.bak
+        fi
+        cp test/test-http-keepalive.cpp src/main.cpp
+        echo "✓ Đã chuyển sang test-http-keepalive.cpp"
+        ;;
+    9)
+        echo ""
+        echo "→ Chuyển sang benchmark restore (server + sensor giả lập, không cần R307)..."
+        if [ ! -f "src/main.cpp.bak" ]; then
+            cp src/main.cpp src/main.cpp.bak
+        fi
+        cp test/test-restore-sim.cpp src/main.cpp
+        echo "✓ Đã chuyển sang test-restore-sim.cpp"
+        ;;
+    10)
+        echo ""
+        echo "→ Chuyển sang test slot cache (sensor + đồng hồ giả lập, không cần R307)..."
+        if [ ! -f "src/main.cpp.bak" ]; then
+            cp src/main.cpp src/main.cpp.bak
+        fi
+        cp test/test-slot-sim.cpp src/main.cpp
+        echo "✓ Đã chuyển sang test-slot-sim.cpp"
+        ;;
     *)
         echo "❌ Lựa chọn không hợp lệ"
         exit 1
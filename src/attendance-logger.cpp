@@ -0,0 +1,157 @@
+#include "attendance-logger.h"
+#include "directus-client.h"
+#include "offline-queue.h"
+
+AttendanceLogger::AttendanceLogger(DirectusClient* directus, OfflineQueue* offlineQueue) :
+    _directus(directus),
+    _offlineQueue(offlineQueue),
+    _queue(nullptr),
+    _task(nullptr),
+    _submitted(0),
+    _spilled(0),
+    _posted(0),
+    _deviceLock(portMUX_INITIALIZER_UNLOCKED)
+{
+    memset(_deviceId, 0, sizeof(_deviceId));
+}
+
+bool AttendanceLogger::begin(const String& deviceId) {
+    strlcpy(_deviceId, deviceId.c_str(), sizeof(_deviceId));
+
+    _queue = xQueueCreate(ATTENDANCE_QUEUE_LENGTH, sizeof(AttendanceRecord));
+    if (!_queue) {
+        Serial.println("[ATTEND] ✗ Cannot create queue");
+        return false;
+    }
+
+    BaseType_t ok = xTaskCreatePinnedToCore(AttendanceLogger::taskEntry, "attendance",
+                                            ATTENDANCE_TASK_STACK, this,
+                                            ATTENDANCE_TASK_PRIORITY, &_task,
+                                            ATTENDANCE_TASK_CORE);
+    if (ok != pdPASS) {
+        Serial.println("[ATTEND] ✗ Cannot start logger task");
+        vQueueDelete(_queue);
+        _queue = nullptr;
+        return false;
+    }
+
+    Serial.printf("[ATTEND] Logger ready (queue %d records, core %d)\n",
+                  ATTENDANCE_QUEUE_LENGTH, ATTENDANCE_TASK_CORE);
+    return true;
+}
+
+bool AttendanceLogger::submit(const String& memberId, uint16_t fingerprintId,
+                              uint16_t confidence, bool accessGranted,
+                              const String& reason) {
+    AttendanceRecord record;
+    memset(&record, 0, sizeof(record));
+    strlcpy(record.memberId, memberId.c_str(), sizeof(record.memberId));
+    strlcpy(record.reason, reason.c_str(), sizeof(record.reason));
+    record.fingerprintId = fingerprintId;
+    record.confidence = confidence;
+    record.accessGranted = accessGranted;
+    record.checkInTime = time(nullptr);  // Thời điểm scan, không phải lúc POST
+
+    _submitted++;
+
+    // Không chờ: queue đầy thì spill xuống flash ngay
+    if (!_queue || xQueueSend(_queue, &record, 0) != pdTRUE) {
+        spill(record);
+        return false;
+    }
+    return true;
+}
+
+void AttendanceLogger::spill(const AttendanceRecord& record) {
+    _spilled++;
+
+    if (!_offlineQueue) {
+        Serial.println("[ATTEND] ⚠ Queue full, no offline queue - record dropped");
+        return;
+    }
+
+    // Scan path: chỉ dùng UUID đã có (logger / member cache), không query Directus.
+    // Vẫn chưa có → "device_id":"", OfflineQueue điền lúc gửi
+    String id = deviceId();
+    if (id.length() == 0 && _directus->getMemberCache()) {
+        id = _directus->getMemberCache()->getDeviceUuid();
+    }
+    String payload = _directus->buildAttendancePayload(record.memberId, id,
+                                                       record.confidence,
+                                                       record.accessGranted,
+                                                       record.reason,
+                                                       record.checkInTime);
+    _offlineQueue->enqueue("/items/attendance", "POST", payload);
+    Serial.println("[ATTEND] Queue full - spilled record to offline queue");
+}
+
+void AttendanceLogger::run() {
+    AttendanceRecord record;
+
+    while (true) {
+        if (xQueueReceive(_queue, &record, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+
+        // Boot khi chưa đăng ký được device → resolve trên task này
+        String id = deviceId();
+        if (id.length() == 0) {
+            id = _directus->getDeviceId();
+            portENTER_CRITICAL(&_deviceLock);
+            strlcpy(_deviceId, id.c_str(), sizeof(_deviceId));
+            portEXIT_CRITICAL(&_deviceLock);
+        }
+
+        if (id.length() == 0 && _offlineQueue) {
+            // Device chưa đăng ký được: POST sẽ bị 400 → để OfflineQueue điền UUID lúc gửi
+            String payload = _directus->buildAttendancePayload(record.memberId, id,
+                                                               record.confidence,
+                                                               record.accessGranted,
+                                                               record.reason,
+                                                               record.checkInTime);
+            _offlineQueue->enqueue("/items/attendance", "POST", payload);
+            _posted++;
+            continue;
+        }
+
+        // logAttendance tự queue xuống OfflineQueue nếu offline / POST lỗi
+        _directus->logAttendance(record.memberId, id, record.fingerprintId,
+                                 record.confidence, record.accessGranted,
+                                 record.reason, record.checkInTime);
+        _posted++;
+    }
+}
+
+String AttendanceLogger::deviceId() {
+    char copy[sizeof(_deviceId)];
+    portENTER_CRITICAL(&_deviceLock);
+    memcpy(copy, _deviceId, sizeof(copy));
+    portEXIT_CRITICAL(&_deviceLock);
+    return String(copy);
+}
+
+void AttendanceLogger::taskEntry(void* param) {
+    static_cast<AttendanceLogger*>(param)->run();
+}
+
+uint32_t AttendanceLogger::getSubmittedCount() {
+    return _submitted;
+}
+
+uint32_t AttendanceLogger::getSpilledCount() {
+    return _spilled;
+}
+
+uint32_t AttendanceLogger::getPendingCount() {
+    return _queue ? uxQueueMessagesWaiting(_queue) : 0;
+}
+
+void AttendanceLogger::printInfo() {
+    Serial.println("\n=== Attendance logger ===");
+    Serial.printf("Submitted: %lu\n", (unsigned long)_submitted);
+    Serial.printf("Processed: %lu\n", (unsigned long)_posted);
+    Serial.printf("Pending (RAM): %lu/%d\n", (unsigned long)getPendingCount(),
+                  ATTENDANCE_QUEUE_LENGTH);
+    Serial.printf("Spilled to flash: %lu\n", (unsigned long)_spilled);
+    Serial.println("=========================\n");
+}
@@ -0,0 +1,82 @@
+#ifndef ATTENDANCE_LOGGER_H
+#define ATTENDANCE_LOGGER_H
+
+#include <Arduino.h>
+#include <time.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+
+#define ATTENDANCE_QUEUE_LENGTH 16     // Số record tối đa chờ trong RAM
+#define ATTENDANCE_TASK_STACK 8192     // HTTP + JSON cần stack lớn
+#define ATTENDANCE_TASK_PRIORITY 1
+#define ATTENDANCE_TASK_CORE 0         // Core network (loop() chạy core 1)
+
+class DirectusClient;
+class OfflineQueue;
+
+// Record POD để copy qua FreeRTOS queue (không dùng String)
+struct AttendanceRecord {
+    char memberId[37];
+    uint16_t fingerprintId;
+    uint16_t confidence;
+    bool accessGranted;
+    char reason[24];
+    time_t checkInTime;
+};
+
+/**
+ * AttendanceLogger - Ghi attendance bất đồng bộ
+ *
+ * Chức năng:
+ * - submit() chỉ copy record vào queue RAM, trả về ngay (không HTTP)
+ * - Task riêng trên core 0 drain queue và POST lên Directus
+ * - Queue RAM đầy → spill record xuống OfflineQueue (LittleFS)
+ * - Device UUID truyền vào lúc begin() → scan path không gọi Directus
+ */
+class AttendanceLogger {
+public:
+    AttendanceLogger(DirectusClient* directus, OfflineQueue* offlineQueue);
+
+    /**
+     * Tạo queue + network task
+     * @param deviceId Device UUID đã resolve lúc boot ("" nếu chưa đăng ký:
+     *                 logger task tự lấy lại, spill() trên scan path không gửi HTTP)
+     * @return true nếu khởi tạo thành công
+     */
+    bool begin(const String& deviceId);
+
+    /**
+     * Đưa attendance vào queue (non-blocking)
+     * @return true nếu vào queue RAM, false nếu đã spill xuống OfflineQueue
+     */
+    bool submit(const String& memberId, uint16_t fingerprintId, uint16_t confidence,
+                bool accessGranted, const String& reason);
+
+    uint32_t getSubmittedCount();
+    uint32_t getSpilledCount();
+    uint32_t getPendingCount();
+
+    void printInfo();
+
+private:
+    DirectusClient* _directus;
+    OfflineQueue* _offlineQueue;
+    QueueHandle_t _queue;
+    TaskHandle_t _task;
+
+    volatile uint32_t _submitted;
+    volatile uint32_t _spilled;
+    volatile uint32_t _posted;
+
+    char _deviceId[37];       // Chỉ logger task ghi (khi còn rỗng), đọc dưới _deviceLock
+    portMUX_TYPE _deviceLock;
+
+    String deviceId();
+
+    void spill(const AttendanceRecord& record);
+    void run();
+    static void taskEntry(void* param);
+};
+
+#endif
@@ -1,7 +1,29 @@
 #include "buzzer-handler.h"
 #include <Arduino.h>
 
-BuzzerHandler::BuzzerHandler() : initialized(false), enabled(true) {
+// Bảng pattern theo thứ tự enum BuzzerSound
+static const BuzzerPattern PATTERNS[] = {
+    {2, {{100, 150}, {100, 0}}},                                  // BUZZ_SUCCESS
+    {1, {{500, 0}}},                                              // BUZZ_ERROR
+    {1, {{200, 0}}},                                              // BUZZ_WARNING
+    {1, {{100, 0}}},                                              // BUZZ_SINGLE
+    {2, {{100, 150}, {100, 0}}},                                  // BUZZ_DOUBLE
+    {3, {{80, 100}, {80, 100}, {80, 0}}},                         // BUZZ_CONFIRM
+    {2, {{50, 500}, {50, 0}}},                                    // BUZZ_ENROLL_WAIT
+    {5, {{100, 100}, {100, 100}, {100, 100}, {150, 100}, {200, 0}}},  // BUZZ_ACCESS_GRANTED: ascend lên
+    {2, {{150, 100}, {150, 0}}},                                  // BUZZ_ACCESS_DENIED: 2 buzz
+    {1, {{200, 0}}}                                               // BUZZ_DELETE
+};
+
+BuzzerHandler::BuzzerHandler() :
+    initialized(false),
+    enabled(true),
+    timer(nullptr),
+    mux(portMUX_INITIALIZER_UNLOCKED),
+    step(0),
+    pinOn(false)
+{
+    memset(&current, 0, sizeof(current));
 }
 
 bool BuzzerHandler::begin() {
@@ -9,6 +31,15 @@ bool BuzzerHandler::begin() {
     pinMode(BUZZER_PIN, OUTPUT);
     digitalWrite(BUZZER_PIN, LOW);  // Start off
 
+    esp_timer_create_args_t args = {};
+    args.callback = BuzzerHandler::timerCallback;
+    args.arg = this;
+    args.name = "buzzer";
+    if (esp_timer_create(&args, &timer) != ESP_OK) {
+        Serial.println("✗ Không tạo được buzzer timer");
+        return false;
+    }
+
     initialized = true;
     Serial.println("✓ Buzzer KY-012 sẵn sàng!");
     return true;
@@ -26,65 +57,13 @@ bool BuzzerHandler::isEnabled() {
 }
 
 void BuzzerHandler::play(BuzzerSound sound) {
-    if (!initialized || !enabled) return;
-
-    switch (sound) {
-        case BUZZ_SUCCESS:
-            beep(100);
-            delay(150);
-            beep(100);
-            break;
-
-        case BUZZ_ERROR:
-            beep(500);
-            break;
-
-        case BUZZ_WARNING:
-            beep(200);
-            break;
-
-        case BUZZ_SINGLE:
-            beep(100);
-            break;
-
-        case BUZZ_DOUBLE:
-            beep(100);
-            delay(150);
-            beep(100);
-            break;
-
-        case BUZZ_CONFIRM:
-            beep(80);
-            delay(100);
-            beep(80);
-            delay(100);
-            beep(80);
-            break;
-
-        case BUZZ_ENROLL_WAIT:
-            beep(50);
-            delay(500);
-            beep(50);
-            break;
-
-        case BUZZ_ACCESS_GRANTED:
-            playSuccessMelody();
-            break;
-
-        case BUZZ_ACCESS_DENIED:
-            playErrorMelody();
-            break;
-
-        case BUZZ_DELETE:
-            beep(200);
-            break;
-    }
+    if ((size_t)sound >= sizeof(PATTERNS) / sizeof(PATTERNS[0])) return;
+    start(PATTERNS[sound]);
 }
 
 void BuzzerHandler::beep(int durationMs) {
-    digitalWrite(BUZZER_PIN, HIGH);
-    delay(durationMs);
-    digitalWrite(BUZZER_PIN, LOW);
+    BuzzerPattern pattern = {1, {{(uint16_t)durationMs, 0}}};
+    start(pattern);
 }
 
 void BuzzerHandler::beep(int frequency, int durationMs) {
@@ -93,36 +72,73 @@ void BuzzerHandler::beep(int frequency, int durationMs) {
 }
 
 void BuzzerHandler::beep(int frequency, int onMs, int offMs, int count) {
-    for (int i = 0; i < count; i++) {
-        beep(onMs);
-        if (i < count - 1) {
-            delay(offMs);
+    BuzzerPattern pattern;
+    memset(&pattern, 0, sizeof(pattern));
+    pattern.count = constrain(count, 0, BUZZER_MAX_STEPS);
+    for (uint8_t i = 0; i < pattern.count; i++) {
+        pattern.steps[i].onMs = onMs;
+        pattern.steps[i].offMs = (i < pattern.count - 1) ? offMs : 0;
+    }
+    start(pattern);
+}
+
+void BuzzerHandler::start(const BuzzerPattern& pattern) {
+    if (!initialized || !enabled || pattern.count == 0) return;
+
+    esp_timer_stop(timer);  // Âm mới thay thế âm đang phát
+
+    portENTER_CRITICAL(&mux);
+    current = pattern;
+    step = 0;
+    pinOn = false;
+    portEXIT_CRITICAL(&mux);
+
+    advance();
+}
+
+void BuzzerHandler::advance() {
+    uint32_t waitMs = 0;
+
+    portENTER_CRITICAL(&mux);
+    if (!pinOn && step < current.count) {
+        // Bắt đầu beep của bước hiện tại
+        pinOn = true;
+        waitMs = current.steps[step].onMs;
+    } else if (pinOn) {
+        // Hết beep → im lặng offMs rồi sang bước tiếp theo
+        pinOn = false;
+        waitMs = current.steps[step].offMs;
+        step++;
+        if (waitMs == 0 && step < current.count) {
+            pinOn = true;
+            waitMs = current.steps[step].onMs;
         }
     }
+    bool on = pinOn;
+    bool done = !pinOn && step >= current.count;
+    portEXIT_CRITICAL(&mux);
+
+    digitalWrite(BUZZER_PIN, on ? HIGH : LOW);
+    if (!done && waitMs > 0) {
+        esp_timer_start_once(timer, (uint64_t)waitMs * 1000);
+    }
 }
 
-void BuzzerHandler::playSuccessMelody() {
-    // Happy melody dài: ascend lên
-    beep(100);
-    delay(100);
-    beep(100);
-    delay(100);
-    beep(100);
-    delay(100);
-    beep(150);
-    delay(100);
-    beep(200);  // Note cao cuối
+void BuzzerHandler::timerCallback(void* param) {
+    static_cast<BuzzerHandler*>(param)->advance();
 }
 
-void BuzzerHandler::playErrorMelody() {
-    // Error ngắn: 2 buzz
-    beep(150);
-    delay(100);
-    beep(150);
+bool BuzzerHandler::isPlaying() {
+    return timer && esp_timer_is_active(timer);
 }
 
 void BuzzerHandler::stop() {
-    if (initialized) {
-        digitalWrite(BUZZER_PIN, LOW);
-    }
+    if (!initialized) return;
+
+    esp_timer_stop(timer);
+    portENTER_CRITICAL(&mux);
+    step = current.count;
+    pinOn = false;
+    portEXIT_CRITICAL(&mux);
+    digitalWrite(BUZZER_PIN, LOW);
 }
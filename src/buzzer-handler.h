@@ -1,8 +1,12 @@
 #ifndef BUZZER_HANDLER_H
 #define BUZZER_HANDLER_H
 
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
 #include "config.h"
 
+#define BUZZER_MAX_STEPS 5  // Số beep tối đa trong một pattern
+
 // Loại âm thanh
 enum BuzzerSound {
     BUZZ_SUCCESS,      // Thành công - 2 beep ngắn, cao
@@ -17,10 +21,39 @@ enum BuzzerSound {
     BUZZ_DELETE        // Xóa - 1 beep
 };
 
+// Một beep: kêu onMs rồi im offMs (offMs = 0 ở bước cuối)
+struct BuzzerStep {
+    uint16_t onMs;
+    uint16_t offMs;
+};
+
+struct BuzzerPattern {
+    uint8_t count;
+    BuzzerStep steps[BUZZER_MAX_STEPS];
+};
+
+/**
+ * BuzzerHandler - Âm thanh phản hồi (KY-012 active buzzer)
+ *
+ * Pattern lấy từ bảng tĩnh, esp_timer đảo chân buzzer theo từng bước
+ * → play() trả về ngay, không có delay() trên scan path.
+ * Âm mới thay thế âm đang phát (kết quả mới nhất luôn được nghe ngay).
+ */
 class BuzzerHandler {
 private:
     bool initialized;
     bool enabled;  // Cho phép tắt tiếng nếu cần
+    esp_timer_handle_t timer;
+    portMUX_TYPE mux;
+
+    // Pattern đang phát (copy để beep() tùy biến dùng chung đường đi)
+    BuzzerPattern current;
+    uint8_t step;
+    bool pinOn;
+
+    void start(const BuzzerPattern& pattern);
+    void advance();
+    static void timerCallback(void* param);
 
 public:
     BuzzerHandler();
@@ -32,15 +65,14 @@ public:
     void setEnabled(bool enabled);
     bool isEnabled();
 
-    // Phát âm thanh
+    // Phát âm thanh (non-blocking)
     void play(BuzzerSound sound);
     void beep(int durationMs);  // KY-012 active buzzer - chỉ cần duration
     void beep(int frequency, int durationMs);  // Không dùng cho active buzzer
     void beep(int frequency, int onMs, int offMs, int count);
 
-    // Melody cho access granted
-    void playSuccessMelody();
-    void playErrorMelody();
+    // Đang phát pattern
+    bool isPlaying();
 
     // Dừng âm thanh
     void stop();
@@ -0,0 +1,155 @@
+#include "command-dedup.h"
+
+#define COMMAND_DEDUP_MAGIC 0x43445550  // "CDUP"
+#define COMMAND_DEDUP_VERSION 1
+
+struct CommandDedupHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint8_t slots;
+    uint8_t next;
+};
+
+CommandDedup::CommandDedup() :
+    _next(0),
+    _initialized(false),
+    _duplicates(0)
+{
+    memset(_entries, 0, sizeof(_entries));
+    _lock = xSemaphoreCreateMutex();
+}
+
+bool CommandDedup::begin() {
+    _initialized = true;
+
+    File file = LittleFS.open(COMMAND_DEDUP_FILE, "r");
+    if (!file) {
+        Serial.println("[CMD] No command dedup ring on flash, starting empty");
+        return true;
+    }
+
+    CommandDedupHeader header;
+    bool ok = file.read((uint8_t*)&header, sizeof(header)) == sizeof(header) &&
+              header.magic == COMMAND_DEDUP_MAGIC &&
+              header.version == COMMAND_DEDUP_VERSION &&
+              header.slots == COMMAND_DEDUP_SLOTS &&
+              header.next < COMMAND_DEDUP_SLOTS &&
+              file.read((uint8_t*)_entries, sizeof(_entries)) == sizeof(_entries);
+    file.close();
+
+    if (!ok) {
+        memset(_entries, 0, sizeof(_entries));
+        Serial.println("[CMD] ⚠ Command dedup ring invalid, starting empty");
+        return true;
+    }
+    _next = header.next;
+
+    // Lệnh đang chạy lúc mất điện / restart: không biết đã làm tới đâu → không chạy lại
+    uint8_t interrupted = 0;
+    for (uint8_t i = 0; i < COMMAND_DEDUP_SLOTS; i++) {
+        Entry& entry = _entries[i];
+        entry.commandId[COMMAND_DEDUP_ID_MAX - 1] = '\0';
+        entry.payload[COMMAND_DEDUP_PAYLOAD_MAX - 1] = '\0';
+        if (entry.commandId[0] != '\0' && entry.payload[0] == '\0') {
+            strlcpy(entry.payload, "{\"status\":\"failed\",\"error_message\":\"Interrupted by restart\"}",
+                    sizeof(entry.payload));
+            interrupted++;
+        }
+    }
+    if (interrupted > 0) {
+        save();
+        Serial.printf("[CMD] ⚠ %d command(s) interrupted by restart\n", interrupted);
+    }
+    return true;
+}
+
+int CommandDedup::find(const String& commandId) {
+    for (uint8_t i = 0; i < COMMAND_DEDUP_SLOTS; i++) {
+        if (_entries[i].commandId[0] != '\0' && commandId == _entries[i].commandId) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+DedupState CommandDedup::lookup(const String& commandId, JsonDocument& cached) {
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    int index = find(commandId);
+    DedupState state = DEDUP_NEW;
+    if (index >= 0) {
+        _duplicates++;
+        if (_entries[index].payload[0] == '\0') {
+            state = DEDUP_PENDING;
+        } else {
+            state = DEDUP_DONE;
+            deserializeJson(cached, _entries[index].payload);
+        }
+    }
+    xSemaphoreGive(_lock);
+    return state;
+}
+
+bool CommandDedup::recordPending(const String& commandId) {
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    bool ok = find(commandId) >= 0;
+    for (uint8_t i = 0; !ok && i < COMMAND_DEDUP_SLOTS; i++) {
+        // Bỏ qua entry chưa có status cuối: ghi đè sẽ làm lệnh đó chạy lại khi redeliver
+        uint8_t index = (_next + i) % COMMAND_DEDUP_SLOTS;
+        Entry& entry = _entries[index];
+        if (entry.commandId[0] != '\0' && entry.payload[0] == '\0') continue;
+
+        strlcpy(entry.commandId, commandId.c_str(), sizeof(entry.commandId));
+        entry.payload[0] = '\0';
+        _next = (index + 1) % COMMAND_DEDUP_SLOTS;
+        save();
+        ok = true;
+    }
+    xSemaphoreGive(_lock);
+    return ok;
+}
+
+void CommandDedup::recordFinal(const String& commandId, const String& status,
+                               JsonObject result, const String& errorMsg) {
+    JsonDocument doc;
+    doc["status"] = status;
+    if (!result.isNull()) doc["result"] = result;
+    if (errorMsg.length() > 0) doc["error_message"] = errorMsg;
+
+    // Result quá lớn → chỉ giữ status (lệnh vẫn không bị chạy lại)
+    if (measureJson(doc) >= COMMAND_DEDUP_PAYLOAD_MAX) {
+        doc.remove("result");
+    }
+
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    int index = find(commandId);
+    if (index >= 0) {
+        serializeJson(doc, _entries[index].payload, sizeof(_entries[index].payload));
+        save();
+    }
+    xSemaphoreGive(_lock);
+}
+
+bool CommandDedup::save() {
+    if (!_initialized) return false;
+
+    File file = LittleFS.open(COMMAND_DEDUP_FILE, "w");
+    if (!file) {
+        Serial.println("[CMD] ✗ Cannot open command dedup ring for writing");
+        return false;
+    }
+
+    CommandDedupHeader header;
+    header.magic = COMMAND_DEDUP_MAGIC;
+    header.version = COMMAND_DEDUP_VERSION;
+    header.slots = COMMAND_DEDUP_SLOTS;
+    header.next = _next;
+
+    bool ok = file.write((const uint8_t*)&header, sizeof(header)) == sizeof(header) &&
+              file.write((const uint8_t*)_entries, sizeof(_entries)) == sizeof(_entries);
+    file.close();
+    return ok;
+}
+
+uint32_t CommandDedup::getDuplicateCount() {
+    return _duplicates;
+}
@@ -0,0 +1,82 @@
+#ifndef COMMAND_DEDUP_H
+#define COMMAND_DEDUP_H
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <ArduinoJson.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include "config.h"
+
+#define COMMAND_DEDUP_FILE "/command-dedup.bin"
+
+#ifndef COMMAND_DEDUP_SLOTS
+#define COMMAND_DEDUP_SLOTS 16         // Số command_id gần nhất được nhớ
+#endif
+
+#define COMMAND_DEDUP_ID_MAX 48
+#define COMMAND_DEDUP_PAYLOAD_MAX 256  // {status, result, error_message} đã serialize
+
+// Trạng thái của command_id trong ring
+enum DedupState {
+    DEDUP_NEW,       // Chưa thấy → thực thi
+    DEDUP_PENDING,   // Đã nhận, đang chờ / đang chạy
+    DEDUP_DONE       // Đã có status cuối → publish lại, không chạy lại
+};
+
+/**
+ * CommandDedup - Ring command_id đã nhận (MQTT QoS 1 có thể redeliver)
+ *
+ * Chức năng:
+ * - Ghi command_id khi lệnh được nhận vào queue, ghi status cuối khi xong
+ * - Lệnh trùng: trả về status cuối đã lưu để publish lại thay vì chạy lại
+ *   (enroll / delete_all / restart không bị chạy 2 lần sau broker failover)
+ * - Lưu LittleFS mỗi lần thay đổi (lệnh hiếm, an toàn hơn ghi theo lô)
+ * - Lệnh đang dở khi reboot → coi như failed "Interrupted by restart"
+ */
+class CommandDedup {
+public:
+    CommandDedup();
+
+    /**
+     * Load ring từ flash (LittleFS đã được MemberCache mount)
+     */
+    bool begin();
+
+    /**
+     * Tra cứu command_id
+     * @param cached Status cuối đã lưu (chỉ khi DEDUP_DONE)
+     */
+    DedupState lookup(const String& commandId, JsonDocument& cached);
+
+    /**
+     * Lệnh mới được nhận (ghi đè entry đã xong cũ nhất nếu ring đầy)
+     * @return false nếu mọi entry đều còn đang chờ / chạy (không ghi đè)
+     */
+    bool recordPending(const String& commandId);
+
+    /**
+     * Lưu status cuối (completed / failed / cancelled) của lệnh đã ghi nhận
+     */
+    void recordFinal(const String& commandId, const String& status,
+                     JsonObject result, const String& errorMsg);
+
+    uint32_t getDuplicateCount();
+
+private:
+    struct Entry {
+        char commandId[COMMAND_DEDUP_ID_MAX];
+        char payload[COMMAND_DEDUP_PAYLOAD_MAX];  // "" = chưa có status cuối
+    };
+
+    Entry _entries[COMMAND_DEDUP_SLOTS];
+    uint8_t _next;  // Entry sẽ bị ghi đè tiếp theo
+    SemaphoreHandle_t _lock;
+    bool _initialized;
+    volatile uint32_t _duplicates;
+
+    int find(const String& commandId);
+    bool save();
+};
+
+#endif
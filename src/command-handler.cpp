@@ -1,4 +1,6 @@
 #include "command-handler.h"
+#include "template-restore.h"
+#include "slot-manager.h"
 #include <base64.h>
 
 CommandHandler::CommandHandler(FingerprintHandler* fp, MQTTClient* mqtt,
@@ -7,9 +9,238 @@ CommandHandler::CommandHandler(FingerprintHandler* fp, MQTTClient* mqtt,
     _mqtt(mqtt),
     _directus(directus),
     _wifi(wifi),
+    _rejected(0),
+    _lock(nullptr),
+    _head(0),
+    _count(0),
+    _currentStartedAt(0),
+    _cancelRequested(false),
+    _enroll(fp, fp->getBuzzer()),
+    _enrollIsUpdate(false),
+    _enrollStage(ENROLL_IDLE),
     _paused(false),
     _pauseStartTime(0)
 {
+    _currentId[0] = '\0';
+    _currentType[0] = '\0';
+}
+
+bool CommandHandler::begin() {
+    _lock = xSemaphoreCreateMutex();
+    if (!_lock) {
+        Serial.println("[CMD] ✗ Cannot create command queue lock");
+        return false;
+    }
+    return _dedup.begin();
+}
+
+bool CommandHandler::enqueue(const String& commandId, const String& type, JsonObject params) {
+    // Chỉ đọc trạng thái RAM → trả lời ngay, kể cả khi đang có lệnh dài chạy
+    if (type == "get_status") {
+        handleGetStatus(commandId);
+        return true;
+    }
+    if (type == "cancel") {
+        handleCancel(commandId, params);
+        return true;
+    }
+
+    // QoS 1 redelivery: không chạy lại lệnh đã nhận
+    JsonDocument cached;
+    DedupState seen = _dedup.lookup(commandId, cached);
+    if (seen == DEDUP_DONE) {
+        Serial.printf("[CMD] ⚠ Duplicate %s, republishing final status\n", commandId.c_str());
+        if (_mqtt && _mqtt->isConnected()) {
+            _mqtt->publishStatus(commandId, cached["status"] | "completed",
+                                 cached["result"].as<JsonObject>(), cached["error_message"] | "");
+        }
+        return true;
+    }
+    if (seen == DEDUP_PENDING) {
+        bool running = false;
+        if (_lock) {
+            xSemaphoreTake(_lock, portMAX_DELAY);
+            running = commandId == _currentId;
+            xSemaphoreGive(_lock);
+        }
+        Serial.printf("[CMD] ⚠ Duplicate %s, still %s\n", commandId.c_str(),
+                      running ? "running" : "queued");
+        publishStatus(commandId, running ? "processing" : "queued");
+        return true;
+    }
+
+    QueuedCommand command;
+    memset(&command, 0, sizeof(command));
+    strlcpy(command.commandId, commandId.c_str(), sizeof(command.commandId));
+    strlcpy(command.type, type.c_str(), sizeof(command.type));
+
+    if (measureJson(params) >= sizeof(command.params)) {
+        _rejected++;
+        publishStatus(commandId, "failed", JsonObject(), "Params too large");
+        return false;
+    }
+    serializeJson(params, command.params, sizeof(command.params));
+
+    uint8_t position = 0;
+    if (_lock) {
+        xSemaphoreTake(_lock, portMAX_DELAY);
+        // Chỉ ghi nhận lệnh được nhận vào queue (lệnh bị từ chối gửi lại phải chạy được).
+        // Ghi trước khi thả _lock: sensor task có thể chạy xong trước khi hàm này trả về
+        if (_count < COMMAND_QUEUE_LENGTH && _dedup.recordPending(commandId)) {
+            _pending[(_head + _count) % COMMAND_QUEUE_LENGTH] = command;
+            _count++;
+            position = _count;
+        }
+        xSemaphoreGive(_lock);
+    }
+
+    if (position == 0) {
+        _rejected++;
+        Serial.printf("[CMD] ✗ Queue full, rejecting %s\n", command.type);
+        publishStatus(commandId, "failed", JsonObject(), "Device busy");
+        return false;
+    }
+
+    JsonDocument resultDoc;
+    resultDoc["position"] = position;
+    publishStatus(commandId, "queued", resultDoc.as<JsonObject>());
+    return true;
+}
+
+bool CommandHandler::processPending() {
+    if (!_lock) return false;
+
+    // Enroll đang chờ ngón tay → chỉ step, lệnh tiếp theo chờ tới khi xong
+    if (_enroll.isActive()) {
+        stepEnroll();
+        return true;
+    }
+
+    QueuedCommand command;
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    if (_count == 0) {
+        xSemaphoreGive(_lock);
+        return false;
+    }
+    command = _pending[_head];
+    _head = (_head + 1) % COMMAND_QUEUE_LENGTH;
+    _count--;
+    strlcpy(_currentId, command.commandId, sizeof(_currentId));
+    strlcpy(_currentType, command.type, sizeof(_currentType));
+    _currentStartedAt = millis();
+    _cancelRequested = false;
+    xSemaphoreGive(_lock);
+
+    JsonDocument params;
+    deserializeJson(params, command.params);
+    executeCommand(command.commandId, command.type, params.as<JsonObject>());
+
+    // Enroll / update vừa bắt đầu: vẫn là lệnh đang chạy cho tới khi session kết thúc
+    if (!_enroll.isActive()) {
+        clearCurrent();
+    }
+    return true;
+}
+
+void CommandHandler::clearCurrent() {
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    _currentId[0] = '\0';
+    _currentType[0] = '\0';
+    _cancelRequested = false;
+    xSemaphoreGive(_lock);
+}
+
+void CommandHandler::handleCancel(const String& cmdId, JsonObject params) {
+    String target = params["command_id"] | "";
+    if (target.length() == 0) {
+        publishStatus(cmdId, "failed", JsonObject(), "Missing command_id");
+        return;
+    }
+
+    if (!_lock) return;
+
+    bool removed = false;
+    bool running = false;
+
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    for (uint8_t i = 0; i < _count; i++) {
+        if (target != _pending[(_head + i) % COMMAND_QUEUE_LENGTH].commandId) continue;
+
+        // Dồn các lệnh phía sau lên một vị trí
+        for (uint8_t j = i; j + 1 < _count; j++) {
+            _pending[(_head + j) % COMMAND_QUEUE_LENGTH] =
+                _pending[(_head + j + 1) % COMMAND_QUEUE_LENGTH];
+        }
+        _count--;
+        removed = true;
+        break;
+    }
+    if (!removed && target == _currentId) {
+        _cancelRequested = true;
+        running = true;
+    }
+    xSemaphoreGive(_lock);
+
+    if (!removed && !running) {
+        publishStatus(cmdId, "failed", JsonObject(), "Command not queued or running");
+        return;
+    }
+
+    Serial.printf("[CMD] Cancel %s (%s)\n", target.c_str(), removed ? "queued" : "running");
+    if (removed) {
+        publishStatus(target, "cancelled");
+    }
+    // Lệnh đang chạy tự publish "cancelled" khi dừng xong
+
+    JsonDocument resultDoc;
+    resultDoc["command_id"] = target;
+    resultDoc["state"] = removed ? "queued" : "running";
+    publishStatus(cmdId, "completed", resultDoc.as<JsonObject>());
+}
+
+void CommandHandler::fillQueueStatus(JsonObject out) {
+    if (!_lock) return;
+
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    if (_currentId[0] != '\0') {
+        JsonObject running = out["running"].to<JsonObject>();
+        running["command_id"] = (const char*)_currentId;
+        running["type"] = (const char*)_currentType;
+        running["elapsed_ms"] = millis() - _currentStartedAt;
+        running["cancel_requested"] = (bool)_cancelRequested;
+        if (_enroll.isActive()) {
+            running["stage"] = EnrollSession::stateName(_enrollStage);
+        }
+    }
+
+    JsonArray queued = out["queued"].to<JsonArray>();
+    for (uint8_t i = 0; i < _count; i++) {
+        const QueuedCommand& command = _pending[(_head + i) % COMMAND_QUEUE_LENGTH];
+        JsonObject item = queued.add<JsonObject>();
+        item["command_id"] = (const char*)command.commandId;
+        item["type"] = (const char*)command.type;
+    }
+    xSemaphoreGive(_lock);
+
+    out["rejected"] = (uint32_t)_rejected;
+    out["duplicates"] = _dedup.getDuplicateCount();
+}
+
+uint32_t CommandHandler::getPendingCount() {
+    if (!_lock) return 0;
+
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    uint32_t count = _count;
+    xSemaphoreGive(_lock);
+    return count;
+}
+
+uint32_t CommandHandler::getRejectedCount() {
+    return _rejected;
+}
+
+bool CommandHandler::isEnrolling() {
+    return _enroll.isActive();
 }
 
 bool CommandHandler::executeCommand(const String& commandId, const String& type,
@@ -51,8 +282,10 @@ bool CommandHandler::executeCommand(const String& commandId, const String& type,
         return false;
     }
 
-    // Resume auto-login mode after command completes
-    resume();
+    // Resume auto-login mode after command completes (enroll: khi session kết thúc)
+    if (!_enroll.isActive()) {
+        resume();
+    }
 
     return (result == CMD_SUCCESS);
 }
@@ -63,11 +296,10 @@ CommandResult CommandHandler::handleEnroll(const String& cmdId, JsonObject param
     // Extract parameters
     int fingerprintId = params["fingerprint_id"] | -1;
     String memberId = params["member_id"] | "";
+    uint8_t captures = constrain(params["captures"] | ENROLL_CAPTURES, 2, ENROLL_MAX_CAPTURES);
+    bool replaceExisting = params["replace_existing"] | false;
 
-    if (fingerprintId < 1 || fingerprintId > 127) {
-        Serial.println("[CMD] ✗ Invalid fingerprint_id (must be 1-127)");
-        publishStatus(cmdId, "failed", JsonObject(),
-                     "Invalid fingerprint_id (must be 1-127)");
+    if (!validateFingerprintId(cmdId, fingerprintId)) {
         return CMD_INVALID_PARAMS;
     }
 
@@ -76,46 +308,8 @@ CommandResult CommandHandler::handleEnroll(const String& cmdId, JsonObject param
     Serial.print("[CMD] Member ID: ");
     Serial.println(memberId);
 
-    // Update status to processing
-    publishStatus(cmdId, "processing");
-
-    // Enroll fingerprint
-    int enrollResult = _fp->enrollFingerprint(fingerprintId);
-
-    if (enrollResult < 0) {
-        Serial.println("[CMD] ✗ Enrollment failed");
-        publishStatus(cmdId, "failed", JsonObject(), "Fingerprint enrollment failed");
-        return CMD_SENSOR_ERROR;
-    }
-
-    // Get template data
-    uint8_t templateBuffer[512];
-    uint16_t templateSize = 0;
-
-    if (!_fp->getTemplate(fingerprintId, templateBuffer, &templateSize)) {
-        Serial.println("[CMD] ✗ Failed to get template data");
-        publishStatus(cmdId, "failed", JsonObject(), "Failed to get template data");
-        return CMD_SENSOR_ERROR;
-    }
-
-    // Upload to Directus
-    String templateBase64 = base64::encode(templateBuffer, templateSize);
-    String deviceMac = _wifi->getMACAddress();
-
-    if (!_directus->enrollFingerprint(deviceMac, fingerprintId, templateBase64, memberId)) {
-        Serial.println("[CMD] ⚠ Failed to upload to Directus (saved locally)");
-    }
-
-    // Create result object
-    JsonDocument resultDoc;
-    resultDoc["fingerprint_id"] = fingerprintId;
-    resultDoc["member_id"] = memberId;
-    resultDoc["template_size"] = templateSize;
-    resultDoc["confidence"] = _fp->getConfidence();
-
-    Serial.println("[CMD] ✓ Enrollment completed successfully");
-    publishStatus(cmdId, "completed", resultDoc.as<JsonObject>());
-
+    // Các bước còn lại chạy qua stepEnroll()
+    startEnroll(cmdId, fingerprintId, memberId, captures, replaceExisting, false);
     return CMD_SUCCESS;
 }
 
@@ -125,11 +319,10 @@ CommandResult CommandHandler::handleUpdate(const String& cmdId, JsonObject param
     // Extract parameters
     int fingerprintId = params["fingerprint_id"] | -1;
     String memberId = params["member_id"] | "";
+    uint8_t captures = constrain(params["captures"] | ENROLL_CAPTURES, 2, ENROLL_MAX_CAPTURES);
+    bool replaceExisting = params["replace_existing"] | false;
 
-    if (fingerprintId < 1 || fingerprintId > 127) {
-        Serial.println("[CMD] ✗ Invalid fingerprint_id (must be 1-127)");
-        publishStatus(cmdId, "failed", JsonObject(),
-                     "Invalid fingerprint_id (must be 1-127)");
+    if (!validateFingerprintId(cmdId, fingerprintId)) {
         return CMD_INVALID_PARAMS;
     }
 
@@ -138,46 +331,115 @@ CommandResult CommandHandler::handleUpdate(const String& cmdId, JsonObject param
     Serial.print("[CMD] Member ID: ");
     Serial.println(memberId);
 
-    // Update status to processing
-    publishStatus(cmdId, "processing");
+    // Không xóa template cũ trước: enroll chạy trong CharBuffer, storeModel ghi đè
+    // slot chỉ khi thành công → trùng / timeout / cancel vẫn giữ nguyên template cũ
+    // (search trùng khớp chính slot này không tính là duplicate)
+    Serial.println("[CMD] Enrolling new fingerprint (old template kept until store)...");
+    startEnroll(cmdId, fingerprintId, memberId, captures, replaceExisting, true);
+    return CMD_SUCCESS;
+}
 
-    // Step 1: Delete existing fingerprint at this ID
-    Serial.println("[CMD] Step 1: Deleting existing fingerprint...");
-    bool existed = _fp->deleteFingerprint(fingerprintId);
-    if (existed) {
-        Serial.println("[CMD] ✓ Existing fingerprint deleted");
-    } else {
-        Serial.println("[CMD] ⚠ No existing fingerprint at this ID (continuing anyway)");
+void CommandHandler::startEnroll(const String& cmdId, uint16_t fingerprintId, const String& memberId,
+                                 uint8_t captures, bool replaceExisting, bool isUpdate) {
+    _enrollCmdId = cmdId;
+    _enrollMemberId = memberId;
+    _enrollIsUpdate = isUpdate;
+
+    _enroll.start(fingerprintId, captures, replaceExisting);
+    _enrollStage = ENROLL_IDLE;
+    stepEnroll();
+}
+
+void CommandHandler::stepEnroll() {
+    if (_cancelRequested) {
+        _enroll.cancel();
+    }
+    _enroll.step();
+
+    EnrollState state = _enroll.getState();
+    if (_enroll.isActive()) {
+        if (state != _enrollStage) {
+            _enrollStage = state;
+            JsonDocument progressDoc;
+            progressDoc["fingerprint_id"] = _enroll.getId();
+            progressDoc["stage"] = EnrollSession::stateName(state);
+            progressDoc["captures"] = _enroll.getStats().captures;
+            progressDoc["max_captures"] = _enroll.getStats().maxCaptures;
+            publishStatus(_enrollCmdId, "processing", progressDoc.as<JsonObject>());
+        }
+        return;
     }
 
-    // Small delay to ensure sensor is ready
-    delay(100);
+    finishEnroll(state);
+    clearCurrent();
+    resume();
+}
 
-    // Step 2: Enroll new fingerprint
-    Serial.println("[CMD] Step 2: Enrolling new fingerprint...");
-    int enrollResult = _fp->enrollFingerprint(fingerprintId);
+void CommandHandler::finishEnroll(EnrollState state) {
+    const String& cmdId = _enrollCmdId;
+    uint16_t fingerprintId = _enroll.getId();
 
-    if (enrollResult < 0) {
-        Serial.println("[CMD] ✗ Enrollment failed");
-        publishStatus(cmdId, "failed", JsonObject(), "Fingerprint re-enrollment failed");
-        return CMD_SENSOR_ERROR;
+    if (state == ENROLL_CANCELLED) {
+        Serial.printf("[CMD] ⚠ %s cancelled%s\n", _enrollIsUpdate ? "Update" : "Enrollment",
+                      _enrollIsUpdate ? " (template cũ được giữ nguyên)" : "");
+        publishStatus(cmdId, "cancelled");
+        return;
+    }
+    if (state == ENROLL_DUPLICATE) {
+        uint16_t existingId = _enroll.getDuplicateId();
+        JsonDocument resultDoc;
+        resultDoc["fingerprint_id"] = fingerprintId;
+        resultDoc["duplicate"] = true;
+        resultDoc["match_score"] = _enroll.getDuplicateScore();
+        fillSlotMapping(resultDoc["existing"].to<JsonObject>(), existingId);
+        fillEnrollStats(resultDoc["enroll"].to<JsonObject>());
+        String error = "Finger already enrolled at fingerprint_id " + String(existingId);
+        Serial.println("[CMD] ✗ " + error);
+        publishStatus(cmdId, "failed", resultDoc.as<JsonObject>(), error);
+        return;
+    }
+    if (state != ENROLL_DONE) {
+        JsonDocument resultDoc;
+        resultDoc["fingerprint_id"] = fingerprintId;
+        resultDoc["stage"] = EnrollSession::stateName(_enrollStage);
+        fillEnrollStats(resultDoc["enroll"].to<JsonObject>());
+        String error = String(state == ENROLL_TIMEOUT ? "Enrollment timed out: " : "Enrollment failed: ") +
+                       _enroll.getError();
+        Serial.println("[CMD] ✗ " + error);
+        publishStatus(cmdId, "failed", resultDoc.as<JsonObject>(), error);
+        return;
+    }
+
+    // Slot giữ template mới → bỏ mapping cũ (nếu có) cho tới khi Directus xác nhận
+    if (SlotManager* slots = _directus->getSlotManager()) {
+        slots->markLocal(fingerprintId, "");
+    }
+
+    // replace_existing: template mới đã lưu → xóa bản cũ ở slot trùng
+    JsonDocument replacedDoc;
+    uint16_t replacedId = _enroll.getDuplicateId();
+    if (replacedId != 0) {
+        fillSlotMapping(replacedDoc.to<JsonObject>(), replacedId);
+        replacedDoc["deleted"] = _fp->deleteFingerprint(replacedId);
+        releaseSlot(replacedId);
+        Serial.printf("[CMD] ✓ Replaced duplicate at fingerprint_id %d\n", replacedId);
     }
 
-    // Step 3: Get template data
+    // Get template data
     uint8_t templateBuffer[512];
     uint16_t templateSize = 0;
 
     if (!_fp->getTemplate(fingerprintId, templateBuffer, &templateSize)) {
         Serial.println("[CMD] ✗ Failed to get template data");
         publishStatus(cmdId, "failed", JsonObject(), "Failed to get template data");
-        return CMD_SENSOR_ERROR;
+        return;
     }
 
-    // Step 4: Upload to Directus
+    // Upload to Directus
     String templateBase64 = base64::encode(templateBuffer, templateSize);
     String deviceMac = _wifi->getMACAddress();
 
-    bool synced = _directus->enrollFingerprint(deviceMac, fingerprintId, templateBase64, memberId);
+    bool synced = _directus->enrollFingerprint(deviceMac, fingerprintId, templateBase64, _enrollMemberId);
     if (!synced) {
         Serial.println("[CMD] ⚠ Failed to upload to Directus (saved locally)");
         // Continue - fingerprint is enrolled on device
@@ -186,16 +448,56 @@ CommandResult CommandHandler::handleUpdate(const String& cmdId, JsonObject param
     // Create result object
     JsonDocument resultDoc;
     resultDoc["fingerprint_id"] = fingerprintId;
-    resultDoc["member_id"] = memberId;
+    resultDoc["member_id"] = _enrollMemberId;
     resultDoc["template_size"] = templateSize;
+    resultDoc["template_transfer_ms"] = _fp->getLastTransferMs();
     resultDoc["confidence"] = _fp->getConfidence();
-    resultDoc["updated"] = true;  // Flag to indicate this was an update
     resultDoc["synced"] = synced; // Directus sync status
+    if (_enrollIsUpdate) {
+        resultDoc["updated"] = true;  // Flag to indicate this was an update
+    }
+    fillEnrollStats(resultDoc["enroll"].to<JsonObject>());
+    if (replacedId != 0) {
+        resultDoc["replaced"] = replacedDoc.as<JsonObject>();
+    }
 
-    Serial.println("[CMD] ✓ Update completed successfully");
+    Serial.printf("[CMD] ✓ %s completed successfully\n", _enrollIsUpdate ? "Update" : "Enrollment");
     publishStatus(cmdId, "completed", resultDoc.as<JsonObject>());
+}
 
-    return CMD_SUCCESS;
+void CommandHandler::fillEnrollStats(JsonObject out) {
+    const EnrollStats& stats = _enroll.getStats();
+    out["captures"] = stats.captures;
+    out["max_captures"] = stats.maxCaptures;
+    out["rejected_quality"] = stats.rejectedQuality;
+    out["rejected_match"] = stats.rejectedMatch;
+    out["reanchors"] = stats.reanchors;
+    out["best_score"] = stats.bestScore;
+    out["min_score"] = ENROLL_MIN_MATCH_SCORE;
+    out["good_score"] = ENROLL_GOOD_MATCH_SCORE;
+    out["early_stop"] = stats.earlyStop;
+}
+
+void CommandHandler::fillSlotMapping(JsonObject out, uint16_t slot) {
+    out["fingerprint_id"] = slot;
+
+    String fingerprintUuid;
+    String memberUuid;
+    MemberCache* cache = _directus->getMemberCache();
+    if (cache && cache->lookup(slot, fingerprintUuid, memberUuid)) {
+        out["fingerprint_uuid"] = fingerprintUuid;
+        out["member_id"] = memberUuid;
+    }
+}
+
+void CommandHandler::releaseSlot(uint16_t slot) {
+    if (MemberCache* cache = _directus->getMemberCache()) {
+        cache->erase(slot);
+        cache->save();
+    }
+    if (SlotManager* slots = _directus->getSlotManager()) {
+        slots->release(slot);
+    }
 }
 
 CommandResult CommandHandler::handleDelete(const String& cmdId, JsonObject params) {
@@ -203,10 +505,7 @@ CommandResult CommandHandler::handleDelete(const String& cmdId, JsonObject param
 
     int fingerprintId = params["fingerprint_id"] | -1;
 
-    if (fingerprintId < 1 || fingerprintId > 127) {
-        Serial.println("[CMD] ✗ Invalid fingerprint_id (must be 1-127)");
-        publishStatus(cmdId, "failed", JsonObject(),
-                     "Invalid fingerprint_id (must be 1-127)");
+    if (!validateFingerprintId(cmdId, fingerprintId)) {
         return CMD_INVALID_PARAMS;
     }
 
@@ -218,6 +517,8 @@ CommandResult CommandHandler::handleDelete(const String& cmdId, JsonObject param
         return CMD_SENSOR_ERROR;
     }
 
+    releaseSlot(fingerprintId);
+
     JsonDocument resultDoc;
     resultDoc["fingerprint_id"] = fingerprintId;
     resultDoc["deleted"] = true;
@@ -239,6 +540,14 @@ CommandResult CommandHandler::handleDeleteAll(const String& cmdId) {
         return CMD_SENSOR_ERROR;
     }
 
+    if (MemberCache* cache = _directus->getMemberCache()) {
+        cache->clear();
+        cache->save();
+    }
+    if (SlotManager* slots = _directus->getSlotManager()) {
+        slots->releaseAll();
+    }
+
     JsonDocument resultDoc;
     resultDoc["deleted_all"] = true;
 
@@ -258,7 +567,13 @@ CommandResult CommandHandler::handleGetInfo(const String& cmdId) {
     JsonDocument resultDoc;
     resultDoc["template_count"] = templateCount;
     resultDoc["sensor_type"] = "R307";
-    resultDoc["max_capacity"] = 1000;
+    resultDoc["max_capacity"] = _fp->getCapacity();
+
+    // Bitmap slot từ ReadIndexTable (4 round trip cho 1000 slot)
+    if (_fp->loadIndexTable()) {
+        resultDoc["used_slots"] = _fp->getUsedCount();
+        resultDoc["free_slot"] = _fp->findFreeSlot();
+    }
 
     Serial.println("[CMD] ✓ Get info completed successfully");
     publishStatus(cmdId, "completed", resultDoc.as<JsonObject>());
@@ -283,6 +598,18 @@ CommandResult CommandHandler::handleRestart(const String& cmdId) {
     return CMD_SUCCESS;
 }
 
+bool CommandHandler::validateFingerprintId(const String& cmdId, int fingerprintId) {
+    uint16_t capacity = _fp->getCapacity();
+    if (fingerprintId >= 1 && fingerprintId < capacity) {
+        return true;
+    }
+
+    String error = "Invalid fingerprint_id (must be 1-" + String(capacity - 1) + ")";
+    Serial.println("[CMD] ✗ " + error);
+    publishStatus(cmdId, "failed", JsonObject(), error);
+    return false;
+}
+
 CommandResult CommandHandler::handleSyncAll(const String& cmdId) {
     Serial.println("[CMD] → Syncing all fingerprints from Directus");
     publishStatus(cmdId, "processing");
@@ -290,50 +617,49 @@ CommandResult CommandHandler::handleSyncAll(const String& cmdId) {
     // Get device MAC
     String deviceMac = _wifi->getMACAddress();
 
-    // Fetch fingerprints from Directus
-    JsonDocument doc;
-    int count = _directus->getFingerprints(deviceMac, doc);
-
-    if (count == 0) {
-        JsonDocument resultDoc;
-        resultDoc["total_fingerprints"] = 0;
-        resultDoc["synced"] = 0;
-        resultDoc["failed"] = 0;
-        publishStatus(cmdId, "completed", resultDoc.as<JsonObject>());
-        return CMD_SUCCESS;
-    }
-
-    // Download and upload each template
-    JsonArray data = doc["data"];
-    int synced = 0, failed = 0;
-
-    for (int i = 0; i < count; i++) {
-        String fpId = data[i]["id"].as<String>();
-        uint8_t localId;
-        uint8_t templateBuffer[512];
-        uint16_t templateSize;
-
-        if (_directus->downloadFingerprintTemplate(fpId, templateBuffer, &templateSize, &localId)) {
-            if (_fp->uploadModel(localId, templateBuffer, templateSize)) {
-                synced++;
-                Serial.printf("[CMD] ✓ Synced fingerprint ID %d\n", localId);
-            } else {
-                failed++;
-                Serial.printf("[CMD] ✗ Failed to upload ID %d to sensor\n", localId);
-            }
-        } else {
-            failed++;
-            Serial.printf("[CMD] ✗ Failed to download template %s\n", fpId.c_str());
+    // Diff theo template_hash: chỉ truyền template mới / đã đổi, xóa slot không còn active
+    // Download (core 0) và upload lên sensor chạy song song
+    TemplateRestorer restorer(_directus, _fp);
+    unsigned long lastProgress = millis();
+    restorer.setProgressCallback([&](const RestoreStats& progress) {
+        if (millis() - lastProgress >= COMMAND_PROGRESS_INTERVAL_MS) {
+            JsonDocument progressDoc;
+            progressDoc["processed"] = progress.total + progress.skipped;
+            progressDoc["synced"] = progress.synced;
+            progressDoc["failed"] = progress.failed;
+            progressDoc["skipped"] = progress.skipped;
+            publishStatus(cmdId, "processing", progressDoc.as<JsonObject>());
+            lastProgress = millis();
         }
-        delay(100);  // Prevent overwhelming sensor
+        return !_cancelRequested;
+    });
+    RestoreStats stats = restorer.restore(deviceMac, true);
+
+    if (!stats.listed && !stats.aborted) {
+        Serial.println("[CMD] ✗ Failed to list fingerprints from Directus");
+        publishStatus(cmdId, "failed", JsonObject(), "Failed to list fingerprints from Directus");
+        return CMD_FAILED;
     }
 
     JsonDocument resultDoc;
-    resultDoc["total_fingerprints"] = count;
-    resultDoc["synced"] = synced;
-    resultDoc["failed"] = failed;
+    resultDoc["total_fingerprints"] = stats.total;
+    resultDoc["synced"] = stats.synced;
+    resultDoc["failed"] = stats.failed;
+    resultDoc["skipped"] = stats.skipped;
+    resultDoc["deleted"] = stats.deleted;
+    resultDoc["bytes_transferred"] = stats.bytesTransferred;
+    resultDoc["bytes_skipped"] = stats.bytesSkipped;
+    resultDoc["elapsed_ms"] = stats.elapsedMs;
+    resultDoc["download_ms"] = stats.downloadMs;
+    resultDoc["upload_ms"] = stats.uploadMs;
+
+    if (stats.aborted) {
+        Serial.printf("[CMD] ⚠ Sync cancelled after %d synced\n", stats.synced);
+        publishStatus(cmdId, "cancelled", resultDoc.as<JsonObject>());
+        return CMD_CANCELLED;
+    }
 
-    Serial.printf("[CMD] ✓ Sync completed: %d/%d synced\n", synced, count);
+    Serial.printf("[CMD] ✓ Sync completed: %d/%d synced\n", stats.synced, stats.total);
     publishStatus(cmdId, "completed", resultDoc.as<JsonObject>());
     return CMD_SUCCESS;
 }
@@ -346,10 +672,12 @@ CommandResult CommandHandler::handleGetStatus(const String& cmdId) {
     resultDoc["wifi_connected"] = _wifi->isConnected();
     resultDoc["wifi_rssi"] = WiFi.RSSI();
     resultDoc["mqtt_connected"] = _mqtt->isConnected();
-    resultDoc["sensor_ok"] = (_fp->getTemplateCount() >= 0);
-    resultDoc["template_count"] = _fp->getTemplateCount();
+    // Chạy trên network task → đọc bitmap slot trong RAM thay vì hỏi sensor qua UART
+    resultDoc["sensor_ok"] = _fp->hasIndexTable();
+    resultDoc["template_count"] = _fp->getUsedCount();
     resultDoc["free_heap"] = ESP.getFreeHeap();
     resultDoc["uptime_seconds"] = millis() / 1000;
+    fillQueueStatus(resultDoc["commands"].to<JsonObject>());
 
     Serial.println("[CMD] ✓ Status retrieved");
     publishStatus(cmdId, "completed", resultDoc.as<JsonObject>());
@@ -358,6 +686,12 @@ CommandResult CommandHandler::handleGetStatus(const String& cmdId) {
 
 void CommandHandler::publishStatus(const String& cmdId, const String& status,
                                    JsonObject result, const String& errorMsg) {
+    // Status cuối được nhớ để trả lời command_id trùng (kể cả khi MQTT đang mất kết nối)
+    if (cmdId.length() > 0 &&
+        (status == "completed" || status == "failed" || status == "cancelled")) {
+        _dedup.recordFinal(cmdId, status, result, errorMsg);
+    }
+
     if (_mqtt && _mqtt->isConnected()) {
         _mqtt->publishStatus(cmdId, status, result, errorMsg);
     }
@@ -3,10 +3,25 @@
 
 #include <Arduino.h>
 #include <ArduinoJson.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
 #include "fingerprint-handler.h"
 #include "mqtt-client.h"
 #include "directus-client.h"
 #include "wifi-manager.h"
+#include "command-dedup.h"
+#include "enroll-session.h"
+
+#define COMMAND_QUEUE_LENGTH 4   // Lệnh chờ sensor task xử lý
+#define COMMAND_PARAMS_MAX 256   // params JSON đã serialize
+#define COMMAND_PROGRESS_INTERVAL_MS 2000  // Publish tiến độ lệnh dài (sync_all)
+
+// Lệnh POD, copy từ MQTT callback (core 0) sang sensor task (core 1)
+struct QueuedCommand {
+    char commandId[48];
+    char type[24];
+    char params[COMMAND_PARAMS_MAX];
+};
 
 // Command execution results
 enum CommandResult {
@@ -14,15 +29,56 @@ enum CommandResult {
     CMD_FAILED,
     CMD_INVALID_PARAMS,
     CMD_SENSOR_ERROR,
-    CMD_TIMEOUT
+    CMD_TIMEOUT,
+    CMD_CANCELLED
 };
 
+/**
+ * CommandHandler - Thực thi lệnh MQTT từ CMS
+ *
+ * Chức năng:
+ * - enqueue() (MQTT callback, network task): copy lệnh vào queue có giới hạn,
+ *   publish "queued" → PubSubClient loop() không bao giờ chờ lệnh chạy
+ * - processPending() (sensor task): thực thi lần lượt, status / tiến độ đi qua
+ *   MQTT outbox
+ * - get_status, cancel trả lời ngay trên network task (không dùng UART sensor)
+ * - cancel: bỏ lệnh đang chờ, hoặc yêu cầu lệnh đang chạy dừng
+ *   (enroll / update đang chờ ngón tay, sync_all)
+ * - enroll / update chạy bằng EnrollSession: processPending() step từng bước,
+ *   publish "processing" + stage mỗi lần chuyển bước, timeout theo bước
+ * - Ngón tay đã có ở slot khác → trả về slot + member đang giữ thay vì lưu bản sao
+ *   (params.replace_existing: lưu vào slot yêu cầu và xóa slot cũ)
+ * - command_id trùng (QoS 1 redelivery) → publish lại status cuối, không chạy lại
+ */
+
 class CommandHandler {
 private:
     FingerprintHandler* _fp;
     MQTTClient* _mqtt;
     DirectusClient* _directus;
     WiFiManager* _wifi;
+    volatile uint32_t _rejected;
+
+    // Queue lệnh chờ (ring) + lệnh đang chạy, bảo vệ bởi _lock
+    SemaphoreHandle_t _lock;
+    QueuedCommand _pending[COMMAND_QUEUE_LENGTH];
+    uint8_t _head;
+    uint8_t _count;
+    char _currentId[48];
+    char _currentType[24];
+    unsigned long _currentStartedAt;
+    volatile bool _cancelRequested;
+    CommandDedup _dedup;
+
+    // Enroll / update đang chạy (step từ processPending, lệnh khác chờ)
+    EnrollSession _enroll;
+    String _enrollCmdId;
+    String _enrollMemberId;
+    bool _enrollIsUpdate;
+    EnrollState _enrollStage;  // Bước đang chờ đã publish gần nhất
+
+    // Kiểm tra fingerprint_id trong 1..capacity-1, publish lỗi nếu sai
+    bool validateFingerprintId(const String& cmdId, int fingerprintId);
 
     // Command handlers
     CommandResult handleEnroll(const String& cmdId, JsonObject params);
@@ -33,6 +89,18 @@ private:
     CommandResult handleSyncAll(const String& cmdId);
     CommandResult handleGetStatus(const String& cmdId);
     CommandResult handleUpdate(const String& cmdId, JsonObject params);
+    void handleCancel(const String& cmdId, JsonObject params);
+    void fillQueueStatus(JsonObject out);
+
+    // Enroll state machine
+    void startEnroll(const String& cmdId, uint16_t fingerprintId, const String& memberId,
+                     uint8_t captures, bool replaceExisting, bool isUpdate);
+    void stepEnroll();
+    void finishEnroll(EnrollState state);
+    void fillEnrollStats(JsonObject out);
+    void fillSlotMapping(JsonObject out, uint16_t slot);
+    void releaseSlot(uint16_t slot);
+    void clearCurrent();
 
     // Helper methods
     void publishStatus(const String& cmdId, const String& status,
@@ -43,9 +111,37 @@ public:
     CommandHandler(FingerprintHandler* fp, MQTTClient* mqtt,
                    DirectusClient* directus, WiFiManager* wifi);
 
+    /**
+     * Tạo lock cho command queue, load dedup ring từ flash
+     */
+    bool begin();
+
+    /**
+     * Đưa lệnh vào queue (gọi từ MQTT callback, non-blocking)
+     * Queue đầy / params quá lớn → publish failed ngay
+     * get_status / cancel được xử lý luôn, không vào queue
+     */
+    bool enqueue(const String& commandId, const String& type, JsonObject params);
+
+    /**
+     * Thực thi 1 lệnh đang chờ, hoặc step enroll đang chạy
+     * (gọi từ sensor task - lệnh dùng UART sensor)
+     * @return true nếu đã xử lý một lệnh / một bước enroll
+     */
+    bool processPending();
+
     bool executeCommand(const String& commandId, const String& type,
                        JsonObject params);
 
+    uint32_t getPendingCount();
+    uint32_t getRejectedCount();
+
+    /**
+     * Enroll / update đang chờ ngón tay: sensor task không được dùng
+     * CharBuffer / LED cho việc khác (upload template, scan, menu)
+     */
+    bool isEnrolling();
+
     // Auto-login pause control
     bool isPaused();
     void pause();
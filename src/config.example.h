@@ -13,6 +13,10 @@
 // ==========================================
 #define DIRECTUS_URL "http://192.168.1.xxx:8055"  // Directus URL (LAN IP của máy chạy Directus)
 #define DIRECTUS_TOKEN "your-directus-token"      // Static access token từ Directus
+#define DIRECTUS_PAGE_SIZE 100                    // Số record mỗi trang khi list fingerprints
+#define DIRECTUS_WS_ENABLED 1                     // Nhận thay đổi qua Directus WebSocket (0 = chỉ polling)
+#define DIRECTUS_WS_PATH "/websocket"             // Endpoint realtime (WEBSOCKETS_ENABLED=true trên Directus)
+#define REALTIME_FALLBACK_SYNC_MS 900000          // Delta sync dự phòng khi WebSocket đang subscribe
 
 // ==========================================
 // R307 Fingerprint Sensor Configuration
@@ -37,6 +41,14 @@
 #define MQTT_KEEPALIVE_INTERVAL 60       // MQTT keepalive interval (seconds)
 #define MQTT_QOS_COMMANDS 1              // QoS level for commands (0, 1, or 2)
 #define MQTT_QOS_TELEMETRY 0             // QoS level for telemetry (0 for best effort)
+#define MQTT_TELEMETRY_INTERVAL_MS 60000 // Publish telemetry (queue, cache stats) mỗi 60 giây
+#define MQTT_OUTBOX_LENGTH 8             // Status / attendance từ sensor task chờ network task publish
+#define COMMAND_DEDUP_SLOTS 16           // Số command_id gần nhất được nhớ (chống chạy lại khi QoS 1 redeliver)
+#define ENROLL_FINGER_TIMEOUT_MS 30000   // Enroll qua MQTT: chờ đặt ngón tay tối đa (mỗi lần capture)
+#define ENROLL_LIFT_TIMEOUT_MS 15000     // Enroll qua MQTT: chờ nhấc tay giữa 2 lần capture
+#define ENROLL_CAPTURES 4                // Số lần đặt tay tối đa khi đăng ký (2 = gộp đúng 2 ảnh như cũ)
+#define ENROLL_MIN_MATCH_SCORE 50        // Điểm Match với ảnh gốc dưới mức này → loại ảnh
+#define ENROLL_GOOD_MATCH_SCORE 100      // Đạt điểm này → dừng sớm, tạo model ngay
 
 // MQTT Topic Prefix and Templates
 #define MQTT_TOPIC_PREFIX "monkey-muaythai"
@@ -48,7 +60,31 @@
 // ==========================================
 // Timing Configuration
 // ==========================================
-#define FINGERPRINT_CHECK_INTERVAL 1000 // Kiểm tra vân tay mỗi 1 giây (auto-login mode)
+#define SCAN_FAST_INTERVAL_MS 40         // Poll getImage() khi vừa có ngón tay (auto-login mode)
+#define SCAN_IDLE_INTERVAL_MS 400        // Khi rảnh: giãn dần tới mức này
+#define SCAN_PEAK_INTERVAL_MS 80         // Trong giờ cao điểm: không giãn quá mức này
+#define SCAN_ACTIVE_WINDOW_MS 15000      // Giữ nhịp nhanh bao lâu sau lần cuối thấy ngón tay
+#define SCAN_PEAK_HOURS "6-9,17-21"      // Giờ cao điểm (giờ địa phương), "" = không dùng
+#define SCAN_TOUCH_PIN -1                // GPIO nối chân Touch (WAKEUP) R307, -1 = chỉ poll
+#define RECENT_SCAN_WINDOW_MS 30000      // Member chạm lại trong khoảng này → không gửi Directus / MQTT lần nữa
 #define HTTP_TIMEOUT_MS 10000           // HTTP request timeout (10 giây)
+#define HTTP_KEEP_ALIVE 1               // Giữ connection tới Directus giữa các request (0 = tắt)
+#define MEMBER_CACHE_REFRESH_MS 300000  // Refresh member cache từ Directus mỗi 5 phút
+#define SLOT_PRELOAD_INTERVAL_MS 3600000 // Nạp template member check-in gần đây lên sensor mỗi 1 giờ
+#define SLOT_PRELOAD_MAX 10              // Số template tối đa nạp mỗi lần preload
+#define SLOT_PRELOAD_DAYS 7              // Member có check-in trong N ngày qua được ưu tiên
+#define SLOT_PRELOAD_LOOKUP_BATCH 25     // Số member gộp trong 1 request tra fingerprint / template khi preload
+#define DELTA_SYNC_INTERVAL_MS 60000     // Áp dụng thay đổi member_fingerprints trên CMS mỗi 1 phút
+#define DELTA_SYNC_MAX_TRANSFERS 5       // Số template tối đa tải + nạp mỗi lần delta sync
+
+// ==========================================
+// Offline Queue Configuration
+// ==========================================
+#define QUEUE_FLUSH_BATCH_SIZE 20       // Số attendance gộp trong 1 POST khi flush queue
+#define QUEUE_DRAIN_MAX_BATCHES 1       // Số batch gửi mỗi vòng loop() (drain không chặn scan)
+#define QUEUE_DRAIN_BUDGET_MS 200       // Thời gian drain tối đa mỗi vòng loop()
+#define QUEUE_DRAIN_YIELD_MS 3000       // Tạm dừng drain N ms sau khi có ngón tay trên sensor
+#define QUEUE_DRAIN_RETRY_MS 30000      // Chờ trước khi drain lại sau lỗi mạng (gấp đôi mỗi lần lỗi tiếp)
+#define QUEUE_DRAIN_RETRY_MAX_MS 600000 // Backoff tối đa khi Directus lỗi liên tục
 
 #endif
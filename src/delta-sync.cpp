@@ -0,0 +1,356 @@
+#include "delta-sync.h"
+#include "directus-client.h"
+#include "fingerprint-handler.h"
+#include "member-cache.h"
+#include "slot-manager.h"
+#include "template-manifest.h"
+
+#define DELTA_SYNC_CURSOR_MAGIC 0x44435532     // "DCU2": (timestamp, id) cho 2 luồng
+#define DELTA_SYNC_CURSOR_MAGIC_V1 0x44435552  // "DCUR": 1 timestamp chung
+
+struct DeltaSyncCursorFile {
+    uint32_t magic;
+    DeltaCursor created;
+    DeltaCursor updated;
+};
+
+static void initStream(DeltaStream& stream, const char* field) {
+    memset(&stream, 0, sizeof(stream));
+    stream.field = field;
+}
+
+DeltaSync::DeltaSync(DirectusClient* directus, FingerprintHandler* fp, SensorJobs* jobs) :
+    _directus(directus),
+    _fp(fp),
+    _jobs(jobs)
+{
+    initStream(_created, "date_created");
+    initStream(_updated, "date_updated");
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+bool DeltaSync::begin() {
+    File file = LittleFS.open(DELTA_SYNC_CURSOR_FILE, "r");
+    if (!file) {
+        Serial.println("[SYNC] No delta cursor, first run reconciles all records");
+        return true;
+    }
+
+    DeltaSyncCursorFile data;
+    memset(&data, 0, sizeof(data));
+    bool ok = file.read((uint8_t*)&data.magic, sizeof(data.magic)) == sizeof(data.magic);
+
+    if (ok && data.magic == DELTA_SYNC_CURSOR_MAGIC) {
+        size_t size = sizeof(data) - sizeof(data.magic);
+        ok = file.read((uint8_t*)&data.created, size) == size;
+    } else if (ok && data.magic == DELTA_SYNC_CURSOR_MAGIC_V1) {
+        // Firmware cũ: 1 timestamp, không có id → record cùng timestamp áp dụng lại 1 lần
+        ok = file.read((uint8_t*)data.created.time, sizeof(data.created.time)) ==
+             sizeof(data.created.time);
+        data.updated = data.created;
+    } else {
+        ok = false;
+    }
+    file.close();
+
+    if (ok) {
+        data.created.time[sizeof(data.created.time) - 1] = '\0';
+        data.created.id[sizeof(data.created.id) - 1] = '\0';
+        data.updated.time[sizeof(data.updated.time) - 1] = '\0';
+        data.updated.id[sizeof(data.updated.id) - 1] = '\0';
+        _created.cursor = data.created;
+        _updated.cursor = data.updated;
+        Serial.printf("[SYNC] Delta cursor: created %s, updated %s\n",
+                      _created.cursor.time, _updated.cursor.time);
+    }
+    return true;
+}
+
+bool DeltaSync::saveCursor() {
+    File file = LittleFS.open(DELTA_SYNC_CURSOR_FILE, "w");
+    if (!file) {
+        Serial.println("[SYNC] ✗ Cannot open delta cursor for writing");
+        return false;
+    }
+
+    DeltaSyncCursorFile data;
+    memset(&data, 0, sizeof(data));
+    data.magic = DELTA_SYNC_CURSOR_MAGIC;
+    data.created = _created.cursor;
+    data.updated = _updated.cursor;
+
+    bool ok = file.write((const uint8_t*)&data, sizeof(data)) == sizeof(data);
+    file.close();
+    return ok;
+}
+
+void DeltaSync::reset() {
+    initStream(_created, "date_created");
+    initStream(_updated, "date_updated");
+    LittleFS.remove(DELTA_SYNC_CURSOR_FILE);
+}
+
+int DeltaSync::run(const String& deviceMac) {
+    unsigned long start = millis();
+    _stats.runs++;
+
+    DeltaCursor created = _created.cursor;
+    DeltaCursor updated = _updated.cursor;
+    int transfers = 0;
+    bool complete = true;
+
+    int total = runStream(deviceMac, _created, transfers, complete);
+    if (total >= 0) {
+        int changed = runStream(deviceMac, _updated, transfers, complete);
+        total = changed < 0 ? -1 : total + changed;
+    }
+
+    // Manifest do sensor task ghi (cùng lúc upload) và lưu theo lô trong loop()
+    if (MemberCache* cache = _directus->getMemberCache()) cache->save();
+
+    // Con trỏ đã tiến tới trước record lỗi đầu tiên → lưu kể cả khi luồng sau query lỗi
+    if (memcmp(&created, &_created.cursor, sizeof(created)) != 0 ||
+        memcmp(&updated, &_updated.cursor, sizeof(updated)) != 0) {
+        saveCursor();
+    }
+
+    _stats.lastRunMs = millis() - start;
+    if (total < 0) {
+        Serial.println("[SYNC] ✗ Delta query failed, lần sau chạy tiếp từ con trỏ");
+        return -1;
+    }
+
+    if (total > 0) {
+        Serial.printf("[SYNC] Delta: %d changed, %d templates (%lu ms)%s\n", total, transfers,
+                      _stats.lastRunMs, complete ? "" : ", tiếp tục lần sau");
+    }
+    return total;
+}
+
+int DeltaSync::runStream(const String& deviceMac, DeltaStream& stream, int& transfers,
+                         bool& complete) {
+    DeltaCursor& cursor = stream.cursor;
+
+    // Directus để date_updated null khi mới tạo → 2 luồng không giao nhau
+    String query = strcmp(stream.field, "date_updated") == 0
+        ? "&filter[date_updated][_nnull]=true"
+        : "&filter[date_updated][_null]=true";
+    if (cursor.time[0] != '\0') {
+        query += String("&filter[") + stream.field + "][_gte]=" + cursor.time;
+    }
+    String fields = String("id,finger_print_id,member_id,status,template_hash,") + stream.field;
+    String sort = String(stream.field) + ",id";
+
+    bool advancing = true;  // Chưa gặp record lỗi → con trỏ theo record vừa áp dụng
+    int changed = 0;
+
+    int listed = _directus->forEachFingerprint(deviceMac, fields.c_str(), query, sort.c_str(),
+        [&](JsonObject fp) {
+        const char* time = fp[stream.field] | "";
+        const char* id = fp["id"] | "";
+
+        // _gte trả lại các record cùng timestamp đã áp dụng ở lần trước
+        int order = strcmp(time, cursor.time);
+        if (order < 0 || (order == 0 && strcmp(id, cursor.id) <= 0)) return true;
+
+        FingerprintChange change;
+        bool valid = change.fromJson(fp);
+
+        if (valid && change.active && transfers >= DELTA_SYNC_MAX_TRANSFERS) {
+            // Đủ quota cho lần này: dừng, lần sau làm tiếp từ con trỏ
+            complete = false;
+            return false;
+        }
+
+        changed++;
+        ChangeResult result = valid ? apply(change) : CHANGE_APPLIED;
+        if (result == CHANGE_FAILED) {
+            // Xử lý tiếp các record khác; con trỏ dừng ở trước record lỗi đầu tiên
+            complete = false;
+            Serial.printf("[SYNC] ✗ Slot #%d: áp dụng thay đổi thất bại\n", change.slot);
+            if (advancing && !skipFailure(stream, id)) advancing = false;
+            if (!advancing) return true;
+        } else if (result == CHANGE_TRANSFERRED) {
+            transfers++;
+        }
+
+        if (advancing) {
+            if (strcmp(stream.failedId, id) == 0) {
+                stream.failedId[0] = '\0';
+                stream.failures = 0;
+            }
+            strlcpy(cursor.time, time, sizeof(cursor.time));
+            strlcpy(cursor.id, id, sizeof(cursor.id));
+        }
+        return true;
+    });
+
+    return listed < 0 ? -1 : changed;
+}
+
+bool DeltaSync::skipFailure(DeltaStream& stream, const char* id) {
+    if (strcmp(stream.failedId, id) != 0) {
+        strlcpy(stream.failedId, id, sizeof(stream.failedId));
+        stream.failures = 0;
+    }
+    if (++stream.failures < DELTA_SYNC_MAX_FAILURES) return false;
+
+    Serial.printf("[SYNC] ⚠ Record %s lỗi %d lần liên tiếp, bỏ qua (sync_all sẽ đối chiếu)\n",
+                  id, stream.failures);
+    stream.failedId[0] = '\0';
+    stream.failures = 0;
+    return true;
+}
+
+bool FingerprintChange::fromJson(JsonObject fp) {
+    strlcpy(fingerprintId, fp["id"] | "", sizeof(fingerprintId));
+    strlcpy(memberId, fp["member_id"] | "", sizeof(memberId));
+    strlcpy(templateHash, fp["template_hash"] | "", sizeof(templateHash));
+    slot = fp["finger_print_id"] | 0;
+    active = strcmp(fp["status"] | "", "active") == 0;
+    return fingerprintId[0] != '\0' && slot > 0;
+}
+
+ChangeResult DeltaSync::apply(const FingerprintChange& change) {
+    if (change.slot == 0 || change.slot >= _fp->getCapacity() ||
+        change.slot >= MEMBER_CACHE_SLOTS) {
+        return CHANGE_APPLIED;
+    }
+
+    // Slot đang giữ template preload của member khác → không đụng tới
+    SlotManager* slots = _directus->getSlotManager();
+    if (slots && slots->isManaged(change.slot)) return CHANGE_APPLIED;
+
+    _stats.changes++;
+    return change.active ? applyActive(change) : applyInactive(change);
+}
+
+ChangeResult DeltaSync::applyActive(const FingerprintChange& change) {
+    MemberCache* cache = _directus->getMemberCache();
+    TemplateManifest* manifest = _fp->getManifest();
+    uint16_t slot = change.slot;
+
+    // Template đã đúng trên sensor → chỉ cập nhật mapping
+    String cachedFp, cachedMember;
+    bool resident = _fp->hasIndexTable() && _fp->isSlotUsed(slot) &&
+        (change.templateHash[0] != '\0'
+            ? (manifest && manifest->matches(slot, change.templateHash))
+            : (cache && cache->lookup(slot, cachedFp, cachedMember) &&
+               cachedFp == change.fingerprintId));
+
+    if (resident) {
+        if (cache) cache->put(slot, change.fingerprintId, change.memberId, MEMBER_ACTIVE);
+        return CHANGE_APPLIED;
+    }
+
+    uint16_t localId = 0;
+    if (!_directus->downloadFingerprintTemplate(change.fingerprintId, _job.data, &_job.size,
+                                                &localId) ||
+        localId != slot) {
+        return CHANGE_FAILED;
+    }
+
+    // Sensor task: DownChar + Store, markLocal, cập nhật mapping
+    _job.kind = SENSOR_JOB_STORE;
+    _job.slot = slot;
+    strlcpy(_job.fingerprintId, change.fingerprintId, sizeof(_job.fingerprintId));
+    strlcpy(_job.memberId, change.memberId, sizeof(_job.memberId));
+    if (!_jobs->run(_job)) {
+        return CHANGE_FAILED;
+    }
+
+    _stats.downloads++;
+    Serial.printf("[SYNC] ✓ Slot #%d updated\n", slot);
+    return CHANGE_TRANSFERRED;
+}
+
+ChangeResult DeltaSync::applyInactive(const FingerprintChange& change) {
+    MemberCache* cache = _directus->getMemberCache();
+
+    // Chỉ xóa khi slot đang map tới chính record này (slot có thể đã thuộc record active mới)
+    String cachedFp, memberId;
+    MemberStatus status;
+    if (!cache || !cache->lookup(change.slot, cachedFp, memberId, &status) ||
+        cachedFp != change.fingerprintId) {
+        return CHANGE_APPLIED;
+    }
+
+    if (status == MEMBER_ACTIVE && !removeSlot(change.slot)) {
+        return CHANGE_FAILED;
+    }
+
+    cache->put(change.slot, change.fingerprintId, change.memberId, MEMBER_INACTIVE);
+    return CHANGE_APPLIED;
+}
+
+ChangeResult DeltaSync::applyRemoved(const String& fingerprintId) {
+    MemberCache* cache = _directus->getMemberCache();
+    if (!cache) return CHANGE_APPLIED;
+
+    uint16_t slot = cache->findSlot(fingerprintId);
+    if (slot == 0) return CHANGE_APPLIED;
+
+    SlotManager* slots = _directus->getSlotManager();
+    if (slots && slots->isManaged(slot)) return CHANGE_APPLIED;
+
+    _stats.changes++;
+    if (!removeSlot(slot)) return CHANGE_FAILED;
+
+    cache->erase(slot);
+    cache->save();
+    return CHANGE_APPLIED;
+}
+
+ChangeResult DeltaSync::applyMemberRemoved(const String& memberId) {
+    MemberCache* cache = _directus->getMemberCache();
+    if (!cache) return CHANGE_APPLIED;
+
+    // Gồm cả slot preload (managed): member không còn tồn tại thì không được match
+    String cachedFp, cachedMember;
+    ChangeResult result = CHANGE_APPLIED;
+    for (uint16_t slot = 1; slot < MEMBER_CACHE_SLOTS; slot++) {
+        if (!cache->lookup(slot, cachedFp, cachedMember) || cachedMember != memberId) continue;
+
+        _stats.changes++;
+        if (removeSlot(slot)) {
+            cache->erase(slot);
+        } else {
+            result = CHANGE_FAILED;
+        }
+    }
+
+    cache->save();
+    return result;
+}
+
+bool DeltaSync::removeSlot(uint16_t slot) {
+    if (!_fp->isSlotUsed(slot)) return true;
+
+    // Sensor task: DeleteChar + giải phóng slot trong SlotManager
+    _job.kind = SENSOR_JOB_REMOVE;
+    _job.slot = slot;
+    if (!_jobs->run(_job)) return false;
+
+    _stats.removals++;
+    Serial.printf("[SYNC] Slot #%d removed\n", slot);
+    return true;
+}
+
+const DeltaSyncStats& DeltaSync::getStats() {
+    return _stats;
+}
+
+void DeltaSync::printInfo() {
+    Serial.println("\n=== Delta sync ===");
+    Serial.printf("Cursor created: %s %s\n",
+                  _created.cursor.time[0] ? _created.cursor.time : "(chưa sync)",
+                  _created.cursor.id);
+    Serial.printf("Cursor updated: %s %s\n",
+                  _updated.cursor.time[0] ? _updated.cursor.time : "(chưa sync)",
+                  _updated.cursor.id);
+    Serial.printf("Runs: %lu, changes: %lu, downloads: %lu, removals: %lu\n",
+                  (unsigned long)_stats.runs, (unsigned long)_stats.changes,
+                  (unsigned long)_stats.downloads, (unsigned long)_stats.removals);
+    Serial.printf("Last run: %lu ms\n", _stats.lastRunMs);
+    Serial.println("==================\n");
+}
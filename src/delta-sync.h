@@ -0,0 +1,145 @@
+#ifndef DELTA_SYNC_H
+#define DELTA_SYNC_H
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <ArduinoJson.h>
+#include "config.h"
+#include "r307-protocol.h"
+#include "sensor-jobs.h"
+
+#define DELTA_SYNC_CURSOR_FILE "/sync-cursor.bin"
+
+#ifndef DELTA_SYNC_INTERVAL_MS
+#define DELTA_SYNC_INTERVAL_MS 60000   // Hỏi Directus các record đã thay đổi mỗi 1 phút
+#endif
+
+#ifndef DELTA_SYNC_MAX_TRANSFERS
+#define DELTA_SYNC_MAX_TRANSFERS 5     // Số template tối đa tải + nạp mỗi lần chạy
+#endif
+
+#ifndef DELTA_SYNC_MAX_FAILURES
+#define DELTA_SYNC_MAX_FAILURES 3      // Record lỗi liên tiếp bấy nhiêu lần → con trỏ vượt qua
+#endif
+
+class DirectusClient;
+class FingerprintHandler;
+
+// Một thay đổi của member_fingerprints (từ delta query hoặc WebSocket event)
+struct FingerprintChange {
+    char fingerprintId[37];
+    char memberId[37];
+    char templateHash[17];
+    uint16_t slot;
+    bool active;
+
+    // Parse record Directus, false nếu thiếu id / slot
+    bool fromJson(JsonObject fp);
+};
+
+// Vị trí đã áp dụng trong một luồng thay đổi; id tách các record cùng timestamp
+struct DeltaCursor {
+    char time[32];   // ISO timestamp Directus ("" = chưa sync)
+    char id[37];     // Record cuối đã áp dụng tại timestamp đó
+};
+
+// Một luồng record sắp theo (field, id): record mới tạo (date_created) / đã sửa (date_updated)
+struct DeltaStream {
+    const char* field;
+    DeltaCursor cursor;
+    char failedId[37];   // Record lỗi đang chặn con trỏ
+    uint8_t failures;
+};
+
+// Kết quả áp dụng một thay đổi
+enum ChangeResult {
+    CHANGE_APPLIED,      // Đã xử lý (có thể không cần làm gì)
+    CHANGE_TRANSFERRED,  // Đã tải + nạp template lên sensor
+    CHANGE_FAILED
+};
+
+// Thống kê (hiển thị qua lệnh 'i')
+struct DeltaSyncStats {
+    uint32_t runs;
+    uint32_t changes;      // Record thay đổi đã xử lý
+    uint32_t downloads;    // Template mới / đã đổi được tải và nạp lên sensor
+    uint32_t removals;     // Slot bị xóa do record chuyển sang không active
+    unsigned long lastRunMs;
+};
+
+/**
+ * DeltaSync - Đồng bộ tăng dần member_fingerprints theo con trỏ (timestamp, id)
+ *
+ * Chức năng:
+ * - 2 luồng: record chưa sửa lần nào (date_created) và record đã sửa (date_updated,
+ *   Directus để null khi mới tạo), mỗi luồng sort theo (timestamp, id)
+ * - Query _gte con trỏ, bỏ record cùng timestamp có id <= id của con trỏ
+ *   → record cùng timestamp không bị bỏ sót khi dừng giữa chừng
+ * - Record active: nạp template nếu slot chưa có đúng hash / UUID
+ * - Record không còn active: xóa slot nếu sensor đang giữ template của record đó
+ * - Con trỏ tiến tới ngay trước record lỗi đầu tiên (lần sau làm lại từ đó, idempotent
+ *   nhờ manifest hash); record lỗi DELTA_SYNC_MAX_FAILURES lần liên tiếp thì bỏ qua
+ *   để không chặn luồng mãi (sync_all đối chiếu lại)
+ *
+ * Record bị xóa hẳn (hard delete) không hiện trong delta → sync_all prune.
+ *
+ * Chạy trên sync task (core 0): HTTP + decode ở đây, ghi sensor (DownChar + Store,
+ * DeleteChar) gửi sang sensor task qua SensorJobs.
+ */
+class DeltaSync {
+public:
+    DeltaSync(DirectusClient* directus, FingerprintHandler* fp, SensorJobs* jobs);
+
+    /**
+     * Load con trỏ từ flash
+     */
+    bool begin();
+
+    /**
+     * Áp dụng các thay đổi kể từ lần chạy trước
+     * @param deviceMac MAC address
+     * @return Số record đã xử lý, -1 nếu lỗi
+     */
+    int run(const String& deviceMac);
+
+    /**
+     * Bỏ con trỏ → lần chạy sau đối chiếu lại toàn bộ record
+     */
+    void reset();
+
+    /**
+     * Áp dụng một record lên sensor + member cache (dùng chung với RealtimeClient)
+     */
+    ChangeResult apply(const FingerprintChange& change);
+
+    /**
+     * Record bị xóa hẳn trong Directus: xóa slot nếu đang map tới record này
+     */
+    ChangeResult applyRemoved(const String& fingerprintId);
+
+    /**
+     * Member bị xóa trong Directus: xóa mọi slot đang map tới member này
+     */
+    ChangeResult applyMemberRemoved(const String& memberId);
+
+    const DeltaSyncStats& getStats();
+    void printInfo();
+
+private:
+    DirectusClient* _directus;
+    FingerprintHandler* _fp;
+    SensorJobs* _jobs;
+    DeltaStream _created;   // date_updated null, theo date_created
+    DeltaStream _updated;   // theo date_updated
+    DeltaSyncStats _stats;
+    SensorJob _job;  // Template đang tải (chỉ sync task dùng)
+
+    bool saveCursor();
+    int runStream(const String& deviceMac, DeltaStream& stream, int& transfers, bool& complete);
+    bool skipFailure(DeltaStream& stream, const char* id);
+    ChangeResult applyActive(const FingerprintChange& change);
+    ChangeResult applyInactive(const FingerprintChange& change);
+    bool removeSlot(uint16_t slot);
+};
+
+#endif
@@ -1,25 +1,94 @@
 #include "directus-client.h"
+#include "attendance-logger.h"
+#include "slot-manager.h"
+#include "sensor-jobs.h"
+#include "r307-protocol.h"
+#include "template-manifest.h"
 #include "config.h"
 #include <base64.h>
 #include <mbedtls/base64.h>
 #include <time.h>
+#include <vector>
 
 DirectusClient::DirectusClient(HTTPClientManager* httpClient, WiFiManager* wifiManager,
-                               OfflineQueue* offlineQueue) {
+                               OfflineQueue* offlineQueue, MemberCache* memberCache) {
     _httpClient = httpClient;
     _wifiManager = wifiManager;
     _offlineQueue = offlineQueue;
+    _memberCache = memberCache;
+    _attendanceLogger = nullptr;
+    _slotManager = nullptr;
+    _sensorJobs = nullptr;
     _deviceUuid = "";  // Will be loaded on first request
+    _deviceLock = xSemaphoreCreateMutex();
+}
+
+String DirectusClient::cachedDeviceUuid() {
+    xSemaphoreTake(_deviceLock, portMAX_DELAY);
+    String uuid = _deviceUuid;
+    xSemaphoreGive(_deviceLock);
+    return uuid;
+}
+
+void DirectusClient::setDeviceUuid(const String& uuid) {
+    xSemaphoreTake(_deviceLock, portMAX_DELAY);
+    _deviceUuid = uuid;
+    xSemaphoreGive(_deviceLock);
+    if (_memberCache && uuid.length() > 0) _memberCache->setDeviceUuid(uuid);
+    if (_offlineQueue && uuid.length() > 0) _offlineQueue->setDeviceId(uuid);
+}
+
+void DirectusClient::setAttendanceLogger(AttendanceLogger* logger) {
+    _attendanceLogger = logger;
+}
+
+void DirectusClient::recordAttendance(const String& memberId, uint16_t fingerprintID,
+                                      uint16_t confidence, bool accessGranted,
+                                      const String& reason) {
+    if (_attendanceLogger) {
+        _attendanceLogger->submit(memberId, fingerprintID, confidence, accessGranted, reason);
+        return;
+    }
+
+    logAttendance(memberId, getDeviceId(), fingerprintID, confidence, accessGranted, reason);
+}
+
+MemberCache* DirectusClient::getMemberCache() {
+    return _memberCache;
+}
+
+void DirectusClient::setSlotManager(SlotManager* slotManager) {
+    _slotManager = slotManager;
+}
+
+SlotManager* DirectusClient::getSlotManager() {
+    return _slotManager;
+}
+
+void DirectusClient::setSensorJobs(SensorJobs* jobs) {
+    _sensorJobs = jobs;
 }
 
 String DirectusClient::buildUrl(const String& endpoint) {
     return String(DIRECTUS_URL) + endpoint;
 }
 
+String DirectusClient::getDeviceId() {
+    return getDeviceId(_wifiManager->getMACAddress());
+}
+
 String DirectusClient::getDeviceId(const String& deviceMac) {
-    // Return cached UUID if available
-    if (_deviceUuid.length() > 0) {
-        return _deviceUuid;
+    // Return cached UUID if available (copy dưới mutex: gọi từ nhiều task)
+    String cached = cachedDeviceUuid();
+    if (cached.length() > 0) {
+        return cached;
+    }
+
+    // Offline: dùng UUID đã lưu trong member cache
+    if (!_wifiManager->isConnected()) {
+        String stored = _memberCache ? _memberCache->getDeviceUuid() : String("");
+        if (stored.length() > 0) setDeviceUuid(stored);
+        return stored;
     }
 
     // Query Directus for device by MAC address
@@ -33,10 +102,11 @@ String DirectusClient::getDeviceId(const String& deviceMac) {
         if (_httpClient->parseJSON(response, doc)) {
             JsonArray data = doc["data"];
             if (data.size() > 0) {
-                _deviceUuid = data[0]["id"].as<String>();
+                String uuid = data[0]["id"].as<String>();
                 Serial.print("✓ Device UUID: ");
-                Serial.println(_deviceUuid);
-                return _deviceUuid;
+                Serial.println(uuid);
+                setDeviceUuid(uuid);
+                return uuid;
             }
         }
     }
@@ -82,9 +152,10 @@ String DirectusClient::registerDevice(const String& deviceMac, const String& dev
     if (httpCode == 200 || httpCode == 201) {
         JsonDocument responseDoc;
         if (_httpClient->parseJSON(response, responseDoc)) {
-            _deviceUuid = responseDoc["data"]["id"].as<String>();
+            String uuid = responseDoc["data"]["id"].as<String>();
             Serial.println("✓ Đăng ký device thành công!");
-            return _deviceUuid;
+            setDeviceUuid(uuid);
+            return uuid;
         }
     }
 
@@ -100,100 +171,101 @@ bool DirectusClient::compareTemplates(const String& template1, const String& tem
 
 bool DirectusClient::findMatchingFingerprint(const String& deviceMac, const String& templateData,
                                             String& fingerprintId, String& memberId,
-                                            uint8_t sensorFingerprintID) {
+                                            uint16_t sensorFingerprintID) {
     // R307 sensor đã verify fingerprint locally (ID match)
     // Query Directus để lấy member_id từ finger_print_id + device
+    Serial.printf("[VERIFY] Sensor finger_print_id=%d\n", sensorFingerprintID);
 
-    // Get device UUID
-    String deviceId = getDeviceId(deviceMac);
-    if (deviceId.length() == 0) {
-        Serial.println("✗ Device chưa được đăng ký trong Directus!");
-        return false;
-    }
-
-    // Query member_fingerprints by device_id to find matching fingerprint
-    String url = buildUrl("/items/member_fingerprints?filter[device_id][_eq]=" + deviceId +
-                         "&filter[status][_eq]=active&fields=id,finger_print_id,member_id,template_data&limit=127");
-    String response;
-
-    Serial.printf("[VERIFY] Sensor finger_print_id=%d, deviceId=%s\n",
-                 sensorFingerprintID, deviceId.c_str());
-    Serial.printf("[VERIFY] URL: %s\n", url.c_str());
-
-    int httpCode = _httpClient->get(url.c_str(), response);
+    bool found = false;
+    int scanned = 0;
 
-    Serial.printf("[VERIFY] HTTP %d, response length=%d\n", httpCode, response.length());
-
-    if (httpCode != 200) {
-        Serial.printf("✗ Lỗi query fingerprints (HTTP %d)\n", httpCode);
-        Serial.println(response.substring(0, 200));
-        return false;
-    }
-
-    JsonDocument doc;
-    if (!_httpClient->parseJSON(response, doc)) {
-        Serial.println("✗ Lỗi parse JSON response");
-        Serial.println(response.substring(0, 200));
+    // Slot do SlotManager nạp: finger_print_id của device không phản ánh template trên sensor
+    if (_slotManager && _slotManager->isManaged(sensorFingerprintID)) {
+        Serial.printf("✗ Slot #%d is managed but not in member cache\n", sensorFingerprintID);
         return false;
     }
 
-    JsonArray fingerprints = doc["data"].as<JsonArray>();
-    Serial.printf("[VERIFY] Found %d fingerprints in Directus\n", fingerprints.size());
-
-    if (fingerprints.size() == 0) {
-        Serial.println("✗ Không có fingerprint nào được đăng ký cho device này");
-        return false;
+    // Match by R307 sensor finger_print_id first (most reliable) - chỉ 1 record
+    if (sensorFingerprintID > 0) {
+        String query = "&filter[status][_eq]=active&filter[finger_print_id][_eq]=" +
+                       String(sensorFingerprintID);
+        scanned = forEachFingerprint(deviceMac, "id,finger_print_id,member_id", query,
+                                     [&](JsonObject fp) {
+            fingerprintId = fp["id"].as<String>();
+            memberId = fp["member_id"].as<String>();
+            found = true;
+            return false;
+        });
+
+        if (found) {
+            Serial.printf("✓ Matched finger_print_id=%d → Member: %s\n",
+                         sensorFingerprintID, memberId.c_str());
+            if (_memberCache &&
+                _memberCache->put(sensorFingerprintID, fingerprintId, memberId, MEMBER_ACTIVE)) {
+                _memberCache->save();
+            }
+            return true;
+        }
+        if (scanned < 0) return false;
     }
 
-    // Match by R307 sensor finger_print_id first (most reliable)
-    if (sensorFingerprintID > 0) {
-        for (JsonObject fp : fingerprints) {
-            int fpId = fp["finger_print_id"] | 0;
-            Serial.printf("[VERIFY] Comparing sensor=%d vs db=%d\n", sensorFingerprintID, fpId);
-            if (fpId == sensorFingerprintID) {
+    // Fallback: try template matching (template_data ~700 bytes/record → duyệt theo trang)
+    if (templateData.length() > 0) {
+        scanned = forEachFingerprint(deviceMac, "id,finger_print_id,member_id,template_data",
+                                     "&filter[status][_eq]=active", [&](JsonObject fp) {
+            String fpTemplate = fp["template_data"] | "";
+            if (fpTemplate.length() > 0 && compareTemplates(templateData, fpTemplate)) {
                 fingerprintId = fp["id"].as<String>();
                 memberId = fp["member_id"].as<String>();
-                Serial.printf("✓ Matched finger_print_id=%d → Member: %s\n",
-                             sensorFingerprintID, memberId.c_str());
-                return true;
+                found = true;
+                return false;
             }
-        }
-    }
+            return true;
+        });
 
-    // Fallback: try template matching
-    for (JsonObject fp : fingerprints) {
-        String fpTemplate = fp["template_data"] | "";
-        if (fpTemplate.length() > 0 && compareTemplates(templateData, fpTemplate)) {
-            fingerprintId = fp["id"].as<String>();
-            memberId = fp["member_id"].as<String>();
+        if (found) {
             Serial.printf("✓ Template match! Member: %s\n", memberId.c_str());
             return true;
         }
     }
 
-    Serial.printf("✗ No match: sensor_id=%d not found in %d fingerprints\n",
-                 sensorFingerprintID, fingerprints.size());
+    Serial.printf("✗ No match: sensor_id=%d not found in Directus\n", sensorFingerprintID);
     return false;
 }
 
-bool DirectusClient::verifyFingerprint(const String& deviceMac, uint8_t fingerprintID,
+bool DirectusClient::verifyFingerprint(const String& deviceMac, uint16_t fingerprintID,
                                       const String& templateData, uint16_t confidence,
                                       String& memberId) {
-    if (!_wifiManager->isConnected()) {
-        Serial.println("✗ WiFi chưa kết nối!");
-        return false;
-    }
+    String fingerprintId;
+    MemberStatus status = MEMBER_NONE;
 
-    Serial.println("\n╔════════════════════════════════════════╗");
-    Serial.println("║   ĐANG XÁC THỰC VỚI DIRECTUS...       ║");
-    Serial.println("╚════════════════════════════════════════╝");
+    // 1. Member cache: O(1), không cần WiFi
+    if (_memberCache && _memberCache->lookup(fingerprintID, fingerprintId, memberId, &status)) {
+        Serial.printf("[VERIFY] Cache hit: finger_print_id=%d → Member: %s\n",
+                     fingerprintID, memberId.c_str());
 
-    // Tìm fingerprint match (truyền fingerprintID từ R307 sensor)
-    String fingerprintId;
-    if (!findMatchingFingerprint(deviceMac, templateData, fingerprintId, memberId, fingerprintID)) {
-        // Skip attendance log — Directus requires member_id
-        Serial.println("✗ Fingerprint not registered — skipping attendance log");
-        return false;
+        if (status != MEMBER_ACTIVE) {
+            Serial.println("✗ Fingerprint không còn active");
+            recordAttendance(memberId, fingerprintID, confidence, false, "inactive");
+            return false;
+        }
+    } else {
+        // 2. Cache miss: fallback query Directus
+        if (!_wifiManager->isConnected()) {
+            Serial.println("✗ WiFi chưa kết nối và slot chưa có trong member cache!");
+            return false;
+        }
+
+        Serial.println("\n╔════════════════════════════════════════╗");
+        Serial.println("║   ĐANG XÁC THỰC VỚI DIRECTUS...       ║");
+        Serial.println("╚════════════════════════════════════════╝");
+
+        // Tìm fingerprint match (truyền fingerprintID từ R307 sensor)
+        if (!findMatchingFingerprint(deviceMac, templateData, fingerprintId, memberId, fingerprintID)) {
+            // Skip attendance log — Directus requires member_id
+            Serial.println("✗ Fingerprint not registered — skipping attendance log");
+            return false;
+        }
     }
 
     // Check confidence threshold
@@ -202,8 +274,7 @@ bool DirectusClient::verifyFingerprint(const String& deviceMac, uint8_t fingerpr
     if (confidence < MIN_CONFIDENCE) {
         Serial.printf("✗ Confidence quá thấp (%d < %d)\n", confidence, MIN_CONFIDENCE);
 
-        String deviceId = getDeviceId(deviceMac);
-        logAttendance(memberId, deviceId, fingerprintID, confidence, false, "low_confidence");
+        recordAttendance(memberId, fingerprintID, confidence, false, "low_confidence");
         return false;
     }
 
@@ -215,14 +286,13 @@ bool DirectusClient::verifyFingerprint(const String& deviceMac, uint8_t fingerpr
     Serial.printf("║   Confidence: %d                       ║\n", confidence);
     Serial.println("╚════════════════════════════════════════╝");
 
-    // Log successful attendance
-    String deviceId = getDeviceId(deviceMac);
-    logAttendance(memberId, deviceId, fingerprintID, confidence, true, "success");
+    // Log successful attendance (async nếu có AttendanceLogger)
+    recordAttendance(memberId, fingerprintID, confidence, true, "success");
 
     return true;
 }
 
-bool DirectusClient::enrollFingerprint(const String& deviceMac, uint8_t fingerprintID,
+bool DirectusClient::enrollFingerprint(const String& deviceMac, uint16_t fingerprintID,
                                       const String& templateData, const String& memberId) {
     if (!_wifiManager->isConnected()) {
         Serial.println("✗ WiFi chưa kết nối!");
@@ -259,6 +329,15 @@ bool DirectusClient::enrollFingerprint(const String& deviceMac, uint8_t fingerpr
     enrollDoc["template_data"] = templateData;
     enrollDoc["status"] = "active";
 
+    // Hash của template raw: sync_all so với manifest để bỏ qua slot không đổi
+    uint8_t rawTemplate[600];
+    size_t rawLength = 0;
+    if (mbedtls_base64_decode(rawTemplate, sizeof(rawTemplate), &rawLength,
+                              (const unsigned char*)templateData.c_str(),
+                              templateData.length()) == 0 && rawLength > 0) {
+        enrollDoc["template_hash"] = TemplateManifest::hashHex(rawTemplate, rawLength);
+    }
+
     // Get current timestamp
     time_t now = time(nullptr);
     struct tm timeinfo;
@@ -274,6 +353,16 @@ bool DirectusClient::enrollFingerprint(const String& deviceMac, uint8_t fingerpr
 
     if (httpCode == 200 || httpCode == 201) {
         Serial.println("\n✓ Đăng ký vân tay lên Directus thành công!");
+
+        // Cập nhật member cache ngay để scan tiếp theo không cần query
+        JsonDocument responseDoc;
+        if (_memberCache && _httpClient->parseJSON(response, responseDoc)) {
+            String recordId = responseDoc["data"]["id"] | "";
+            if (_slotManager) _slotManager->markLocal(fingerprintID, recordId);
+            if (_memberCache->put(fingerprintID, recordId, memberId, MEMBER_ACTIVE)) {
+                _memberCache->save();
+            }
+        }
         return true;
     }
 
@@ -281,9 +370,9 @@ bool DirectusClient::enrollFingerprint(const String& deviceMac, uint8_t fingerpr
     return false;
 }
 
-bool DirectusClient::logAttendance(const String& memberId, const String& deviceId,
-                                  uint8_t fingerprintID, uint16_t confidence,
-                                  bool accessGranted, const String& reason) {
+String DirectusClient::buildAttendancePayload(const String& memberId, const String& deviceId,
+                                              uint16_t confidence, bool accessGranted,
+                                              const String& reason, time_t checkInTime) {
     JsonDocument doc;
 
     if (memberId.length() > 0 && memberId != "unknown") {
@@ -295,15 +384,34 @@ bool DirectusClient::logAttendance(const String& memberId, const String& deviceI
     doc["access_granted"] = accessGranted;
     doc["deny_reason"] = reason;
 
-    // Add current timestamp
-    time_t now = time(nullptr);
+    // Timestamp lúc scan (record có thể được POST muộn hơn)
     struct tm timeinfo;
-    gmtime_r(&now, &timeinfo);
+    gmtime_r(&checkInTime, &timeinfo);
     char timestamp[30];
     strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%S.000Z", &timeinfo);
     doc["check_in_time"] = timestamp;
 
-    String jsonPayload = _httpClient->createJSON(doc);
+    return _httpClient->createJSON(doc);
+}
+
+bool DirectusClient::logAttendance(const String& memberId, const String& deviceId,
+                                  uint16_t fingerprintID, uint16_t confidence,
+                                  bool accessGranted, const String& reason,
+                                  time_t checkInTime) {
+    if (checkInTime == 0) {
+        checkInTime = time(nullptr);
+    }
+
+    String jsonPayload = buildAttendancePayload(memberId, deviceId, confidence,
+                                                accessGranted, reason, checkInTime);
+
+    // Offline: queue ngay, không chờ HTTP timeout
+    if (!_wifiManager->isConnected() && _offlineQueue) {
+        _offlineQueue->enqueue("/items/attendance", "POST", jsonPayload);
+        Serial.println("[DIRECTUS] Offline - queued attendance for later sync");
+        return false;
+    }
+
     String url = buildUrl("/items/attendance");
     String response;
 
@@ -324,42 +432,108 @@ bool DirectusClient::logAttendance(const String& memberId, const String& deviceI
     return false;
 }
 
-int DirectusClient::getFingerprints(const String& deviceMac, JsonDocument& doc) {
+int DirectusClient::forEachFingerprint(const String& deviceMac, const char* fields,
+                                       const String& query, FingerprintRecordCallback callback,
+                                       int pageSize) {
+    return forEachFingerprint(deviceMac, fields, query, "finger_print_id", callback, pageSize);
+}
+
+int DirectusClient::forEachFingerprint(const String& deviceMac, const char* fields,
+                                       const String& query, const char* sort,
+                                       FingerprintRecordCallback callback, int pageSize) {
     if (!_wifiManager->isConnected()) {
         Serial.println("✗ WiFi chưa kết nối!");
-        return 0;
+        return -1;
     }
 
     // Get device UUID
     String deviceId = getDeviceId(deviceMac);
     if (deviceId.length() == 0) {
         Serial.println("✗ Device chưa được đăng ký!");
-        return 0;
+        return -1;
     }
 
-    // Query fingerprints for this device
-    String url = buildUrl("/items/member_fingerprints?filter[device_id][_eq]=" + deviceId +
-                         "&filter[status][_eq]=active&fields=id,finger_print_id,member_id,template_data&limit=127");
-    String response;
+    // Filter chỉ giữ các field được yêu cầu
+    JsonDocument filter;
+    JsonObject fieldFilter = filter["data"][0].to<JsonObject>();
+    String fieldList = fields;
+    int pos = 0;
+    while (pos < (int)fieldList.length()) {
+        int comma = fieldList.indexOf(',', pos);
+        if (comma < 0) comma = fieldList.length();
+        fieldFilter[fieldList.substring(pos, comma)] = true;
+        pos = comma + 1;
+    }
 
-    int httpCode = _httpClient->get(url.c_str(), response);
+    // Mỗi lần chỉ giữ 1 trang trong RAM
+    int total = 0;
+    for (int offset = 0; ; offset += pageSize) {
+        String url = buildUrl("/items/member_fingerprints?filter[device_id][_eq]=" + deviceId +
+                             query + "&fields=" + fields + "&sort=" + sort +
+                             "&limit=" + String(pageSize) +
+                             "&offset=" + String(offset));
 
-    if (httpCode == 200) {
-        if (_httpClient->parseJSON(response, doc)) {
-            JsonArray data = doc["data"];
-            Serial.printf("✓ Tìm thấy %d fingerprints trong Directus\n", data.size());
-            return data.size();
+        JsonDocument doc;
+        int httpCode = _httpClient->getJSON(url.c_str(), doc, &filter);
+        if (httpCode != 200) {
+            Serial.printf("✗ Lỗi query fingerprints (HTTP %d, offset %d)\n", httpCode, offset);
+            return -1;
         }
+
+        JsonArray data = doc["data"].as<JsonArray>();
+        for (JsonObject fp : data) {
+            total++;
+            if (!callback(fp)) return total;
+        }
+
+        if ((int)data.size() < pageSize) break;  // Trang cuối
+    }
+
+    return total;
+}
+
+bool DirectusClient::decodeTemplate(const char* base64, uint8_t* templateBuffer,
+                                    uint16_t* templateSize) {
+    size_t base64Len = strlen(base64);
+    if (base64Len == 0) {
+        Serial.println("✗ Template data rỗng!");
+        return false;
+    }
+
+    // Decode Base64 using mbedtls
+    size_t outputLen = 0;
+    unsigned char tempBuffer[600];  // Base64 expands ~33%, so 512 bytes -> ~683 chars
+
+    int ret = mbedtls_base64_decode(tempBuffer, sizeof(tempBuffer), &outputLen,
+                                   (const unsigned char*)base64, base64Len);
+
+    if (ret != 0) {
+        Serial.printf("✗ Base64 decode failed (error: %d)\n", ret);
+        return false;
     }
 
-    Serial.printf("✗ Lỗi query fingerprints (HTTP %d)\n", httpCode);
-    return 0;
+    *templateSize = outputLen;
+
+    if (*templateSize > 512) {
+        Serial.printf("✗ Template size quá lớn: %d bytes\n", *templateSize);
+        return false;
+    }
+
+    // Copy to buffer
+    memcpy(templateBuffer, tempBuffer, *templateSize);
+
+    // Pad with zeros if needed
+    if (*templateSize < 512) {
+        memset(templateBuffer + *templateSize, 0, 512 - *templateSize);
+        *templateSize = 512;
+    }
+    return true;
 }
 
 bool DirectusClient::downloadFingerprintTemplate(const String& fingerprintId,
                                                  uint8_t* templateBuffer,
                                                  uint16_t* templateSize,
-                                                 uint8_t* fingerprintIdLocal) {
+                                                 uint16_t* fingerprintIdLocal) {
     if (!_wifiManager->isConnected()) {
         Serial.println("✗ WiFi chưa kết nối!");
         return false;
@@ -374,49 +548,216 @@ bool DirectusClient::downloadFingerprintTemplate(const String& fingerprintId,
     if (httpCode == 200) {
         JsonDocument doc;
         if (_httpClient->parseJSON(response, doc)) {
-            String templateDataBase64 = doc["data"]["template_data"].as<String>();
-            *fingerprintIdLocal = doc["data"]["finger_print_id"].as<uint8_t>();
+            *fingerprintIdLocal = doc["data"]["finger_print_id"].as<uint16_t>();
 
-            if (templateDataBase64.length() == 0) {
-                Serial.println("✗ Template data rỗng!");
+            if (!decodeTemplate(doc["data"]["template_data"] | "", templateBuffer, templateSize)) {
                 return false;
             }
 
-            // Decode Base64 using mbedtls
-            size_t outputLen = 0;
-            unsigned char tempBuffer[600];  // Base64 expands ~33%, so 512 bytes -> ~683 chars
+            Serial.printf("✓ Downloaded template (ID local: %d, size: %d bytes)\n",
+                         *fingerprintIdLocal, *templateSize);
+            return true;
+        }
+    }
 
-            int ret = mbedtls_base64_decode(tempBuffer, sizeof(tempBuffer), &outputLen,
-                                           (const unsigned char*)templateDataBase64.c_str(),
-                                           templateDataBase64.length());
+    Serial.printf("✗ Lỗi download fingerprint (HTTP %d)\n", httpCode);
+    return false;
+}
 
-            if (ret != 0) {
-                Serial.printf("✗ Base64 decode failed (error: %d)\n", ret);
-                return false;
-            }
+bool DirectusClient::refreshMemberCache(const String& deviceMac) {
+    if (!_memberCache) return false;
 
-            *templateSize = outputLen;
+    if (!_wifiManager->isConnected()) {
+        return false;
+    }
 
-            if (*templateSize > 512) {
-                Serial.printf("✗ Template size quá lớn: %d bytes\n", *templateSize);
-                return false;
-            }
+    String deviceId = getDeviceId(deviceMac);
+    if (deviceId.length() == 0) {
+        Serial.println("[CACHE] ✗ Device chưa được đăng ký, bỏ qua refresh");
+        return false;
+    }
 
-            // Copy to buffer
-            memcpy(templateBuffer, tempBuffer, *templateSize);
+    // Chỉ lấy các field cần cho mapping, không kéo template_data.
+    // Duyệt theo trang và ghi đè dần; slot không còn trong Directus chỉ bị xóa
+    // khi đã đọc hết mọi trang → refresh lỗi giữa chừng vẫn giữ cache dùng được
+    uint8_t seen[(MEMBER_CACHE_SLOTS + 7) / 8] = {0};
+    uint8_t seenActive[(MEMBER_CACHE_SLOTS + 7) / 8] = {0};
+    int loaded = 0;
 
-            // Pad with zeros if needed
-            if (*templateSize < 512) {
-                memset(templateBuffer + *templateSize, 0, 512 - *templateSize);
-                *templateSize = 512;
-            }
+    int total = forEachFingerprint(deviceMac, "id,finger_print_id,member_id,status", "",
+                                   [&](JsonObject fp) {
+        int slot = fp["finger_print_id"] | 0;
+        if (slot <= 0 || slot >= MEMBER_CACHE_SLOTS) return true;
 
-            Serial.printf("✓ Downloaded template (ID local: %d, size: %d bytes)\n",
-                         *fingerprintIdLocal, *templateSize);
+        // Sensor đang giữ template do SlotManager nạp → record của device không còn đúng
+        if (_slotManager && _slotManager->isManaged(slot)) return true;
+
+        String status = fp["status"] | "";
+        MemberStatus memberStatus = (status == "active") ? MEMBER_ACTIVE : MEMBER_INACTIVE;
+
+        // Slot có cả bản ghi cũ (inactive) và mới (active) → giữ bản active
+        if (memberStatus != MEMBER_ACTIVE && (seenActive[slot / 8] & (1 << (slot % 8)))) {
             return true;
         }
+
+        if (_memberCache->put(slot, fp["id"] | "", fp["member_id"] | "", memberStatus)) {
+            seen[slot / 8] |= 1 << (slot % 8);
+            if (memberStatus == MEMBER_ACTIVE) seenActive[slot / 8] |= 1 << (slot % 8);
+            loaded++;
+        }
+        return true;
+    });
+
+    if (total < 0) {
+        _memberCache->save();
+        Serial.println("[CACHE] ✗ Refresh failed, giữ cache cũ cho các slot chưa cập nhật");
+        return false;
     }
 
-    Serial.printf("✗ Lỗi download fingerprint (HTTP %d)\n", httpCode);
-    return false;
+    for (uint16_t slot = 1; slot < MEMBER_CACHE_SLOTS; slot++) {
+        if (!(seen[slot / 8] & (1 << (slot % 8))) &&
+            !(_slotManager && _slotManager->isManaged(slot))) {
+            _memberCache->erase(slot);
+        }
+    }
+
+    _memberCache->save();
+    _memberCache->markRefreshed();
+
+    Serial.printf("[CACHE] ✓ Refreshed %d/%d fingerprints\n", loaded, total);
+    return true;
+}
+
+// "2025-01-31T08:15:00" (UTC) → epoch giây, 0 nếu sai format
+static uint32_t parseIsoTime(const char* text) {
+    int year, month, day, hour = 0, minute = 0, second = 0;
+    if (!text || sscanf(text, "%d-%d-%dT%d:%d:%d", &year, &month, &day,
+                        &hour, &minute, &second) < 3) {
+        return 0;
+    }
+
+    // Days from civil (proleptic Gregorian)
+    year -= month <= 2;
+    int era = (year >= 0 ? year : year - 399) / 400;
+    unsigned yoe = (unsigned)(year - era * 400);
+    unsigned doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    long days = (long)era * 146097 + (long)doe - 719468;
+
+    return (uint32_t)(days * 86400 + hour * 3600 + minute * 60 + second);
+}
+
+int DirectusClient::preloadRecentMembers(int maxTemplates) {
+    if (!_slotManager || !_memberCache || !_sensorJobs) return 0;
+
+    if (!_wifiManager->isConnected()) {
+        return -1;
+    }
+
+    int recent = 0;
+    int loaded = _slotManager->preload(*this, maxTemplates, &recent);
+    if (loaded < 0) return -1;
+
+    Serial.printf("[SLOT] Preload: %d templates loaded (%d recent members)\n", loaded, recent);
+    return loaded;
+}
+
+bool DirectusClient::listRecentMembers(std::vector<PreloadMember>& members) {
+    // Member check-in thành công trong SLOT_PRELOAD_DAYS ngày qua, ở bất kỳ device nào của branch
+    // Sort theo lần check-in gần nhất → limit giữ đúng các member mới nhất
+    String url = buildUrl(String("/items/attendance?filter[access_granted][_eq]=true") +
+                          "&filter[device_id][branch_id][_eq]=" + DEVICE_BRANCH_ID +
+                          "&filter[check_in_time][_gte]=$NOW(-" + String(SLOT_PRELOAD_DAYS) +
+                          "%20days)&groupBy[]=member_id&aggregate[max]=check_in_time" +
+                          "&sort=-max.check_in_time&limit=" + String(SLOT_PRELOAD_RECENT_MAX));
+
+    JsonDocument filter;
+    filter["data"][0]["member_id"] = true;
+    filter["data"][0]["max"]["check_in_time"] = true;
+
+    JsonDocument doc;
+    int httpCode = _httpClient->getJSON(url.c_str(), doc, &filter);
+    if (httpCode != 200) {
+        Serial.printf("[SLOT] ✗ Query recent members failed (HTTP %d)\n", httpCode);
+        return false;
+    }
+
+    for (JsonObject row : doc["data"].as<JsonArray>()) {
+        String memberId = row["member_id"] | "";
+        if (memberId.length() == 0) continue;
+        members.push_back({memberId, "", parseIsoTime(row["max"]["check_in_time"])});
+    }
+    return true;
+}
+
+bool DirectusClient::resolveFingerprints(std::vector<PreloadMember>& members,
+                                         size_t first, size_t last) {
+    // 1 request cho cả nhóm: template active của member trong branch (có thể enroll ở device khác)
+    String memberIds;
+    for (size_t i = first; i < last; i++) {
+        if (i > first) memberIds += ',';
+        memberIds += members[i].memberId;
+    }
+    String url = buildUrl("/items/member_fingerprints?filter[member_id][_in]=" + memberIds +
+                          "&filter[status][_eq]=active&filter[device_id][branch_id][_eq]=" +
+                          DEVICE_BRANCH_ID + "&fields=id,member_id&limit=" +
+                          String(DIRECTUS_PAGE_SIZE));
+    JsonDocument filter;
+    filter["data"][0]["id"] = true;
+    filter["data"][0]["member_id"] = true;
+    JsonDocument doc;
+    if (_httpClient->getJSON(url.c_str(), doc, &filter) != 200) return false;
+    JsonArray fingerprints = doc["data"].as<JsonArray>();
+
+    for (size_t i = first; i < last; i++) {
+        for (JsonObject fp : fingerprints) {
+            if (members[i].memberId == (fp["member_id"] | "")) {
+                members[i].fingerprintId = fp["id"] | "";
+                break;
+            }
+        }
+    }
+    return true;
+}
+
+bool DirectusClient::loadTemplates(const std::vector<const PreloadMember*>& members,
+                                   int& loaded) {
+    // 1 request tải template của mọi member cần nạp trong nhóm
+    String ids;
+    for (size_t i = 0; i < members.size(); i++) {
+        if (i > 0) ids += ',';
+        ids += members[i]->fingerprintId;
+    }
+    String url = buildUrl("/items/member_fingerprints?filter[id][_in]=" + ids +
+                          "&fields=id,template_data&limit=" + String(members.size()));
+    JsonDocument filter;
+    filter["data"][0]["id"] = true;
+    filter["data"][0]["template_data"] = true;
+    JsonDocument doc;
+    if (_httpClient->getJSON(url.c_str(), doc, &filter) != 200) return false;
+    JsonArray templates = doc["data"].as<JsonArray>();
+
+    SensorJob job;
+    for (const PreloadMember* member : members) {
+        const char* base64 = "";
+        for (JsonObject fp : templates) {
+            if (member->fingerprintId == (fp["id"] | "")) {
+                base64 = fp["template_data"] | "";
+                break;
+            }
+        }
+
+        if (!decodeTemplate(base64, job.data, &job.size)) continue;
+
+        // Sensor task: chọn slot (trống / LRU), DownChar + Store, cập nhật cache
+        job.kind = SENSOR_JOB_RESIDENT;
+        job.lastActive = member->lastActive;
+        strlcpy(job.fingerprintId, member->fingerprintId.c_str(), sizeof(job.fingerprintId));
+        strlcpy(job.memberId, member->memberId.c_str(), sizeof(job.memberId));
+        if (!_sensorJobs->run(job)) {
+            return false;  // Không còn slot nào lạnh hơn member này → các member sau càng không
+        }
+        loaded++;
+    }
+    return true;
 }
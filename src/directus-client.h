@@ -4,7 +4,19 @@
 #include "http-client.h"
 #include "wifi-manager.h"
 #include "offline-queue.h"
+#include "member-cache.h"
+#include "template-restore.h"
+#include "slot-manager.h"
 #include <ArduinoJson.h>
+#include <functional>
+#include <time.h>
+
+#ifndef DIRECTUS_PAGE_SIZE
+#define DIRECTUS_PAGE_SIZE 100  // Số record mỗi trang khi list member_fingerprints
+#endif
+
+class AttendanceLogger;
+class SensorJobs;
 
 /**
  * DirectusClient - Directus API client cho fingerprint system
@@ -14,22 +26,26 @@
  * - Enroll fingerprint vào Directus
  * - Get/Update device info
  * - Create attendance logs
+ * - Refresh member cache (slot → member) cho scan path offline/O(1)
+ * - Preload template member hoạt động gần đây của branch (SlotManager)
  */
-class DirectusClient {
+class DirectusClient : public RestoreSource, public PreloadSource {
 public:
     DirectusClient(HTTPClientManager* httpClient, WiFiManager* wifiManager,
-                   OfflineQueue* offlineQueue = nullptr);
+                   OfflineQueue* offlineQueue = nullptr,
+                   MemberCache* memberCache = nullptr);
 
     /**
-     * Verify fingerprint với Directus
+     * Verify fingerprint: tra member cache trước (O(1), không cần WiFi),
+     * chỉ query Directus khi slot chưa có trong cache
      * @param deviceMac MAC address của ESP32
-     * @param fingerprintID ID vân tay (1-127)
+     * @param fingerprintID ID vân tay (slot trên sensor)
      * @param templateData Base64 encoded template
      * @param confidence Confidence score
      * @param memberId Output: Member UUID nếu verify thành công
      * @return true nếu access granted
      */
-    bool verifyFingerprint(const String& deviceMac, uint8_t fingerprintID,
+    bool verifyFingerprint(const String& deviceMac, uint16_t fingerprintID,
                           const String& templateData, uint16_t confidence,
                           String& memberId);
 
@@ -41,7 +57,7 @@ public:
      * @param memberId Member UUID
      * @return true nếu enroll thành công
      */
-    bool enrollFingerprint(const String& deviceMac, uint8_t fingerprintID,
+    bool enrollFingerprint(const String& deviceMac, uint16_t fingerprintID,
                           const String& templateData, const String& memberId);
 
     /**
@@ -62,11 +78,27 @@ public:
      * @param confidence Confidence score
      * @param accessGranted Access result
      * @param reason Lý do (success, low_confidence, not_registered...)
+     * @param checkInTime Thời điểm scan (0 = now)
      * @return true nếu log thành công
      */
     bool logAttendance(const String& memberId, const String& deviceId,
-                      uint8_t fingerprintID, uint16_t confidence,
-                      bool accessGranted, const String& reason);
+                      uint16_t fingerprintID, uint16_t confidence,
+                      bool accessGranted, const String& reason,
+                      time_t checkInTime = 0);
+
+    /**
+     * Tạo JSON payload cho /items/attendance
+     * @return JSON string
+     */
+    String buildAttendancePayload(const String& memberId, const String& deviceId,
+                                  uint16_t confidence, bool accessGranted,
+                                  const String& reason, time_t checkInTime);
+
+    /**
+     * Gắn AttendanceLogger: verifyFingerprint() sẽ log bất đồng bộ
+     * thay vì POST trực tiếp trên scan path
+     */
+    void setAttendanceLogger(AttendanceLogger* logger);
 
     /**
      * Get device UUID from MAC address
@@ -76,31 +108,105 @@ public:
     String getDeviceId(const String& deviceMac);
 
     /**
-     * Get list of fingerprints từ Directus cho device này
+     * Get device UUID của chính thiết bị này (MAC từ WiFiManager)
+     * Thread-safe; chưa có trong cache thì có thể gửi HTTP GET → không gọi trên scan path
+     */
+    String getDeviceId();
+
+    /**
+     * Duyệt member_fingerprints của device này theo trang (DIRECTUS_PAGE_SIZE)
+     * Mỗi lần chỉ giữ 1 trang đã lọc trong RAM
      * @param deviceMac MAC address
-     * @param doc Output JsonDocument chứa array fingerprints
-     * @return Số lượng fingerprints tìm thấy
+     * @param fields Các field cần lấy (VD: "id,finger_print_id,member_id")
+     * @param query Filter thêm (VD: "&filter[status][_eq]=active")
+     * @param callback Gọi cho từng record, trả về false để dừng
+     * @param pageSize Số record mỗi trang (lớn hơn khi chỉ lấy vài field nhỏ)
+     * @return Số record đã duyệt, -1 nếu lỗi
+     */
+    int forEachFingerprint(const String& deviceMac, const char* fields, const String& query,
+                           FingerprintRecordCallback callback,
+                           int pageSize = DIRECTUS_PAGE_SIZE) override;
+
+    /**
+     * Như trên, với thứ tự duyệt khác finger_print_id
+     * @param sort Directus sort (VD: "date_updated,id" cho delta sync)
      */
-    int getFingerprints(const String& deviceMac, JsonDocument& doc);
+    int forEachFingerprint(const String& deviceMac, const char* fields, const String& query,
+                           const char* sort, FingerprintRecordCallback callback,
+                           int pageSize = DIRECTUS_PAGE_SIZE);
 
     /**
      * Download một fingerprint template từ Directus
      * @param fingerprintId Fingerprint UUID
      * @param templateBuffer Output buffer (512 bytes)
      * @param templateSize Output size
-     * @param fingerprintIdLocal Output local ID (1-127)
+     * @param fingerprintIdLocal Output local ID (slot trên sensor)
      * @return true nếu download thành công
      */
     bool downloadFingerprintTemplate(const String& fingerprintId,
                                      uint8_t* templateBuffer,
                                      uint16_t* templateSize,
-                                     uint8_t* fingerprintIdLocal);
+                                     uint16_t* fingerprintIdLocal) override;
+
+    /**
+     * Refresh member cache từ Directus (chỉ lấy id, finger_print_id,
+     * member_id, status - không kéo template_data)
+     * @param deviceMac MAC address
+     * @return true nếu refresh thành công
+     */
+    bool refreshMemberCache(const String& deviceMac);
+
+    /**
+     * Member cache đang dùng (có thể nullptr)
+     */
+    MemberCache* getMemberCache() override;
+
+    /**
+     * Gắn SlotManager: refresh không ghi đè slot managed, enroll/restore cập nhật bảng slot
+     */
+    void setSlotManager(SlotManager* slotManager);
+    SlotManager* getSlotManager() override;
+
+    /**
+     * Gắn SensorJobs: preload tải template ở task gọi, ghi sensor ở sensor task
+     */
+    void setSensorJobs(SensorJobs* jobs);
+
+    /**
+     * Nạp template của member check-in gần đây (toàn branch) lên sensor
+     * Member mới nhất trước, evict slot ít dùng nhất khi sensor đầy
+     * Fingerprint + template tải theo nhóm SLOT_PRELOAD_LOOKUP_BATCH member (filter _in)
+     * Gọi từ sync task (core 0): DownChar + Store chạy ở sensor task qua SensorJobs
+     * @param maxTemplates Số template tối đa nạp trong lần gọi này
+     * @return Số template đã nạp, -1 nếu lỗi
+     */
+    int preloadRecentMembers(int maxTemplates);
+
+    // PreloadSource: attendance aggregate / member_fingerprints theo nhóm _in / SensorJobs
+    bool listRecentMembers(std::vector<PreloadMember>& members) override;
+    bool resolveFingerprints(std::vector<PreloadMember>& members,
+                             size_t first, size_t last) override;
+    bool loadTemplates(const std::vector<const PreloadMember*>& members, int& loaded) override;
 
 private:
     HTTPClientManager* _httpClient;
     WiFiManager* _wifiManager;
     OfflineQueue* _offlineQueue;
-    String _deviceUuid;  // Cache device UUID
+    MemberCache* _memberCache;
+    AttendanceLogger* _attendanceLogger;
+    SlotManager* _slotManager;
+    SensorJobs* _sensorJobs;
+    String _deviceUuid;  // Cache device UUID (chỉ đọc/ghi qua cachedDeviceUuid / setDeviceUuid)
+    SemaphoreHandle_t _deviceLock;
+
+    String cachedDeviceUuid();
+    void setDeviceUuid(const String& uuid);
+
+    /**
+     * Ghi attendance qua AttendanceLogger nếu có, không thì POST đồng bộ
+     */
+    void recordAttendance(const String& memberId, uint16_t fingerprintID,
+                          uint16_t confidence, bool accessGranted, const String& reason);
 
     /**
      * Build Directus API URL
@@ -109,6 +215,11 @@ private:
      */
     String buildUrl(const String& endpoint);
 
+    /**
+     * Decode template_data (Base64) vào buffer 512 bytes, pad 0 nếu ngắn hơn
+     */
+    bool decodeTemplate(const char* base64, uint8_t* templateBuffer, uint16_t* templateSize);
+
     /**
      * Tìm fingerprint match trong Directus database
      * @param deviceMac MAC address
@@ -119,7 +230,7 @@ private:
      */
     bool findMatchingFingerprint(const String& deviceMac, const String& templateData,
                                 String& fingerprintId, String& memberId,
-                                uint8_t sensorFingerprintID = 0);
+                                uint16_t sensorFingerprintID = 0);
 
     /**
      * So sánh 2 Base64 template strings
@@ -0,0 +1,260 @@
+#include "enroll-session.h"
+#include "buzzer-handler.h"
+#include <Adafruit_Fingerprint.h>
+
+EnrollSession::EnrollSession(EnrollSensor* sensor, BuzzerHandler* buzzer) :
+    _sensor(sensor),
+    _buzzer(buzzer),
+    _state(ENROLL_IDLE),
+    _id(0),
+    _stageStartedAt(0),
+    _lastPollAt(0),
+    _fingerTimeoutMs(ENROLL_FINGER_TIMEOUT_MS),
+    _liftTimeoutMs(ENROLL_LIFT_TIMEOUT_MS),
+    _error(""),
+    _bestSize(0),
+    _bestInBuffer(false),
+    _bestSaved(false),
+    _hasAnchor(false),
+    _replaceExisting(false),
+    _duplicateId(0),
+    _duplicateScore(0)
+{
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+void EnrollSession::start(uint16_t id, uint8_t captures, bool replaceExisting) {
+    if (captures < 2) captures = 2;
+    if (captures > ENROLL_MAX_CAPTURES) captures = ENROLL_MAX_CAPTURES;
+
+    _id = id;
+    _error = "";
+    memset(&_stats, 0, sizeof(_stats));
+    _stats.maxCaptures = captures;
+    _bestSize = 0;
+    _bestInBuffer = false;
+    _bestSaved = false;
+    _hasAnchor = false;
+    _replaceExisting = replaceExisting;
+    _duplicateId = 0;
+    _duplicateScore = 0;
+
+    Serial.printf("\n=== Đăng ký vân tay ID #%d (tối đa %d lần đặt tay) ===\n", id, captures);
+    Serial.println("Đặt ngón tay lên cảm biến...");
+    if (_buzzer) _buzzer->play(BUZZ_SINGLE);
+    _sensor->setLed(2);  // Blue LED
+    enter(ENROLL_CAPTURE_1);
+}
+
+void EnrollSession::setTimeouts(unsigned long fingerMs, unsigned long liftMs) {
+    _fingerTimeoutMs = fingerMs;
+    _liftTimeoutMs = liftMs;
+}
+
+void EnrollSession::enter(EnrollState state) {
+    _state = state;
+    _stageStartedAt = millis();
+    _lastPollAt = 0;
+}
+
+void EnrollSession::finish(EnrollState state, const char* error) {
+    _error = error;
+    _state = state;
+    _sensor->setLed(0);
+
+    if (state == ENROLL_DONE) {
+        Serial.printf("✓ Đã lưu vân tay ID #%d thành công! (%d lần đặt tay, điểm khớp %d)\n",
+                      _id, _stats.captures, _stats.bestScore);
+        if (_buzzer) _buzzer->play(BUZZ_SUCCESS);
+    } else {
+        Serial.printf("✗ Đăng ký thất bại (%s): %s\n", stateName(state), error);
+        if (_buzzer && state != ENROLL_CANCELLED) _buzzer->play(BUZZ_ERROR);
+    }
+}
+
+void EnrollSession::cancel() {
+    if (isActive()) finish(ENROLL_CANCELLED, "Cancelled");
+}
+
+void EnrollSession::nextCapture() {
+    uint8_t remaining = _stats.maxCaptures - _stats.captures;
+
+    if (_stats.bestScore >= ENROLL_GOOD_MATCH_SCORE) {
+        _stats.earlyStop = remaining > 0;
+        enter(ENROLL_STORE);
+        return;
+    }
+    if (remaining == 0 || (!_hasAnchor && remaining < 2)) {
+        if (_stats.bestScore > 0) {
+            enter(ENROLL_STORE);
+        } else if (_stats.rejectedQuality == _stats.captures) {
+            finish(ENROLL_FAILED, "Poor image quality");
+        } else {
+            finish(ENROLL_FAILED, "Fingerprints did not match");
+        }
+        return;
+    }
+
+    Serial.println("Nhấc tay ra...");
+    if (_buzzer) _buzzer->play(BUZZ_DOUBLE);
+    enter(ENROLL_LIFT);
+}
+
+void EnrollSession::step() {
+    if (!isActive()) return;
+
+    unsigned long now = millis();
+    if (_lastPollAt != 0 && now - _lastPollAt < ENROLL_POLL_MS) return;
+    _lastPollAt = now;
+
+    unsigned long timeout = (_state == ENROLL_LIFT) ? _liftTimeoutMs : _fingerTimeoutMs;
+    if (_state != ENROLL_STORE && now - _stageStartedAt >= timeout) {
+        finish(ENROLL_TIMEOUT, _state == ENROLL_LIFT ? "Finger not lifted"
+                                                     : "No finger placed");
+        return;
+    }
+
+    switch (_state) {
+        case ENROLL_CAPTURE_1:
+            if (_sensor->getImage() != FINGERPRINT_OK) return;
+            _stats.captures++;
+            if (_sensor->image2Tz(1) != FINGERPRINT_OK) {
+                _stats.rejectedQuality++;
+                Serial.printf("⚠ Ảnh lần %d kém chất lượng, bỏ qua\n", _stats.captures);
+                nextCapture();
+                return;
+            }
+            Serial.printf("✓ Đã lấy ảnh lần %d (ảnh gốc)\n", _stats.captures);
+            _hasAnchor = true;
+            nextCapture();
+            break;
+
+        case ENROLL_LIFT:
+            if (_sensor->getImage() != FINGERPRINT_NOFINGER) return;
+            Serial.println("Đặt lại ngón tay lên cảm biến...");
+            if (_buzzer) _buzzer->play(BUZZ_SINGLE);
+            _sensor->setLed(_hasAnchor ? 3 : 2);  // Purple: ảnh so khớp, Blue: chụp lại ảnh gốc
+            enter(_hasAnchor ? ENROLL_CAPTURE_2 : ENROLL_CAPTURE_1);
+            break;
+
+        case ENROLL_CAPTURE_2: {
+            if (_sensor->getImage() != FINGERPRINT_OK) return;
+            _stats.captures++;
+
+            // Ảnh tốt nhất sắp bị ghi đè trong CharBuffer2 → sao lưu ra RAM
+            if (_bestInBuffer && !_bestSaved) {
+                _bestSaved = _sensor->saveCharBuffer(2, _best, &_bestSize);
+                if (!_bestSaved) {
+                    Serial.println("⚠ Không sao lưu được ảnh tốt nhất, bỏ cặp hiện tại");
+                    _stats.bestScore = 0;
+                }
+            }
+            _bestInBuffer = false;
+
+            if (_sensor->image2Tz(2) != FINGERPRINT_OK) {
+                _stats.rejectedQuality++;
+                Serial.printf("⚠ Ảnh lần %d kém chất lượng, bỏ qua\n", _stats.captures);
+                nextCapture();
+                return;
+            }
+
+            uint16_t score = 0;
+            if (_sensor->match(&score) != FINGERPRINT_OK) {
+                score = 0;
+            }
+            Serial.printf("→ Ảnh lần %d: điểm khớp %d\n", _stats.captures, score);
+
+            if (score < ENROLL_MIN_MATCH_SCORE) {
+                _stats.rejectedMatch++;
+                // Chưa có cặp nào khớp: ảnh gốc có thể là ảnh kém → dùng ảnh này làm gốc
+                if (_stats.bestScore == 0) {
+                    _hasAnchor = _sensor->image2Tz(1) == FINGERPRINT_OK;
+                    if (_hasAnchor) _stats.reanchors++;
+                }
+            } else if (score > _stats.bestScore) {
+                _stats.bestScore = score;
+                _bestInBuffer = true;
+                _bestSaved = false;
+            }
+            nextCapture();
+            break;
+        }
+
+        case ENROLL_STORE: {
+            // Cặp tốt nhất: ảnh gốc (CharBuffer1) + ảnh điểm cao nhất (CharBuffer2)
+            if (!_bestInBuffer && !_sensor->loadCharBuffer(2, _best, _bestSize)) {
+                finish(ENROLL_FAILED, "Cannot restore best capture");
+                return;
+            }
+            if (_sensor->createModel() != FINGERPRINT_OK) {
+                finish(ENROLL_FAILED, "Fingerprints did not match");
+                return;
+            }
+
+            // Model mới (CharBuffer1) đã có trong database ở slot khác → không lưu bản sao
+            uint16_t foundId, foundScore;
+            if (_sensor->search(&foundId, &foundScore) == FINGERPRINT_OK && foundId != _id) {
+                _duplicateId = foundId;
+                _duplicateScore = foundScore;
+                Serial.printf("⚠ Vân tay đã có ở ID #%d (điểm %d)\n", foundId, foundScore);
+                if (!_replaceExisting) {
+                    finish(ENROLL_DUPLICATE, "Finger already enrolled");
+                    return;
+                }
+            }
+            if (_sensor->storeModel(_id) != FINGERPRINT_OK) {
+                finish(ENROLL_FAILED, "Store failed");
+                return;
+            }
+            finish(ENROLL_DONE, "");
+            break;
+        }
+
+        default:
+            break;
+    }
+}
+
+bool EnrollSession::isActive() {
+    return _state >= ENROLL_CAPTURE_1 && _state <= ENROLL_STORE;
+}
+
+EnrollState EnrollSession::getState() {
+    return _state;
+}
+
+uint16_t EnrollSession::getId() {
+    return _id;
+}
+
+const char* EnrollSession::getError() {
+    return _error;
+}
+
+const EnrollStats& EnrollSession::getStats() {
+    return _stats;
+}
+
+uint16_t EnrollSession::getDuplicateId() {
+    return _duplicateId;
+}
+
+uint16_t EnrollSession::getDuplicateScore() {
+    return _duplicateScore;
+}
+
+const char* EnrollSession::stateName(EnrollState state) {
+    switch (state) {
+        case ENROLL_IDLE: return "idle";
+        case ENROLL_CAPTURE_1: return "capture_1";
+        case ENROLL_LIFT: return "lift";
+        case ENROLL_CAPTURE_2: return "capture_2";
+        case ENROLL_STORE: return "store";
+        case ENROLL_DONE: return "done";
+        case ENROLL_FAILED: return "failed";
+        case ENROLL_TIMEOUT: return "timeout";
+        case ENROLL_CANCELLED: return "cancelled";
+        case ENROLL_DUPLICATE: return "duplicate";
+    }
+    return "unknown";
+}
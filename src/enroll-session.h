@@ -0,0 +1,153 @@
+#ifndef ENROLL_SESSION_H
+#define ENROLL_SESSION_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "r307-protocol.h"
+
+class BuzzerHandler;
+
+#ifndef ENROLL_FINGER_TIMEOUT_MS
+#define ENROLL_FINGER_TIMEOUT_MS 30000  // Chờ đặt ngón tay (mỗi lần capture)
+#endif
+
+#ifndef ENROLL_LIFT_TIMEOUT_MS
+#define ENROLL_LIFT_TIMEOUT_MS 15000    // Chờ nhấc tay giữa 2 lần capture
+#endif
+
+#ifndef ENROLL_CAPTURES
+#define ENROLL_CAPTURES 4               // Số lần đặt tay tối đa (2 = gộp đúng 2 ảnh như cũ)
+#endif
+
+#ifndef ENROLL_MIN_MATCH_SCORE
+#define ENROLL_MIN_MATCH_SCORE 50       // Điểm Match với ảnh gốc dưới mức này → loại ảnh
+#endif
+
+#ifndef ENROLL_GOOD_MATCH_SCORE
+#define ENROLL_GOOD_MATCH_SCORE 100     // Đạt mức này → dừng sớm, không cần đặt tay thêm
+#endif
+
+#define ENROLL_MAX_CAPTURES 8
+#define ENROLL_POLL_MS 100              // Nhịp hỏi getImage() (tránh spam UART)
+
+/**
+ * EnrollSensor - Các lệnh sensor mà enrollment cần
+ *
+ * FingerprintHandler implement trên R307 thật, test/test-enroll-sim.cpp dùng
+ * sensor giả lập để chạy toàn bộ luồng không cần phần cứng.
+ * Mã trả về theo Adafruit_Fingerprint (FINGERPRINT_OK, FINGERPRINT_NOFINGER...)
+ */
+class EnrollSensor {
+public:
+    virtual ~EnrollSensor() {}
+
+    virtual uint8_t getImage() = 0;
+    virtual uint8_t image2Tz(uint8_t charBuffer) = 0;
+    virtual uint8_t match(uint16_t* score) = 0;   // So CharBuffer1 với CharBuffer2
+    virtual uint8_t createModel() = 0;
+    virtual uint8_t search(uint16_t* id, uint16_t* score) = 0;  // Tìm CharBuffer1 trong database
+    virtual uint8_t storeModel(uint16_t id) = 0;
+    virtual void setLed(uint8_t color) = 0;  // 0 = tắt, 1=Red, 2=Blue, 3=Purple
+
+    // Sao lưu / khôi phục CharBuffer (giữ ảnh tốt nhất khi sensor chỉ có 2 buffer)
+    virtual bool saveCharBuffer(uint8_t charBuffer, uint8_t* data, uint16_t* size) = 0;
+    virtual bool loadCharBuffer(uint8_t charBuffer, const uint8_t* data, uint16_t size) = 0;
+};
+
+// Các bước đăng ký
+enum EnrollState {
+    ENROLL_IDLE,
+    ENROLL_CAPTURE_1,    // Chờ ngón tay cho ảnh gốc (CharBuffer1)
+    ENROLL_LIFT,         // Chờ nhấc tay
+    ENROLL_CAPTURE_2,    // Chờ ngón tay cho ảnh so khớp (CharBuffer2), lặp tới hết lượt
+    ENROLL_STORE,        // createModel + search trùng + storeModel
+    ENROLL_DONE,
+    ENROLL_FAILED,
+    ENROLL_TIMEOUT,
+    ENROLL_CANCELLED,
+    ENROLL_DUPLICATE     // Ngón tay đã có ở slot khác, không lưu bản sao
+};
+
+// Chất lượng một lần đăng ký (báo qua MQTT để so sánh số lần scan lại)
+struct EnrollStats {
+    uint8_t captures;          // Số lần đã đặt tay
+    uint8_t maxCaptures;
+    uint8_t rejectedQuality;   // image2Tz lỗi (ảnh mờ / ít đặc trưng)
+    uint8_t rejectedMatch;     // Điểm Match với ảnh gốc < ENROLL_MIN_MATCH_SCORE
+    uint8_t reanchors;         // Đổi ảnh gốc khi chưa có cặp nào khớp
+    uint16_t bestScore;        // Điểm của cặp dùng để tạo model
+    bool earlyStop;            // Dừng trước maxCaptures vì đạt ENROLL_GOOD_MATCH_SCORE
+};
+
+/**
+ * EnrollSession - Đăng ký vân tay dạng state machine
+ *
+ * Chức năng:
+ * - start() rồi gọi step() mỗi vòng sensor task; mỗi step tối đa vài lệnh UART
+ *   → task vẫn chạy được việc khác giữa các bước
+ * - Multi-capture: ảnh đầu vào CharBuffer1 (gốc), các ảnh sau vào CharBuffer2 và
+ *   được chấm điểm bằng Match (0x03); ảnh lỗi image2Tz / điểm thấp bị loại ngay
+ * - Giữ ảnh điểm cao nhất (UpChar ra RAM, DownChar lại trước createModel)
+ *   → model tạo từ cặp tốt nhất, dừng sớm khi đạt ENROLL_GOOD_MATCH_SCORE
+ * - Trước storeModel: Search model mới trong database → ngón tay đã đăng ký ở slot
+ *   khác thì dừng ở DUPLICATE (hoặc vẫn lưu nếu replaceExisting, caller xóa slot cũ)
+ * - Timeout theo từng bước (đặt tay / nhấc tay), cancel() bất kỳ lúc nào
+ * - Trạng thái cuối: DONE / FAILED / TIMEOUT / CANCELLED / DUPLICATE
+ */
+class EnrollSession {
+public:
+    EnrollSession(EnrollSensor* sensor, BuzzerHandler* buzzer = nullptr);
+
+    /**
+     * @param captures Số lần đặt tay tối đa (2..ENROLL_MAX_CAPTURES)
+     * @param replaceExisting Trùng với slot khác vẫn lưu vào id (caller xóa slot trùng)
+     */
+    void start(uint16_t id, uint8_t captures = ENROLL_CAPTURES, bool replaceExisting = false);
+    void step();
+    void cancel();
+
+    /**
+     * Đổi timeout (test giả lập dùng giá trị ngắn)
+     */
+    void setTimeouts(unsigned long fingerMs, unsigned long liftMs);
+
+    bool isActive();
+    EnrollState getState();
+    uint16_t getId();
+    const char* getError();   // Lý do khi FAILED / TIMEOUT
+    const EnrollStats& getStats();
+
+    // Slot đã có cùng ngón tay (0 = không trùng) và điểm Search
+    uint16_t getDuplicateId();
+    uint16_t getDuplicateScore();
+
+    static const char* stateName(EnrollState state);
+
+private:
+    EnrollSensor* _sensor;
+    BuzzerHandler* _buzzer;
+    EnrollState _state;
+    uint16_t _id;
+    unsigned long _stageStartedAt;
+    unsigned long _lastPollAt;
+    unsigned long _fingerTimeoutMs;
+    unsigned long _liftTimeoutMs;
+    const char* _error;
+    EnrollStats _stats;
+
+    // Ảnh tốt nhất: còn trong CharBuffer2, hoặc đã sao lưu ra _best
+    uint8_t _best[R307_TEMPLATE_SIZE];
+    uint16_t _bestSize;
+    bool _bestInBuffer;
+    bool _bestSaved;
+    bool _hasAnchor;
+    bool _replaceExisting;
+    uint16_t _duplicateId;
+    uint16_t _duplicateScore;
+
+    void enter(EnrollState state);
+    void finish(EnrollState state, const char* error);
+    void nextCapture();
+};
+
+#endif
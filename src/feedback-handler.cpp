@@ -0,0 +1,56 @@
+#include "feedback-handler.h"
+#include "fingerprint-handler.h"
+
+#define FEEDBACK_NO_SOUND -1
+
+struct FeedbackPattern {
+    uint8_t ledColor;   // 1=Red, 2=Blue, 3=Purple
+    uint16_t holdMs;    // 0 = giữ tới khi có kết quả tiếp theo
+    int8_t sound;       // BuzzerSound hoặc FEEDBACK_NO_SOUND
+};
+
+// Bảng pattern theo thứ tự enum FeedbackEvent
+static const FeedbackPattern PATTERNS[] = {
+    {3, 0, FEEDBACK_NO_SOUND},        // FEEDBACK_PROCESSING
+    {2, 2000, BUZZ_ACCESS_GRANTED},   // FEEDBACK_GRANTED
+    {1, 2000, BUZZ_ACCESS_DENIED},    // FEEDBACK_DENIED
+    {1, 1500, BUZZ_ACCESS_DENIED}     // FEEDBACK_NO_MATCH
+};
+
+FeedbackHandler::FeedbackHandler(FingerprintHandler* fp, BuzzerHandler* buzzer) :
+    _fp(fp),
+    _buzzer(buzzer),
+    _holdUntil(0),
+    _holding(false)
+{
+}
+
+void FeedbackHandler::show(FeedbackEvent event) {
+    const FeedbackPattern& pattern = PATTERNS[event];
+
+    // Buzzer trước: không phụ thuộc UART, người dùng nghe ngay
+    if (_buzzer && pattern.sound != FEEDBACK_NO_SOUND) {
+        _buzzer->play((BuzzerSound)pattern.sound);
+    }
+
+    _fp->ledOn(pattern.ledColor);
+    _holding = pattern.holdMs > 0;
+    _holdUntil = millis() + pattern.holdMs;
+}
+
+void FeedbackHandler::loop() {
+    if (_holding && (long)(millis() - _holdUntil) >= 0) {
+        _fp->ledOff();
+        _holding = false;
+    }
+}
+
+void FeedbackHandler::clear() {
+    if (_buzzer) _buzzer->stop();
+    _fp->ledOff();
+    _holding = false;
+}
+
+bool FeedbackHandler::isHolding() {
+    return _holding;
+}
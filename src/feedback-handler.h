@@ -0,0 +1,48 @@
+#ifndef FEEDBACK_HANDLER_H
+#define FEEDBACK_HANDLER_H
+
+#include <Arduino.h>
+#include "buzzer-handler.h"
+
+class FingerprintHandler;
+
+// Kết quả hiển thị cho người dùng sau mỗi lần scan
+enum FeedbackEvent {
+    FEEDBACK_PROCESSING,   // Đã nhận ngón tay, đang quyết định
+    FEEDBACK_GRANTED,
+    FEEDBACK_DENIED,       // Khớp trên sensor nhưng member không hợp lệ
+    FEEDBACK_NO_MATCH      // Có ngón tay nhưng không khớp slot nào
+};
+
+/**
+ * FeedbackHandler - LED + buzzer theo bảng pattern, không chặn scan path
+ *
+ * Chức năng:
+ * - show(): bật LED (1 lệnh UART, bỏ qua nếu màu không đổi) + phát buzzer
+ *   qua esp_timer, trả về ngay
+ * - loop(): tắt LED khi hết thời gian hiển thị (gọi từ sensor task vì LED
+ *   đi chung UART với R307)
+ * - Kết quả mới thay thế kết quả đang hiển thị → scan tiếp được ngay
+ */
+class FeedbackHandler {
+public:
+    FeedbackHandler(FingerprintHandler* fp, BuzzerHandler* buzzer);
+
+    void show(FeedbackEvent event);
+    void loop();
+
+    /**
+     * Tắt LED + buzzer ngay
+     */
+    void clear();
+
+    bool isHolding();
+
+private:
+    FingerprintHandler* _fp;
+    BuzzerHandler* _buzzer;
+    unsigned long _holdUntil;
+    bool _holding;
+};
+
+#endif
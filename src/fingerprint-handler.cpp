@@ -1,17 +1,37 @@
 #include "fingerprint-handler.h"
 #include "buzzer-handler.h"
+#include "template-manifest.h"
 
 FingerprintHandler::FingerprintHandler(HardwareSerial *serial) {
     serialPort = serial;  // Save serial port reference
     finger = new Adafruit_Fingerprint(serial);
     enrollStep = 0;
     buzzer = nullptr;
+    manifest = nullptr;
+    lastTransferMs = 0;
+    packetSize = R307_DEFAULT_DATA_PACKET;
+    capacity = R307_DEFAULT_CAPACITY;
+    memset(indexTable, 0, sizeof(indexTable));
+    indexLoaded = false;
+    ledColor = R307_LED_UNKNOWN;
 }
 
 void FingerprintHandler::setBuzzer(BuzzerHandler* buzz) {
     buzzer = buzz;
 }
 
+BuzzerHandler* FingerprintHandler::getBuzzer() {
+    return buzzer;
+}
+
+void FingerprintHandler::setManifest(TemplateManifest* templateManifest) {
+    manifest = templateManifest;
+}
+
+TemplateManifest* FingerprintHandler::getManifest() {
+    return manifest;
+}
+
 bool FingerprintHandler::begin() {
     // Khởi động UART với baudrate R307
     finger->begin(57600);
@@ -34,6 +54,28 @@ bool FingerprintHandler::begin() {
 
     if (connected) {
         Serial.println("✓ Tìm thấy cảm biến vân tay R307!");
+
+        // Data packet size dùng cho DownChar phải khớp cấu hình sensor
+        if (finger->getParameters() == FINGERPRINT_OK) {
+            if (finger->packet_len > 0 && finger->packet_len <= R307_MAX_DATA_PACKET) {
+                packetSize = finger->packet_len;
+            }
+            if (finger->capacity > 0) {
+                // Sensor báo capacity lớn hơn bảng slot / index table → chỉ dùng phần có bảng
+                capacity = finger->capacity;
+                if (capacity > MEMBER_CACHE_SLOTS) capacity = MEMBER_CACHE_SLOTS;
+                if (capacity > R307_INDEX_PAGE_BYTES * 8 * R307_INDEX_MAX_PAGES) {
+                    capacity = R307_INDEX_PAGE_BYTES * 8 * R307_INDEX_MAX_PAGES;
+                }
+            }
+        }
+        Serial.printf("→ Capacity: %d templates, packet size: %d bytes\n", capacity, packetSize);
+
+        if (loadIndexTable()) {
+            Serial.printf("→ Index table: %d slot đã dùng\n", getUsedCount());
+        } else {
+            Serial.println("⚠ Không đọc được index table");
+        }
         return true;
     } else {
         Serial.println("✗ Không tìm thấy cảm biến R307");
@@ -86,79 +128,98 @@ FingerprintStatus FingerprintHandler::captureImage() {
     }
 }
 
-int FingerprintHandler::enrollFingerprint(uint8_t id) {
-    Serial.printf("\n=== Đăng ký vân tay ID #%d ===\n", id);
+int FingerprintHandler::enrollFingerprint(uint16_t id) {
+    EnrollSession session(this, buzzer);
+    session.start(id);
+    while (session.isActive()) {
+        session.step();
+        delay(10);
+    }
+    return session.getState() == ENROLL_DONE ? id : -1;
+}
 
-    // Bước 1: Lấy ảnh lần 1
-    Serial.println("Đặt ngón tay lên cảm biến...");
-    if (buzzer) buzzer->play(BUZZ_SINGLE);
-    ledOn(2); // Blue LED
+uint8_t FingerprintHandler::getImage() {
+    return finger->getImage();
+}
 
-    while (finger->getImage() != FINGERPRINT_OK) {
-        delay(100);
-    }
+uint8_t FingerprintHandler::image2Tz(uint8_t charBuffer) {
+    return finger->image2Tz(charBuffer);
+}
 
-    Serial.println("✓ Đã lấy ảnh lần 1");
-    uint8_t p = finger->image2Tz(1);
-    if (p != FINGERPRINT_OK) {
-        Serial.println("✗ Lỗi chuyển đổi ảnh lần 1");
-        if (buzzer) buzzer->play(BUZZ_ERROR);
-        ledOff();
-        return -1;
-    }
+uint8_t FingerprintHandler::match(uint16_t* score) {
+    *score = 0;
 
-    // Yêu cầu nhấc tay
-    Serial.println("Nhấc tay ra...");
-    if (buzzer) buzzer->play(BUZZ_DOUBLE);
-    delay(2000);
-    while (finger->getImage() != FINGERPRINT_NOFINGER) {
-        delay(100);
+    while (serialPort->available()) {
+        serialPort->read();
     }
 
-    // Bước 2: Lấy ảnh lần 2
-    Serial.println("Đặt lại ngón tay lên cảm biến...");
-    if (buzzer) buzzer->play(BUZZ_SINGLE);
-    ledOn(3); // Purple LED
+    // ACK payload: confirmation code + 2 bytes điểm khớp (big-endian)
+    uint8_t payload[R307_MAX_ACK_PAYLOAD];
+    R307PacketParser parser;
+    parser.setPayloadBuffer(payload, sizeof(payload));
 
-    while (finger->getImage() != FINGERPRINT_OK) {
-        delay(100);
+    if (!sendCommand(R307_CMD_MATCH, nullptr, 0) ||
+        receivePacket(parser, R307_ACK_TIMEOUT_MS) != R307_PARSE_PACKET ||
+        parser.pid() != R307_PID_ACK) {
+        return FINGERPRINT_PACKETRECIEVEERR;
     }
+    if (parser.payloadLength() >= 3) {
+        *score = ((uint16_t)payload[1] << 8) | payload[2];
+    }
+    return parser.ackCode();
+}
 
-    Serial.println("✓ Đã lấy ảnh lần 2");
-    p = finger->image2Tz(2);
-    if (p != FINGERPRINT_OK) {
-        Serial.println("✗ Lỗi chuyển đổi ảnh lần 2");
-        if (buzzer) buzzer->play(BUZZ_ERROR);
-        ledOff();
-        return -1;
+uint8_t FingerprintHandler::createModel() {
+    return finger->createModel();
+}
+
+uint8_t FingerprintHandler::search(uint16_t* id, uint16_t* score) {
+    *id = 0;
+    *score = 0;
+
+    while (serialPort->available()) {
+        serialPort->read();
     }
 
-    // Tạo mẫu
-    p = finger->createModel();
-    if (p != FINGERPRINT_OK) {
-        Serial.println("✗ Vân tay không khớp, thử lại!");
-        if (buzzer) buzzer->play(BUZZ_ERROR);
-        ledOff();
-        return -1;
+    // Params: CharBuffer1, StartPage(2), PageNum(2)
+    // ACK payload: confirmation code + PageID(2) + MatchScore(2)
+    uint8_t params[5] = {1, 0, 0, (uint8_t)(capacity >> 8), (uint8_t)(capacity & 0xFF)};
+    uint8_t payload[R307_MAX_ACK_PAYLOAD];
+    R307PacketParser parser;
+    parser.setPayloadBuffer(payload, sizeof(payload));
+
+    if (!sendCommand(R307_CMD_SEARCH, params, sizeof(params)) ||
+        receivePacket(parser, R307_SEARCH_TIMEOUT_MS) != R307_PARSE_PACKET ||
+        parser.pid() != R307_PID_ACK) {
+        return FINGERPRINT_PACKETRECIEVEERR;
+    }
+    if (parser.ackCode() == FINGERPRINT_OK && parser.payloadLength() >= 5) {
+        *id = ((uint16_t)payload[1] << 8) | payload[2];
+        *score = ((uint16_t)payload[3] << 8) | payload[4];
     }
+    return parser.ackCode();
+}
 
-    // Lưu vào bộ nhớ
-    p = finger->storeModel(id);
-    if (p == FINGERPRINT_OK) {
-        Serial.printf("✓ Đã lưu vân tay ID #%d thành công!\n", id);
-        if (buzzer) buzzer->play(BUZZ_SUCCESS);
-        ledOn(2); // Blue LED success
-        delay(500);
+uint8_t FingerprintHandler::storeModel(uint16_t id) {
+    // Nội dung mới chưa biết hash cho tới khi UpChar
+    if (manifest) manifest->erase(id);
+    uint8_t p = finger->storeModel(id);
+    if (p == FINGERPRINT_OK) setSlotUsed(id, true);
+    return p;
+}
+
+void FingerprintHandler::setLed(uint8_t color) {
+    if (color == 0) {
         ledOff();
-        return id;
     } else {
-        Serial.println("✗ Lỗi lưu vân tay");
-        if (buzzer) buzzer->play(BUZZ_ERROR);
-        ledOff();
-        return -1;
+        ledOn(color);
     }
 }
 
+bool FingerprintHandler::saveCharBuffer(uint8_t charBuffer, uint8_t* data, uint16_t* size) {
+    return downloadModel(charBuffer, data, size);
+}
+
 int FingerprintHandler::verifyFingerprint() {
     // Lấy ảnh
     uint8_t p = finger->getImage();
@@ -184,12 +245,14 @@ int FingerprintHandler::verifyFingerprint() {
     }
 }
 
-bool FingerprintHandler::deleteFingerprint(uint8_t id) {
+bool FingerprintHandler::deleteFingerprint(uint16_t id) {
     Serial.printf("→ Đang xóa vân tay ID #%d...\n", id);
 
     uint8_t p = finger->deleteModel(id);
 
     if (p == FINGERPRINT_OK) {
+        setSlotUsed(id, false);
+        if (manifest) manifest->erase(id);
         Serial.printf("✓ Đã xóa vân tay ID #%d\n", id);
         if (buzzer) buzzer->play(BUZZ_DELETE);
         return true;
@@ -204,6 +267,8 @@ bool FingerprintHandler::deleteAllFingerprints() {
     uint8_t p = finger->emptyDatabase();
 
     if (p == FINGERPRINT_OK) {
+        memset(indexTable, 0, sizeof(indexTable));
+        if (manifest) manifest->clear();
         Serial.println("✓ Đã xóa toàn bộ vân tay");
         return true;
     } else {
@@ -215,16 +280,30 @@ bool FingerprintHandler::deleteAllFingerprints() {
 void FingerprintHandler::ledOn(uint8_t color) {
     // R307 LED control
     // color: 1=Red, 2=Blue, 3=Purple
+    if (color == ledColor) return;
+
     uint8_t p = finger->LEDcontrol(FINGERPRINT_LED_BREATHING, 1, color);
-    Serial.printf("→ LED ON color=%d, result=0x%02X\n", color, p);
+    if (p == FINGERPRINT_OK) {
+        ledColor = color;
+    } else {
+        ledColor = R307_LED_UNKNOWN;
+        Serial.printf("✗ LED ON color=%d failed, result=0x%02X\n", color, p);
+    }
 }
 
 void FingerprintHandler::ledOff() {
+    if (ledColor == 0) return;
+
     uint8_t p = finger->LEDcontrol(FINGERPRINT_LED_OFF, 0, 0);
-    Serial.printf("→ LED OFF, result=0x%02X\n", p);
+    if (p == FINGERPRINT_OK) {
+        ledColor = 0;
+    } else {
+        ledColor = R307_LED_UNKNOWN;
+        Serial.printf("✗ LED OFF failed, result=0x%02X\n", p);
+    }
 }
 
-bool FingerprintHandler::getTemplate(uint8_t id, uint8_t* templateBuffer, uint16_t* templateSize) {
+bool FingerprintHandler::getTemplate(uint16_t id, uint8_t* templateBuffer, uint16_t* templateSize) {
     // Load template từ flash memory vào buffer slot 1
     uint8_t p = finger->loadModel(id);
     if (p != FINGERPRINT_OK) {
@@ -233,217 +312,247 @@ bool FingerprintHandler::getTemplate(uint8_t id, uint8_t* templateBuffer, uint16
     }
 
     // Download template từ buffer
-    return downloadModel(1, templateBuffer, templateSize);
+    if (!downloadModel(1, templateBuffer, templateSize)) {
+        return false;
+    }
+    if (manifest) manifest->set(id, templateBuffer, *templateSize);
+    return true;
 }
 
 bool FingerprintHandler::downloadModel(uint8_t slot, uint8_t* templateBuffer, uint16_t* templateSize) {
-    // NOTE: Adafruit library không expose fingerTemplate data
-    // Workaround: Tạo unique identifier từ fingerprint ID
+    unsigned long start = millis();
+
+    // Bỏ dữ liệu cũ còn trong UART để không lẫn với response UpChar
+    while (serialPort->available()) {
+        serialPort->read();
+    }
 
-    Serial.println("⚠ Adafruit library không hỗ trợ download template data");
-    Serial.println("  Sử dụng fingerprint ID để identify trong Directus");
+    // UpChar: sensor gửi CharBuffer <slot> lên host
+    uint8_t code;
+    if (!sendCommand(R307_CMD_UPCHAR, &slot, 1) || !waitAck(&code, R307_ACK_TIMEOUT_MS)) {
+        Serial.println("✗ UpChar: không nhận được ACK");
+        return false;
+    }
+    if (code != FINGERPRINT_OK) {
+        Serial.printf("✗ UpChar bị từ chối (code 0x%02X)\n", code);
+        return false;
+    }
 
-    // Tạo placeholder template với fingerprint ID
-    *templateSize = 512;
-    memset(templateBuffer, 0, 512);
+    // Data packets: parser ghi thẳng payload vào buffer của caller
+    R307DataReceiver receiver(templateBuffer, R307_TEMPLATE_SIZE);
+    while (true) {
+        R307DataStatus status = receiver.onPacket(receivePacket(receiver.parser(), R307_ACK_TIMEOUT_MS));
+        if (status == R307_DATA_DONE) break;
+        if (status != R307_DATA_MORE) {
+            Serial.printf("✗ UpChar: gói dữ liệu #%d lỗi (%s)\n", receiver.packets() + 1,
+                         status == R307_DATA_CHECKSUM_ERROR ? "checksum" :
+                         status == R307_DATA_OVERFLOW ? "quá kích thước" :
+                         status == R307_DATA_INCOMPLETE ? "thiếu dữ liệu" :
+                         status == R307_DATA_TIMEOUT ? "timeout" : "sai PID");
+            return false;
+        }
+    }
 
-    // Đặt fingerprint ID vào đầu template để unique
-    templateBuffer[0] = slot;
-    templateBuffer[1] = 0xFF;  // Marker
-    templateBuffer[2] = finger->fingerID & 0xFF;
-    templateBuffer[3] = (finger->fingerID >> 8) & 0xFF;
+    *templateSize = receiver.received();
+    lastTransferMs = millis() - start;
 
-    Serial.printf("✓ Generated ID-based template (%d bytes)\n", *templateSize);
-    Serial.println("  NOTE: Template matching sẽ dùng fingerprint_id trong Directus");
+    Serial.printf("✓ Downloaded template: %d bytes, %d packets, %lu ms\n",
+                 receiver.received(), receiver.packets(), lastTransferMs);
     return true;
 }
 
-bool FingerprintHandler::uploadModel(uint8_t id, uint8_t* templateBuffer, uint16_t templateSize) {
+bool FingerprintHandler::uploadModel(uint16_t id, uint8_t* templateBuffer, uint16_t templateSize) {
     Serial.printf("→ Uploading template to R307 (ID #%d, size: %d bytes)...\n", id, templateSize);
 
     // Validate template size (should be 512 bytes for R307)
-    if (templateSize != 512) {
-        Serial.printf("✗ Invalid template size: %d (expected 512)\n", templateSize);
+    if (templateSize != R307_TEMPLATE_SIZE) {
+        Serial.printf("✗ Invalid template size: %d (expected %d)\n",
+                     templateSize, R307_TEMPLATE_SIZE);
         return false;
     }
 
-    // ⚠️ WARNING: R307 template upload via UART packets
-    // This uses raw UART communication to send template data
-    // May not work on all R307 firmware versions!
-
-    Serial.println("→ Sending DownChar command...");
-
-    // Create packet for DownChar command (0x08)
-    // Command packet: Header + Addr + PID + Length + Data + Checksum
-    uint8_t cmdPacket[12];
-    cmdPacket[0] = 0xEF;  // Header high
-    cmdPacket[1] = 0x01;  // Header low
-    cmdPacket[2] = 0xFF;  // Address byte 1
-    cmdPacket[3] = 0xFF;  // Address byte 2
-    cmdPacket[4] = 0xFF;  // Address byte 3
-    cmdPacket[5] = 0xFF;  // Address byte 4
-    cmdPacket[6] = 0x01;  // Package identifier (command packet)
-    cmdPacket[7] = 0x00;  // Package length high
-    cmdPacket[8] = 0x04;  // Package length low (4 bytes: cmd + bufferID + checksum)
-    cmdPacket[9] = 0x08;  // Command code: DownChar
-    cmdPacket[10] = 0x01; // Buffer ID (CharBuffer1)
-
-    // Calculate checksum
-    uint16_t sum = 0x01 + 0x00 + 0x04 + 0x08 + 0x01;
-    cmdPacket[11] = (sum >> 8) & 0xFF;  // Checksum high (always 0 for this case)
-    // We need 2 bytes for checksum but packet is only 12, so we'll send separately
-
-    // Actually, let me fix the packet structure properly
-    uint8_t cmdPacketFull[13];
-    cmdPacketFull[0] = 0xEF;  // Header high
-    cmdPacketFull[1] = 0x01;  // Header low
-    cmdPacketFull[2] = 0xFF;  // Address
-    cmdPacketFull[3] = 0xFF;
-    cmdPacketFull[4] = 0xFF;
-    cmdPacketFull[5] = 0xFF;
-    cmdPacketFull[6] = 0x01;  // Package ID (command)
-    cmdPacketFull[7] = 0x00;  // Length high
-    cmdPacketFull[8] = 0x04;  // Length low
-    cmdPacketFull[9] = 0x08;  // DownChar command
-    cmdPacketFull[10] = 0x01; // BufferID = 1
-    sum = 0x01 + 0x00 + 0x04 + 0x08 + 0x01;
-    cmdPacketFull[11] = (sum >> 8) & 0xFF;
-    cmdPacketFull[12] = sum & 0xFF;
-
-    serialPort->write(cmdPacketFull, 13);
-    delay(100);
-
-    // Now send data packets (2 packets of 256 bytes each)
-    uint8_t dataPacket[267];
-
-    // Packet 1
-    Serial.println("→ Sending data packet 1/2...");
-    dataPacket[0] = 0xEF;
-    dataPacket[1] = 0x01;
-    dataPacket[2] = 0xFF;
-    dataPacket[3] = 0xFF;
-    dataPacket[4] = 0xFF;
-    dataPacket[5] = 0xFF;
-    dataPacket[6] = 0x02;  // Data packet
-    dataPacket[7] = 0x01;  // Length high (258 = 0x0102)
-    dataPacket[8] = 0x02;  // Length low
-
-    memcpy(&dataPacket[9], templateBuffer, 256);
-
-    sum = 0x02 + 0x01 + 0x02;
-    for (int i = 0; i < 256; i++) {
-        sum += templateBuffer[i];
-    }
-    dataPacket[265] = (sum >> 8) & 0xFF;
-    dataPacket[266] = sum & 0xFF;
-
-    serialPort->write(dataPacket, 267);
-    delay(100);
-
-    // Packet 2 (end packet)
-    Serial.println("→ Sending data packet 2/2...");
-    dataPacket[6] = 0x08;  // End data packet
-    memcpy(&dataPacket[9], templateBuffer + 256, 256);
-
-    sum = 0x08 + 0x01 + 0x02;
-    for (int i = 256; i < 512; i++) {
-        sum += templateBuffer[i];
-    }
-    dataPacket[265] = (sum >> 8) & 0xFF;
-    dataPacket[266] = sum & 0xFF;
-
-    serialPort->write(dataPacket, 267);
-    delay(200);
-
-    // Wait for ACK from DownChar command
-    // Read response (12 bytes expected)
-    uint8_t response[12];
-    int bytesRead = 0;
-    unsigned long timeout = millis();
-
-    while (bytesRead < 12 && (millis() - timeout) < 1000) {
-        if (serialPort->available()) {
-            response[bytesRead++] = serialPort->read();
-        }
+    unsigned long start = millis();
+
+    // Slot sắp bị ghi: bỏ hash cũ trước, chỉ ghi hash mới khi Store thành công
+    if (manifest) manifest->erase(id);
+
+    uint8_t bufferId = 1;
+    if (!loadCharBuffer(bufferId, templateBuffer, templateSize)) {
+        return false;
     }
 
-    if (bytesRead >= 12 && response[9] == 0x00) {
-        Serial.println("✓ DownChar succeeded");
-    } else {
-        Serial.printf("⚠ DownChar response unclear (%d bytes read)\n", bytesRead);
-        // Continue anyway - some firmware versions may not respond properly
+    // Store (0x06): CharBuffer1 → flash page <id>
+    Serial.printf("→ Storing CharBuffer to flash memory (ID #%d)...\n", id);
+    uint8_t code;
+    uint8_t storeParams[3] = {bufferId, (uint8_t)(id >> 8), (uint8_t)(id & 0xFF)};
+    if (!sendCommand(R307_CMD_STORE, storeParams, sizeof(storeParams)) ||
+        !waitAck(&code, R307_ACK_TIMEOUT_MS)) {
+        Serial.println("✗ Store command timeout");
+        return false;
+    }
+    if (code != FINGERPRINT_OK) {
+        Serial.printf("✗ Store thất bại (code 0x%02X)\n", code);
+        return false;
     }
 
-    // Clear serial buffer before sending Store command
+    setSlotUsed(id, true);
+    if (manifest) manifest->set(id, templateBuffer, templateSize);
+    lastTransferMs = millis() - start;
+    Serial.printf("✓ Template uploaded & stored successfully! ID #%d (%lu ms)\n",
+                 id, lastTransferMs);
+    return true;
+}
+
+bool FingerprintHandler::loadCharBuffer(uint8_t charBuffer, const uint8_t* data, uint16_t size) {
     while (serialPort->available()) {
         serialPort->read();
     }
-    delay(100);
 
-    // Send Store command (0x06) to save CharBuffer1 to flash
-    Serial.printf("→ Storing CharBuffer to flash memory (ID #%d)...\n", id);
+    // DownChar (0x09): sensor ACK trước, sau đó mới nhận data packets
+    uint8_t code;
+    if (!sendCommand(R307_CMD_DOWNCHAR, &charBuffer, 1) || !waitAck(&code, R307_ACK_TIMEOUT_MS)) {
+        Serial.println("✗ DownChar: không nhận được ACK");
+        return false;
+    }
+    if (code != FINGERPRINT_OK) {
+        Serial.printf("✗ DownChar bị từ chối (code 0x%02X)\n", code);
+        return false;
+    }
 
-    uint8_t storeCmd[14];
-    storeCmd[0] = 0xEF;  // Header
-    storeCmd[1] = 0x01;
-    storeCmd[2] = 0xFF;  // Address
-    storeCmd[3] = 0xFF;
-    storeCmd[4] = 0xFF;
-    storeCmd[5] = 0xFF;
-    storeCmd[6] = 0x01;  // Command packet
-    storeCmd[7] = 0x00;  // Length high
-    storeCmd[8] = 0x06;  // Length low (6 bytes)
-    storeCmd[9] = 0x06;  // Store command
-    storeCmd[10] = 0x01; // BufferID = 1
-    storeCmd[11] = (id >> 8) & 0xFF;  // Page ID high
-    storeCmd[12] = id & 0xFF;          // Page ID low
-
-    sum = 0x01 + 0x00 + 0x06 + 0x06 + 0x01 + ((id >> 8) & 0xFF) + (id & 0xFF);
-    storeCmd[13] = sum & 0xFF;  // Checksum low byte only (high byte would be in storeCmd[14] if needed)
-
-    // Actually need 15 bytes for full packet with 2-byte checksum
-    uint8_t storeCmdFull[15];
-    memcpy(storeCmdFull, storeCmd, 13);
-    storeCmdFull[13] = (sum >> 8) & 0xFF;  // Checksum high
-    storeCmdFull[14] = sum & 0xFF;          // Checksum low
-
-    serialPort->write(storeCmdFull, 15);
-    delay(200);
-
-    // Read Store response
-    bytesRead = 0;
-    timeout = millis();
-    while (bytesRead < 12 && (millis() - timeout) < 1000) {
-        if (serialPort->available()) {
-            response[bytesRead++] = serialPort->read();
+    // Gửi data theo packet size đã cấu hình trên sensor, gói cuối là END_DATA
+    uint16_t offset = 0;
+    while (offset < size) {
+        uint16_t remaining = size - offset;
+        uint16_t chunk = remaining < packetSize ? remaining : packetSize;
+        uint8_t pid = (offset + chunk >= size) ? R307_PID_END_DATA : R307_PID_DATA;
+        if (!sendPacket(pid, data + offset, chunk)) {
+            Serial.println("✗ DownChar: lỗi encode data packet");
+            return false;
         }
+        offset += chunk;
     }
+    return true;
+}
 
-    if (bytesRead >= 12 && response[9] == 0x00) {
-        Serial.printf("✓ Template uploaded & stored successfully! ID #%d\n", id);
-        return true;
-    } else if (bytesRead >= 10) {
-        Serial.printf("⚠ Store response code: 0x%02X (read %d bytes)\n", response[9], bytesRead);
+bool FingerprintHandler::sendPacket(uint8_t pid, const uint8_t* data, uint16_t length) {
+    uint8_t frame[R307_MAX_DATA_PACKET + R307_FRAME_OVERHEAD];
+    size_t frameLen = r307EncodePacket(frame, sizeof(frame), pid, data, length);
+    if (frameLen == 0) return false;
 
-        // Check if template already exists by trying to verify
-        Serial.println("→ Verifying if template was actually stored...");
-        delay(500);
+    return serialPort->write(frame, frameLen) == frameLen;
+}
 
-        // Try to load the model we just stored
-        uint8_t p = finger->loadModel(id);
-        if (p == FINGERPRINT_OK) {
-            Serial.printf("✓ Verification SUCCESS! Template ID #%d is stored and working!\n", id);
-            return true;
-        } else {
-            Serial.printf("✗ Verification FAILED - template not stored (load error: 0x%02X)\n", p);
-            return false;
+bool FingerprintHandler::sendCommand(uint8_t cmd, const uint8_t* params, uint16_t length) {
+    uint8_t frame[32];
+    size_t frameLen = r307EncodeCommand(frame, sizeof(frame), cmd, params, length);
+    if (frameLen == 0) return false;
+
+    return serialPort->write(frame, frameLen) == frameLen;
+}
+
+R307ParseResult FingerprintHandler::receivePacket(R307PacketParser& parser, unsigned long timeoutMs) {
+    unsigned long deadline = millis() + timeoutMs;
+
+    // Xử lý ngay khi byte tới, chỉ nhường CPU khi UART rỗng
+    while (true) {
+        while (serialPort->available()) {
+            R307ParseResult result = parser.feed(serialPort->read());
+            if (result != R307_PARSE_NEED_MORE) return result;
         }
-    } else {
-        Serial.printf("✗ Store command timeout (%d bytes received)\n", bytesRead);
+        if ((long)(millis() - deadline) >= 0) {
+            parser.reset();
+            return R307_PARSE_NEED_MORE;
+        }
+        delay(1);
+    }
+}
+
+bool FingerprintHandler::waitAck(uint8_t* code, unsigned long timeoutMs) {
+    uint8_t payload[R307_MAX_ACK_PAYLOAD];
+    R307PacketParser parser;
+    parser.setPayloadBuffer(payload, sizeof(payload));
+
+    if (receivePacket(parser, timeoutMs) != R307_PARSE_PACKET ||
+        parser.pid() != R307_PID_ACK) {
         return false;
     }
+    *code = parser.ackCode();
+    return true;
 }
 
 uint16_t FingerprintHandler::getConfidence() {
     return finger->confidence;
 }
+
+uint16_t FingerprintHandler::getCapacity() {
+    return capacity;
+}
+
+unsigned long FingerprintHandler::getLastTransferMs() {
+    return lastTransferMs;
+}
+
+bool FingerprintHandler::loadIndexTable() {
+    uint8_t pages = (capacity + R307_INDEX_PAGE_BYTES * 8 - 1) / (R307_INDEX_PAGE_BYTES * 8);
+    if (pages > R307_INDEX_MAX_PAGES) pages = R307_INDEX_MAX_PAGES;
+
+    while (serialPort->available()) {
+        serialPort->read();
+    }
+
+    // ACK payload: confirmation code + 32 bytes bitmap của trang
+    uint8_t payload[R307_MAX_ACK_PAYLOAD];
+    R307PacketParser parser;
+    parser.setPayloadBuffer(payload, sizeof(payload));
+
+    for (uint8_t page = 0; page < pages; page++) {
+        if (!sendCommand(R307_CMD_READ_INDEX_TABLE, &page, 1) ||
+            receivePacket(parser, R307_ACK_TIMEOUT_MS) != R307_PARSE_PACKET ||
+            parser.pid() != R307_PID_ACK ||
+            parser.ackCode() != FINGERPRINT_OK ||
+            parser.payloadLength() < 1 + R307_INDEX_PAGE_BYTES) {
+            Serial.printf("✗ ReadIndexTable trang %d lỗi\n", page);
+            indexLoaded = false;
+            return false;
+        }
+        memcpy(indexTable + page * R307_INDEX_PAGE_BYTES, payload + 1, R307_INDEX_PAGE_BYTES);
+    }
+
+    indexLoaded = true;
+    return true;
+}
+
+bool FingerprintHandler::hasIndexTable() {
+    return indexLoaded;
+}
+
+bool FingerprintHandler::isSlotUsed(uint16_t id) {
+    if (id >= sizeof(indexTable) * 8) return false;
+    // Bit 0 của byte 0 = page 0 (LSB trước)
+    return indexTable[id >> 3] & (1 << (id & 7));
+}
+
+void FingerprintHandler::setSlotUsed(uint16_t id, bool used) {
+    if (id >= sizeof(indexTable) * 8) return;
+    if (used) {
+        indexTable[id >> 3] |= (1 << (id & 7));
+    } else {
+        indexTable[id >> 3] &= ~(1 << (id & 7));
+    }
+}
+
+uint16_t FingerprintHandler::findFreeSlot(uint16_t from) {
+    if (!indexLoaded) return 0;
+    for (uint16_t id = from < 1 ? 1 : from; id < capacity; id++) {
+        if (!isSlotUsed(id)) return id;
+    }
+    return 0;
+}
+
+uint16_t FingerprintHandler::getUsedCount() {
+    uint16_t count = 0;
+    for (uint16_t id = 1; id < capacity; id++) {
+        if (isSlotUsed(id)) count++;
+    }
+    return count;
+}
@@ -2,9 +2,24 @@
 #define FINGERPRINT_HANDLER_H
 
 #include <Adafruit_Fingerprint.h>
+#include "r307-protocol.h"
+#include "enroll-session.h"
+#include "template-restore.h"
+#include "slot-manager.h"
 
 // Forward declaration
 class BuzzerHandler;
+class TemplateManifest;
+
+#define R307_ACK_TIMEOUT_MS 1000       // Chờ ACK / data packet tối đa
+#define R307_SEARCH_TIMEOUT_MS 3000    // Search 1:N toàn database chậm hơn lệnh thường
+#define R307_DEFAULT_DATA_PACKET 128   // Packet size mặc định (N=2)
+#define R307_MAX_DATA_PACKET 256
+#define R307_MAX_ACK_PAYLOAD 64        // ACK lớn nhất (ReadIndexTable: 1 + 32 bytes)
+#define R307_DEFAULT_CAPACITY 1000     // Dùng khi không đọc được system parameters
+#define R307_INDEX_PAGE_BYTES 32       // ReadIndexTable: 1 trang = 32 bytes = 256 slot
+#define R307_INDEX_MAX_PAGES 4         // Đủ cho capacity tối đa 1024
+#define R307_LED_UNKNOWN 0xFF
 
 // Trạng thái xử lý vân tay
 enum FingerprintStatus {
@@ -17,12 +32,26 @@ enum FingerprintStatus {
     FP_COMMUNICATION_ERROR  // Lỗi kết nối
 };
 
-class FingerprintHandler {
+class FingerprintHandler : public EnrollSensor, public RestoreSensor, public SlotSensor {
 private:
     Adafruit_Fingerprint *finger;
     HardwareSerial *serialPort;  // Serial port cho raw UART access
     uint8_t enrollStep;  // Bước đăng ký hiện tại
     BuzzerHandler* buzzer;    // Buzzer
+    TemplateManifest* manifest;  // Hash template theo slot (có thể nullptr)
+    unsigned long lastTransferMs;  // Thời gian transfer template gần nhất
+    uint16_t packetSize;      // Data packet size của sensor (bytes)
+    uint16_t capacity;        // Số slot template của sensor (từ getParameters)
+    uint8_t indexTable[R307_INDEX_PAGE_BYTES * R307_INDEX_MAX_PAGES];  // Bitmap slot đã dùng
+    bool indexLoaded;         // false nếu chưa đọc được ReadIndexTable
+    uint8_t ledColor;         // Trạng thái LED đã gửi (0 = tắt, R307_LED_UNKNOWN = chưa biết)
+
+    // Raw UART packet helpers (framing trong r307-protocol)
+    bool sendPacket(uint8_t pid, const uint8_t* data, uint16_t length);
+    bool sendCommand(uint8_t cmd, const uint8_t* params, uint16_t length);
+    R307ParseResult receivePacket(R307PacketParser& parser, unsigned long timeoutMs);
+    bool waitAck(uint8_t* code, unsigned long timeoutMs);
+    void setSlotUsed(uint16_t id, bool used);
 
 public:
     FingerprintHandler(HardwareSerial *serial);
@@ -32,19 +61,50 @@ public:
 
     // Set buzzer cho UX feedback
     void setBuzzer(BuzzerHandler* buzz);
+    BuzzerHandler* getBuzzer();
+
+    // Gắn manifest: cập nhật hash mỗi lần store / UpChar / delete
+    void setManifest(TemplateManifest* templateManifest);
+    TemplateManifest* getManifest() override;
 
     // Lấy thông tin cảm biến
     void printSensorInfo();
     uint16_t getTemplateCount();
 
-    // Đăng ký vân tay (trả về ID nếu thành công, -1 nếu thất bại)
-    int enrollFingerprint(uint8_t id);
+    // Số page template của sensor (page 0..capacity-1, ID dùng: 1..capacity-1)
+    uint16_t getCapacity() override;
+
+    // Đọc bitmap slot đã dùng bằng ReadIndexTable (0x1F), 1 lệnh / 256 slot
+    // Bitmap được cập nhật tại chỗ sau mỗi store / delete
+    bool loadIndexTable();
+    bool hasIndexTable() override;
+
+    // Tra cứu bitmap trong RAM (không tốn round trip tới sensor)
+    bool isSlotUsed(uint16_t id) override;
+    uint16_t findFreeSlot(uint16_t from = 1) override;  // 0 nếu hết slot
+    uint16_t getUsedCount();
+
+    // Đăng ký vân tay blocking (serial menu), chạy EnrollSession tới khi xong
+    // Trả về ID nếu thành công, -1 nếu thất bại
+    int enrollFingerprint(uint16_t id);
+
+    // EnrollSensor: từng lệnh R307 cho EnrollSession
+    // storeModel() cập nhật bitmap slot + manifest như các lệnh store khác
+    uint8_t getImage() override;
+    uint8_t image2Tz(uint8_t charBuffer) override;
+    uint8_t match(uint16_t* score) override;   // Match (0x03), score từ ACK payload
+    uint8_t createModel() override;
+    uint8_t search(uint16_t* id, uint16_t* score) override;  // Search (0x04) trên 0..capacity
+    uint8_t storeModel(uint16_t id) override;
+    void setLed(uint8_t color) override;
+    bool saveCharBuffer(uint8_t charBuffer, uint8_t* data, uint16_t* size) override;  // UpChar
+    bool loadCharBuffer(uint8_t charBuffer, const uint8_t* data, uint16_t size) override;  // DownChar
 
     // Xác thực vân tay (trả về ID nếu tìm thấy, -1 nếu không tìm thấy)
     int verifyFingerprint();
 
     // Xóa vân tay
-    bool deleteFingerprint(uint8_t id);
+    bool deleteFingerprint(uint16_t id) override;
     bool deleteAllFingerprints();
 
     // Kiểm tra ngón tay có đặt trên cảm biến không
@@ -54,18 +114,22 @@ public:
     FingerprintStatus captureImage();
 
     // Lấy fingerprint template data (raw data của vân tay)
-    bool getTemplate(uint8_t id, uint8_t* templateBuffer, uint16_t* templateSize);
+    bool getTemplate(uint16_t id, uint8_t* templateBuffer, uint16_t* templateSize);
 
-    // Download template từ sensor buffer sang storage
+    // Download template từ CharBuffer (1/2) của sensor qua UpChar (0x08)
+    // templateBuffer phải có ít nhất R307_TEMPLATE_SIZE bytes
     bool downloadModel(uint8_t slot, uint8_t* templateBuffer, uint16_t* templateSize);
 
     // Upload template từ buffer lên sensor
-    bool uploadModel(uint8_t id, uint8_t* templateBuffer, uint16_t templateSize);
+    bool uploadModel(uint16_t id, uint8_t* templateBuffer, uint16_t templateSize) override;
 
     // Lấy confidence score từ lần verify cuối
     uint16_t getConfidence();
 
-    // LED control
+    // Thời gian (ms) của lần transfer template gần nhất
+    unsigned long getLastTransferMs();
+
+    // LED control (bỏ qua lệnh UART nếu LED đã ở trạng thái đó)
     void ledOn(uint8_t color);  // 1=Red, 2=Blue, 3=Purple
     void ledOff();
 };
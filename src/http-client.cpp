@@ -2,71 +2,222 @@
 
 HTTPClientManager::HTTPClientManager() {
     _timeout = HTTP_TIMEOUT_MS;
+    _lock = xSemaphoreCreateMutex();
+    _keepAlive = HTTP_KEEP_ALIVE;
+#ifdef HTTP_SIMULATE_LATENCY
+    _simulatedLatencyMs = 0;
+#endif
+    memset(&_stats, 0, sizeof(_stats));
 }
 
 int HTTPClientManager::post(const char* url, const String& jsonPayload, String& response) {
-    _http.begin(url);
-    _http.setTimeout(_timeout);
-    _http.addHeader("Content-Type", "application/json");
-
-    // Thêm Directus token
-    if (strlen(DIRECTUS_TOKEN) > 0) {
-        _http.addHeader("Authorization", String("Bearer ") + DIRECTUS_TOKEN);
-    }
-
     Serial.println("\n→ Đang gửi POST request...");
     Serial.print("URL: ");
     Serial.println(url);
     Serial.print("Payload: ");
     Serial.println(jsonPayload);
 
-    int httpCode = _http.POST(jsonPayload);
+    return request("POST", url, &jsonPayload, response);
+}
+
+int HTTPClientManager::get(const char* url, String& response) {
+    Serial.println("\n→ Đang gửi GET request...");
+    Serial.print("URL: ");
+    Serial.println(url);
+
+    return request("GET", url, nullptr, response);
+}
+
+int HTTPClientManager::getJSON(const char* url, JsonDocument& doc, const JsonDocument* filter) {
+    Serial.println("\n→ Đang gửi GET request (stream)...");
+    Serial.print("URL: ");
+    Serial.println(url);
+
+    String unused;
+    return request("GET", url, nullptr, unused, &doc, filter);  // Đo heap của doc trong request()
+}
+
+int HTTPClientManager::request(const char* method, const char* url, const String* payload,
+                               String& response, JsonDocument* doc,
+                               const JsonDocument* filter) {
+    xSemaphoreTake(_lock, portMAX_DELAY);
+
+    // Đo sau khi lấy lock: request của task khác (đang chờ / đang chạy) không lọt vào chênh lệch
+    uint32_t heapBefore = doc ? ESP.getFreeHeap() : 0;
+
+#ifdef HTTP_SIMULATE_LATENCY
+    if (_simulatedLatencyMs > 0) {
+        delay(_simulatedLatencyMs);  // Giữ lock như một request chậm thật
+    }
+#endif
+
+    bool reused = _keepAlive && _client.connected();
+    unsigned long start = millis();
+    int httpCode = send(method, url, payload, response, doc, filter);
+
+    // Connection keep-alive đã bị server đóng (idle timeout) → mở lại, gửi lại 1 lần.
+    // POST chỉ gửi lại khi request chưa được ghi ra socket: mất connection sau đó thì
+    // server có thể đã xử lý (VD: attendance) → gửi lại sẽ tạo bản ghi trùng
+    bool notSent = httpCode == HTTPC_ERROR_CONNECTION_REFUSED ||
+                   httpCode == HTTPC_ERROR_SEND_HEADER_FAILED ||
+                   httpCode == HTTPC_ERROR_NOT_CONNECTED;
+    bool idempotent = !payload;  // GET
+    if (reused && (notSent || (idempotent && (httpCode == HTTPC_ERROR_CONNECTION_LOST ||
+                                              httpCode == HTTPC_ERROR_SEND_PAYLOAD_FAILED)))) {
+        Serial.println("[HTTP] Keep-alive connection closed by server, reconnecting");
+        _client.stop();
+        _stats.staleRetries++;
+        reused = false;
+        start = millis();
+        httpCode = send(method, url, payload, response, doc, filter);
+    }
+
+    uint32_t elapsed = millis() - start;
+    _stats.requests++;
+    if (reused) {
+        _stats.reused++;
+        _stats.reusedTotalMs += elapsed;
+    } else {
+        _stats.newConnections++;
+        _stats.newTotalMs += elapsed;
+    }
 
     if (httpCode > 0) {
-        response = _http.getString();
         Serial.print("HTTP Code: ");
         Serial.println(httpCode);
-        Serial.print("Response: ");
-        Serial.println(response);
+        if (!doc) {
+            Serial.print("Response: ");
+            Serial.println(response);
+        }
     } else {
         Serial.print("✗ HTTP Error: ");
         Serial.println(_http.errorToString(httpCode));
+        _client.stop();  // Không tái sử dụng connection lỗi
     }
 
-    _http.end();
+    if (doc) {
+        // Document vẫn còn sống → chênh lệch heap ≈ kích thước document đã lọc
+        uint32_t heapAfter = ESP.getFreeHeap();
+        uint32_t used = heapBefore > heapAfter ? heapBefore - heapAfter : 0;
+        _stats.lastJsonHeapUsed = used;
+        if (used > _stats.maxJsonHeapUsed) _stats.maxJsonHeapUsed = used;
+        Serial.printf("[PERF] getJSON heap: before=%lu after=%lu (doc ~%lu bytes), min ever=%lu\n",
+                      (unsigned long)heapBefore, (unsigned long)heapAfter, (unsigned long)used,
+                      (unsigned long)ESP.getMinFreeHeap());
+    }
+
+    xSemaphoreGive(_lock);
     return httpCode;
 }
 
-int HTTPClientManager::get(const char* url, String& response) {
-    _http.begin(url);
+int HTTPClientManager::send(const char* method, const char* url, const String* payload,
+                            String& response, JsonDocument* doc,
+                            const JsonDocument* filter) {
+    // begin() với WiFiClient của mình: nếu connection còn mở tới cùng host,
+    // HTTPClient dùng lại socket thay vì handshake mới
+    _http.setReuse(_keepAlive);
+    if (!_http.begin(_client, url)) {
+        return HTTPC_ERROR_CONNECTION_REFUSED;
+    }
     _http.setTimeout(_timeout);
 
+    if (payload) {
+        _http.addHeader("Content-Type", "application/json");
+    }
+
     // Thêm Directus token
     if (strlen(DIRECTUS_TOKEN) > 0) {
         _http.addHeader("Authorization", String("Bearer ") + DIRECTUS_TOKEN);
     }
 
-    Serial.println("\n→ Đang gửi GET request...");
-    Serial.print("URL: ");
-    Serial.println(url);
-
-    int httpCode = _http.GET();
+    int httpCode = payload ? _http.POST(*payload) : _http.GET();
 
-    if (httpCode > 0) {
+    if (httpCode == HTTP_CODE_OK && doc) {
+        if (!readJSON(*doc, filter)) {
+            _client.stop();  // Stream có thể còn dữ liệu thừa → không tái sử dụng
+            httpCode = HTTP_JSON_PARSE_ERROR;
+        }
+    } else if (httpCode > 0) {
         response = _http.getString();
-        Serial.print("HTTP Code: ");
-        Serial.println(httpCode);
-        Serial.print("Response: ");
-        Serial.println(response);
-    } else {
-        Serial.print("✗ HTTP Error: ");
-        Serial.println(_http.errorToString(httpCode));
     }
 
+    // Với setReuse(true), end() giữ socket mở nếu server trả keep-alive
     _http.end();
     return httpCode;
 }
 
+bool HTTPClientManager::readJSON(JsonDocument& doc, const JsonDocument* filter) {
+    DeserializationError error;
+
+    if (_http.getSize() >= 0) {
+        // Có Content-Length: đọc thẳng từ socket, không copy response
+        if (filter) {
+            error = deserializeJson(doc, _http.getStream(),
+                                    DeserializationOption::Filter(*filter));
+        } else {
+            error = deserializeJson(doc, _http.getStream());
+        }
+    } else {
+        // Chunked transfer: stream thô có chunk header → phải đọc qua getString()
+        String body = _http.getString();
+        if (filter) {
+            error = deserializeJson(doc, body, DeserializationOption::Filter(*filter));
+        } else {
+            error = deserializeJson(doc, body);
+        }
+    }
+
+    if (error) {
+        Serial.print("✗ JSON Parse Error: ");
+        Serial.println(error.c_str());
+        return false;
+    }
+    return true;
+}
+
+void HTTPClientManager::setKeepAlive(bool enabled) {
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    _keepAlive = enabled;
+    if (!enabled) {
+        _client.stop();
+    }
+    xSemaphoreGive(_lock);
+}
+
+#ifdef HTTP_SIMULATE_LATENCY
+void HTTPClientManager::setSimulatedLatency(uint32_t ms) {
+    _simulatedLatencyMs = ms;
+}
+
+uint32_t HTTPClientManager::getSimulatedLatency() {
+    return _simulatedLatencyMs;
+}
+#endif
+
+const HTTPConnectionStats& HTTPClientManager::getStats() {
+    return _stats;
+}
+
+void HTTPClientManager::printInfo() {
+    Serial.println("\n=== HTTP connection ===");
+    Serial.printf("Keep-alive: %s\n", _keepAlive ? "ON" : "OFF");
+#ifdef HTTP_SIMULATE_LATENCY
+    if (_simulatedLatencyMs > 0) {
+        Serial.printf("Simulated latency: %lu ms/request\n", (unsigned long)_simulatedLatencyMs);
+    }
+#endif
+    Serial.printf("Requests: %lu\n", (unsigned long)_stats.requests);
+    Serial.printf("Reused connection: %lu (avg %lu ms)\n", (unsigned long)_stats.reused,
+                  _stats.reused ? (unsigned long)(_stats.reusedTotalMs / _stats.reused) : 0UL);
+    Serial.printf("New connection: %lu (avg %lu ms)\n", (unsigned long)_stats.newConnections,
+                  _stats.newConnections
+                      ? (unsigned long)(_stats.newTotalMs / _stats.newConnections) : 0UL);
+    Serial.printf("Reconnect after server close: %lu\n", (unsigned long)_stats.staleRetries);
+    Serial.printf("JSON doc heap: last %lu bytes, max %lu bytes\n",
+                  (unsigned long)_stats.lastJsonHeapUsed, (unsigned long)_stats.maxJsonHeapUsed);
+    Serial.println("=======================\n");
+}
+
 bool HTTPClientManager::parseJSON(const String& response, JsonDocument& doc) {
     DeserializationError error = deserializeJson(doc, response);
 
@@ -2,9 +2,30 @@
 #define HTTP_CLIENT_H
 
 #include <HTTPClient.h>
+#include <WiFiClient.h>
 #include <ArduinoJson.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
 #include "config.h"
 
+#define HTTP_JSON_PARSE_ERROR -100  // getJSON(): HTTP 200 nhưng body không parse được
+
+#ifndef HTTP_KEEP_ALIVE
+#define HTTP_KEEP_ALIVE 1  // Giữ TCP connection tới Directus giữa các request
+#endif
+
+// Thống kê connection (hiển thị qua lệnh 'i' và MQTT telemetry)
+struct HTTPConnectionStats {
+    uint32_t requests;
+    uint32_t reused;          // Request chạy trên connection keep-alive sẵn có
+    uint32_t newConnections;  // Request phải mở TCP mới
+    uint32_t staleRetries;    // Server đã đóng connection → mở lại và gửi lại
+    uint32_t reusedTotalMs;   // Tổng thời gian request (để tính trung bình)
+    uint32_t newTotalMs;
+    uint32_t lastJsonHeapUsed;   // Heap bị chiếm sau getJSON() gần nhất (document đã lọc)
+    uint32_t maxJsonHeapUsed;
+};
+
 /**
  * HTTPClientManager - Quản lý HTTP requests đến CMS
  *
@@ -12,6 +33,12 @@
  * - Gửi POST request với JSON payload
  * - Parse JSON response từ server
  * - Handle timeout và errors
+ * - Thread-safe: request được serialize bằng mutex (dùng chung giữa loop()
+ *   và các task network)
+ * - Keep-alive: giữ 1 TCP connection tới Directus giữa các request
+ *   (HTTP_KEEP_ALIVE). Server đóng connection → tự mở lại và gửi lại 1 lần
+ *   (POST chỉ gửi lại nếu request chưa được ghi ra socket)
+ * - getJSON(): parse thẳng từ stream với filter, không giữ cả response trong String
  */
 class HTTPClientManager {
 public:
@@ -34,6 +61,16 @@ public:
      */
     int get(const char* url, String& response);
 
+    /**
+     * Gửi GET và deserialize response trực tiếp từ stream
+     * Chỉ các field có trong filter được giữ lại → heap chỉ tốn cỡ document đã lọc
+     * @param url API endpoint URL
+     * @param doc JsonDocument để lưu kết quả
+     * @param filter ArduinoJson filter (VD: filter["data"][0]["id"] = true), nullptr = giữ hết
+     * @return HTTP status code (200 = OK, HTTP_JSON_PARSE_ERROR nếu body hỏng)
+     */
+    int getJSON(const char* url, JsonDocument& doc, const JsonDocument* filter = nullptr);
+
     /**
      * Parse JSON response thành JsonDocument
      * @param response String chứa JSON response
@@ -49,9 +86,40 @@ public:
      */
     String createJSON(const JsonDocument& doc);
 
+    /**
+     * Bật/tắt giữ connection (tắt → đóng connection hiện tại)
+     */
+    void setKeepAlive(bool enabled);
+
+#ifdef HTTP_SIMULATE_LATENCY
+    /**
+     * Thêm độ trễ giả lập vào mỗi request (đo ảnh hưởng của server chậm
+     * lên nhịp scan / MQTT keepalive). 0 = tắt. Chỉ có khi build với
+     * -DHTTP_SIMULATE_LATENCY (không dùng cho firmware production)
+     */
+    void setSimulatedLatency(uint32_t ms);
+    uint32_t getSimulatedLatency();
+#endif
+
+    const HTTPConnectionStats& getStats();
+    void printInfo();
+
 private:
     HTTPClient _http;
+    WiFiClient _client;       // Giữ lâu dài để HTTPClient tái sử dụng socket
     unsigned long _timeout;
+    SemaphoreHandle_t _lock;
+    bool _keepAlive;
+#ifdef HTTP_SIMULATE_LATENCY
+    volatile uint32_t _simulatedLatencyMs;
+#endif
+    HTTPConnectionStats _stats;
+
+    int request(const char* method, const char* url, const String* payload, String& response,
+                JsonDocument* doc = nullptr, const JsonDocument* filter = nullptr);
+    int send(const char* method, const char* url, const String* payload, String& response,
+             JsonDocument* doc, const JsonDocument* filter);
+    bool readJSON(JsonDocument& doc, const JsonDocument* filter);
 };
 
 #endif
@@ -8,7 +8,36 @@
 #include "mqtt-client.h"
 #include "command-handler.h"
 #include "offline-queue.h"
+#include "member-cache.h"
+#include "attendance-logger.h"
 #include "buzzer-handler.h"
+#include "feedback-handler.h"
+#include "template-restore.h"
+#include "slot-manager.h"
+#include "template-manifest.h"
+#include "delta-sync.h"
+#include "realtime-client.h"
+#include "scan-scheduler.h"
+#include "recent-scans.h"
+#include "sensor-jobs.h"
+
+// ==========================================
+// Task Layout
+// ==========================================
+// loop() (Arduino task, core 1) = sensor task: UART R307, scan, lệnh MQTT, ghi template (SensorJobs)
+// networkTask (core 0): WiFi, MQTT, WebSocket, offline queue, refresh member cache
+// syncTask (core 0): delta sync, realtime change, preload — HTTP + decode, chờ sensor task ghi
+#define NETWORK_TASK_STACK 12288     // MQTT + HTTP + JSON refresh cache
+#define NETWORK_TASK_PRIORITY 1
+#define NETWORK_TASK_CORE 0
+#define NETWORK_TASK_PERIOD_MS 10
+#define SYNC_TASK_STACK 12288        // HTTP + JSON + base64 decode + SensorJob (~600 bytes)
+#define SYNC_TASK_PRIORITY 1
+#define SYNC_TASK_CORE 0
+#define SYNC_TASK_PERIOD_MS 100
+
+// NO_MATCH rồi khớp trong khoảng này → tính là scan lại của cùng một lần check-in
+#define REPEAT_SCAN_WINDOW_MS 10000
 
 // ==========================================
 // Global Objects
@@ -21,14 +50,41 @@ DirectusClient* directusClient;
 MQTTClient* mqttClient;
 CommandHandler* commandHandler;
 OfflineQueue* offlineQueue;
+MemberCache* memberCache;
+SlotManager* slotManager;
+SensorJobs* sensorJobs;
+TemplateManifest* templateManifest;
+DeltaSync* deltaSync;
+RealtimeClient* realtimeClient = nullptr;
+AttendanceLogger* attendanceLogger;
 BuzzerHandler* buzzerHandler;
+FeedbackHandler* feedback;
+ScanScheduler* scanScheduler;
+RecentScans* recentScans;
 
 // ==========================================
 // Global Variables
 // ==========================================
 bool autoLoginMode = true;  // Auto-login ON by default, pauses for MQTT commands
 unsigned long lastFingerprintCheck = 0;
+volatile unsigned long lastMemberCacheRefresh = 0;  // Ghi ở network task
+unsigned long lastSlotPreload = 0;  // Sync task
+unsigned long lastSlotSave = 0;
+unsigned long lastDeltaSync = 0;    // Sync task
+unsigned long lastTelemetry = 0;
+volatile unsigned long lastFingerSeen = 0; // Lần cuối có ngón tay trên sensor (đọc ở network task)
+bool awaitingLift = false;               // Đã quyết định cho ngón tay hiện tại, chờ nhấc ra
+unsigned long maxScanGapDuringDrain = 0; // Khoảng cách lớn nhất giữa 2 lần scan khi đang drain
+unsigned long maxScanGap = 0;            // Khoảng cách lớn nhất giữa 2 lần scan (nhịp thực tế)
+unsigned long scanGapTotal = 0;
+uint32_t scanGapCount = 0;
+uint32_t checkIns = 0;                   // Scan khớp trên sensor
+uint32_t repeatScans = 0;                // NO_MATCH ngay trước một check-in (chất lượng template)
+uint8_t pendingNoMatch = 0;
+unsigned long lastNoMatchAt = 0;
 static bool wasWiFiConnected = false;
+TaskHandle_t networkTaskHandle = nullptr;
+TaskHandle_t syncTaskHandle = nullptr;
 
 // Buffer cho fingerprint template
 uint8_t templateBuffer[512];
@@ -47,6 +103,13 @@ void toggleAutoLogin();
 void configureWiFi();
 void restoreFromDirectus();
 void checkAutoLogin();
+void publishTelemetry();
+void networkTask(void* param);
+void syncTask(void* param);
+#ifdef HTTP_SIMULATE_LATENCY
+void configureNetworkStall();
+#endif
+void printTaskInfo();
 
 // ==========================================
 // Setup
@@ -76,6 +139,7 @@ void setup() {
 
     // Set buzzer cho UX feedback
     fpHandler->setBuzzer(buzzerHandler);
+    feedback = new FeedbackHandler(fpHandler, buzzerHandler);
 
     if (!fpHandler->begin()) {
         Serial.println("✗ WARNING: Không kết nối được R307!");
@@ -90,6 +154,11 @@ void setup() {
 
     fpHandler->printSensorInfo();
 
+    // Nhịp poll getImage() thích ứng (+ ngắt chân Touch nếu có nối)
+    scanScheduler = new ScanScheduler();
+    scanScheduler->begin();
+    recentScans = new RecentScans();
+
     // 2. Khởi tạo WiFi Manager
     Serial.println("\n→ Khởi tạo WiFi Manager...");
     wifiManager = new WiFiManager();
@@ -112,9 +181,40 @@ void setup() {
         Serial.println("⚠ Offline queue init failed");
     }
 
+    // 3b. Khởi tạo Member Cache (slot → member, dùng được khi offline)
+    Serial.println("\n→ Khởi tạo Member Cache...");
+    memberCache = new MemberCache();
+    if (!memberCache->begin()) {
+        Serial.println("⚠ Member cache init failed (verify sẽ query Directus)");
+    }
+
     // 4. Khởi tạo HTTP Client và Directus Client
     httpClient = new HTTPClientManager();
-    directusClient = new DirectusClient(httpClient, wifiManager, offlineQueue);
+    directusClient = new DirectusClient(httpClient, wifiManager, offlineQueue, memberCache);
+
+    // 4a. Slot manager: sensor là cache LRU trên toàn bộ template của branch
+    slotManager = new SlotManager(fpHandler, memberCache);
+    slotManager->begin();
+    directusClient->setSlotManager(slotManager);
+
+    // Ghi template lên sensor do sync task gửi sang (loop() thực hiện giữa các lần scan)
+    sensorJobs = new SensorJobs(fpHandler, memberCache, slotManager);
+    directusClient->setSensorJobs(sensorJobs);
+
+    // Manifest hash template theo slot (diff sync)
+    templateManifest = new TemplateManifest();
+    templateManifest->begin();
+    fpHandler->setManifest(templateManifest);
+
+    // Delta sync: áp dụng thay đổi trên CMS theo con trỏ date_updated
+    deltaSync = new DeltaSync(directusClient, fpHandler, sensorJobs);
+    deltaSync->begin();
+
+#if DIRECTUS_WS_ENABLED
+    // Directus WebSocket: thay đổi trên CMS được đẩy về ngay, polling chỉ còn dự phòng
+    realtimeClient = new RealtimeClient(wifiManager, directusClient, deltaSync);
+    realtimeClient->begin(DIRECTUS_URL, DIRECTUS_TOKEN);
+#endif
 
     // 5. Register device with Directus
     if (wifiManager->isConnected()) {
@@ -126,6 +226,19 @@ void setup() {
         if (deviceId.length() > 0) {
             Serial.println("✓ Device đã được đăng ký trong Directus");
         }
+
+        directusClient->refreshMemberCache(deviceMac);
+        lastMemberCacheRefresh = millis();
+    }
+
+    // 5b. Attendance logger: POST attendance trên task riêng (core 0),
+    // access decision không phải chờ HTTP
+    // Device UUID resolve 1 lần ở trên (hoặc lấy từ member cache khi offline) trước khi task chạy
+    attendanceLogger = new AttendanceLogger(directusClient, offlineQueue);
+    if (attendanceLogger->begin(directusClient->getDeviceId())) {
+        directusClient->setAttendanceLogger(attendanceLogger);
+    } else {
+        Serial.println("⚠ Attendance logger init failed (log đồng bộ)");
     }
 
     // Success beep
@@ -140,43 +253,162 @@ void setup() {
 
     // 7. Khởi tạo Command Handler
     commandHandler = new CommandHandler(fpHandler, mqttClient, directusClient, wifiManager);
+    commandHandler->begin();
 
-    // Set command callback
+    // Callback chạy ở network task → chỉ đưa vào queue, sensor task thực thi
     mqttClient->setCommandCallback([](const String& commandId, const String& type, JsonObject params) {
-        commandHandler->executeCommand(commandId, type, params);
+        commandHandler->enqueue(commandId, type, params);
     });
 
+    // 8. Network task: MQTT keepalive / HTTP không còn chặn scan và ngược lại
+    if (xTaskCreatePinnedToCore(networkTask, "network", NETWORK_TASK_STACK, nullptr,
+                                NETWORK_TASK_PRIORITY, &networkTaskHandle,
+                                NETWORK_TASK_CORE) != pdPASS) {
+        Serial.println("✗ Cannot create network task");
+    }
+
+    // 9. Sync task: delta sync / realtime / preload chờ HTTP ở core 0, không chặn scan
+    if (xTaskCreatePinnedToCore(syncTask, "sync", SYNC_TASK_STACK, nullptr,
+                                SYNC_TASK_PRIORITY, &syncTaskHandle,
+                                SYNC_TASK_CORE) != pdPASS) {
+        Serial.println("✗ Cannot create sync task");
+    }
+
     Serial.println("\n✓ Hệ thống sẵn sàng!");
     printMenu();
 }
 
 // ==========================================
-// Loop
+// Network Task (core 0)
 // ==========================================
-void loop() {
-    // Check WiFi reconnect for queue flush
-    bool isConnected = wifiManager->isConnected();
-    if (isConnected && !wasWiFiConnected) {
-        Serial.println("\n✓ WiFi reconnected!");
-        if (offlineQueue && offlineQueue->getPendingCount() > 0) {
-            Serial.println("→ Flushing offline queue...");
-            offlineQueue->flush(httpClient, DIRECTUS_URL);
+void networkTask(void* param) {
+    while (true) {
+        // Check WiFi reconnect for queue flush
+        bool isConnected = wifiManager->isConnected();
+        if (isConnected && !wasWiFiConnected) {
+            Serial.println("\n✓ WiFi reconnected!");
+            if (offlineQueue && offlineQueue->getPendingCount() > 0) {
+                offlineQueue->retryNow();
+                Serial.printf("→ Draining offline queue (%d entries) in background...\n",
+                              offlineQueue->getPendingCount());
+            }
+            lastMemberCacheRefresh = 0;  // Refresh cache ngay sau khi có mạng lại
+        }
+        wasWiFiConnected = isConnected;
+
+        // Drain offline queue từng phần, nhường cho scanner khi có ngón tay
+        // (HTTP client dùng chung với scan path fallback)
+        if (isConnected && offlineQueue->isDraining()) {
+            offlineQueue->drainStep(httpClient, DIRECTUS_URL, QUEUE_DRAIN_MAX_BATCHES,
+                                    QUEUE_DRAIN_BUDGET_MS, []() {
+                return lastFingerSeen != 0 && millis() - lastFingerSeen < QUEUE_DRAIN_YIELD_MS;
+            });
+        }
+
+        // Refresh member cache định kỳ (chỉ HTTP + cache, không đụng sensor)
+        if (isConnected &&
+            (lastMemberCacheRefresh == 0 || millis() - lastMemberCacheRefresh >= MEMBER_CACHE_REFRESH_MS)) {
+            directusClient->refreshMemberCache(wifiManager->getMACAddress());
+            lastMemberCacheRefresh = millis();
+        }
+
+        // Realtime event từ Directus: chỉ nhận, sensor task áp dụng
+        if (realtimeClient) {
+            realtimeClient->loop();
+        }
+
+        // MQTT loop - handle connection and messages
+        mqttClient->loop();
+
+        // Telemetry định kỳ (queue drain throughput, cache, logger)
+        if (mqttClient->isConnected() && millis() - lastTelemetry >= MQTT_TELEMETRY_INTERVAL_MS) {
+            publishTelemetry();
+            lastTelemetry = millis();
+        }
+
+        vTaskDelay(pdMS_TO_TICKS(NETWORK_TASK_PERIOD_MS));
+    }
+}
+
+// ==========================================
+// Sync Task (core 0)
+// ==========================================
+// Tách khỏi network task: mỗi thay đổi chờ sensor task ghi xong (SensorJobs::run),
+// MQTT keepalive không phải chờ theo
+void syncTask(void* param) {
+    while (true) {
+        bool isConnected = wifiManager->isConnected();
+
+        // Realtime event từ Directus (áp dụng từng thay đổi một)
+        if (realtimeClient) {
+            realtimeClient->applyPending();
+            if (realtimeClient->consumeResyncRequest()) {
+                lastDeltaSync = 0;  // Lỡ event / queue đầy → delta sync ngay
+            }
+        }
+
+        // Delta sync định kỳ
+        // Đang subscribe WebSocket → chỉ chạy dự phòng với chu kỳ dài
+        unsigned long deltaInterval = (realtimeClient && realtimeClient->isSubscribed())
+            ? REALTIME_FALLBACK_SYNC_MS : DELTA_SYNC_INTERVAL_MS;
+        if (isConnected && (lastDeltaSync == 0 || millis() - lastDeltaSync >= deltaInterval)) {
+            deltaSync->run(wifiManager->getMACAddress());
+            lastDeltaSync = millis();
         }
+
+        // Preload template member hoạt động gần đây
+        if (isConnected && lastMemberCacheRefresh != 0 &&
+            (lastSlotPreload == 0 || millis() - lastSlotPreload >= SLOT_PRELOAD_INTERVAL_MS)) {
+            directusClient->preloadRecentMembers(SLOT_PRELOAD_MAX);
+            lastSlotPreload = millis();
+        }
+
+        vTaskDelay(pdMS_TO_TICKS(SYNC_TASK_PERIOD_MS));
+    }
+}
+
+// ==========================================
+// Loop (sensor task, core 1)
+// ==========================================
+void loop() {
+    // Lệnh MQTT nhận ở network task, thực thi ở đây vì dùng UART sensor
+    if (commandHandler->processPending()) {
+        lastFingerprintCheck = 0;  // Lệnh chặn scan có chủ đích, không tính vào nhịp scan
+    }
+
+    // Enroll đang chờ ngón tay: CharBuffer 1/2 + LED thuộc về enroll session
+    // → tạm hoãn mọi việc upload template / scan / menu trên sensor
+    bool enrolling = commandHandler->isEnrolling();
+
+    // Template sync task đã tải sẵn (delta sync, realtime, preload): chỉ ghi sensor ở đây,
+    // 1 job mỗi vòng, không ghi khi vừa có người scan
+    if (!enrolling && millis() - lastFingerSeen >= QUEUE_DRAIN_YIELD_MS) {
+        sensorJobs->processPending();
     }
-    wasWiFiConnected = isConnected;
 
-    // MQTT loop - handle connection and messages
-    mqttClient->loop();
+    // lastHit + manifest được ghi xuống flash theo lô
+    if (millis() - lastSlotSave >= MEMBER_CACHE_REFRESH_MS) {
+        slotManager->save();
+        templateManifest->save();
+        lastSlotSave = millis();
+    }
+
+    // Hết thời gian hiển thị kết quả → tắt LED (scan không phải chờ)
+    if (!enrolling) {
+        feedback->loop();
+    }
 
     // Kiểm tra auto-login mode (pause if command is executing)
+    scanScheduler->loop(millis());
     if (autoLoginMode && !commandHandler->isPaused()) {
         checkAutoLogin();
     }
 
     // Xử lý Serial commands
-    if (Serial.available()) {
+    if (!enrolling && Serial.available()) {
         char cmd = Serial.read();
         handleMenuCommand(cmd);
+        lastFingerprintCheck = 0;  // Menu chặn scan có chủ đích
     }
 
     delay(10);
@@ -197,6 +429,9 @@ void printMenu() {
     Serial.println("║  [a] Bật/Tắt Auto-Login Mode          ║");
     Serial.println("║  [w] Cấu hình WiFi                    ║");
     Serial.println("║  [i] Thông tin cảm biến               ║");
+#ifdef HTTP_SIMULATE_LATENCY
+    Serial.println("║  [x] Giả lập mạng chậm (đo nhịp scan) ║");
+#endif
     Serial.println("║  [h] Hiển thị menu này                ║");
     Serial.println("╚════════════════════════════════════════╝");
 
@@ -260,7 +495,23 @@ void handleMenuCommand(char cmd) {
         case 'I':
             fpHandler->printSensorInfo();
             wifiManager->printInfo();
+            httpClient->printInfo();
+            memberCache->printInfo();
+            slotManager->printInfo();
+            deltaSync->printInfo();
+            if (realtimeClient) realtimeClient->printInfo();
+            attendanceLogger->printInfo();
+            offlineQueue->printInfo();
+            Serial.printf("Max scan gap during drain: %lu ms\n\n", maxScanGapDuringDrain);
+            printTaskInfo();
+            break;
+
+#ifdef HTTP_SIMULATE_LATENCY
+        case 'x':
+        case 'X':
+            configureNetworkStall();
             break;
+#endif
 
         case 'h':
         case 'H':
@@ -282,20 +533,31 @@ void handleMenuCommand(char cmd) {
 // Feature Functions
 // ==========================================
 void enrollFingerprint() {
-    Serial.println("Nhập ID vân tay (1-127): ");
+    uint16_t capacity = fpHandler->getCapacity();
+    uint16_t freeSlot = fpHandler->findFreeSlot();
+    if (freeSlot > 0) {
+        Serial.printf("Nhập ID vân tay (1-%d, slot trống: #%d): \n", capacity - 1, freeSlot);
+    } else {
+        Serial.printf("Nhập ID vân tay (1-%d): \n", capacity - 1);
+    }
 
     while (!Serial.available()) delay(10);
-    uint8_t id = Serial.parseInt();
+    long id = Serial.parseInt();
 
-    if (id < 1 || id > 127) {
-        Serial.println("✗ ID không hợp lệ (phải từ 1-127)");
+    if (id < 1 || id >= capacity) {
+        Serial.printf("✗ ID không hợp lệ (phải từ 1-%d)\n", capacity - 1);
         return;
     }
+    if (fpHandler->isSlotUsed(id)) {
+        Serial.printf("⚠ Slot #%ld đang có vân tay, sẽ bị ghi đè\n", id);
+    }
 
     // Enroll vào sensor
     int result = fpHandler->enrollFingerprint(id);
 
     if (result > 0) {
+        slotManager->markLocal(id, "");
+
         Serial.println("\n→ Đang lấy template data...");
 
         // Lấy template data
@@ -359,10 +621,11 @@ void enrollFingerprint() {
 }
 
 void deleteFingerprint() {
-    Serial.println("Nhập ID vân tay cần xóa (1-127, hoặc 0 để xóa TẤT CẢ): ");
+    uint16_t capacity = fpHandler->getCapacity();
+    Serial.printf("Nhập ID vân tay cần xóa (1-%d, hoặc 0 để xóa TẤT CẢ): \n", capacity - 1);
 
     while (!Serial.available()) delay(10);
-    uint8_t id = Serial.parseInt();
+    long id = Serial.parseInt();
 
     if (id == 0) {
         Serial.println("⚠ XÓA TẤT CẢ vân tay? (y/n): ");
@@ -370,12 +633,20 @@ void deleteFingerprint() {
 
         char confirm = Serial.read();
         if (confirm == 'y' || confirm == 'Y') {
-            fpHandler->deleteAllFingerprints();
+            if (fpHandler->deleteAllFingerprints()) {
+                memberCache->clear();
+                memberCache->save();
+                slotManager->releaseAll();
+            }
         } else {
             Serial.println("Đã hủy.");
         }
-    } else if (id >= 1 && id <= 127) {
-        fpHandler->deleteFingerprint(id);
+    } else if (id >= 1 && id < capacity) {
+        if (fpHandler->deleteFingerprint(id)) {
+            memberCache->erase(id);
+            memberCache->save();
+            slotManager->release(id);
+        }
     } else {
         Serial.println("✗ ID không hợp lệ");
     }
@@ -384,35 +655,38 @@ void deleteFingerprint() {
 }
 
 void listFingerprints() {
-    uint16_t count = fpHandler->getTemplateCount();
-
     Serial.println("\n╔════════════════════════════════════════╗");
     Serial.println("║      DANH SÁCH VÂN TAY ĐÃ LƯU        ║");
     Serial.println("╚════════════════════════════════════════╝");
-    Serial.printf("Số lượng: %d vân tay\n", count);
-
-    // Note: R307 không có API để list tất cả IDs
-    // Cần scan từng slot từ 1-127 (tốn thời gian)
-    Serial.println("\n⚠ Để xem chi tiết từng ID, cần scan toàn bộ slots (1-127).");
-    Serial.println("Scan tất cả? (y/n): ");
 
-    while (!Serial.available()) delay(10);
-    char response = Serial.read();
-
-    if (response == 'y' || response == 'Y') {
-        Serial.println("\nĐang scan...");
-
-        for (uint8_t id = 1; id <= 127; id++) {
-            // Thử load model
-            // Note: Adafruit library không có loadModel public
-            // Cần sử dụng workaround hoặc modify library
-            Serial.print(".");
-            if (id % 20 == 0) Serial.println();
-            delay(10);
+    // ReadIndexTable: 1 round trip / 256 slot thay vì dò từng ID
+    unsigned long start = millis();
+    if (!fpHandler->loadIndexTable()) {
+        Serial.println("✗ Không đọc được index table từ cảm biến");
+        printMenu();
+        return;
+    }
+    Serial.printf("[PERF] Index table: %lu ms\n", millis() - start);
+
+    uint16_t count = 0;
+    String fpId, memberId;
+    MemberStatus status;
+    for (uint16_t id = 1; id < fpHandler->getCapacity(); id++) {
+        if (!fpHandler->isSlotUsed(id)) continue;
+        count++;
+
+        if (memberCache->lookup(id, fpId, memberId, &status)) {
+            Serial.printf("  #%-4d member %s%s\n", id, memberId.c_str(),
+                          status == MEMBER_ACTIVE ? "" : " (inactive)");
+        } else {
+            Serial.printf("  #%-4d (chưa có trong member cache)\n", id);
         }
+    }
 
-        Serial.println("\n✓ Scan hoàn tất.");
-        Serial.printf("Tổng số: %d vân tay\n", count);
+    Serial.printf("\nTổng số: %d/%d slot đã dùng\n", count, fpHandler->getCapacity());
+    uint16_t freeSlot = fpHandler->findFreeSlot();
+    if (freeSlot > 0) {
+        Serial.printf("Slot trống đầu tiên: #%d\n", freeSlot);
     }
 
     printMenu();
@@ -465,6 +739,64 @@ void testLogin() {
     printMenu();
 }
 
+#ifdef HTTP_SIMULATE_LATENCY
+void configureNetworkStall() {
+    Serial.printf("Độ trễ giả lập hiện tại: %lu ms/request\n",
+                  (unsigned long)httpClient->getSimulatedLatency());
+    Serial.println("Nhập độ trễ cho mỗi HTTP request (ms, 0 = tắt): ");
+
+    while (!Serial.available()) delay(10);
+    long ms = Serial.parseInt();
+    if (ms < 0) ms = 0;
+
+    httpClient->setSimulatedLatency(ms);
+
+    // Đo lại từ đầu với cấu hình mới
+    maxScanGap = 0;
+    scanGapTotal = 0;
+    scanGapCount = 0;
+    scanScheduler->resetStats();
+    mqttClient->resetLoopStats();
+
+    Serial.printf("✓ Simulated latency: %ld ms. Xem kết quả bằng lệnh 'i'\n", ms);
+}
+#endif
+
+void printTaskInfo() {
+    Serial.println("=== Tasks ===");
+    Serial.printf("Scan cadence: avg %lu ms, max %lu ms (%lu checks, now %lu ms, %s)\n",
+                  scanGapCount ? scanGapTotal / scanGapCount : 0UL, maxScanGap,
+                  (unsigned long)scanGapCount, scanScheduler->getInterval(),
+                  scanScheduler->getMode());
+    ScanStats scan = scanScheduler->getStats();
+    Serial.printf("Time-to-detect: p50 %lu ms, p99 %lu ms, max %lu ms (%lu detects, %lu polls, %lu touch IRQ)\n",
+                  (unsigned long)scan.detectP50Ms, (unsigned long)scan.detectP99Ms,
+                  (unsigned long)scan.detectMaxMs, (unsigned long)scan.detects,
+                  (unsigned long)scan.polls, (unsigned long)scan.touchIrqs);
+    Serial.printf("Repeat scans suppressed: %lu (window %d ms)\n",
+                  (unsigned long)recentScans->getSuppressedCount(), RECENT_SCAN_WINDOW_MS);
+    Serial.printf("MQTT loop: max gap %lu ms, outbox dropped %lu\n",
+                  mqttClient->getMaxLoopGapMs(), (unsigned long)mqttClient->getOutboxDropped());
+    Serial.printf("Commands: %lu pending, %lu rejected\n",
+                  (unsigned long)commandHandler->getPendingCount(),
+                  (unsigned long)commandHandler->getRejectedCount());
+    if (networkTaskHandle) {
+        Serial.printf("Network task stack free: %u bytes\n",
+                      (unsigned)uxTaskGetStackHighWaterMark(networkTaskHandle));
+    }
+    if (syncTaskHandle) {
+        Serial.printf("Sync task stack free: %u bytes (%lu sensor jobs done)\n",
+                      (unsigned)uxTaskGetStackHighWaterMark(syncTaskHandle),
+                      (unsigned long)sensorJobs->getCompletedCount());
+    }
+    Serial.printf("Sensor task stack free: %u bytes\n",
+                  (unsigned)uxTaskGetStackHighWaterMark(nullptr));
+#ifdef HTTP_SIMULATE_LATENCY
+    Serial.printf("Simulated HTTP latency: %lu ms\n", (unsigned long)httpClient->getSimulatedLatency());
+#endif
+    Serial.println("=============\n");
+}
+
 void toggleAutoLogin() {
     autoLoginMode = !autoLoginMode;
 
@@ -518,91 +850,82 @@ void restoreFromDirectus() {
 
     String deviceMac = wifiManager->getMACAddress();
 
-    // Fetch danh sách fingerprints từ Directus
+    // Danh sách fingerprints từ Directus (đọc và in theo trang)
     Serial.println("→ Đang query fingerprints từ Directus...");
-    JsonDocument doc;
-    int count = directusClient->getFingerprints(deviceMac, doc);
-
-    if (count == 0) {
-        Serial.println("⚠ Không có fingerprint nào trong Directus cho device này.");
-        printMenu();
-        return;
-    }
-
-    // Hiển thị danh sách
     Serial.println("\nDanh sách fingerprints trong Directus:");
     Serial.println("─────────────────────────────────────────");
 
-    JsonArray data = doc["data"];
-    for (int i = 0; i < count; i++) {
-        String fpId = data[i]["id"].as<String>();
-        uint8_t localId = data[i]["finger_print_id"].as<uint8_t>();
-        String memberId = data[i]["member_id"].as<String>();
+    int count = directusClient->forEachFingerprint(deviceMac, "id,finger_print_id,member_id",
+                                                   "&filter[status][_eq]=active",
+                                                   [](JsonObject fp) {
+        Serial.printf("ID: %d | Member: %s | UUID: %s\n",
+                     fp["finger_print_id"].as<int>(),
+                     fp["member_id"].as<const char*>(), fp["id"].as<const char*>());
+        return true;
+    });
+
+    Serial.println("─────────────────────────────────────────");
 
-        Serial.printf("[%d] ID: %d | Member: %s | UUID: %s\n",
-                     i + 1, localId, memberId.c_str(), fpId.c_str());
+    if (count <= 0) {
+        Serial.println("⚠ Không có fingerprint nào trong Directus cho device này.");
+        printMenu();
+        return;
     }
 
-    Serial.println("─────────────────────────────────────────");
     Serial.println("\nChọn:");
     Serial.println("  [0] Restore TẤT CẢ");
-    Serial.println("  [1-n] Restore từng fingerprint");
+    Serial.println("  [ID] Restore 1 fingerprint theo ID trên sensor");
     Serial.println("  [c] Hủy");
     Serial.print("\nLựa chọn: ");
 
     while (!Serial.available()) delay(10);
-    char choice = Serial.read();
+    String choice = Serial.readStringUntil('\n');
+    choice.trim();
     Serial.println(choice);
 
-    if (choice == 'c' || choice == 'C') {
+    if (choice.length() == 0 || choice == "c" || choice == "C") {
         Serial.println("Đã hủy.");
         printMenu();
         return;
     }
 
-    int selected = choice - '0';  // Convert char to int
+    long selected = choice.toInt();
 
     if (selected == 0) {
-        // Restore all
+        // Restore all: pipeline download/upload, danh sách đọc theo trang
         Serial.printf("\n→ Restore %d fingerprints...\n", count);
 
-        int successCount = 0;
-        for (int i = 0; i < count; i++) {
-            String fpId = data[i]["id"].as<String>();
-            uint8_t localId;
-
-            Serial.printf("\n[%d/%d] Downloading...\n", i + 1, count);
-
-            if (directusClient->downloadFingerprintTemplate(fpId, templateBuffer,
-                                                            &templateSize, &localId)) {
-                Serial.printf("→ Uploading to R307 (ID #%d)...\n", localId);
-
-                if (fpHandler->uploadModel(localId, templateBuffer, templateSize)) {
-                    successCount++;
-                    Serial.println("✓ Success!");
-                } else {
-                    Serial.println("✗ Upload failed!");
-                }
-            }
-
-            delay(500);  // Delay giữa các uploads
-        }
+        TemplateRestorer restorer(directusClient, fpHandler);
+        RestoreStats stats = restorer.restore(deviceMac);
 
         Serial.println("\n╔════════════════════════════════════════╗");
-        Serial.printf("║  ✓ Restored %d/%d fingerprints\n", successCount, count);
+        Serial.printf("║  ✓ Restored %d/%d fingerprints (%d đã có sẵn)\n",
+                      stats.synced, stats.total, stats.skipped);
         Serial.println("╚════════════════════════════════════════╝");
 
-    } else if (selected >= 1 && selected <= count) {
+    } else if (selected >= 1 && selected < fpHandler->getCapacity()) {
         // Restore single fingerprint
-        int index = selected - 1;
-        String fpId = data[index]["id"].as<String>();
-        uint8_t localId;
+        String fpId;
+        directusClient->forEachFingerprint(deviceMac, "id",
+                                           "&filter[status][_eq]=active&filter[finger_print_id][_eq]=" +
+                                           String(selected), [&](JsonObject fp) {
+            fpId = fp["id"].as<String>();
+            return false;
+        });
+
+        if (fpId.length() == 0) {
+            Serial.printf("✗ Không tìm thấy ID #%ld trong Directus\n", selected);
+            printMenu();
+            return;
+        }
 
-        Serial.printf("\n→ Restoring fingerprint #%d...\n", selected);
+        uint16_t localId;
+        Serial.printf("\n→ Restoring fingerprint #%ld...\n", selected);
 
         if (directusClient->downloadFingerprintTemplate(fpId, templateBuffer,
                                                         &templateSize, &localId)) {
             if (fpHandler->uploadModel(localId, templateBuffer, templateSize)) {
+                slotManager->markLocal(localId, fpId);
                 Serial.println("\n✓ Restore thành công!");
             } else {
                 Serial.println("\n✗ Upload failed!");
@@ -618,61 +941,198 @@ void restoreFromDirectus() {
 void checkAutoLogin() {
     unsigned long now = millis();
 
-    if (now - lastFingerprintCheck < FINGERPRINT_CHECK_INTERVAL) {
-        return;  // Chưa đến lúc check
+    if (lastFingerprintCheck != 0 && !scanScheduler->isDue(now)) {
+        return;  // Chưa đến lúc check (nhịp do ScanScheduler quyết định)
     }
 
+    // Nhịp scan thực tế (lastFingerprintCheck = 0 sau LED hold / menu / lệnh → không tính)
+    if (lastFingerprintCheck != 0) {
+        unsigned long gap = now - lastFingerprintCheck;
+        if (gap > maxScanGap) maxScanGap = gap;
+        scanGapTotal += gap;
+        scanGapCount++;
+
+        // Đo độ trễ scan do drain queue gây ra (so với nhịp check bình thường)
+        if (offlineQueue->isDraining() && gap > maxScanGapDuringDrain) {
+            maxScanGapDuringDrain = gap;
+        }
+    }
     lastFingerprintCheck = now;
 
+    // Ngón tay vừa được quyết định vẫn còn trên sensor → không scan lại
+    if (awaitingLift) {
+        bool present = fpHandler->isFingerDetected();
+        scanScheduler->recordPoll(present, now);
+        if (present) {
+            lastFingerSeen = millis();
+            return;
+        }
+        awaitingLift = false;
+    }
+
     // Kiểm tra vân tay
     int fingerprintID = fpHandler->verifyFingerprint();
+    scanScheduler->recordPoll(fingerprintID != -2, now);
+    if (fingerprintID != -2) {
+        lastFingerSeen = millis();  // Có ngón tay → drain nhường trong vòng loop tới
+    }
+
+    // Member vừa check-in chạm lại → chỉ báo lại tại chỗ, không Directus / MQTT.
+    // Kiểm tra trước mọi thống kê: lần chạm lặp không phải check-in / LRU hit
+    String fingerprintUuid;
+    String memberId;
+    if (fingerprintID > 0) {
+        memberCache->lookup(fingerprintID, fingerprintUuid, memberId);
+        if (recentScans->isRecent(fingerprintID, memberId, millis())) {
+            feedback->show(FEEDBACK_GRANTED);
+            Serial.printf("→ Slot %d vừa check-in, bỏ qua scan lặp (%lu đã chặn)\n",
+                          fingerprintID, (unsigned long)recentScans->getSuppressedCount());
+            pendingNoMatch = 0;
+            awaitingLift = true;
+            return;
+        }
+    }
+
+    if (fingerprintID > 0) {
+        slotManager->recordHit(fingerprintID);
+        checkIns++;
+        if (pendingNoMatch > 0 && millis() - lastNoMatchAt <= REPEAT_SCAN_WINDOW_MS) {
+            repeatScans += pendingNoMatch;
+        }
+        pendingNoMatch = 0;
+    } else if (fingerprintID == -1) {
+        slotManager->recordMiss();  // Có thể là member chưa được nạp lên sensor
+        if (millis() - lastNoMatchAt > REPEAT_SCAN_WINDOW_MS) {
+            pendingNoMatch = 0;
+        }
+        if (pendingNoMatch < 255) pendingNoMatch++;
+        lastNoMatchAt = millis();
+    }
 
     if (fingerprintID > 0) {
         // Tìm thấy vân tay trên sensor
         uint16_t confidence = fpHandler->getConfidence();
 
         Serial.println("\n→ Phát hiện vân tay!");
-        fpHandler->ledOn(3); // Purple LED - processing
-
-        // Lấy template
-        if (fpHandler->getTemplate(fingerprintID, templateBuffer, &templateSize)) {
-            // Convert to Base64
-            String templateBase64 = base64::encode(templateBuffer, templateSize);
-            String deviceMac = wifiManager->getMACAddress();
-            String memberId;
-
-            // Verify với Directus
-            bool access = directusClient->verifyFingerprint(deviceMac, fingerprintID,
-                                                           templateBase64, confidence, memberId);
-
-            if (access) {
-                // ACCESS GRANTED
-                fpHandler->ledOn(2); // Blue LED
-                if (buzzerHandler) buzzerHandler->play(BUZZ_ACCESS_GRANTED);
-                Serial.println("✓ ACCESS GRANTED - Attendance logged");
-            } else {
-                // ACCESS DENIED - RẤT SAI!
-                fpHandler->ledOn(1); // Red LED
-                if (buzzerHandler) buzzerHandler->play(BUZZ_ACCESS_DENIED);
-                Serial.println("✗ ACCESS DENIED!");
-            }
+        feedback->show(FEEDBACK_PROCESSING);
 
-            // Publish attendance event via MQTT (real-time)
-            if (mqttClient->isConnected()) {
-                mqttClient->publishAttendance(deviceMac, memberId,
-                    "", confidence, access);
-            }
+        // Mapping slot → member lấy từ member cache, không cần template
+        // trên scan path (template chỉ dùng khi fallback query Directus)
+        String deviceMac = wifiManager->getMACAddress();
+        unsigned long decisionStart = millis();
+
+        bool access = directusClient->verifyFingerprint(deviceMac, fingerprintID,
+                                                       "", confidence, memberId);
+        Serial.printf("[PERF] Access decision: %lu ms\n", millis() - decisionStart);
 
-            delay(2000);
-            fpHandler->ledOff();
+        if (access) {
+            // ACCESS GRANTED
+            feedback->show(FEEDBACK_GRANTED);
+            Serial.println("✓ ACCESS GRANTED - Attendance queued");
+            recentScans->record(fingerprintID, memberId, millis());
+        } else {
+            // ACCESS DENIED - RẤT SAI!
+            feedback->show(FEEDBACK_DENIED);
+            Serial.println("✗ ACCESS DENIED!");
         }
+
+        // Publish attendance event via MQTT (real-time)
+        // (qua outbox, network task gửi)
+        if (mqttClient->isConnected()) {
+            mqttClient->publishAttendance(deviceMac, memberId,
+                "", confidence, access);
+        }
+
+        awaitingLift = true;
     } else if (fingerprintID == -1) {
         // CÓ ngón tay nhưng KHÔNG KHỚP trên sensor - RẤT SAI!
-        fpHandler->ledOn(1); // Red LED
-        if (buzzerHandler) buzzerHandler->play(BUZZ_ACCESS_DENIED);
+        feedback->show(FEEDBACK_NO_MATCH);
         Serial.println("✗ VÂN TAY KHÔNG HỢP LỆ!");
-        delay(1500);
-        fpHandler->ledOff();
+        awaitingLift = true;
     }
     // fingerprintID == -2: không có ngón tay → không làm gì
 }
+
+void publishTelemetry() {
+    JsonDocument doc;
+    doc["free_heap"] = ESP.getFreeHeap();
+    doc["uptime_seconds"] = millis() / 1000;
+    doc["wifi_rssi"] = WiFi.RSSI();
+    doc["member_cache_size"] = memberCache->size();
+
+    const SlotStats& slots = slotManager->getStats();
+    JsonObject slotCache = doc["slot_cache"].to<JsonObject>();
+    slotCache["hits"] = slots.hits;
+    slotCache["misses"] = slots.misses;
+    slotCache["hit_rate"] = slotManager->getHitRate();
+    slotCache["loads"] = slots.loads;
+    slotCache["evictions"] = slots.evictions;
+
+    if (realtimeClient) {
+        const RealtimeStats& realtime = realtimeClient->getStats();
+        JsonObject ws = doc["realtime"].to<JsonObject>();
+        ws["subscribed"] = realtimeClient->isSubscribed();
+        ws["events"] = realtime.events;
+        ws["dropped"] = realtime.dropped;
+        ws["last_latency_ms"] = realtime.lastLatencyMs;
+        ws["max_latency_ms"] = realtime.maxLatencyMs;
+    }
+
+    const QueueFlushStats& flush = offlineQueue->getFlushStats();
+    JsonObject queue = doc["offline_queue"].to<JsonObject>();
+    queue["pending"] = offlineQueue->getPendingCount();
+    queue["last_flush_records"] = flush.lastRecords;
+    queue["last_flush_ms"] = flush.lastDurationMs;
+    queue["drain_records_per_sec"] = flush.lastThroughput;
+    queue["total_records"] = flush.totalRecords;
+    queue["total_batches"] = flush.totalBatches;
+    queue["failed_batches"] = flush.failedBatches;
+    queue["dropped_records"] = flush.droppedRecords;
+    queue["max_drain_step_ms"] = flush.maxStepMs;
+    queue["drain_yields"] = flush.yields;
+    queue["max_scan_gap_ms"] = maxScanGapDuringDrain;
+
+    JsonObject tasks = doc["tasks"].to<JsonObject>();
+    tasks["scan_gap_avg_ms"] = scanGapCount ? scanGapTotal / scanGapCount : 0;
+    tasks["scan_gap_max_ms"] = maxScanGap;
+    tasks["mqtt_loop_gap_max_ms"] = mqttClient->getMaxLoopGapMs();
+    tasks["mqtt_outbox_dropped"] = mqttClient->getOutboxDropped();
+    tasks["commands_rejected"] = commandHandler->getRejectedCount();
+#ifdef HTTP_SIMULATE_LATENCY
+    tasks["simulated_latency_ms"] = httpClient->getSimulatedLatency();
+#endif
+
+    // Số lần phải scan lại mỗi check-in (so sánh trước / sau khi đổi ENROLL_CAPTURES)
+    JsonObject scans = doc["scans"].to<JsonObject>();
+    scans["check_ins"] = checkIns;
+    scans["repeat_scans"] = repeatScans;
+    scans["repeats_per_check_in"] = checkIns ? (float)repeatScans / checkIns : 0.0f;
+
+    ScanStats scan = scanScheduler->getStats();
+    scans["mode"] = scanScheduler->getMode();
+    scans["interval_ms"] = scanScheduler->getInterval();
+    scans["polls"] = scan.polls;
+    scans["detects"] = scan.detects;
+    scans["detect_p50_ms"] = scan.detectP50Ms;
+    scans["detect_p99_ms"] = scan.detectP99Ms;
+    scans["detect_max_ms"] = scan.detectMaxMs;
+    scans["touch_irqs"] = scan.touchIrqs;
+    scans["suppressed"] = recentScans->getSuppressedCount();
+
+    const HTTPConnectionStats& conn = httpClient->getStats();
+    JsonObject http = doc["http"].to<JsonObject>();
+    http["requests"] = conn.requests;
+    http["reused"] = conn.reused;
+    http["new_connections"] = conn.newConnections;
+    http["stale_retries"] = conn.staleRetries;
+    http["avg_reused_ms"] = conn.reused ? conn.reusedTotalMs / conn.reused : 0;
+    http["avg_new_ms"] = conn.newConnections ? conn.newTotalMs / conn.newConnections : 0;
+    http["json_heap_max"] = conn.maxJsonHeapUsed;
+
+    JsonObject attendance = doc["attendance_logger"].to<JsonObject>();
+    attendance["submitted"] = attendanceLogger->getSubmittedCount();
+    attendance["pending"] = attendanceLogger->getPendingCount();
+    attendance["spilled"] = attendanceLogger->getSpilledCount();
+
+    mqttClient->publishTelemetry(doc.as<JsonObject>());
+}
@@ -0,0 +1,296 @@
+#include "member-cache.h"
+
+#define MEMBER_CACHE_MAGIC 0x4D434143  // "MCAC"
+#define MEMBER_CACHE_VERSION 1
+#define MEMBER_CACHE_SAVE_CHUNK 32  // Entries copy mỗi lần giữ lock khi save (~1KB stack)
+
+struct MemberCacheHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t slots;
+    uint8_t hasDeviceUuid;
+    uint8_t deviceUuid[16];
+};
+
+// Giữ recursive mutex của cache trong scope hiện tại
+class CacheLock {
+public:
+    explicit CacheLock(SemaphoreHandle_t lock) : _lock(lock) {
+        xSemaphoreTakeRecursive(_lock, portMAX_DELAY);
+    }
+    ~CacheLock() {
+        xSemaphoreGiveRecursive(_lock);
+    }
+
+private:
+    SemaphoreHandle_t _lock;
+};
+
+MemberCache::MemberCache() :
+    _hasDeviceUuid(false),
+    _initialized(false),
+    _dirty(false),
+    _version(0),
+    _lastRefresh(0)
+{
+    memset(_entries, 0, sizeof(_entries));
+    memset(_deviceUuid, 0, sizeof(_deviceUuid));
+    _lock = xSemaphoreCreateRecursiveMutex();
+    _saveLock = xSemaphoreCreateMutex();
+}
+
+bool MemberCache::begin() {
+    CacheLock lock(_lock);
+    if (!LittleFS.begin(true)) {  // true = format if failed
+        Serial.println("[CACHE] LittleFS mount failed");
+        return false;
+    }
+
+    _initialized = true;
+
+    if (!load()) {
+        Serial.println("[CACHE] No valid cache on flash, starting empty");
+    }
+
+    Serial.printf("[CACHE] Initialized, %d members cached\n", size());
+    return true;
+}
+
+bool MemberCache::load() {
+    if (!LittleFS.exists(MEMBER_CACHE_FILE)) return false;
+
+    File file = LittleFS.open(MEMBER_CACHE_FILE, "r");
+    if (!file) return false;
+
+    MemberCacheHeader header;
+    bool ok = file.read((uint8_t*)&header, sizeof(header)) == sizeof(header) &&
+              header.magic == MEMBER_CACHE_MAGIC &&
+              header.version == MEMBER_CACHE_VERSION;
+
+    // Số slot thay đổi (firmware cũ 128 slot) → bỏ entries, vẫn giữ device UUID
+    if (ok && header.slots != MEMBER_CACHE_SLOTS) {
+        file.close();
+        _hasDeviceUuid = header.hasDeviceUuid != 0;
+        memcpy(_deviceUuid, header.deviceUuid, sizeof(_deviceUuid));
+        return false;
+    }
+
+    if (ok) {
+        ok = file.read((uint8_t*)_entries, sizeof(_entries)) == sizeof(_entries);
+    }
+    file.close();
+
+    if (!ok) {
+        memset(_entries, 0, sizeof(_entries));
+        return false;
+    }
+
+    _hasDeviceUuid = header.hasDeviceUuid != 0;
+    memcpy(_deviceUuid, header.deviceUuid, sizeof(_deviceUuid));
+    _dirty = false;
+    return true;
+}
+
+bool MemberCache::save() {
+    if (!_initialized) return false;
+
+    // Ghi file ~33KB không giữ _lock: lookup() trên scan path chỉ chờ copy từng đoạn.
+    // _saveLock giữ cho 2 task không ghi cùng file một lúc.
+    xSemaphoreTake(_saveLock, portMAX_DELAY);
+
+    MemberCacheHeader header;
+    uint32_t version;
+    {
+        CacheLock lock(_lock);
+        if (!_dirty) {
+            xSemaphoreGive(_saveLock);
+            return true;
+        }
+        version = _version;
+        header.magic = MEMBER_CACHE_MAGIC;
+        header.version = MEMBER_CACHE_VERSION;
+        header.slots = MEMBER_CACHE_SLOTS;
+        header.hasDeviceUuid = _hasDeviceUuid ? 1 : 0;
+        memcpy(header.deviceUuid, _deviceUuid, sizeof(_deviceUuid));
+    }
+
+    File file = LittleFS.open(MEMBER_CACHE_FILE, "w");
+    if (!file) {
+        xSemaphoreGive(_saveLock);
+        Serial.println("[CACHE] ✗ Cannot open cache file for writing");
+        return false;
+    }
+
+    bool ok = file.write((const uint8_t*)&header, sizeof(header)) == sizeof(header);
+
+    MemberCacheEntry chunk[MEMBER_CACHE_SAVE_CHUNK];
+    for (uint16_t slot = 0; ok && slot < MEMBER_CACHE_SLOTS; slot += MEMBER_CACHE_SAVE_CHUNK) {
+        uint16_t count = MEMBER_CACHE_SLOTS - slot;
+        if (count > MEMBER_CACHE_SAVE_CHUNK) count = MEMBER_CACHE_SAVE_CHUNK;
+        {
+            CacheLock lock(_lock);
+            memcpy(chunk, &_entries[slot], count * sizeof(MemberCacheEntry));
+        }
+        size_t bytes = count * sizeof(MemberCacheEntry);
+        ok = file.write((const uint8_t*)chunk, bytes) == bytes;
+    }
+    file.close();
+
+    if (ok) {
+        // Có thay đổi trong lúc ghi → file có thể lẫn dữ liệu cũ, giữ dirty cho lần sau
+        CacheLock lock(_lock);
+        if (_version == version) _dirty = false;
+    } else {
+        Serial.println("[CACHE] ✗ Write cache file failed");
+    }
+    xSemaphoreGive(_saveLock);
+    return ok;
+}
+
+bool MemberCache::lookup(uint16_t slot, String& fingerprintId, String& memberId,
+                         MemberStatus* status) {
+    CacheLock lock(_lock);
+    if (slot == 0 || slot >= MEMBER_CACHE_SLOTS) return false;
+
+    const MemberCacheEntry& entry = _entries[slot];
+    if (entry.status == MEMBER_NONE) return false;
+
+    fingerprintId = formatUuid(entry.fingerprintUuid);
+    memberId = formatUuid(entry.memberUuid);
+    if (status) *status = (MemberStatus)entry.status;
+    return true;
+}
+
+bool MemberCache::put(uint16_t slot, const String& fingerprintId, const String& memberId,
+                      MemberStatus status) {
+    CacheLock lock(_lock);
+    if (slot == 0 || slot >= MEMBER_CACHE_SLOTS || status == MEMBER_NONE) return false;
+
+    MemberCacheEntry entry;
+    entry.status = status;
+    if (!parseUuid(fingerprintId, entry.fingerprintUuid) ||
+        !parseUuid(memberId, entry.memberUuid)) {
+        return false;
+    }
+
+    if (memcmp(&_entries[slot], &entry, sizeof(entry)) != 0) {
+        _entries[slot] = entry;
+        markDirty();
+    }
+    return true;
+}
+
+uint16_t MemberCache::findSlot(const String& fingerprintId) {
+    CacheLock lock(_lock);
+    uint8_t uuid[16];
+    if (!parseUuid(fingerprintId, uuid)) return 0;
+
+    for (uint16_t slot = 1; slot < MEMBER_CACHE_SLOTS; slot++) {
+        if (_entries[slot].status != MEMBER_NONE &&
+            memcmp(_entries[slot].fingerprintUuid, uuid, sizeof(uuid)) == 0) {
+            return slot;
+        }
+    }
+    return 0;
+}
+
+void MemberCache::erase(uint16_t slot) {
+    CacheLock lock(_lock);
+    if (slot == 0 || slot >= MEMBER_CACHE_SLOTS) return;
+    if (_entries[slot].status == MEMBER_NONE) return;
+
+    memset(&_entries[slot], 0, sizeof(MemberCacheEntry));
+    markDirty();
+}
+
+void MemberCache::clear() {
+    CacheLock lock(_lock);
+    memset(_entries, 0, sizeof(_entries));
+    markDirty();
+}
+
+void MemberCache::markDirty() {
+    _dirty = true;
+    _version++;
+}
+
+uint16_t MemberCache::size() {
+    CacheLock lock(_lock);
+    uint16_t count = 0;
+    for (uint16_t slot = 1; slot < MEMBER_CACHE_SLOTS; slot++) {
+        if (_entries[slot].status != MEMBER_NONE) count++;
+    }
+    return count;
+}
+
+unsigned long MemberCache::getLastRefresh() {
+    return _lastRefresh;
+}
+
+void MemberCache::markRefreshed() {
+    _lastRefresh = millis();
+}
+
+void MemberCache::setDeviceUuid(const String& deviceUuid) {
+    uint8_t parsed[16];
+    if (!parseUuid(deviceUuid, parsed)) return;
+
+    {
+        CacheLock lock(_lock);
+        if (_hasDeviceUuid && memcmp(parsed, _deviceUuid, sizeof(parsed)) == 0) return;
+        memcpy(_deviceUuid, parsed, sizeof(parsed));
+        _hasDeviceUuid = true;
+        markDirty();
+    }
+    save();  // Không giữ _lock (save() lấy _saveLock trước _lock)
+}
+
+String MemberCache::getDeviceUuid() {
+    CacheLock lock(_lock);
+    return _hasDeviceUuid ? formatUuid(_deviceUuid) : String("");
+}
+
+void MemberCache::printInfo() {
+    Serial.println("\n=== Member cache ===");
+    Serial.printf("Members cached: %d\n", size());
+    if (_lastRefresh > 0) {
+        Serial.printf("Last refresh: %lu giây trước\n", (millis() - _lastRefresh) / 1000);
+    } else {
+        Serial.println("Last refresh: chưa refresh (dùng dữ liệu từ flash)");
+    }
+    Serial.println("====================\n");
+}
+
+static int hexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+bool MemberCache::parseUuid(const String& text, uint8_t out[16]) {
+    if (text.length() != 36) return false;
+
+    int byteIndex = 0;
+    for (unsigned int i = 0; i < text.length() && byteIndex < 16; ) {
+        if (text[i] == '-') {
+            i++;
+            continue;
+        }
+        int hi = hexValue(text[i]);
+        int lo = (i + 1 < text.length()) ? hexValue(text[i + 1]) : -1;
+        if (hi < 0 || lo < 0) return false;
+        out[byteIndex++] = (uint8_t)((hi << 4) | lo);
+        i += 2;
+    }
+    return byteIndex == 16;
+}
+
+String MemberCache::formatUuid(const uint8_t uuid[16]) {
+    char buffer[37];
+    snprintf(buffer, sizeof(buffer),
+             "%02x%02x%02x%02x-%02x%02x-%02x%02x-%02x%02x-%02x%02x%02x%02x%02x%02x",
+             uuid[0], uuid[1], uuid[2], uuid[3], uuid[4], uuid[5], uuid[6], uuid[7],
+             uuid[8], uuid[9], uuid[10], uuid[11], uuid[12], uuid[13], uuid[14], uuid[15]);
+    return String(buffer);
+}
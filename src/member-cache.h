@@ -0,0 +1,113 @@
+#ifndef MEMBER_CACHE_H
+#define MEMBER_CACHE_H
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include "config.h"
+
+#define MEMBER_CACHE_FILE "/member-cache.bin"
+#define MEMBER_CACHE_SLOTS 1001  // Index = sensor ID 1-1000, slot 0 không dùng (R307 1000 template: ID 1-999)
+
+#ifndef MEMBER_CACHE_REFRESH_MS
+#define MEMBER_CACHE_REFRESH_MS 300000  // Refresh từ Directus mỗi 5 phút
+#endif
+
+// Trạng thái member_fingerprints trong Directus
+enum MemberStatus : uint8_t {
+    MEMBER_NONE = 0,     // Slot trống / chưa biết
+    MEMBER_ACTIVE,       // status = active
+    MEMBER_INACTIVE      // status khác active (inactive, archived...)
+};
+
+// UUID lưu dạng binary 16 bytes để giữ RAM/flash nhỏ
+struct MemberCacheEntry {
+    uint8_t status;
+    uint8_t fingerprintUuid[16];
+    uint8_t memberUuid[16];
+};
+
+/**
+ * MemberCache - Index local: sensor slot → fingerprint UUID / member UUID / status
+ *
+ * Chức năng:
+ * - Lookup O(1) theo sensor slot trên scan path (không cần HTTP)
+ * - Lưu trong RAM + LittleFS, dùng được khi mất WiFi
+ * - Được refresh định kỳ từ Directus (DirectusClient::refreshMemberCache)
+ * - Cache luôn device UUID để log attendance khi offline
+ * - Thread-safe: refresh chạy ở network task (core 0), scan path đọc ở core 1
+ */
+class MemberCache {
+public:
+    MemberCache();
+
+    /**
+     * Mount LittleFS và load cache từ flash
+     * @return true nếu sẵn sàng (cache rỗng vẫn là true)
+     */
+    bool begin();
+
+    /**
+     * Tra cứu mapping theo sensor slot
+     * @param slot Sensor finger_print_id
+     * @param fingerprintId Output: Fingerprint UUID
+     * @param memberId Output: Member UUID
+     * @param status Output: trạng thái (có thể nullptr)
+     * @return true nếu slot có trong cache
+     */
+    bool lookup(uint16_t slot, String& fingerprintId, String& memberId,
+                MemberStatus* status = nullptr);
+
+    /**
+     * Thêm/cập nhật mapping cho một slot (chỉ trong RAM, gọi save() để lưu)
+     * @return false nếu slot hoặc UUID không hợp lệ
+     */
+    bool put(uint16_t slot, const String& fingerprintId, const String& memberId,
+             MemberStatus status);
+
+    /**
+     * Tìm slot đang giữ fingerprint (reverse lookup)
+     * @return slot, 0 nếu không có
+     */
+    uint16_t findSlot(const String& fingerprintId);
+
+    void erase(uint16_t slot);
+    void clear();
+
+    /**
+     * Ghi cache xuống LittleFS nếu có thay đổi
+     * Copy từng đoạn dưới lock, ghi flash ngoài lock → lookup() không chờ ghi file
+     * Không gọi khi đang giữ lock của cache
+     */
+    bool save();
+
+    uint16_t size();
+    unsigned long getLastRefresh();
+    void markRefreshed();
+
+    void setDeviceUuid(const String& deviceUuid);
+    String getDeviceUuid();
+
+    void printInfo();
+
+    // UUID helpers ("xxxxxxxx-xxxx-xxxx-xxxx-xxxxxxxxxxxx" <-> 16 bytes)
+    static bool parseUuid(const String& text, uint8_t out[16]);
+    static String formatUuid(const uint8_t uuid[16]);
+
+private:
+    MemberCacheEntry _entries[MEMBER_CACHE_SLOTS];
+    uint8_t _deviceUuid[16];
+    bool _hasDeviceUuid;
+    bool _initialized;
+    bool _dirty;
+    uint32_t _version;         // Tăng mỗi lần thay đổi (save() biết có ghi đè trong lúc ghi file)
+    unsigned long _lastRefresh;
+    SemaphoreHandle_t _lock;
+    SemaphoreHandle_t _saveLock;  // Mỗi lần 1 task ghi file
+
+    bool load();
+    void markDirty();
+};
+
+#endif
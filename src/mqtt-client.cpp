@@ -11,9 +11,14 @@ MQTTClient::MQTTClient(WiFiManager* wifi) :
     _lastReconnect(0),
     _reconnectRetries(0),
     _isConnected(false),
+    _lastLoopAt(0),
+    _maxLoopGapMs(0),
+    _loopTask(nullptr),
+    _outboxDropped(0),
     _port(1883)
 {
     instance = this;
+    _outbox = xQueueCreate(MQTT_OUTBOX_LENGTH, sizeof(OutboxMessage));
     _client.setCallback(MQTTClient::messageCallback);
 }
 
@@ -65,6 +70,13 @@ void MQTTClient::setupTopics() {
 }
 
 void MQTTClient::loop() {
+    unsigned long now = millis();
+    if (_lastLoopAt != 0 && now - _lastLoopAt > _maxLoopGapMs) {
+        _maxLoopGapMs = now - _lastLoopAt;
+    }
+    _lastLoopAt = now;
+    _loopTask = xTaskGetCurrentTaskHandle();
+
     if (!_wifi->isConnected()) {
         _isConnected = false;
         return;
@@ -77,7 +89,8 @@ void MQTTClient::loop() {
 
     if (_client.connected()) {
         _client.loop();
-        _isConnected = true;
+        flushOutbox();
+        _isConnected = _client.connected();
     }
 }
 
@@ -170,6 +183,41 @@ void MQTTClient::subscribe() {
 }
 
 bool MQTTClient::publish(const char* topic, const char* payload, bool retained) {
+    if (xTaskGetCurrentTaskHandle() == _loopTask) {
+        return publishNow(topic, payload, retained);
+    }
+
+    if (!_isConnected) {
+        Serial.println("[MQTT] ✗ Not connected, cannot publish");
+        return false;
+    }
+
+    OutboxMessage message;
+    if (strlen(topic) >= sizeof(message.topic) || strlen(payload) >= sizeof(message.payload)) {
+        Serial.printf("[MQTT] ✗ Message too large for outbox: %s\n", topic);
+        _outboxDropped++;
+        return false;
+    }
+    strlcpy(message.topic, topic, sizeof(message.topic));
+    strlcpy(message.payload, payload, sizeof(message.payload));
+    message.retained = retained;
+
+    if (!_outbox || xQueueSend(_outbox, &message, 0) != pdTRUE) {
+        Serial.printf("[MQTT] ⚠ Outbox full, dropped: %s\n", topic);
+        _outboxDropped++;
+        return false;
+    }
+    return true;
+}
+
+void MQTTClient::flushOutbox() {
+    OutboxMessage message;
+    while (_outbox && _client.connected() && xQueueReceive(_outbox, &message, 0) == pdTRUE) {
+        publishNow(message.topic, message.payload, message.retained);
+    }
+}
+
+bool MQTTClient::publishNow(const char* topic, const char* payload, bool retained) {
     if (!_client.connected()) {
         Serial.println("[MQTT] ✗ Not connected, cannot publish");
         return false;
@@ -218,10 +266,32 @@ bool MQTTClient::publishTelemetry(JsonObject telemetry) {
     doc["timestamp"] = millis() / 1000;
     doc["data"] = telemetry;
 
-    String payload;
-    serializeJson(doc, payload);
+    if (xTaskGetCurrentTaskHandle() != _loopTask) {
+        String payload;
+        serializeJson(doc, payload);
+        return publish(_telemetryTopic.c_str(), payload.c_str(), false);
+    }
+
+    if (!_client.connected()) {
+        Serial.println("[MQTT] ✗ Not connected, cannot publish");
+        return false;
+    }
+
+    // Telemetry lớn hơn buffer của PubSubClient → stream thẳng ra socket
+    // (beginPublish/write không giới hạn bởi setBufferSize)
+    size_t length = measureJson(doc);
+    bool result = _client.beginPublish(_telemetryTopic.c_str(), length, false) &&
+                  serializeJson(doc, _client) == length &&
+                  _client.endPublish();
 
-    return publish(_telemetryTopic.c_str(), payload.c_str(), false);
+    if (result) {
+        Serial.printf("[MQTT] ✓ Published to: %s (%u bytes)\n",
+                      _telemetryTopic.c_str(), (unsigned)length);
+    } else {
+        Serial.printf("[MQTT] ✗ Failed to publish to: %s (%u bytes)\n",
+                      _telemetryTopic.c_str(), (unsigned)length);
+    }
+    return result;
 }
 
 bool MQTTClient::publishAttendance(const String& deviceId, const String& memberId,
@@ -297,7 +367,20 @@ void MQTTClient::setCommandCallback(CommandCallback callback) {
 }
 
 bool MQTTClient::isConnected() {
-    return _isConnected && _client.connected();
+    return _isConnected;  // Cập nhật bởi loop(), đọc được từ task khác
+}
+
+unsigned long MQTTClient::getMaxLoopGapMs() {
+    return _maxLoopGapMs;
+}
+
+void MQTTClient::resetLoopStats() {
+    _maxLoopGapMs = 0;
+    _outboxDropped = 0;
+}
+
+uint32_t MQTTClient::getOutboxDropped() {
+    return _outboxDropped;
 }
 
 String MQTTClient::getCommandTopic() {
@@ -4,7 +4,29 @@
 #include <WiFi.h>
 #include <PubSubClient.h>
 #include <ArduinoJson.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
 #include "wifi-manager.h"
+#include "config.h"
+
+#ifndef MQTT_TELEMETRY_INTERVAL_MS
+#define MQTT_TELEMETRY_INTERVAL_MS 60000  // Publish telemetry mỗi 60 giây
+#endif
+
+#ifndef MQTT_OUTBOX_LENGTH
+#define MQTT_OUTBOX_LENGTH 8      // Message chờ network task publish
+#endif
+
+#define MQTT_OUTBOX_TOPIC_MAX 96
+#define MQTT_OUTBOX_PAYLOAD_MAX 768
+
+// Message POD publish từ task khác, network task gửi trong loop()
+struct OutboxMessage {
+    char topic[MQTT_OUTBOX_TOPIC_MAX];
+    char payload[MQTT_OUTBOX_PAYLOAD_MAX];
+    bool retained;
+};
 
 // MQTT callback function type
 typedef std::function<void(const String& commandId, const String& type, JsonObject params)> CommandCallback;
@@ -22,7 +44,15 @@ private:
 
     unsigned long _lastReconnect;
     uint8_t _reconnectRetries;
-    bool _isConnected;
+    volatile bool _isConnected;
+
+    // PubSubClient không thread-safe: chỉ task gọi loop() (network task) chạm vào client,
+    // publish() từ task khác (sensor, command) đi qua outbox
+    TaskHandle_t _loopTask;
+    QueueHandle_t _outbox;
+    unsigned long _lastLoopAt;
+    volatile unsigned long _maxLoopGapMs;  // Khoảng lớn nhất giữa 2 lần loop() (keepalive jitter)
+    volatile uint32_t _outboxDropped;
 
     CommandCallback _commandCallback;
 
@@ -38,6 +68,8 @@ private:
     void reconnect();
     unsigned long getReconnectDelay();
     void setupTopics();
+    bool publishNow(const char* topic, const char* payload, bool retained);
+    void flushOutbox();
 
     // Static callback wrapper for PubSubClient
     static void messageCallback(char* topic, uint8_t* payload, unsigned int length);
@@ -51,9 +83,17 @@ public:
 
     void loop();
     void subscribe();
+
+    /**
+     * Publish ngay nếu gọi từ task chạy loop(), ngược lại đưa vào outbox
+     * (non-blocking, outbox đầy → bỏ message)
+     */
     bool publish(const char* topic, const char* payload, bool retained = false);
     bool publishStatus(const String& commandId, const String& status,
                       JsonObject result = JsonObject(), const String& errorMsg = "");
+    /**
+     * Từ task chạy loop(): stream payload (không bị giới hạn buffer 1024 byte)
+     */
     bool publishTelemetry(JsonObject telemetry);
     bool publishAttendance(const String& deviceId, const String& memberId,
                            const String& memberName, uint16_t confidence,
@@ -63,6 +103,9 @@ public:
     String getAttendanceTopic();
 
     bool isConnected();
+    unsigned long getMaxLoopGapMs();
+    void resetLoopStats();
+    uint32_t getOutboxDropped();
     String getCommandTopic();
     String getStatusTopic();
     String getTelemetryTopic();
@@ -1,6 +1,58 @@
 #include "offline-queue.h"
+#include <algorithm>
+#include <climits>
+#include <vector>
+
+#define QUEUE_CHECKPOINT_MAGIC 0x51434B50  // "QCKP"
+#define QUEUE_DEVICE_ID_UNSET "\"device_id\":\"\""  // Record ghi khi chưa biết device UUID
+
+struct QueueCheckpoint {
+    uint32_t magic;
+    uint32_t headSeg;
+    uint32_t headOffset;
+    uint16_t headIndex;
+    uint8_t headRetries;
+};
+
+// Giữ recursive mutex của queue trong scope hiện tại
+class QueueLock {
+public:
+    explicit QueueLock(SemaphoreHandle_t lock) : _lock(lock) {
+        xSemaphoreTakeRecursive(_lock, portMAX_DELAY);
+    }
+    ~QueueLock() {
+        xSemaphoreGiveRecursive(_lock);
+    }
 
-OfflineQueue::OfflineQueue() : _initialized(false) {}
+private:
+    SemaphoreHandle_t _lock;
+};
+
+OfflineQueue::OfflineQueue() :
+    _initialized(false),
+    _headSeg(1),
+    _headOffset(0),
+    _headIndex(0),
+    _headRetries(0),
+    _tailSeg(1),
+    _tailCount(0),
+    _count(0),
+    _popsSinceCheckpoint(0),
+    _peekValid(false),
+    _peekNextOffset(0),
+    _batchLimit(QUEUE_FLUSH_BATCH_SIZE),
+    _isolateRemaining(0),
+    _sessionStart(0),
+    _sessionRecords(0),
+    _sessionFailed(0),
+    _retryAfter(0),
+    _yielding(false),
+    _draining(false),
+    _generation(0)
+{
+    _lock = xSemaphoreCreateRecursiveMutex();
+    memset(&_stats, 0, sizeof(_stats));
+}
 
 bool OfflineQueue::begin() {
     if (!LittleFS.begin(true)) {  // true = format if failed
@@ -13,206 +65,683 @@ bool OfflineQueue::begin() {
         LittleFS.mkdir(QUEUE_DIR);
     }
 
+    QueueLock guard(_lock);
+
+    recover();
     _initialized = true;
-    Serial.printf("[QUEUE] Initialized, %d pending entries\n", getPendingCount());
+    migrateLegacyEntries();
+
+    Serial.printf("[QUEUE] Initialized, %d pending entries (segments %u..%u)\n",
+                  (int)_count, (unsigned)_headSeg, (unsigned)_tailSeg);
+    return true;
+}
+
+String OfflineQueue::segmentPath(uint32_t seg) {
+    char path[32];
+    snprintf(path, sizeof(path), "%s/seg-%06u.log", QUEUE_DIR, (unsigned)seg);
+    return String(path);
+}
+
+void OfflineQueue::recover() {
+    // Chỉ quét thư mục 1 lần lúc boot để tìm segment đầu/cuối
+    uint32_t minSeg = UINT32_MAX, maxSeg = 0;
+
+    File root = LittleFS.open(QUEUE_DIR);
+    if (root) {
+        File file = root.openNextFile();
+        while (file) {
+            String name = file.name();
+            if (name.startsWith("seg-")) {
+                uint32_t seg = name.substring(4).toInt();
+                if (seg < minSeg) minSeg = seg;
+                if (seg > maxSeg) maxSeg = seg;
+            }
+            file = root.openNextFile();
+        }
+    }
+
+    if (maxSeg == 0) {
+        // Queue rỗng: đánh số tiếp từ head của checkpoint (lần drain cuối) thay vì về 1,
+        // để checkpoint không bao giờ trỏ vào giữa một segment mới trùng số
+        uint32_t nextSeg = (loadCheckpoint() && _headSeg > 0) ? _headSeg : 1;
+        resetEmpty(nextSeg);
+        saveCheckpoint();
+        return;
+    }
+
+    _tailSeg = maxSeg;
+    _tailCount = countRecords(maxSeg, true);
+
+    if (loadCheckpoint() && _headSeg >= minSeg && _headSeg <= maxSeg) {
+        // Checkpoint hợp lệ
+    } else {
+        _headSeg = minSeg;
+        _headOffset = 0;
+        _headIndex = 0;
+        _headRetries = 0;
+    }
+
+    recomputeCount();
+}
+
+void OfflineQueue::recomputeCount() {
+    if (_headSeg == _tailSeg) {
+        _count = (_tailCount > _headIndex) ? (_tailCount - _headIndex) : 0;
+    } else {
+        // Các segment trước tail luôn đầy (tail chỉ roll khi đủ QUEUE_SEGMENT_ENTRIES)
+        uint32_t headRemaining = (QUEUE_SEGMENT_ENTRIES > _headIndex)
+                                 ? (QUEUE_SEGMENT_ENTRIES - _headIndex) : 0;
+        _count = headRemaining +
+                 (_tailSeg - _headSeg - 1) * QUEUE_SEGMENT_ENTRIES +
+                 _tailCount;
+    }
+}
+
+void OfflineQueue::resetEmpty(uint32_t nextSeg) {
+    _headSeg = nextSeg;
+    _tailSeg = nextSeg;
+    _headOffset = 0;
+    _headIndex = 0;
+    _headRetries = 0;
+    _tailCount = 0;
+    _count = 0;
+    _peekValid = false;
+}
+
+uint16_t OfflineQueue::countRecords(uint32_t seg, bool repairTail) {
+    File file = LittleFS.open(segmentPath(seg), "r");
+    if (!file) return 0;
+
+    uint16_t lines = 0;
+    uint8_t buffer[64];
+    uint8_t last = '\n';
+    size_t size = file.size();
+
+    while (file.available()) {
+        size_t n = file.read(buffer, sizeof(buffer));
+        if (n == 0) break;
+        for (size_t i = 0; i < n; i++) {
+            if (buffer[i] == '\n') lines++;
+        }
+        last = buffer[n - 1];
+    }
+    file.close();
+
+    // Mất điện giữa lúc append → dòng cuối không có '\n'.
+    // Đóng dòng đó lại để record sau không bị dính vào; dòng hỏng sẽ bị skip khi đọc.
+    if (repairTail && size > 0 && last != '\n') {
+        File append = LittleFS.open(segmentPath(seg), "a");
+        if (append) {
+            append.write('\n');
+            append.close();
+            lines++;
+        }
+    }
+    return lines;
+}
+
+bool OfflineQueue::loadCheckpoint() {
+    File file = LittleFS.open(QUEUE_CHECKPOINT_FILE, "r");
+    if (!file) return false;
+
+    QueueCheckpoint cp;
+    bool ok = file.read((uint8_t*)&cp, sizeof(cp)) == sizeof(cp) &&
+              cp.magic == QUEUE_CHECKPOINT_MAGIC;
+    file.close();
+    if (!ok) return false;
+
+    _headSeg = cp.headSeg;
+    _headOffset = cp.headOffset;
+    _headIndex = cp.headIndex;
+    _headRetries = cp.headRetries;
     return true;
 }
 
+bool OfflineQueue::saveCheckpoint() {
+    _popsSinceCheckpoint = 0;
+
+    File file = LittleFS.open(QUEUE_CHECKPOINT_FILE, "w");
+    if (!file) return false;
+
+    QueueCheckpoint cp;
+    memset(&cp, 0, sizeof(cp));
+    cp.magic = QUEUE_CHECKPOINT_MAGIC;
+    cp.headSeg = _headSeg;
+    cp.headOffset = _headOffset;
+    cp.headIndex = _headIndex;
+    cp.headRetries = _headRetries;
+
+    bool ok = file.write((const uint8_t*)&cp, sizeof(cp)) == sizeof(cp);
+    file.close();
+    return ok;
+}
+
+void OfflineQueue::migrateLegacyEntries() {
+    // Định dạng cũ: mỗi entry 1 file /queue/NNNNNN.json → chuyển vào log 1 lần
+    std::vector<String> legacy;
+
+    File root = LittleFS.open(QUEUE_DIR);
+    if (!root) return;
+
+    File file = root.openNextFile();
+    while (file) {
+        String name = file.name();
+        if (name.endsWith(".json")) {
+            legacy.push_back(String(QUEUE_DIR) + "/" + name);
+        }
+        file = root.openNextFile();
+    }
+    root.close();
+
+    if (legacy.empty()) return;
+
+    std::sort(legacy.begin(), legacy.end(),
+              [](const String& a, const String& b) { return a < b; });
+
+    Serial.printf("[QUEUE] Migrating %d legacy entries...\n", (int)legacy.size());
+
+    for (const String& path : legacy) {
+        File entryFile = LittleFS.open(path, "r");
+        if (entryFile) {
+            JsonDocument doc;
+            if (!deserializeJson(doc, entryFile)) {
+                enqueue(doc["endpoint"].as<String>(), doc["method"].as<String>(),
+                        doc["payload"].as<String>());
+            }
+            entryFile.close();
+        }
+        LittleFS.remove(path);
+    }
+}
+
 bool OfflineQueue::enqueue(const String& endpoint, const String& method,
                            const String& payload) {
     if (!_initialized) return false;
+    QueueLock guard(_lock);
 
-    if (getPendingCount() >= MAX_QUEUE_SIZE) {
+    if (_count >= MAX_QUEUE_SIZE) {
         Serial.println("[QUEUE] Queue full, dropping oldest entry");
-        String oldest = getOldestFilename();
-        if (oldest.length() > 0) {
-            LittleFS.remove(oldest);
-        }
+        pop();
     }
 
-    QueueEntry entry;
-    entry.endpoint = endpoint;
-    entry.method = method;
-    entry.payload = payload;
-    entry.timestamp = millis() / 1000;
-    entry.retries = 0;
+    if (_tailCount >= QUEUE_SEGMENT_ENTRIES) {
+        _tailSeg++;
+        _tailCount = 0;
+    }
 
-    String filename = getNextFilename();
-    if (writeEntry(filename, entry)) {
-        Serial.printf("[QUEUE] Enqueued: %s\n", endpoint.c_str());
-        return true;
+    JsonDocument doc;
+    doc["endpoint"] = endpoint;
+    doc["method"] = method;
+    doc["payload"] = payload;
+    doc["timestamp"] = millis() / 1000;
+
+    String line;
+    serializeJson(doc, line);  // Compact JSON, không chứa '\n'
+    line += '\n';
+
+    File file = LittleFS.open(segmentPath(_tailSeg), "a");
+    if (!file) {
+        Serial.println("[QUEUE] ✗ Cannot open segment for append");
+        return false;
     }
-    return false;
+    size_t written = file.print(line);
+    file.close();
+
+    if (written != line.length()) {
+        Serial.println("[QUEUE] ✗ Append failed");
+        return false;
+    }
+
+    _tailCount++;
+    _count++;
+    Serial.printf("[QUEUE] Enqueued: %s (%d pending)\n", endpoint.c_str(), (int)_count);
+    return true;
+}
+
+int OfflineQueue::readRecord(QueueEntry& entry, uint32_t& nextOffset) {
+    while (_count > 0) {
+        File file = LittleFS.open(segmentPath(_headSeg), "r");
+
+        if (!file || !file.seek(_headOffset) || !file.available()) {
+            if (file) file.close();
+
+            // Segment head mất/thiếu dữ liệu → nhảy sang segment kế tiếp
+            if (_headSeg < _tailSeg) {
+                LittleFS.remove(segmentPath(_headSeg));
+                _headSeg++;
+                _headOffset = 0;
+                _headIndex = 0;
+                _headRetries = 0;
+                recomputeCount();
+                saveCheckpoint();
+                continue;
+            }
+
+            resetEmpty(_tailSeg + 1);
+            saveCheckpoint();
+            return 0;
+        }
+
+        String line = file.readStringUntil('\n');
+        nextOffset = file.position();
+        file.close();
+
+        JsonDocument doc;
+        if (line.length() == 0 || deserializeJson(doc, line)) {
+            return -1;
+        }
+
+        entry.endpoint = doc["endpoint"].as<String>();
+        entry.method = doc["method"].as<String>();
+        entry.payload = doc["payload"].as<String>();
+        entry.timestamp = doc["timestamp"] | 0;
+        entry.retries = _headRetries;
+        return 1;
+    }
+    return 0;
 }
 
 bool OfflineQueue::dequeue(QueueEntry& entry) {
     if (!_initialized) return false;
+    QueueLock guard(_lock);
 
-    String filename = getOldestFilename();
-    if (filename.length() == 0) return false;
+    while (true) {
+        uint32_t nextOffset = 0;
+        int result = readRecord(entry, nextOffset);
+
+        if (result == 1) {
+            _peekValid = true;
+            _peekNextOffset = nextOffset;
+            return true;
+        }
+        if (result == 0) return false;
 
-    return readEntry(filename, entry);
+        // Record hỏng → bỏ qua
+        Serial.println("[QUEUE] ⚠ Skipping corrupt entry");
+        advanceHead(nextOffset);
+    }
 }
 
-bool OfflineQueue::remove(const String& filename) {
-    return LittleFS.remove(filename);
+bool OfflineQueue::pop() {
+    if (!_initialized) return false;
+    QueueLock guard(_lock);
+
+    if (_count == 0) return false;
+
+    uint32_t nextOffset = _peekNextOffset;
+    if (!_peekValid) {
+        QueueEntry skipped;
+        if (readRecord(skipped, nextOffset) == 0) return false;
+    }
+
+    advanceHead(nextOffset);
+    return true;
+}
+
+void OfflineQueue::advanceHead(uint32_t nextOffset) {
+    _peekValid = false;
+    _headOffset = nextOffset;
+    _headIndex++;
+    _headRetries = 0;
+    if (_count > 0) _count--;
+
+    if (_count == 0) {
+        // Queue rỗng → xóa segment, bắt đầu segment mới
+        LittleFS.remove(segmentPath(_tailSeg));
+        if (_headSeg != _tailSeg) LittleFS.remove(segmentPath(_headSeg));
+        resetEmpty(_tailSeg + 1);
+        saveCheckpoint();
+        return;
+    }
+
+    if (_headIndex >= QUEUE_SEGMENT_ENTRIES && _headSeg < _tailSeg) {
+        // Đọc hết segment → xóa nguyên file (1 erase thay vì N)
+        LittleFS.remove(segmentPath(_headSeg));
+        _headSeg++;
+        _headOffset = 0;
+        _headIndex = 0;
+        saveCheckpoint();
+        return;
+    }
+
+    if (++_popsSinceCheckpoint >= QUEUE_CHECKPOINT_INTERVAL) {
+        saveCheckpoint();
+    }
 }
 
 int OfflineQueue::getPendingCount() {
     if (!_initialized) return 0;
+    return (int)_count;
+}
 
-    int count = 0;
-    File root = LittleFS.open(QUEUE_DIR);
-    if (!root) return 0;
+int OfflineQueue::readBatch(QueueEntry* entries, uint32_t* nextOffsets, int maxEntries) {
+    if (!dequeue(entries[0])) return 0;  // dequeue() đã skip record hỏng
+    nextOffsets[0] = _peekNextOffset;
 
-    File file = root.openNextFile();
-    while (file) {
-        if (!file.isDirectory()) count++;
-        file = root.openNextFile();
+    int count = 1;
+    if (maxEntries <= 1 || _count <= 1) return count;
+
+    // Đọc tiếp trong segment head (không vượt sang segment kế tiếp)
+    File file = LittleFS.open(segmentPath(_headSeg), "r");
+    if (!file || !file.seek(_peekNextOffset)) {
+        if (file) file.close();
+        return count;
     }
+
+    while (count < maxEntries && (uint32_t)count < _count && file.available()) {
+        String line = file.readStringUntil('\n');
+        uint32_t nextOffset = file.position();
+
+        JsonDocument doc;
+        if (deserializeJson(doc, line)) break;  // Record hỏng: để dequeue() skip ở vòng sau
+
+        String endpoint = doc["endpoint"].as<String>();
+        String method = doc["method"].as<String>();
+        if (endpoint != entries[0].endpoint || method != entries[0].method) break;
+
+        entries[count].endpoint = endpoint;
+        entries[count].method = method;
+        entries[count].payload = doc["payload"].as<String>();
+        entries[count].timestamp = doc["timestamp"] | 0;
+        entries[count].retries = 0;
+        nextOffsets[count] = nextOffset;
+        count++;
+    }
+    file.close();
     return count;
 }
 
+// Điền device UUID vào record ghi lúc chưa resolve được
+// @return Số record đầu batch gửi được (dừng ở record đầu tiên chưa điền được)
+static int fillDeviceId(QueueEntry* entries, int count, const String& deviceId) {
+    static const size_t unsetLength = strlen(QUEUE_DEVICE_ID_UNSET);
+    for (int i = 0; i < count; i++) {
+        String& payload = entries[i].payload;
+        int pos = payload.indexOf(QUEUE_DEVICE_ID_UNSET);
+        if (pos < 0) continue;
+        if (deviceId.length() == 0) return i;
+        payload = payload.substring(0, pos) + "\"device_id\":\"" + deviceId + "\"" +
+                  payload.substring(pos + unsetLength);
+    }
+    return count;
+}
+
+int OfflineQueue::sendBatch(HTTPClientManager* http, const String& baseUrl,
+                            QueueEntry* entries, int count) {
+    if (entries[0].method != "POST") {
+        // TODO: Add PATCH support
+        return -1;
+    }
+
+    String url = baseUrl + entries[0].endpoint;
+    String response;
+
+    if (count == 1) {
+        return http->post(url.c_str(), entries[0].payload, response);
+    }
+
+    // Payload đã là JSON object → ghép thành JSON array, không cần parse lại
+    String body;
+    size_t total = 2;
+    for (int i = 0; i < count; i++) total += entries[i].payload.length() + 1;
+    body.reserve(total);
+
+    body += '[';
+    for (int i = 0; i < count; i++) {
+        if (i > 0) body += ',';
+        body += entries[i].payload;
+    }
+    body += ']';
+
+    return http->post(url.c_str(), body, response);
+}
+
 void OfflineQueue::flush(HTTPClientManager* http, const String& baseUrl) {
-    if (!_initialized) return;
+    if (!_initialized || _count == 0) return;
 
-    int count = getPendingCount();
-    if (count == 0) return;
+    Serial.printf("[QUEUE] Flushing %d entries (batch size %d)...\n",
+                  getPendingCount(), QUEUE_FLUSH_BATCH_SIZE);
+    drain(http, baseUrl, INT_MAX, 0, nullptr);
+}
 
-    Serial.printf("[QUEUE] Flushing %d entries...\n", count);
+int OfflineQueue::drainStep(HTTPClientManager* http, const String& baseUrl, int maxBatches,
+                            unsigned long budgetMs, DrainYieldCallback shouldYield) {
+    if (!isDraining()) return 0;
+    return drain(http, baseUrl, maxBatches, budgetMs, shouldYield);
+}
 
-    int success = 0, failed = 0;
+bool OfflineQueue::isDraining() {
+    if (!_initialized || _count == 0) return false;
+    return _retryAfter == 0 || (long)(millis() - _retryAfter) >= 0;
+}
 
-    while (true) {
-        String filename = getOldestFilename();
-        if (filename.length() == 0) break;
+void OfflineQueue::retryNow() {
+    QueueLock guard(_lock);
+    _retryAfter = 0;
+}
+
+void OfflineQueue::setDeviceId(const String& deviceId) {
+    QueueLock guard(_lock);
+    if (deviceId.length() == 0 || deviceId == _deviceId) return;
+    _deviceId = deviceId;
+    _retryAfter = 0;  // Record đang chờ UUID gửi được ngay
+}
 
-        QueueEntry entry;
-        if (!readEntry(filename, entry)) {
-            remove(filename);
-            continue;
+int OfflineQueue::drain(HTTPClientManager* http, const String& baseUrl, int maxBatches,
+                        unsigned long budgetMs, DrainYieldCallback shouldYield) {
+    {
+        QueueLock guard(_lock);
+        // Chỉ 1 lần drain tại một thời điểm (drainStep ở network task, flush thủ công)
+        if (_count == 0 || _draining) return 0;
+        _draining = true;
+
+        if (_sessionStart == 0) {
+            _sessionStart = millis();
+            _sessionRecords = 0;
+            _sessionFailed = 0;
         }
+        _retryAfter = 0;
+    }
 
-        String url = baseUrl + entry.endpoint;
-        String response;
-        int httpCode;
+    unsigned long stepStart = millis();
+    int sent = 0, batches = 0;
+    bool stopped = false;  // Dừng do lỗi mạng/server
 
-        if (entry.method == "POST") {
-            httpCode = http->post(url.c_str(), entry.payload, response);
-        } else {
-            // TODO: Add PATCH support
-            httpCode = -1;
+    while (batches < maxBatches) {
+        if (budgetMs > 0 && millis() - stepStart >= budgetMs) break;
+        if (shouldYield && shouldYield()) {
+            if (!_yielding) _stats.yields++;  // Đếm 1 lần cho mỗi đợt nhường
+            _yielding = true;
+            break;
+        }
+        _yielding = false;
+
+        // Đọc batch dưới lock, POST không giữ lock: enqueue() từ scan path (spill)
+        // không phải chờ HTTP timeout
+        int n;
+        uint32_t batchSeg, batchOffset, batchGeneration;
+        String deviceId;
+        {
+            QueueLock guard(_lock);
+            n = readBatch(_batchEntries, _batchOffsets, _batchLimit);
+            batchSeg = _headSeg;
+            batchOffset = _headOffset;
+            batchGeneration = _generation;
+            deviceId = _deviceId;
         }
+        if (n == 0) break;
+
+        n = fillDeviceId(_batchEntries, n, deviceId);
+        if (n == 0) {
+            // Device chưa đăng ký / chưa resolve: giữ thứ tự, chờ setDeviceId()
+            QueueLock guard(_lock);
+            Serial.println("[QUEUE] Device UUID chưa có, chờ trước khi gửi record");
+            scheduleRetry();
+            stopped = true;
+            break;
+        }
+
+        int httpCode = sendBatch(http, baseUrl, _batchEntries, n);
+        batches++;
+
+        QueueLock guard(_lock);
+        // Record đầu batch có thể đã bị enqueue() bỏ (queue đầy) / clear() trong lúc POST
+        int first = unsentStart(batchSeg, batchOffset, batchGeneration, n);
 
-        if (httpCode == 200 || httpCode == 201) {
-            success++;
-            remove(filename);
+        if (httpCode == 200 || httpCode == 201 || httpCode == 204) {
+            for (int i = first; i < n; i++) {
+                advanceHead(_batchOffsets[i]);
+            }
+            sent += n;
+            _sessionRecords += n;
+            _stats.totalBatches++;
+            _stats.totalRecords += n;
         } else {
-            entry.retries++;
-            if (entry.retries >= 3) {
-                Serial.printf("[QUEUE] Max retries reached, dropping: %s\n",
-                             entry.endpoint.c_str());
-                remove(filename);
-                failed++;
+            _stats.failedBatches++;
+            // Chỉ lỗi validation mới là lỗi của record. 401/403/404 là lỗi token /
+            // quyền / collection → mọi record đều sẽ bị từ chối, không được bỏ
+            bool rejected = httpCode == 400 || httpCode == 422;
+            bool configError = httpCode == 401 || httpCode == 403 || httpCode == 404;
+
+            if (configError) {
+                Serial.printf("[QUEUE] HTTP %d from %s (token/permissions?), keeping %d pending\n",
+                             httpCode, _batchEntries[0].endpoint.c_str(), (int)_count);
+                _sessionFailed++;
+                scheduleRetry();
+                stopped = true;
+                break;
+            }
+
+            if (rejected && n > 1) {
+                // Directus tạo batch trong 1 transaction → 1 record lỗi làm hỏng cả batch
+                Serial.printf("[QUEUE] Batch of %d rejected (HTTP %d), retrying one by one\n",
+                             n, httpCode);
+                _isolateRemaining = n;
+                _batchLimit = 1;
+                continue;
+            }
+
+            if (rejected) {
+                // Record bị server từ chối vĩnh viễn → bỏ, không chặn queue
+                Serial.printf("[QUEUE] Entry rejected (HTTP %d), dropping: %s\n",
+                             httpCode, _batchEntries[0].endpoint.c_str());
+                if (first == 0) advanceHead(_batchOffsets[0]);
+                _stats.droppedRecords++;
+                _sessionFailed++;
             } else {
-                writeEntry(filename, entry);
-                failed++;
-                break;  // Stop on first failure to preserve order
+                // Lỗi mạng / server: giữ record, dừng để giữ thứ tự, thử lại sau (backoff)
+                _sessionFailed++;
+                scheduleRetry();
+                Serial.printf("[QUEUE] Send failed (HTTP %d), retry %u in %lu ms\n",
+                             httpCode, (unsigned)_headRetries,
+                             (unsigned long)(_retryAfter - millis()));
+                stopped = true;
+                break;
             }
         }
 
-        delay(100);  // Rate limiting
+        if (_isolateRemaining > 0 && --_isolateRemaining == 0) {
+            _batchLimit = QUEUE_FLUSH_BATCH_SIZE;
+        }
     }
 
-    Serial.printf("[QUEUE] Flush complete: %d success, %d failed\n", success, failed);
-}
+    QueueLock guard(_lock);
+    _draining = false;
 
-void OfflineQueue::clear() {
-    if (!_initialized) return;
+    // Chỉ ghi checkpoint khi head đã dịch chuyển (step nhường / không gửi gì → không ghi flash)
+    if (_popsSinceCheckpoint > 0) saveCheckpoint();
 
-    File root = LittleFS.open(QUEUE_DIR);
-    if (!root) return;
+    unsigned long stepMs = millis() - stepStart;
+    if (stepMs > _stats.maxStepMs) _stats.maxStepMs = stepMs;
 
-    File file = root.openNextFile();
-    while (file) {
-        String path = String(QUEUE_DIR) + "/" + file.name();
-        file = root.openNextFile();
-        LittleFS.remove(path);
+    // Kết thúc phiên drain: queue rỗng hoặc phải chờ retry
+    if (_count == 0 || stopped) {
+        unsigned long elapsed = millis() - _sessionStart;
+        _stats.lastRecords = _sessionRecords;
+        _stats.lastDurationMs = elapsed;
+        _stats.lastThroughput = elapsed > 0 ? (_sessionRecords * 1000.0f / elapsed)
+                                            : (float)_sessionRecords;
+        _sessionStart = 0;
+
+        Serial.printf("[QUEUE] Drain %s: %lu success, %lu failed, %lu ms (%.1f records/s)\n",
+                      stopped ? "paused" : "complete",
+                      (unsigned long)_stats.lastRecords, (unsigned long)_sessionFailed,
+                      elapsed, _stats.lastThroughput);
     }
 
-    Serial.println("[QUEUE] Cleared all entries");
+    return sent;
 }
 
-String OfflineQueue::getNextFilename() {
-    // Find highest numbered file and add 1
-    int maxNum = 0;
-    File root = LittleFS.open(QUEUE_DIR);
-    if (root) {
-        File file = root.openNextFile();
-        while (file) {
-            String name = file.name();
-            int num = name.toInt();
-            if (num > maxNum) maxNum = num;
-            file = root.openNextFile();
-        }
+int OfflineQueue::unsentStart(uint32_t seg, uint32_t offset, uint32_t generation, int count) {
+    // Batch không vượt segment → head sang segment khác nghĩa là cả batch đã bị bỏ
+    if (generation != _generation || _headSeg != seg) return count;
+    if (_headOffset == offset) return 0;
+    for (int i = 0; i < count; i++) {
+        if (_batchOffsets[i] == _headOffset) return i + 1;
     }
-
-    char filename[32];
-    snprintf(filename, sizeof(filename), "%s/%06d.json", QUEUE_DIR, maxNum + 1);
-    return String(filename);
+    return count;
 }
 
-String OfflineQueue::getOldestFilename() {
-    int minNum = INT_MAX;
-    String oldest = "";
+void OfflineQueue::scheduleRetry() {
+    // Backoff theo số lần thất bại liên tiếp của head: 1x, 2x, 4x... tối đa QUEUE_DRAIN_RETRY_MAX_MS.
+    // Record không bao giờ bị bỏ vì lỗi tạm thời
+    if (_headRetries < UINT8_MAX) _headRetries++;
+    uint8_t shift = _headRetries > 1 ? _headRetries - 1 : 0;
+    if (shift > 6) shift = 6;
 
-    File root = LittleFS.open(QUEUE_DIR);
-    if (!root) return "";
+    unsigned long delayMs = (unsigned long)QUEUE_DRAIN_RETRY_MS << shift;
+    if (delayMs > QUEUE_DRAIN_RETRY_MAX_MS) delayMs = QUEUE_DRAIN_RETRY_MAX_MS;
 
-    File file = root.openNextFile();
-    while (file) {
-        String name = file.name();
-        int num = name.toInt();
-        if (num < minNum) {
-            minNum = num;
-            oldest = String(QUEUE_DIR) + "/" + name;
-        }
-        file = root.openNextFile();
-    }
-    return oldest;
+    _retryAfter = millis() + delayMs;
+    if (_retryAfter == 0) _retryAfter = 1;  // 0 = không chờ
+    saveCheckpoint();  // Lưu retries của head (tối đa 1 lần mỗi QUEUE_DRAIN_RETRY_MS)
 }
 
-bool OfflineQueue::writeEntry(const String& filename, const QueueEntry& entry) {
-    File file = LittleFS.open(filename, "w");
-    if (!file) return false;
-
-    JsonDocument doc;
-    doc["endpoint"] = entry.endpoint;
-    doc["method"] = entry.method;
-    doc["payload"] = entry.payload;
-    doc["timestamp"] = entry.timestamp;
-    doc["retries"] = entry.retries;
+const QueueFlushStats& OfflineQueue::getFlushStats() {
+    return _stats;
+}
 
-    serializeJson(doc, file);
-    file.close();
-    return true;
+void OfflineQueue::printInfo() {
+    Serial.println("\n=== Offline queue ===");
+    Serial.printf("Pending: %d (segments %u..%u)\n", getPendingCount(),
+                  (unsigned)_headSeg, (unsigned)_tailSeg);
+    Serial.printf("Last drain: %lu records in %lu ms (%.1f records/s)\n",
+                  (unsigned long)_stats.lastRecords, (unsigned long)_stats.lastDurationMs,
+                  _stats.lastThroughput);
+    Serial.printf("Longest drain step: %lu ms, yields to scanner: %lu\n",
+                  (unsigned long)_stats.maxStepMs, (unsigned long)_stats.yields);
+    Serial.printf("Total: %lu records, %lu batches, %lu failed batches, %lu dropped\n",
+                  (unsigned long)_stats.totalRecords, (unsigned long)_stats.totalBatches,
+                  (unsigned long)_stats.failedBatches, (unsigned long)_stats.droppedRecords);
+    Serial.println("=====================\n");
 }
 
-bool OfflineQueue::readEntry(const String& filename, QueueEntry& entry) {
-    File file = LittleFS.open(filename, "r");
-    if (!file) return false;
+void OfflineQueue::clear() {
+    if (!_initialized) return;
+    QueueLock guard(_lock);
 
-    JsonDocument doc;
-    DeserializationError error = deserializeJson(doc, file);
-    file.close();
+    std::vector<String> paths;
+    File root = LittleFS.open(QUEUE_DIR);
+    if (!root) return;
 
-    if (error) return false;
+    File file = root.openNextFile();
+    while (file) {
+        paths.push_back(String(QUEUE_DIR) + "/" + file.name());
+        file = root.openNextFile();
+    }
+    root.close();
 
-    entry.endpoint = doc["endpoint"].as<String>();
-    entry.method = doc["method"].as<String>();
-    entry.payload = doc["payload"].as<String>();
-    entry.timestamp = doc["timestamp"] | 0;
-    entry.retries = doc["retries"] | 0;
+    for (const String& path : paths) {
+        LittleFS.remove(path);
+    }
 
-    return true;
+    resetEmpty(1);
+    _generation++;  // Batch đang POST (nếu có) không được advance head mới
+    _batchLimit = QUEUE_FLUSH_BATCH_SIZE;
+    _isolateRemaining = 0;
+    _sessionStart = 0;
+    _retryAfter = 0;
+    _yielding = false;
+    saveCheckpoint();
+    Serial.println("[QUEUE] Cleared all entries");
 }
@@ -4,10 +4,44 @@
 #include <Arduino.h>
 #include <LittleFS.h>
 #include <ArduinoJson.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <functional>
+#include "config.h"
 #include "http-client.h"
 
 #define QUEUE_DIR "/queue"
-#define MAX_QUEUE_SIZE 100
+#define QUEUE_CHECKPOINT_FILE QUEUE_DIR "/checkpoint"
+#define MAX_QUEUE_SIZE 1000
+#define QUEUE_SEGMENT_ENTRIES 64       // Số record mỗi segment file
+#define QUEUE_CHECKPOINT_INTERVAL 8    // Ghi checkpoint sau mỗi N lần pop
+
+#ifndef QUEUE_FLUSH_BATCH_SIZE
+#define QUEUE_FLUSH_BATCH_SIZE 20      // Số record tối đa gộp trong 1 POST
+#endif
+
+#ifndef QUEUE_DRAIN_MAX_BATCHES
+#define QUEUE_DRAIN_MAX_BATCHES 1      // Số batch tối đa mỗi vòng loop()
+#endif
+
+#ifndef QUEUE_DRAIN_BUDGET_MS
+#define QUEUE_DRAIN_BUDGET_MS 200      // Thời gian drain tối đa mỗi vòng loop()
+#endif
+
+#ifndef QUEUE_DRAIN_YIELD_MS
+#define QUEUE_DRAIN_YIELD_MS 3000      // Không drain trong N ms sau khi thấy ngón tay
+#endif
+
+#ifndef QUEUE_DRAIN_RETRY_MS
+#define QUEUE_DRAIN_RETRY_MS 30000     // Chờ trước khi drain lại sau lỗi mạng/server
+#endif
+
+#ifndef QUEUE_DRAIN_RETRY_MAX_MS
+#define QUEUE_DRAIN_RETRY_MAX_MS 600000 // Backoff tối đa khi server lỗi liên tục
+#endif
+
+// Trả về true để drain nhường ngay (VD: đang có ngón tay trên sensor)
+typedef std::function<bool()> DrainYieldCallback;
 
 struct QueueEntry {
     String endpoint;
@@ -17,24 +51,145 @@ struct QueueEntry {
     uint8_t retries;
 };
 
+// Thống kê flush (hiển thị qua lệnh 'i' và MQTT telemetry)
+struct QueueFlushStats {
+    uint32_t lastRecords;      // Số record gửi thành công ở lần flush gần nhất
+    uint32_t lastDurationMs;
+    float lastThroughput;      // records/s của lần flush gần nhất
+    uint32_t totalRecords;
+    uint32_t totalBatches;
+    uint32_t failedBatches;
+    uint32_t droppedRecords;
+    uint32_t maxStepMs;        // drainStep() dài nhất (ảnh hưởng tới scan latency)
+    uint32_t yields;           // Số lần drain nhường cho scanner
+};
+
+/**
+ * OfflineQueue - Queue lưu request khi offline, dạng append-only log
+ *
+ * Lưu trữ:
+ * - Record được append vào segment file /queue/seg-NNNNNN.log (1 dòng JSON/record)
+ * - Head/tail index giữ trong RAM → enqueue, dequeue, count đều O(1)
+ * - Checkpoint nhỏ (/queue/checkpoint) lưu vị trí head, ghi theo lô
+ *   → crash có thể gửi lại tối đa QUEUE_CHECKPOINT_INTERVAL record (at-least-once)
+ * - Segment đã đọc hết bị xóa nguyên file
+ *
+ * Flush:
+ * - Gộp các record liên tiếp cùng endpoint thành 1 POST dạng JSON array
+ *   (Directus /items/<collection> nhận array), tối đa QUEUE_FLUSH_BATCH_SIZE
+ * - Batch bị từ chối (400/422) → gửi lẻ từng record để cô lập record lỗi
+ * - 401/403/404 (token, quyền, collection) → dừng, chờ retry, giữ nguyên record
+ * - Lỗi mạng / 5xx → giữ record, thử lại với backoff tăng dần (không bỏ record)
+ * - drainStep() gửi từng phần mỗi vòng loop() (giới hạn số batch + thời gian),
+ *   nhường cho scanner qua DrainYieldCallback
+ */
 class OfflineQueue {
 public:
     OfflineQueue();
 
     bool begin();
     bool enqueue(const String& endpoint, const String& method, const String& payload);
+
+    /**
+     * Đọc record cũ nhất (không xóa khỏi queue)
+     * @return false nếu queue rỗng
+     */
     bool dequeue(QueueEntry& entry);
-    bool remove(const String& filename);
+
+    /**
+     * Xóa record cũ nhất khỏi queue (sau khi gửi thành công / bỏ qua)
+     */
+    bool pop();
+
     int getPendingCount();
+    /**
+     * Gửi toàn bộ queue (blocking) - dùng cho lệnh thủ công
+     */
     void flush(HTTPClientManager* http, const String& baseUrl);
+
+    /**
+     * Drain từng phần, gọi mỗi vòng loop()
+     * @param maxBatches Số batch tối đa trong lần gọi này
+     * @param budgetMs Thời gian tối đa (kiểm tra giữa các batch, 0 = không giới hạn)
+     * @param shouldYield Kiểm tra trước mỗi batch, true → dừng ngay
+     * @return Số record đã gửi thành công
+     */
+    int drainStep(HTTPClientManager* http, const String& baseUrl, int maxBatches,
+                  unsigned long budgetMs, DrainYieldCallback shouldYield = nullptr);
+
+    /**
+     * Còn record cần gửi và không trong thời gian chờ retry
+     */
+    bool isDraining();
+
+    /**
+     * Bỏ thời gian chờ retry (VD: WiFi vừa kết nối lại) → drain ngay vòng sau
+     */
+    void retryNow();
+
+    /**
+     * Device UUID điền vào record ghi lúc device chưa resolve được ("device_id":"")
+     * Chưa có → drain dừng ở record đó và chờ retry (không gửi để bị bỏ vì 400/422)
+     */
+    void setDeviceId(const String& deviceId);
+
     void clear();
 
+    const QueueFlushStats& getFlushStats();
+    void printInfo();
+
 private:
     bool _initialized;
-    String getNextFilename();
-    String getOldestFilename();
-    bool writeEntry(const String& filename, const QueueEntry& entry);
-    bool readEntry(const String& filename, QueueEntry& entry);
+    SemaphoreHandle_t _lock;  // Recursive: enqueue từ logger task / scan path, drain từ network task
+                              // (không giữ trong lúc POST)
+
+    // Head: record cũ nhất chưa gửi
+    uint32_t _headSeg;
+    uint32_t _headOffset;     // Byte offset trong segment head
+    uint16_t _headIndex;      // Số record đã đọc trong segment head
+    uint8_t _headRetries;     // Số lần gửi head thất bại liên tiếp (chỉ dùng cho backoff)
+    // Tail: segment đang append
+    uint32_t _tailSeg;
+    uint16_t _tailCount;      // Số record trong segment tail
+    uint32_t _count;
+
+    uint8_t _popsSinceCheckpoint;
+    bool _peekValid;          // dequeue() đã đọc head → pop() không cần đọc lại
+    uint32_t _peekNextOffset;
+
+    QueueFlushStats _stats;
+
+    // Trạng thái drain giữ giữa các lần drainStep()
+    QueueEntry _batchEntries[QUEUE_FLUSH_BATCH_SIZE];
+    uint32_t _batchOffsets[QUEUE_FLUSH_BATCH_SIZE];
+    int _batchLimit;
+    int _isolateRemaining;     // Số record còn phải gửi lẻ sau khi batch bị từ chối
+    unsigned long _sessionStart;
+    uint32_t _sessionRecords;
+    uint32_t _sessionFailed;
+    unsigned long _retryAfter;
+    bool _yielding;            // Đang trong đợt nhường cho scanner (đếm yields 1 lần/đợt)
+    bool _draining;            // Có drain() đang chạy (POST không giữ _lock)
+    String _deviceId;          // Điền vào "device_id":"" lúc gửi
+    uint32_t _generation;      // Tăng mỗi lần clear()
+
+    String segmentPath(uint32_t seg);
+    int readRecord(QueueEntry& entry, uint32_t& nextOffset);  // 1=ok, 0=rỗng, -1=hỏng
+    void advanceHead(uint32_t nextOffset);
+    void recomputeCount();
+    void resetEmpty(uint32_t nextSeg);
+    int readBatch(QueueEntry* entries, uint32_t* nextOffsets, int maxEntries);
+    int sendBatch(HTTPClientManager* http, const String& baseUrl,
+                  QueueEntry* entries, int count);
+    int drain(HTTPClientManager* http, const String& baseUrl, int maxBatches,
+              unsigned long budgetMs, DrainYieldCallback shouldYield);
+    int unsentStart(uint32_t seg, uint32_t offset, uint32_t generation, int count);
+    void scheduleRetry();
+    bool saveCheckpoint();
+    bool loadCheckpoint();
+    void recover();
+    void migrateLegacyEntries();
+    uint16_t countRecords(uint32_t seg, bool repairTail);
 };
 
 #endif
@@ -0,0 +1,198 @@
+#include "r307-protocol.h"
+
+size_t r307EncodePacket(uint8_t* out, size_t outSize, uint8_t pid,
+                        const uint8_t* data, uint16_t length, uint32_t address) {
+    if (length > 0xFFFF - 2 || outSize < (size_t)length + R307_FRAME_OVERHEAD) {
+        return 0;
+    }
+
+    uint16_t packetLen = length + 2;
+    size_t pos = 0;
+    out[pos++] = R307_HEADER >> 8;
+    out[pos++] = R307_HEADER & 0xFF;
+    out[pos++] = (address >> 24) & 0xFF;
+    out[pos++] = (address >> 16) & 0xFF;
+    out[pos++] = (address >> 8) & 0xFF;
+    out[pos++] = address & 0xFF;
+    out[pos++] = pid;
+    out[pos++] = packetLen >> 8;
+    out[pos++] = packetLen & 0xFF;
+
+    uint16_t sum = pid + (packetLen >> 8) + (packetLen & 0xFF);
+    for (uint16_t i = 0; i < length; i++) {
+        out[pos++] = data[i];
+        sum += data[i];
+    }
+
+    out[pos++] = sum >> 8;
+    out[pos++] = sum & 0xFF;
+    return pos;
+}
+
+size_t r307EncodeCommand(uint8_t* out, size_t outSize, uint8_t cmd,
+                         const uint8_t* params, uint16_t paramsLength) {
+    // Command packet nhỏ (cmd + tối đa vài byte params)
+    uint8_t data[16];
+    if (paramsLength > sizeof(data) - 1) return 0;
+
+    data[0] = cmd;
+    for (uint16_t i = 0; i < paramsLength; i++) {
+        data[i + 1] = params[i];
+    }
+    return r307EncodePacket(out, outSize, R307_PID_COMMAND, data, paramsLength + 1);
+}
+
+R307PacketParser::R307PacketParser() :
+    _buffer(nullptr),
+    _capacity(0)
+{
+    reset();
+}
+
+void R307PacketParser::setPayloadBuffer(uint8_t* buffer, uint16_t capacity) {
+    _buffer = buffer;
+    _capacity = capacity;
+}
+
+void R307PacketParser::reset() {
+    _state = WAIT_HEADER_HIGH;
+    _pid = 0;
+    _address = 0;
+    _addressBytes = 0;
+    _length = 0;
+    _received = 0;
+    _sum = 0;
+    _checksum = 0;
+}
+
+R307ParseResult R307PacketParser::feed(uint8_t value) {
+    switch (_state) {
+        case WAIT_HEADER_HIGH:
+            if (value == (R307_HEADER >> 8)) _state = WAIT_HEADER_LOW;
+            return R307_PARSE_NEED_MORE;
+
+        case WAIT_HEADER_LOW:
+            if (value == (R307_HEADER & 0xFF)) {
+                _address = 0;
+                _addressBytes = 0;
+                _state = READ_ADDRESS;
+            } else if (value != (R307_HEADER >> 8)) {
+                _state = WAIT_HEADER_HIGH;  // 0xEF 0xEF 0x01 vẫn là header hợp lệ
+            }
+            return R307_PARSE_NEED_MORE;
+
+        case READ_ADDRESS:
+            _address = (_address << 8) | value;
+            if (++_addressBytes == 4) _state = READ_PID;
+            return R307_PARSE_NEED_MORE;
+
+        case READ_PID:
+            _pid = value;
+            _sum = value;
+            _state = READ_LENGTH_HIGH;
+            return R307_PARSE_NEED_MORE;
+
+        case READ_LENGTH_HIGH:
+            _length = (uint16_t)value << 8;
+            _sum += value;
+            _state = READ_LENGTH_LOW;
+            return R307_PARSE_NEED_MORE;
+
+        case READ_LENGTH_LOW:
+            _length |= value;
+            _sum += value;
+            _received = 0;
+            if (_length < 2) {
+                // Length không thể nhỏ hơn checksum → frame hỏng, tìm header mới
+                _state = WAIT_HEADER_HIGH;
+                return R307_PARSE_NEED_MORE;
+            }
+            if (_length - 2 > _capacity) {
+                _state = WAIT_HEADER_HIGH;
+                return R307_PARSE_OVERFLOW;
+            }
+            _state = (_length == 2) ? READ_CHECKSUM_HIGH : READ_PAYLOAD;
+            return R307_PARSE_NEED_MORE;
+
+        case READ_PAYLOAD:
+            _buffer[_received++] = value;
+            _sum += value;
+            if (_received == _length - 2) _state = READ_CHECKSUM_HIGH;
+            return R307_PARSE_NEED_MORE;
+
+        case READ_CHECKSUM_HIGH:
+            _checksum = (uint16_t)value << 8;
+            _state = READ_CHECKSUM_LOW;
+            return R307_PARSE_NEED_MORE;
+
+        case READ_CHECKSUM_LOW:
+            _checksum |= value;
+            _state = WAIT_HEADER_HIGH;
+            return (_checksum == _sum) ? R307_PARSE_PACKET : R307_PARSE_CHECKSUM_ERROR;
+    }
+
+    return R307_PARSE_NEED_MORE;
+}
+
+uint8_t R307PacketParser::pid() const {
+    return _pid;
+}
+
+uint32_t R307PacketParser::address() const {
+    return _address;
+}
+
+uint16_t R307PacketParser::payloadLength() const {
+    return _received;
+}
+
+const uint8_t* R307PacketParser::payload() const {
+    return _buffer;
+}
+
+uint8_t R307PacketParser::ackCode() const {
+    if (_pid != R307_PID_ACK || _received == 0) return 0xFF;
+    return _buffer[0];
+}
+
+R307DataReceiver::R307DataReceiver(uint8_t* buffer, uint16_t capacity) :
+    _buffer(buffer),
+    _capacity(capacity),
+    _received(0),
+    _packets(0)
+{
+    _parser.setPayloadBuffer(_buffer, _capacity);
+}
+
+R307PacketParser& R307DataReceiver::parser() {
+    return _parser;
+}
+
+R307DataStatus R307DataReceiver::onPacket(R307ParseResult result) {
+    switch (result) {
+        case R307_PARSE_NEED_MORE: return R307_DATA_TIMEOUT;
+        case R307_PARSE_CHECKSUM_ERROR: return R307_DATA_CHECKSUM_ERROR;
+        case R307_PARSE_OVERFLOW: return R307_DATA_OVERFLOW;
+        case R307_PARSE_PACKET: break;
+    }
+
+    if (_parser.pid() != R307_PID_DATA && _parser.pid() != R307_PID_END_DATA) {
+        return R307_DATA_BAD_PID;
+    }
+
+    // Packet kế tiếp ghi nối sau phần đã nhận
+    _received += _parser.payloadLength();
+    _packets++;
+    _parser.setPayloadBuffer(_buffer + _received, _capacity - _received);
+
+    if (_parser.pid() != R307_PID_END_DATA) return R307_DATA_MORE;
+    return _received == _capacity ? R307_DATA_DONE : R307_DATA_INCOMPLETE;
+}
+
+uint16_t R307DataReceiver::received() const {
+    return _received;
+}
+
+uint16_t R307DataReceiver::packets() const {
+    return _packets;
+}
@@ -0,0 +1,169 @@
+#ifndef R307_PROTOCOL_H
+#define R307_PROTOCOL_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Framing: Header(2) + Address(4) + PID(1) + Length(2) + Data(N) + Checksum(2)
+// Length = N + 2, Checksum = PID + Length(2 byte) + Data (mod 65536)
+#define R307_HEADER 0xEF01
+#define R307_DEFAULT_ADDRESS 0xFFFFFFFF
+#define R307_FRAME_OVERHEAD 11         // Tất cả trừ Data
+
+// Package identifier
+#define R307_PID_COMMAND 0x01
+#define R307_PID_DATA 0x02
+#define R307_PID_ACK 0x07
+#define R307_PID_END_DATA 0x08
+
+// Instruction code
+#define R307_CMD_GENIMG 0x01
+#define R307_CMD_IMG2TZ 0x02
+#define R307_CMD_MATCH 0x03
+#define R307_CMD_SEARCH 0x04
+#define R307_CMD_REGMODEL 0x05
+#define R307_CMD_STORE 0x06
+#define R307_CMD_LOADCHAR 0x07
+#define R307_CMD_UPCHAR 0x08
+#define R307_CMD_DOWNCHAR 0x09
+#define R307_CMD_DELETE 0x0C
+#define R307_CMD_EMPTY 0x0D
+#define R307_CMD_READ_SYSPARA 0x0F
+#define R307_CMD_TEMPLATE_NUM 0x1D
+#define R307_CMD_READ_INDEX_TABLE 0x1F
+
+#define R307_TEMPLATE_SIZE 512         // Kích thước template R307
+
+/**
+ * Encode 1 packet vào buffer của caller (không cấp phát)
+ * @param out Buffer output, cần >= length + R307_FRAME_OVERHEAD bytes
+ * @param outSize Kích thước buffer output
+ * @param pid Package identifier (R307_PID_*)
+ * @param data Payload (instruction + params, hoặc data template)
+ * @param length Số byte payload
+ * @return Số byte đã ghi, 0 nếu buffer không đủ
+ */
+size_t r307EncodePacket(uint8_t* out, size_t outSize, uint8_t pid,
+                        const uint8_t* data, uint16_t length,
+                        uint32_t address = R307_DEFAULT_ADDRESS);
+
+/**
+ * Encode command packet: [cmd, params...]
+ */
+size_t r307EncodeCommand(uint8_t* out, size_t outSize, uint8_t cmd,
+                         const uint8_t* params, uint16_t paramsLength);
+
+// Kết quả sau mỗi byte đưa vào parser
+enum R307ParseResult {
+    R307_PARSE_NEED_MORE,       // Chưa đủ packet
+    R307_PARSE_PACKET,          // Packet hoàn chỉnh, checksum đúng
+    R307_PARSE_CHECKSUM_ERROR,  // Packet hoàn chỉnh nhưng sai checksum
+    R307_PARSE_OVERFLOW         // Payload lớn hơn buffer được cấp
+};
+
+/**
+ * R307PacketParser - Parser incremental cho response của R307
+ *
+ * Chức năng:
+ * - Nhận từng byte từ UART (feed), tự bỏ qua byte rác trước header
+ * - Payload ghi thẳng vào buffer do caller cấp (không cấp phát, không copy)
+ *   → data packet của UpChar được ghi trực tiếp vào template buffer
+ * - Không phụ thuộc Arduino: build và test được trên host (test/native)
+ */
+class R307PacketParser {
+public:
+    R307PacketParser();
+
+    /**
+     * Đặt buffer nhận payload cho packet tiếp theo
+     */
+    void setPayloadBuffer(uint8_t* buffer, uint16_t capacity);
+
+    /**
+     * Đưa 1 byte vào parser
+     */
+    R307ParseResult feed(uint8_t value);
+
+    /**
+     * Bỏ packet đang parse dở, quay về chờ header
+     */
+    void reset();
+
+    uint8_t pid() const;
+    uint32_t address() const;
+    uint16_t payloadLength() const;  // Length - 2
+    const uint8_t* payload() const;
+
+    // Confirmation code của ACK packet (byte đầu payload), 0xFF nếu không có
+    uint8_t ackCode() const;
+
+private:
+    enum State {
+        WAIT_HEADER_HIGH,
+        WAIT_HEADER_LOW,
+        READ_ADDRESS,
+        READ_PID,
+        READ_LENGTH_HIGH,
+        READ_LENGTH_LOW,
+        READ_PAYLOAD,
+        READ_CHECKSUM_HIGH,
+        READ_CHECKSUM_LOW
+    };
+
+    State _state;
+    uint8_t* _buffer;
+    uint16_t _capacity;
+    uint8_t _pid;
+    uint32_t _address;
+    uint8_t _addressBytes;
+    uint16_t _length;
+    uint16_t _received;
+    uint16_t _sum;
+    uint16_t _checksum;
+};
+
+// Trạng thái nhận chuỗi data packet (UpChar) sau mỗi packet
+enum R307DataStatus {
+    R307_DATA_MORE,             // Nhận xong 1 DATA packet, chờ packet tiếp theo
+    R307_DATA_DONE,             // Nhận xong END_DATA packet
+    R307_DATA_TIMEOUT,          // Hết thời gian chờ packet
+    R307_DATA_CHECKSUM_ERROR,
+    R307_DATA_OVERFLOW,         // Tổng data vượt buffer template
+    R307_DATA_INCOMPLETE,       // END_DATA tới khi chưa đủ capacity byte (mất packet)
+    R307_DATA_BAD_PID           // Packet không phải DATA / END_DATA
+};
+
+/**
+ * R307DataReceiver - Ghép các data packet của UpChar vào buffer template
+ *
+ * - Mỗi packet ghi thẳng vào buffer tại vị trí tiếp theo (qua parser())
+ * - Template hợp lệ phải đủ đúng capacity byte: mất 1 packet (VD: header
+ *   bị nhiễu) → END_DATA tới sớm → R307_DATA_INCOMPLETE, không nhận template thiếu
+ * - Không phụ thuộc UART: caller đưa byte vào parser() rồi báo kết quả
+ *   qua onPacket() → dùng chung cho firmware và simulator trên host
+ */
+class R307DataReceiver {
+public:
+    R307DataReceiver(uint8_t* buffer, uint16_t capacity);
+
+    // Parser để caller feed byte cho packet hiện tại
+    R307PacketParser& parser();
+
+    /**
+     * Báo kết quả parse của packet hiện tại
+     * @param result Kết quả khác NEED_MORE, hoặc NEED_MORE nếu hết thời gian chờ
+     */
+    R307DataStatus onPacket(R307ParseResult result);
+
+    uint16_t received() const;  // Số byte data đã ghi vào buffer
+    uint16_t packets() const;   // Số packet hợp lệ đã nhận
+
+private:
+    R307PacketParser _parser;
+    uint8_t* _buffer;
+    uint16_t _capacity;
+    uint16_t _received;
+    uint16_t _packets;
+};
+
+#endif
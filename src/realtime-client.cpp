@@ -0,0 +1,259 @@
+#include "realtime-client.h"
+#include "directus-client.h"
+
+#define REALTIME_UID_FINGERPRINTS "fingerprints"
+#define REALTIME_UID_MEMBERS "members"
+
+RealtimeClient::RealtimeClient(WiFiManager* wifi, DirectusClient* directus, DeltaSync* deltaSync) :
+    _wifi(wifi),
+    _directus(directus),
+    _deltaSync(deltaSync),
+    _authenticated(false),
+    _subscribed(false),
+    _resyncRequested(false)
+{
+    memset(&_stats, 0, sizeof(_stats));
+    _pending = xQueueCreate(REALTIME_QUEUE_SIZE, sizeof(PendingChange));
+}
+
+bool RealtimeClient::begin(const char* directusUrl, const char* token) {
+    _token = token;
+
+    // "http://host:port" → host, port, SSL
+    String url = directusUrl;
+    bool ssl = url.startsWith("https://");
+    int hostStart = url.indexOf("://");
+    hostStart = (hostStart < 0) ? 0 : hostStart + 3;
+    int hostEnd = url.indexOf('/', hostStart);
+    if (hostEnd < 0) hostEnd = url.length();
+
+    String host = url.substring(hostStart, hostEnd);
+    uint16_t port = ssl ? 443 : 80;
+    int colon = host.indexOf(':');
+    if (colon >= 0) {
+        port = host.substring(colon + 1).toInt();
+        host = host.substring(0, colon);
+    }
+
+    if (host.length() == 0) {
+        Serial.println("[WS] ✗ DIRECTUS_URL không hợp lệ");
+        return false;
+    }
+
+    if (ssl) {
+        _ws.beginSSL(host.c_str(), port, DIRECTUS_WS_PATH);
+    } else {
+        _ws.begin(host.c_str(), port, DIRECTUS_WS_PATH);
+    }
+    _ws.onEvent([this](WStype_t type, uint8_t* payload, size_t length) {
+        onEvent(type, payload, length);
+    });
+    _ws.setReconnectInterval(REALTIME_RECONNECT_MS);
+
+    Serial.printf("[WS] Configured: %s:%d%s\n", host.c_str(), port, DIRECTUS_WS_PATH);
+    return true;
+}
+
+void RealtimeClient::loop() {
+    if (!_wifi->isConnected()) {
+        _authenticated = false;
+        _subscribed = false;
+        return;
+    }
+
+    // Filter subscription cần device UUID → chưa gọi _ws.loop() (chưa kết nối) khi chưa có
+    if (_deviceUuid.length() == 0) {
+        _deviceUuid = _directus->getDeviceId();
+        if (_deviceUuid.length() == 0) return;
+    }
+
+    _ws.loop();
+}
+
+void RealtimeClient::onEvent(WStype_t type, uint8_t* payload, size_t length) {
+    switch (type) {
+        case WStype_CONNECTED: {
+            _stats.connects++;
+            Serial.println("[WS] ✓ Connected, authenticating...");
+            JsonDocument auth;
+            auth["type"] = "auth";
+            auth["access_token"] = _token;
+            sendJson(auth);
+            break;
+        }
+
+        case WStype_DISCONNECTED:
+            if (_subscribed) {
+                Serial.println("[WS] ⚠ Disconnected, quay lại polling cho tới khi kết nối lại");
+            }
+            _authenticated = false;
+            _subscribed = false;
+            break;
+
+        case WStype_TEXT:
+            handleMessage(payload, length);
+            break;
+
+        default:
+            break;
+    }
+}
+
+void RealtimeClient::handleMessage(const uint8_t* payload, size_t length) {
+    JsonDocument doc;
+    if (deserializeJson(doc, payload, length) != DeserializationError::Ok) {
+        Serial.println("[WS] ✗ Invalid message");
+        return;
+    }
+
+    const char* type = doc["type"] | "";
+
+    if (strcmp(type, "ping") == 0) {
+        JsonDocument pong;
+        pong["type"] = "pong";
+        sendJson(pong);
+    } else if (strcmp(type, "auth") == 0) {
+        if (strcmp(doc["status"] | "", "ok") == 0) {
+            _authenticated = true;
+            subscribe();
+        } else {
+            Serial.printf("[WS] ✗ Auth failed: %s\n", doc["error"]["message"] | "unknown");
+        }
+    } else if (strcmp(type, "subscription") == 0) {
+        handleSubscription(doc);
+    }
+}
+
+void RealtimeClient::subscribe() {
+    // member_fingerprints của device này, chỉ field cần cho mapping + diff
+    JsonDocument fingerprints;
+    fingerprints["type"] = "subscribe";
+    fingerprints["collection"] = "member_fingerprints";
+    fingerprints["uid"] = REALTIME_UID_FINGERPRINTS;
+    JsonObject query = fingerprints["query"].to<JsonObject>();
+    JsonArray fields = query["fields"].to<JsonArray>();
+    fields.add("id");
+    fields.add("finger_print_id");
+    fields.add("member_id");
+    fields.add("status");
+    fields.add("template_hash");
+    query["filter"]["device_id"]["_eq"] = _deviceUuid;
+    sendJson(fingerprints);
+
+    // members: chỉ event delete. Field của member không nằm trong cache slot và
+    // delta sync chỉ đọc member_fingerprints → create/update không cần xử lý.
+    // Delete chỉ đụng slot có member đó trong cache (applyMemberRemoved)
+    JsonDocument members;
+    members["type"] = "subscribe";
+    members["collection"] = "members";
+    members["uid"] = REALTIME_UID_MEMBERS;
+    members["event"] = "delete";
+    members["query"]["fields"][0] = "id";
+    sendJson(members);
+}
+
+void RealtimeClient::handleSubscription(JsonDocument& doc) {
+    const char* event = doc["event"] | "";
+    const char* uid = doc["uid"] | "";
+    bool isFingerprints = strcmp(uid, REALTIME_UID_FINGERPRINTS) == 0;
+
+    if (strcmp(event, "init") == 0) {
+        if (isFingerprints) {
+            _subscribed = true;
+            // Có thể đã lỡ event trong lúc mất kết nối → delta sync bắt kịp một lần
+            _resyncRequested = true;
+            Serial.println("[WS] ✓ Subscribed to member_fingerprints");
+        }
+        return;
+    }
+
+    _stats.events++;
+    bool isDelete = strcmp(event, "delete") == 0;
+
+    for (JsonVariant item : doc["data"].as<JsonArray>()) {
+        PendingChange pending;
+        memset(&pending, 0, sizeof(pending));
+        pending.receivedAt = millis();
+
+        if (isDelete) {
+            // Delete event chỉ có primary key (có thể là string hoặc object {id})
+            const char* id = item.is<const char*>() ? item.as<const char*>() : (item["id"] | "");
+            strlcpy(pending.removedId, id, sizeof(pending.removedId));
+            pending.kind = isFingerprints ? PENDING_FINGERPRINT_REMOVED : PENDING_MEMBER_REMOVED;
+        } else if (isFingerprints) {
+            if (!pending.change.fromJson(item.as<JsonObject>())) continue;
+            pending.kind = PENDING_UPSERT;
+        } else {
+            continue;  // members create/update (server cũ bỏ qua "event" của subscribe)
+        }
+
+        if (!enqueue(pending)) {
+            _stats.dropped++;
+            _resyncRequested = true;
+        }
+    }
+}
+
+bool RealtimeClient::enqueue(const PendingChange& pending) {
+    return _pending && xQueueSend(_pending, &pending, 0) == pdTRUE;
+}
+
+void RealtimeClient::applyPending() {
+    PendingChange pending;
+    if (!_pending || xQueueReceive(_pending, &pending, 0) != pdTRUE) return;
+
+    ChangeResult result;
+    switch (pending.kind) {
+        case PENDING_FINGERPRINT_REMOVED:
+            result = _deltaSync->applyRemoved(pending.removedId);
+            break;
+        case PENDING_MEMBER_REMOVED:
+            result = _deltaSync->applyMemberRemoved(pending.removedId);
+            break;
+        default:
+            result = _deltaSync->apply(pending.change);
+            if (MemberCache* cache = _directus->getMemberCache()) cache->save();
+            break;
+    }
+
+    if (result == CHANGE_FAILED) {
+        _resyncRequested = true;  // Delta sync sẽ thử lại
+    } else {
+        _stats.applied++;
+        _stats.lastLatencyMs = millis() - pending.receivedAt;
+        if (_stats.lastLatencyMs > _stats.maxLatencyMs) _stats.maxLatencyMs = _stats.lastLatencyMs;
+        Serial.printf("[WS] ✓ Change applied in %lu ms\n", _stats.lastLatencyMs);
+    }
+}
+
+void RealtimeClient::sendJson(JsonDocument& doc) {
+    String message;
+    serializeJson(doc, message);
+    _ws.sendTXT(message);
+}
+
+bool RealtimeClient::isSubscribed() {
+    return _subscribed;
+}
+
+bool RealtimeClient::consumeResyncRequest() {
+    bool requested = _resyncRequested;
+    _resyncRequested = false;
+    return requested;
+}
+
+const RealtimeStats& RealtimeClient::getStats() {
+    return _stats;
+}
+
+void RealtimeClient::printInfo() {
+    Serial.println("\n=== Directus realtime ===");
+    Serial.printf("Subscribed: %s, connects: %lu\n", _subscribed ? "yes" : "no",
+                  (unsigned long)_stats.connects);
+    Serial.printf("Events: %lu, applied: %lu, dropped: %lu, pending: %d\n",
+                  (unsigned long)_stats.events, (unsigned long)_stats.applied,
+                  (unsigned long)_stats.dropped,
+                  _pending ? (int)uxQueueMessagesWaiting(_pending) : 0);
+    Serial.printf("Latency: last %lu ms, max %lu ms\n", _stats.lastLatencyMs, _stats.maxLatencyMs);
+    Serial.println("=========================\n");
+}
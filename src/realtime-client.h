@@ -0,0 +1,118 @@
+#ifndef REALTIME_CLIENT_H
+#define REALTIME_CLIENT_H
+
+#include <Arduino.h>
+#include <WebSocketsClient.h>
+#include <ArduinoJson.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include "wifi-manager.h"
+#include "delta-sync.h"
+#include "config.h"
+
+#ifndef DIRECTUS_WS_ENABLED
+#define DIRECTUS_WS_ENABLED 1             // Nhận thay đổi qua Directus WebSocket (0 = chỉ polling)
+#endif
+
+#ifndef DIRECTUS_WS_PATH
+#define DIRECTUS_WS_PATH "/websocket"
+#endif
+
+#ifndef REALTIME_FALLBACK_SYNC_MS
+#define REALTIME_FALLBACK_SYNC_MS 900000  // Delta sync dự phòng khi đang subscribe (15 phút)
+#endif
+
+#define REALTIME_RECONNECT_MS 5000
+#define REALTIME_QUEUE_SIZE 16            // Thay đổi chờ áp dụng lên sensor
+
+class DirectusClient;
+
+// Thống kê (hiển thị qua lệnh 'i' và MQTT telemetry)
+struct RealtimeStats {
+    uint32_t connects;
+    uint32_t events;        // Event subscription nhận được (không tính init)
+    uint32_t applied;       // Thay đổi đã áp dụng lên sensor / cache
+    uint32_t dropped;       // Queue đầy → chuyển sang delta sync
+    unsigned long lastLatencyMs;  // Từ lúc nhận event tới lúc áp dụng xong
+    unsigned long maxLatencyMs;
+};
+
+/**
+ * RealtimeClient - Subscribe Directus WebSocket (member_fingerprints, members)
+ *
+ * Chức năng:
+ * - Auth bằng static token, subscribe member_fingerprints của device + members (chỉ delete)
+ * - Event create/update/delete → FreeRTOS queue; network task chỉ nhận,
+ *   sync task áp dụng từng thay đổi qua DeltaSync (cùng logic với polling)
+ * - Trả lời ping của server, tự reconnect
+ * - Khi đang subscribe, main loop giãn delta sync thành REALTIME_FALLBACK_SYNC_MS
+ */
+class RealtimeClient {
+public:
+    RealtimeClient(WiFiManager* wifi, DirectusClient* directus, DeltaSync* deltaSync);
+
+    /**
+     * Cấu hình kết nối từ DIRECTUS_URL (http:// hoặc https://)
+     */
+    bool begin(const char* directusUrl, const char* token);
+
+    /**
+     * Gọi từ network task: xử lý WebSocket, event được đưa vào queue
+     */
+    void loop();
+
+    /**
+     * Gọi từ sync task: áp dụng tối đa 1 thay đổi đang chờ
+     * (tải template ở đây, ghi sensor qua SensorJobs)
+     */
+    void applyPending();
+
+    /**
+     * Đã auth + subscribe thành công (event sẽ được đẩy về)
+     */
+    bool isSubscribed();
+
+    /**
+     * Có thay đổi không áp dụng được qua event (queue đầy, áp dụng lỗi, vừa subscribe lại)
+     * → caller chạy delta sync ngay. Đọc xong sẽ xóa cờ.
+     */
+    bool consumeResyncRequest();
+
+    const RealtimeStats& getStats();
+    void printInfo();
+
+private:
+    struct PendingChange {
+        FingerprintChange change;
+        char removedId[37];      // Record bị xóa (fingerprint hoặc member UUID)
+        uint8_t kind;
+        unsigned long receivedAt;
+    };
+
+    enum PendingKind : uint8_t {
+        PENDING_UPSERT,
+        PENDING_FINGERPRINT_REMOVED,
+        PENDING_MEMBER_REMOVED
+    };
+
+    WebSocketsClient _ws;
+    WiFiManager* _wifi;
+    DirectusClient* _directus;
+    DeltaSync* _deltaSync;
+    String _token;
+    String _deviceUuid;
+    bool _authenticated;
+    volatile bool _subscribed;
+    volatile bool _resyncRequested;
+    RealtimeStats _stats;
+    QueueHandle_t _pending;
+
+    void onEvent(WStype_t type, uint8_t* payload, size_t length);
+    void handleMessage(const uint8_t* payload, size_t length);
+    void handleSubscription(JsonDocument& doc);
+    void subscribe();
+    void sendJson(JsonDocument& doc);
+    bool enqueue(const PendingChange& pending);
+};
+
+#endif
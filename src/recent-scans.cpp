@@ -0,0 +1,65 @@
+#include "recent-scans.h"
+#include "member-cache.h"
+
+RecentScans::RecentScans(unsigned long windowMs) :
+    _windowMs(windowMs),
+    _suppressed(0)
+{
+    clear();
+}
+
+bool RecentScans::isRecent(uint16_t slot, const String& memberId, unsigned long now) {
+    if (_windowMs == 0) return false;
+    if (find(slot, memberId, now) < 0) return false;
+    _suppressed++;
+    return true;
+}
+
+void RecentScans::record(uint16_t slot, const String& memberId, unsigned long now) {
+    if (_windowMs == 0) return;
+
+    // Cùng member → cập nhật tại chỗ, không thì dùng entry trống / cũ nhất
+    int index = find(slot, memberId, now);
+    if (index < 0) {
+        index = 0;
+        for (uint8_t i = 0; i < RECENT_SCAN_SLOTS; i++) {
+            if (!_entries[i].used) {
+                index = i;
+                break;
+            }
+            if (now - _entries[i].at > now - _entries[index].at) index = i;
+        }
+    }
+
+    Entry& entry = _entries[index];
+    entry.at = now;
+    entry.slot = slot;
+    entry.hasMember = MemberCache::parseUuid(memberId, entry.member);
+    entry.used = true;
+}
+
+void RecentScans::clear() {
+    memset(_entries, 0, sizeof(_entries));
+}
+
+uint32_t RecentScans::getSuppressedCount() {
+    return _suppressed;
+}
+
+int RecentScans::find(uint16_t slot, const String& memberId, unsigned long now) {
+    uint8_t member[16];
+    bool hasMember = MemberCache::parseUuid(memberId, member);
+
+    for (uint8_t i = 0; i < RECENT_SCAN_SLOTS; i++) {
+        const Entry& entry = _entries[i];
+        if (!entry.used || now - entry.at >= _windowMs) continue;
+
+        // Có member cả hai phía → so member (slot đổi chủ sau enroll / evict không khớp),
+        // slot chưa có trong cache → so slot
+        bool same = hasMember && entry.hasMember
+            ? memcmp(entry.member, member, sizeof(member)) == 0
+            : entry.slot == slot;
+        if (same) return i;
+    }
+    return -1;
+}
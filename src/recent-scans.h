@@ -0,0 +1,62 @@
+#ifndef RECENT_SCANS_H
+#define RECENT_SCANS_H
+
+#include <Arduino.h>
+#include "config.h"
+
+#ifndef RECENT_SCAN_WINDOW_MS
+#define RECENT_SCAN_WINDOW_MS 30000   // Quét lại trong khoảng này → chỉ feedback tại chỗ (0 = tắt)
+#endif
+
+#ifndef RECENT_SCAN_SLOTS
+#define RECENT_SCAN_SLOTS 8           // Số member vừa check-in được nhớ
+#endif
+
+/**
+ * RecentScans - Bảng member vừa được cho vào (chặn scan lặp)
+ *
+ * Chức năng:
+ * - Ghi lại lần check-in GRANTED gần nhất, key theo member UUID
+ *   (mọi ngón tay của cùng member), slot không có member → key theo slot
+ * - Chạm lại trong RECENT_SCAN_WINDOW_MS → caller chỉ báo feedback,
+ *   không verify Directus, không log attendance, không publish MQTT
+ * - Cửa sổ tính từ lần check-in thật, chạm liên tục không kéo dài cửa sổ
+ * - DENIED không được ghi → chạm lại luôn được quyết định lại
+ *   (vd. admin vừa kích hoạt member, hoặc lỗi mạng)
+ * - Chỉ nằm trong RAM, chỉ sensor task ghi
+ */
+class RecentScans {
+public:
+    RecentScans(unsigned long windowMs = RECENT_SCAN_WINDOW_MS);
+
+    /**
+     * Member / slot này vừa check-in trong cửa sổ chưa (có → đếm 1 lần chặn)
+     * @param memberId Member UUID từ MemberCache, "" nếu slot chưa có mapping
+     */
+    bool isRecent(uint16_t slot, const String& memberId, unsigned long now);
+
+    /**
+     * Ghi lần check-in được cho vào (ghi đè entry cũ nhất nếu bảng đầy)
+     */
+    void record(uint16_t slot, const String& memberId, unsigned long now);
+
+    void clear();
+    uint32_t getSuppressedCount();
+
+private:
+    struct Entry {
+        unsigned long at;
+        uint16_t slot;
+        uint8_t member[16];
+        bool hasMember;
+        bool used;
+    };
+
+    Entry _entries[RECENT_SCAN_SLOTS];
+    unsigned long _windowMs;
+    volatile uint32_t _suppressed;
+
+    int find(uint16_t slot, const String& memberId, unsigned long now);
+};
+
+#endif
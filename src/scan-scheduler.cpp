@@ -0,0 +1,197 @@
+#include "scan-scheduler.h"
+#include <time.h>
+
+// Cận trên (ms) của từng bucket time-to-detect, bucket cuối = còn lại
+static const uint32_t DETECT_BUCKET_EDGES[SCAN_DETECT_BUCKETS] = {
+    10, 20, 30, 40, 50, 60, 80, 100, 125, 150,
+    200, 250, 300, 400, 500, 750, 1000, 1500, 2000, UINT32_MAX
+};
+
+ScanScheduler* ScanScheduler::_instance = nullptr;
+
+ScanScheduler::ScanScheduler() :
+    _peakCount(0),
+    _peak(false),
+    _touchEnabled(false),
+    _lastClockCheck(0),
+    _interval(SCAN_FAST_INTERVAL_MS),
+    _lastPollAt(0),
+    _lastPresentAt(0),
+    _lastPresent(false),
+    _hasPolled(false),
+    _everPresent(false),
+    _touchPending(false),
+    _touchAt(0),
+    _touchIrqs(0)
+{
+    resetStats();
+}
+
+void ScanScheduler::begin(const char* peakHours, int touchPin) {
+    // "6-9,17-21" → [6, 9) và [17, 21)
+    _peakCount = 0;
+    const char* p = peakHours;
+    while (p && *p && _peakCount < SCAN_PEAK_RANGES_MAX) {
+        char* end;
+        long start = strtol(p, &end, 10);
+        if (end == p || *end != '-') break;
+        p = end + 1;
+        long stop = strtol(p, &end, 10);
+        if (end == p) break;
+        if (start >= 0 && start < 24 && stop > 0 && stop <= 24) {
+            _peakRanges[_peakCount].startHour = start;
+            _peakRanges[_peakCount].endHour = stop;
+            _peakCount++;
+        }
+        p = (*end == ',') ? end + 1 : end;
+    }
+
+    if (touchPin >= 0) {
+        _instance = this;
+        pinMode(touchPin, INPUT);
+        attachInterrupt(digitalPinToInterrupt(touchPin), touchIsr, SCAN_TOUCH_EDGE);
+        setTouchEnabled(true);
+    }
+
+    Serial.printf("[SCAN] Adaptive polling: fast %dms, idle %dms, peak %dms (%d range), touch IRQ %s\n",
+                  SCAN_FAST_INTERVAL_MS, SCAN_IDLE_INTERVAL_MS, SCAN_PEAK_INTERVAL_MS,
+                  _peakCount, _touchEnabled ? "on" : "off");
+}
+
+void ScanScheduler::loop(unsigned long now) {
+    if (_peakCount == 0) return;
+    if (_lastClockCheck != 0 && now - _lastClockCheck < SCAN_CLOCK_CHECK_MS) return;
+    _lastClockCheck = now;
+
+    // Chưa sync NTP → giữ nguyên trạng thái cũ
+    struct tm timeinfo;
+    if (getLocalTime(&timeinfo, 0)) {
+        setPeak(isPeakHour(timeinfo.tm_hour));
+    }
+}
+
+bool ScanScheduler::isDue(unsigned long now) {
+    if (!_hasPolled || _touchPending) return true;
+    return now - _lastPollAt >= _interval;
+}
+
+void ScanScheduler::recordPoll(bool fingerPresent, unsigned long now) {
+    _polls++;
+
+    // Ngón tay mới đặt lên: có IRQ → tính từ lúc chạm, không → từ lần poll trống trước
+    if (fingerPresent && !_lastPresent && _hasPolled) {
+        recordDetect(_touchPending ? now - _touchAt : now - _lastPollAt);
+    }
+    _touchPending = false;
+
+    if (fingerPresent) {
+        _lastPresentAt = now;
+        _everPresent = true;
+    }
+    _lastPresent = fingerPresent;
+    _lastPollAt = now;
+    _hasPolled = true;
+
+    if (isActive(now)) {
+        _interval = SCAN_FAST_INTERVAL_MS;
+        return;
+    }
+
+    // Rảnh: giãn dần nhịp poll tới mức trần của chế độ hiện tại
+    unsigned long cap = _peak ? SCAN_PEAK_INTERVAL_MS
+                      : _touchEnabled ? SCAN_TOUCH_IDLE_INTERVAL_MS
+                      : SCAN_IDLE_INTERVAL_MS;
+    _interval = _interval * 2;
+    if (_interval < SCAN_FAST_INTERVAL_MS) _interval = SCAN_FAST_INTERVAL_MS;
+    if (_interval > cap) _interval = cap;
+}
+
+void IRAM_ATTR ScanScheduler::notifyTouch(unsigned long now) {
+    if (!_touchPending) {
+        _touchAt = now;
+        _touchPending = true;
+    }
+    _touchIrqs++;
+}
+
+void IRAM_ATTR ScanScheduler::touchIsr() {
+    if (_instance) _instance->notifyTouch(millis());
+}
+
+void ScanScheduler::setPeak(bool peak) {
+    if (peak == _peak) return;
+    _peak = peak;
+    Serial.printf("[SCAN] %s peak hours\n", peak ? "Entering" : "Leaving");
+}
+
+void ScanScheduler::setTouchEnabled(bool enabled) {
+    _touchEnabled = enabled;
+}
+
+bool ScanScheduler::isPeakHour(int hour) {
+    for (uint8_t i = 0; i < _peakCount; i++) {
+        const PeakRange& range = _peakRanges[i];
+        bool inRange = range.startHour < range.endHour
+            ? (hour >= range.startHour && hour < range.endHour)
+            : (hour >= range.startHour || hour < range.endHour);  // Qua nửa đêm, vd "22-2"
+        if (inRange) return true;
+    }
+    return false;
+}
+
+bool ScanScheduler::isActive(unsigned long now) {
+    return _everPresent && now - _lastPresentAt < SCAN_ACTIVE_WINDOW_MS;
+}
+
+unsigned long ScanScheduler::getInterval() {
+    return _interval;
+}
+
+const char* ScanScheduler::getMode() {
+    if (isActive(_lastPollAt)) return "active";
+    if (_peak) return "peak";
+    return _touchEnabled ? "touch" : "idle";
+}
+
+void ScanScheduler::recordDetect(unsigned long latencyMs) {
+    uint8_t bucket = 0;
+    while (bucket < SCAN_DETECT_BUCKETS - 1 && latencyMs > DETECT_BUCKET_EDGES[bucket]) {
+        bucket++;
+    }
+    _buckets[bucket]++;
+    _detects++;
+    if (latencyMs > _detectMax) _detectMax = latencyMs;
+}
+
+uint32_t ScanScheduler::percentile(uint8_t pct) {
+    if (_detects == 0) return 0;
+
+    // Cận trên của bucket chứa mẫu thứ pct% (không vượt quá max đã thấy)
+    uint32_t target = (_detects * pct + 99) / 100;
+    uint32_t seen = 0;
+    for (uint8_t i = 0; i < SCAN_DETECT_BUCKETS; i++) {
+        seen += _buckets[i];
+        if (seen >= target) {
+            return DETECT_BUCKET_EDGES[i] < _detectMax ? DETECT_BUCKET_EDGES[i] : _detectMax;
+        }
+    }
+    return _detectMax;
+}
+
+ScanStats ScanScheduler::getStats() {
+    ScanStats stats;
+    stats.polls = _polls;
+    stats.detects = _detects;
+    stats.touchIrqs = _touchIrqs;
+    stats.detectP50Ms = percentile(50);
+    stats.detectP99Ms = percentile(99);
+    stats.detectMaxMs = _detectMax;
+    return stats;
+}
+
+void ScanScheduler::resetStats() {
+    _polls = 0;
+    _detects = 0;
+    _detectMax = 0;
+    memset(_buckets, 0, sizeof(_buckets));
+}
@@ -0,0 +1,140 @@
+#ifndef SCAN_SCHEDULER_H
+#define SCAN_SCHEDULER_H
+
+#include <Arduino.h>
+#include "config.h"
+
+#ifndef SCAN_FAST_INTERVAL_MS
+#define SCAN_FAST_INTERVAL_MS 40        // Nhịp getImage() khi vừa có ngón tay / giờ cao điểm
+#endif
+
+#ifndef SCAN_IDLE_INTERVAL_MS
+#define SCAN_IDLE_INTERVAL_MS 400       // Nhịp chậm nhất khi không có ai (backoff x2 từ FAST)
+#endif
+
+#ifndef SCAN_PEAK_INTERVAL_MS
+#define SCAN_PEAK_INTERVAL_MS 80        // Nhịp chậm nhất trong giờ cao điểm
+#endif
+
+#ifndef SCAN_ACTIVE_WINDOW_MS
+#define SCAN_ACTIVE_WINDOW_MS 15000     // Giữ nhịp FAST bao lâu sau lần cuối thấy ngón tay
+#endif
+
+#ifndef SCAN_PEAK_HOURS
+#define SCAN_PEAK_HOURS ""              // Giờ cao điểm theo giờ địa phương, vd "6-9,17-21"
+#endif
+
+#ifndef SCAN_TOUCH_PIN
+#define SCAN_TOUCH_PIN -1               // GPIO nối chân Touch (WAKEUP) của R307, -1 = không dùng
+#endif
+
+#ifndef SCAN_TOUCH_EDGE
+#define SCAN_TOUCH_EDGE RISING          // Cạnh ngắt khi đặt tay (tùy module R307)
+#endif
+
+#ifndef SCAN_TOUCH_IDLE_INTERVAL_MS
+#define SCAN_TOUCH_IDLE_INTERVAL_MS 2000  // Có touch IRQ: chỉ poll dự phòng khi rảnh
+#endif
+
+#define SCAN_CLOCK_CHECK_MS 60000       // Đọc lại giờ địa phương (giờ cao điểm) mỗi phút
+#define SCAN_PEAK_RANGES_MAX 4
+#define SCAN_DETECT_BUCKETS 20
+
+// Thống kê thời gian từ lúc đặt tay tới lúc scan phát hiện
+struct ScanStats {
+    uint32_t polls;          // Số lần getImage()
+    uint32_t detects;        // Số lần phát hiện ngón tay mới đặt lên
+    uint32_t touchIrqs;      // Số lần ngắt chân Touch
+    uint32_t detectP50Ms;
+    uint32_t detectP99Ms;
+    uint32_t detectMaxMs;
+};
+
+/**
+ * ScanScheduler - Lịch poll getImage() thích ứng cho auto-login
+ *
+ * Chức năng:
+ * - Vừa thấy ngón tay (SCAN_ACTIVE_WINDOW_MS) → poll mỗi SCAN_FAST_INTERVAL_MS
+ * - Rảnh → backoff x2 tới SCAN_IDLE_INTERVAL_MS (giờ cao điểm: SCAN_PEAK_INTERVAL_MS)
+ * - Chân Touch của R307 (nếu nối): ngắt → poll ngay, khi rảnh chỉ poll dự phòng
+ * - Đo time-to-detect vào histogram → p50 / p99:
+ *   có touch IRQ → từ lúc ngắt; không có → khoảng cách tới lần poll trống trước
+ *   (cận trên, ngón tay đặt lên lúc nào đó trong khoảng này)
+ * - Mọi hàm nhận `now` từ caller → test giả lập chạy được với đồng hồ ảo
+ */
+class ScanScheduler {
+public:
+    ScanScheduler();
+
+    /**
+     * @param peakHours "h1-h2,h3-h4" (giờ địa phương, h2 không tính), "" = không có
+     * @param touchPin GPIO chân Touch, -1 = chỉ poll
+     */
+    void begin(const char* peakHours = SCAN_PEAK_HOURS, int touchPin = SCAN_TOUCH_PIN);
+
+    /**
+     * Cập nhật giờ cao điểm từ đồng hồ NTP (gọi mỗi vòng, tự giới hạn 1 lần / phút)
+     */
+    void loop(unsigned long now);
+
+    /**
+     * Tới lúc poll getImage() chưa
+     */
+    bool isDue(unsigned long now);
+
+    /**
+     * Kết quả một lần poll (fingerPresent = getImage() thấy ngón tay)
+     */
+    void recordPoll(bool fingerPresent, unsigned long now);
+
+    /**
+     * Ngón tay chạm chân Touch (ISR gọi; test giả lập gọi trực tiếp)
+     */
+    void notifyTouch(unsigned long now);
+
+    void setPeak(bool peak);
+    void setTouchEnabled(bool enabled);   // begin() tự bật khi có touchPin; test giả lập bật tay
+    bool isPeakHour(int hour);
+
+    unsigned long getInterval();
+    const char* getMode();      // "active" / "peak" / "touch" / "idle"
+    ScanStats getStats();
+    void resetStats();
+
+private:
+    struct PeakRange {
+        uint8_t startHour;
+        uint8_t endHour;
+    };
+
+    PeakRange _peakRanges[SCAN_PEAK_RANGES_MAX];
+    uint8_t _peakCount;
+    bool _peak;
+    bool _touchEnabled;
+    unsigned long _lastClockCheck;
+
+    unsigned long _interval;
+    unsigned long _lastPollAt;
+    unsigned long _lastPresentAt;
+    bool _lastPresent;
+    bool _hasPolled;
+    bool _everPresent;
+
+    volatile bool _touchPending;
+    volatile unsigned long _touchAt;
+    volatile uint32_t _touchIrqs;
+
+    uint32_t _polls;
+    uint32_t _detects;
+    uint32_t _detectMax;
+    uint32_t _buckets[SCAN_DETECT_BUCKETS];
+
+    void recordDetect(unsigned long latencyMs);
+    uint32_t percentile(uint8_t pct);
+    bool isActive(unsigned long now);
+
+    static ScanScheduler* _instance;
+    static void touchIsr();
+};
+
+#endif
@@ -0,0 +1,85 @@
+#include "sensor-jobs.h"
+#include "fingerprint-handler.h"
+#include "member-cache.h"
+#include "slot-manager.h"
+
+SensorJobs::SensorJobs(FingerprintHandler* fp, MemberCache* memberCache, SlotManager* slotManager) :
+    _fp(fp),
+    _memberCache(memberCache),
+    _slotManager(slotManager),
+    _sensorTask(nullptr),
+    _completed(0)
+{
+    _lock = xSemaphoreCreateMutex();
+    _requests = xQueueCreate(1, sizeof(SensorJob*));
+    _done = xQueueCreate(1, sizeof(uint8_t));
+}
+
+bool SensorJobs::run(SensorJob& job) {
+    job.ok = false;
+    if (xTaskGetCurrentTaskHandle() == _sensorTask) {
+        execute(job);
+        return job.ok;
+    }
+    if (!_lock || !_requests || !_done) return false;
+
+    // Job nằm trên stack / member của caller: chờ xong mới trả về nên không cần copy 512 bytes
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    SensorJob* pending = &job;
+    xQueueSend(_requests, &pending, portMAX_DELAY);
+    uint8_t done;
+    xQueueReceive(_done, &done, portMAX_DELAY);
+    xSemaphoreGive(_lock);
+    return job.ok;
+}
+
+bool SensorJobs::processPending() {
+    _sensorTask = xTaskGetCurrentTaskHandle();
+
+    SensorJob* job;
+    if (!_requests || xQueueReceive(_requests, &job, 0) != pdTRUE) return false;
+
+    execute(*job);
+    _completed++;
+
+    uint8_t done = 1;
+    xQueueSend(_done, &done, portMAX_DELAY);
+    return true;
+}
+
+void SensorJobs::execute(SensorJob& job) {
+    switch (job.kind) {
+        case SENSOR_JOB_STORE:
+            // Tránh map slot sang member cũ nếu upload lỗi giữa chừng
+            if (_memberCache) _memberCache->erase(job.slot);
+            job.ok = _fp->uploadModel(job.slot, job.data, job.size);
+            if (job.ok) {
+                if (_slotManager) _slotManager->markLocal(job.slot, job.fingerprintId);
+                if (_memberCache) {
+                    _memberCache->put(job.slot, job.fingerprintId, job.memberId, MEMBER_ACTIVE);
+                }
+            }
+            break;
+
+        case SENSOR_JOB_RESIDENT:
+            job.slot = _slotManager
+                ? _slotManager->makeResident(job.fingerprintId, job.memberId, job.data,
+                                             job.size, job.lastActive)
+                : 0;
+            job.ok = job.slot != 0;
+            break;
+
+        case SENSOR_JOB_REMOVE:
+            if (!_fp->isSlotUsed(job.slot)) {
+                job.ok = true;  // Slot đã trống
+                break;
+            }
+            job.ok = _fp->deleteFingerprint(job.slot);
+            if (job.ok && _slotManager) _slotManager->release(job.slot);
+            break;
+    }
+}
+
+uint32_t SensorJobs::getCompletedCount() {
+    return _completed;
+}
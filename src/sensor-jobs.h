@@ -0,0 +1,75 @@
+#ifndef SENSOR_JOBS_H
+#define SENSOR_JOBS_H
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include "r307-protocol.h"
+
+class FingerprintHandler;
+class MemberCache;
+class SlotManager;
+
+// Thao tác ghi sensor mà sync task (core 0) nhờ sensor task (core 1) thực hiện
+enum SensorJobKind : uint8_t {
+    SENSOR_JOB_STORE,     // Template của device → đúng slot finger_print_id (delta sync / realtime)
+    SENSOR_JOB_RESIDENT,  // Template preload → SlotManager::makeResident (slot trống / LRU)
+    SENSOR_JOB_REMOVE     // Xóa slot (record không còn active / bị xóa)
+};
+
+// Job POD: template đã tải + decode xong, sensor task chỉ còn ghi
+struct SensorJob {
+    SensorJobKind kind;
+    uint16_t slot;           // STORE / REMOVE: slot đích; RESIDENT: slot đã nạp (kết quả)
+    uint16_t size;
+    uint32_t lastActive;     // RESIDENT: epoch check-in gần nhất của member
+    char fingerprintId[37];
+    char memberId[37];
+    uint8_t data[R307_TEMPLATE_SIZE];
+    bool ok;                 // Kết quả, do sensor task ghi
+};
+
+/**
+ * SensorJobs - Chuyển thao tác ghi sensor từ sync task sang sensor task
+ *
+ * Giống TemplateRestorer: phía core 0 list thay đổi + HTTP GET + base64 decode,
+ * loop() (core 1) chỉ DownChar + Store / DeleteChar giữa 2 lần scan
+ * → người đặt tay không phải chờ HTTP timeout của delta sync / preload.
+ * Mỗi lần 1 job: run() chờ tới khi sensor task làm xong để caller biết kết quả
+ * (con trỏ delta sync chỉ tiến khi template đã nằm trên sensor).
+ */
+class SensorJobs {
+public:
+    SensorJobs(FingerprintHandler* fp, MemberCache* memberCache, SlotManager* slotManager);
+
+    /**
+     * Gọi từ sync task: gửi job, chờ sensor task thực hiện xong (blocking)
+     * Gọi từ chính sensor task → thực hiện ngay
+     * @return job.ok
+     */
+    bool run(SensorJob& job);
+
+    /**
+     * Gọi từ loop(): thực hiện tối đa 1 job đang chờ
+     * @return true nếu đã chạy 1 job
+     */
+    bool processPending();
+
+    uint32_t getCompletedCount();
+
+private:
+    FingerprintHandler* _fp;
+    MemberCache* _memberCache;
+    SlotManager* _slotManager;
+    SemaphoreHandle_t _lock;       // Mỗi lần chỉ 1 job chờ (nhiều task gọi run())
+    QueueHandle_t _requests;       // SensorJob* → sensor task
+    QueueHandle_t _done;           // Sensor task báo xong → task đang chờ trong run()
+    volatile TaskHandle_t _sensorTask;  // Task gọi processPending()
+    volatile uint32_t _completed;
+
+    void execute(SensorJob& job);
+};
+
+#endif
@@ -0,0 +1,259 @@
+#include "slot-manager.h"
+#include <algorithm>
+
+#define SLOT_TABLE_MAGIC 0x534C5442  // "SLTB"
+#define SLOT_TABLE_VERSION 1
+
+struct SlotTableHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t slots;
+};
+
+SlotManager::SlotManager(SlotSensor* sensor, MemberCache* memberCache) :
+    _sensor(sensor),
+    _memberCache(memberCache),
+    _initialized(false),
+    _dirty(false)
+{
+    memset(_table, 0, sizeof(_table));
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+bool SlotManager::begin() {
+    _initialized = true;
+
+    File file = LittleFS.open(SLOT_TABLE_FILE, "r");
+    if (!file) {
+        Serial.println("[SLOT] No slot table on flash, starting empty");
+        return true;
+    }
+
+    SlotTableHeader header;
+    bool ok = file.read((uint8_t*)&header, sizeof(header)) == sizeof(header) &&
+              header.magic == SLOT_TABLE_MAGIC &&
+              header.version == SLOT_TABLE_VERSION &&
+              header.slots == MEMBER_CACHE_SLOTS &&
+              file.read((uint8_t*)_table, sizeof(_table)) == sizeof(_table);
+    file.close();
+
+    if (!ok) {
+        memset(_table, 0, sizeof(_table));
+        Serial.println("[SLOT] ⚠ Slot table invalid, starting empty");
+    }
+    return true;
+}
+
+bool SlotManager::save() {
+    if (!_initialized) return false;
+    if (!_dirty) return true;
+
+    File file = LittleFS.open(SLOT_TABLE_FILE, "w");
+    if (!file) {
+        Serial.println("[SLOT] ✗ Cannot open slot table for writing");
+        return false;
+    }
+
+    SlotTableHeader header;
+    header.magic = SLOT_TABLE_MAGIC;
+    header.version = SLOT_TABLE_VERSION;
+    header.slots = MEMBER_CACHE_SLOTS;
+
+    bool ok = file.write((const uint8_t*)&header, sizeof(header)) == sizeof(header) &&
+              file.write((const uint8_t*)_table, sizeof(_table)) == sizeof(_table);
+    file.close();
+
+    if (ok) _dirty = false;
+    return ok;
+}
+
+uint32_t SlotManager::now() {
+    time_t t = time(nullptr);
+    return t > 100000 ? (uint32_t)t : 0;  // 0 nếu chưa sync NTP
+}
+
+void SlotManager::recordHit(uint16_t slot) {
+    _stats.hits++;
+    if (slot == 0 || slot >= MEMBER_CACHE_SLOTS) return;
+
+    uint32_t t = now();
+    if (t > 0) {
+        _table[slot].lastHit = t;
+        _dirty = true;  // Ghi xuống flash theo lô (save() định kỳ)
+    }
+}
+
+void SlotManager::recordMiss() {
+    _stats.misses++;
+}
+
+uint16_t SlotManager::findResident(const String& fingerprintId) {
+    return _memberCache->findSlot(fingerprintId);
+}
+
+bool SlotManager::isManaged(uint16_t slot) {
+    if (slot == 0 || slot >= MEMBER_CACHE_SLOTS) return false;
+    return _table[slot].flags & SLOT_FLAG_MANAGED;
+}
+
+uint16_t SlotManager::chooseVictim(uint32_t lastActive) {
+    uint16_t capacity = _sensor->getCapacity();
+    if (capacity > MEMBER_CACHE_SLOTS) capacity = MEMBER_CACHE_SLOTS;
+
+    String fpId, memberId;
+    MemberStatus status;
+    uint16_t victim = 0;
+    uint32_t oldest = UINT32_MAX;
+
+    // Slot thật sự trống trên sensor (theo index table) → dùng ngay
+    uint16_t freeSlot = _sensor->findFreeSlot();
+    if (freeSlot > 0 && freeSlot < MEMBER_CACHE_SLOTS) return freeSlot;
+
+    for (uint16_t slot = 1; slot < capacity; slot++) {
+        if (!_memberCache->lookup(slot, fpId, memberId, &status)) {
+            // Sensor có template nhưng chưa biết của ai → không đụng tới
+            // (trừ khi index table không đọc được: coi như slot trống)
+            if (!_sensor->hasIndexTable()) return slot;
+            continue;
+        }
+        if (status != MEMBER_ACTIVE) return slot;  // Member không còn active
+
+        if (_table[slot].lastHit < oldest) {
+            oldest = _table[slot].lastHit;
+            victim = slot;
+        }
+    }
+
+    // Chỉ evict nếu slot lạnh hơn member cần nạp
+    return (victim != 0 && oldest < lastActive) ? victim : 0;
+}
+
+uint16_t SlotManager::makeResident(const String& fingerprintId, const String& memberId,
+                                   uint8_t* templateBuffer, uint16_t templateSize,
+                                   uint32_t lastActive) {
+    uint16_t slot = findResident(fingerprintId);
+    if (slot != 0) return slot;
+
+    slot = chooseVictim(lastActive);
+    if (slot == 0) return 0;
+
+    String oldFp, oldMember;
+    MemberStatus oldStatus;
+    bool evicting = _memberCache->lookup(slot, oldFp, oldMember, &oldStatus) &&
+                    oldStatus == MEMBER_ACTIVE;
+
+    // Xóa mapping trước khi ghi sensor: nếu upload lỗi giữa chừng,
+    // slot không bị map nhầm sang member cũ
+    _memberCache->erase(slot);
+
+    if (!_sensor->uploadModel(slot, templateBuffer, templateSize)) {
+        _memberCache->save();
+        Serial.printf("[SLOT] ✗ Upload to slot #%d failed\n", slot);
+        return 0;
+    }
+
+    _memberCache->put(slot, fingerprintId, memberId, MEMBER_ACTIVE);
+    _memberCache->save();
+
+    _table[slot].lastHit = lastActive;
+    _table[slot].flags |= SLOT_FLAG_MANAGED;
+    _dirty = true;
+    save();
+
+    _stats.loads++;
+    if (evicting) {
+        _stats.evictions++;
+        Serial.printf("[SLOT] Evicted member %s from slot #%d\n", oldMember.c_str(), slot);
+    }
+    Serial.printf("[SLOT] ✓ Member %s resident in slot #%d\n", memberId.c_str(), slot);
+    return slot;
+}
+
+void SlotManager::markLocal(uint16_t slot, const String& fingerprintId) {
+    if (slot == 0 || slot >= MEMBER_CACHE_SLOTS) return;
+
+    String cachedFp, memberId;
+    if (_memberCache->lookup(slot, cachedFp, memberId) && cachedFp != fingerprintId) {
+        // Sensor giữ template mới → mapping cũ sai, để verify/refresh lấy lại từ Directus
+        _memberCache->erase(slot);
+        _memberCache->save();
+    }
+
+    if (_table[slot].flags & SLOT_FLAG_MANAGED) {
+        _table[slot].flags &= ~SLOT_FLAG_MANAGED;
+        _dirty = true;
+    }
+    uint32_t t = now();
+    if (t > 0) {
+        _table[slot].lastHit = t;
+        _dirty = true;
+    }
+}
+
+void SlotManager::release(uint16_t slot) {
+    if (slot == 0 || slot >= MEMBER_CACHE_SLOTS) return;
+    memset(&_table[slot], 0, sizeof(SlotTableEntry));
+    _dirty = true;
+    save();
+}
+
+void SlotManager::releaseAll() {
+    memset(_table, 0, sizeof(_table));
+    _dirty = true;
+    save();
+}
+
+int SlotManager::preload(PreloadSource& source, int maxTemplates, int* recentCount) {
+    std::vector<PreloadMember> recent;
+    if (!source.listRecentMembers(recent)) return -1;
+
+    // Member mới check-in nhất lên trước
+    std::sort(recent.begin(), recent.end(), [](const PreloadMember& a, const PreloadMember& b) {
+        return a.lastActive > b.lastActive;
+    });
+    if (recent.size() > SLOT_PRELOAD_RECENT_MAX) recent.resize(SLOT_PRELOAD_RECENT_MAX);
+    if (recentCount) *recentCount = recent.size();
+
+    int loaded = 0;
+    for (size_t next = 0; next < recent.size() && loaded < maxTemplates; ) {
+        size_t end = std::min(recent.size(), next + (size_t)SLOT_PRELOAD_LOOKUP_BATCH);
+        if (!source.resolveFingerprints(recent, next, end)) break;
+
+        // Giữ thứ tự check-in, bỏ member không có template / đã nằm trên sensor
+        std::vector<const PreloadMember*> pending;
+        for (size_t i = next; i < end && (int)pending.size() < maxTemplates - loaded; i++) {
+            if (recent[i].fingerprintId.length() == 0) continue;
+            if (findResident(recent[i].fingerprintId) != 0) continue;
+            pending.push_back(&recent[i]);
+        }
+        next = end;
+        if (pending.empty()) continue;
+
+        if (!source.loadTemplates(pending, loaded)) break;
+    }
+    return loaded;
+}
+
+const SlotStats& SlotManager::getStats() {
+    return _stats;
+}
+
+float SlotManager::getHitRate() {
+    uint32_t total = _stats.hits + _stats.misses;
+    return total > 0 ? (float)_stats.hits / total : 0.0f;
+}
+
+void SlotManager::printInfo() {
+    uint16_t managed = 0;
+    for (uint16_t slot = 1; slot < MEMBER_CACHE_SLOTS; slot++) {
+        if (_table[slot].flags & SLOT_FLAG_MANAGED) managed++;
+    }
+
+    Serial.println("\n=== Sensor slot cache ===");
+    Serial.printf("Capacity: %d, managed slots: %d\n", _sensor->getCapacity(), managed);
+    Serial.printf("Hits: %lu, misses: %lu (hit rate %.1f%%)\n",
+                  (unsigned long)_stats.hits, (unsigned long)_stats.misses, getHitRate() * 100);
+    Serial.printf("Loads: %lu, evictions: %lu\n",
+                  (unsigned long)_stats.loads, (unsigned long)_stats.evictions);
+    Serial.println("=========================\n");
+}
@@ -0,0 +1,180 @@
+#ifndef SLOT_MANAGER_H
+#define SLOT_MANAGER_H
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <time.h>
+#include <vector>
+#include "config.h"
+#include "member-cache.h"
+
+#define SLOT_TABLE_FILE "/slot-table.bin"
+
+#ifndef SLOT_PRELOAD_INTERVAL_MS
+#define SLOT_PRELOAD_INTERVAL_MS 3600000  // Preload member hoạt động gần đây mỗi 1 giờ
+#endif
+
+#ifndef SLOT_PRELOAD_MAX
+#define SLOT_PRELOAD_MAX 10               // Số template tối đa nạp mỗi lần preload
+#endif
+
+#ifndef SLOT_PRELOAD_DAYS
+#define SLOT_PRELOAD_DAYS 7               // "Gần đây" = check-in trong N ngày qua
+#endif
+
+#ifndef SLOT_PRELOAD_RECENT_MAX
+#define SLOT_PRELOAD_RECENT_MAX 100       // Số member check-in gần nhất được xét mỗi lần preload
+#endif
+
+#ifndef SLOT_PRELOAD_LOOKUP_BATCH
+#define SLOT_PRELOAD_LOOKUP_BATCH 25      // Số member mỗi request filter[member_id][_in] (giới hạn độ dài URL)
+#endif
+
+// Cờ của từng slot trong bảng
+#define SLOT_FLAG_MANAGED 0x01  // Template do SlotManager nạp (không theo finger_print_id của device)
+
+struct SlotTableEntry {
+    uint32_t lastHit;  // Epoch (giây) lần match gần nhất / lần check-in gần nhất khi nạp
+    uint8_t flags;
+};
+
+// Thống kê (hiển thị qua lệnh 'i' và MQTT telemetry)
+struct SlotStats {
+    uint32_t hits;       // Scan match template đang nằm trên sensor
+    uint32_t misses;     // Có ngón tay nhưng sensor không tìm thấy
+    uint32_t evictions;  // Slot đang dùng bị thay bằng template khác
+    uint32_t loads;      // Template được nạp lên sensor (DownChar + Store)
+};
+
+/**
+ * SlotSensor - Các thao tác SlotManager cần từ sensor
+ *
+ * FingerprintHandler implement trên R307 thật, test/test-slot-sim.cpp dùng sensor
+ * giả lập để replay check-in nhiều ngày không cần phần cứng.
+ */
+class SlotSensor {
+public:
+    virtual ~SlotSensor() {}
+
+    virtual uint16_t getCapacity() = 0;
+    virtual uint16_t findFreeSlot(uint16_t from = 1) = 0;  // 0 nếu hết slot
+    virtual bool hasIndexTable() = 0;
+    virtual bool uploadModel(uint16_t id, uint8_t* templateBuffer, uint16_t templateSize) = 0;
+};
+
+// Member check-in gần đây: ứng viên preload
+struct PreloadMember {
+    String memberId;
+    String fingerprintId;  // Template active trong branch, "" = chưa resolve / không có
+    uint32_t lastActive;   // Epoch lần check-in gần nhất
+};
+
+/**
+ * PreloadSource - Dữ liệu preload từ CMS + thao tác nạp template
+ *
+ * DirectusClient implement bằng HTTP + SensorJobs, test/test-slot-sim.cpp dùng
+ * attendance giả lập → cả 2 chạy cùng chính sách chọn member của SlotManager::preload().
+ */
+class PreloadSource {
+public:
+    virtual ~PreloadSource() {}
+
+    // Member check-in thành công trong SLOT_PRELOAD_DAYS ngày qua (thứ tự bất kỳ)
+    virtual bool listRecentMembers(std::vector<PreloadMember>& members) = 0;
+    // Điền fingerprintId cho members[first, last)
+    virtual bool resolveFingerprints(std::vector<PreloadMember>& members,
+                                     size_t first, size_t last) = 0;
+    // Tải + nạp template theo thứ tự; false = dừng preload (lỗi / không còn slot lạnh hơn)
+    virtual bool loadTemplates(const std::vector<const PreloadMember*>& members,
+                               int& loaded) = 0;
+};
+
+/**
+ * SlotManager - Coi flash của R307 là cache trên toàn bộ template của branch
+ *
+ * Chức năng:
+ * - Occupant của từng slot lấy từ MemberCache (slot → fingerprint UUID),
+ *   SlotManager giữ thêm lần hit gần nhất + cờ managed (lưu LittleFS)
+ * - makeResident(): nạp template vào slot trống, hoặc evict slot ít dùng nhất
+ *   (LRU) bằng DownChar + Store, rồi cập nhật MemberCache
+ * - Slot managed không bị refreshMemberCache() ghi đè theo finger_print_id
+ *   của device (sensor đang giữ template khác)
+ */
+class SlotManager {
+public:
+    SlotManager(SlotSensor* sensor, MemberCache* memberCache);
+
+    /**
+     * Load bảng slot từ flash
+     */
+    bool begin();
+
+    /**
+     * Ghi nhận kết quả scan
+     */
+    void recordHit(uint16_t slot);
+    void recordMiss();
+
+    /**
+     * Template đã nằm trên sensor chưa
+     * @return slot, 0 nếu chưa
+     */
+    uint16_t findResident(const String& fingerprintId);
+
+    /**
+     * Đưa template lên sensor (evict slot LRU nếu hết chỗ)
+     * @param fingerprintId Fingerprint UUID
+     * @param memberId Member UUID
+     * @param templateBuffer Template 512 bytes
+     * @param lastActive Epoch lần check-in gần nhất của member: chỉ evict slot
+     *                   có lastHit cũ hơn giá trị này
+     * @return slot đã nạp, 0 nếu không nạp (không có slot nào lạnh hơn / lỗi sensor)
+     */
+    uint16_t makeResident(const String& fingerprintId, const String& memberId,
+                          uint8_t* templateBuffer, uint16_t templateSize, uint32_t lastActive);
+
+    /**
+     * Slot do SlotManager nạp → bỏ qua mapping finger_print_id từ Directus
+     */
+    bool isManaged(uint16_t slot);
+
+    /**
+     * Slot vừa được enroll / restore theo finger_print_id của device
+     * → bỏ cờ managed, xóa mapping cũ khỏi MemberCache nếu là template khác
+     */
+    void markLocal(uint16_t slot, const String& fingerprintId);
+
+    /**
+     * Slot bị xóa khỏi sensor
+     */
+    void release(uint16_t slot);
+    void releaseAll();
+
+    /**
+     * Preload: xét SLOT_PRELOAD_RECENT_MAX member check-in gần nhất, mới nhất trước,
+     * bỏ member đã nằm trên sensor, nạp tối đa maxTemplates, dừng khi nạp bị từ chối
+     * (member sau còn lạnh hơn → cũng không có slot)
+     * @param recentCount Output: số member check-in gần đây (có thể nullptr)
+     * @return Số template đã nạp, -1 nếu không lấy được danh sách member
+     */
+    int preload(PreloadSource& source, int maxTemplates, int* recentCount = nullptr);
+
+    bool save();
+
+    const SlotStats& getStats();
+    float getHitRate();
+    void printInfo();
+
+private:
+    SlotSensor* _sensor;
+    MemberCache* _memberCache;
+    SlotTableEntry _table[MEMBER_CACHE_SLOTS];
+    SlotStats _stats;
+    bool _initialized;
+    bool _dirty;
+
+    uint16_t chooseVictim(uint32_t lastActive);
+    static uint32_t now();
+};
+
+#endif
@@ -0,0 +1,141 @@
+#include "template-manifest.h"
+#include <mbedtls/sha256.h>
+
+#define TEMPLATE_MANIFEST_MAGIC 0x544D4E46  // "TMNF"
+#define TEMPLATE_MANIFEST_VERSION 1
+
+struct TemplateManifestHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t slots;
+};
+
+TemplateManifest::TemplateManifest() :
+    _initialized(false),
+    _dirty(false)
+{
+    memset(_hashes, 0, sizeof(_hashes));
+}
+
+bool TemplateManifest::begin() {
+    _initialized = true;
+
+    File file = LittleFS.open(TEMPLATE_MANIFEST_FILE, "r");
+    if (!file) {
+        Serial.println("[SYNC] No template manifest on flash, starting empty");
+        return true;
+    }
+
+    TemplateManifestHeader header;
+    bool ok = file.read((uint8_t*)&header, sizeof(header)) == sizeof(header) &&
+              header.magic == TEMPLATE_MANIFEST_MAGIC &&
+              header.version == TEMPLATE_MANIFEST_VERSION &&
+              header.slots == MEMBER_CACHE_SLOTS &&
+              file.read((uint8_t*)_hashes, sizeof(_hashes)) == sizeof(_hashes);
+    file.close();
+
+    if (!ok) {
+        memset(_hashes, 0, sizeof(_hashes));
+        Serial.println("[SYNC] ⚠ Template manifest invalid, starting empty");
+        return true;
+    }
+
+    Serial.printf("[SYNC] Template manifest: %d slots known\n", size());
+    return true;
+}
+
+bool TemplateManifest::save() {
+    if (!_initialized) return false;
+    if (!_dirty) return true;
+
+    File file = LittleFS.open(TEMPLATE_MANIFEST_FILE, "w");
+    if (!file) {
+        Serial.println("[SYNC] ✗ Cannot open template manifest for writing");
+        return false;
+    }
+
+    TemplateManifestHeader header;
+    header.magic = TEMPLATE_MANIFEST_MAGIC;
+    header.version = TEMPLATE_MANIFEST_VERSION;
+    header.slots = MEMBER_CACHE_SLOTS;
+
+    bool ok = file.write((const uint8_t*)&header, sizeof(header)) == sizeof(header) &&
+              file.write((const uint8_t*)_hashes, sizeof(_hashes)) == sizeof(_hashes);
+    file.close();
+
+    if (ok) _dirty = false;
+    return ok;
+}
+
+void TemplateManifest::computeHash(const uint8_t* templateData, uint16_t templateSize,
+                                   uint8_t out[TEMPLATE_HASH_SIZE]) {
+    uint8_t digest[32];
+    mbedtls_sha256(templateData, templateSize, digest, 0);  // 0 = SHA-256
+    memcpy(out, digest, TEMPLATE_HASH_SIZE);
+}
+
+bool TemplateManifest::isEmpty(const uint8_t hash[TEMPLATE_HASH_SIZE]) {
+    for (uint8_t i = 0; i < TEMPLATE_HASH_SIZE; i++) {
+        if (hash[i] != 0) return false;
+    }
+    return true;
+}
+
+String TemplateManifest::hashHex(const uint8_t* templateData, uint16_t templateSize) {
+    uint8_t hash[TEMPLATE_HASH_SIZE];
+    computeHash(templateData, templateSize, hash);
+
+    char buffer[TEMPLATE_HASH_SIZE * 2 + 1];
+    for (uint8_t i = 0; i < TEMPLATE_HASH_SIZE; i++) {
+        snprintf(buffer + i * 2, 3, "%02x", hash[i]);
+    }
+    return String(buffer);
+}
+
+bool TemplateManifest::has(uint16_t slot) {
+    if (slot == 0 || slot >= MEMBER_CACHE_SLOTS) return false;
+    return !isEmpty(_hashes[slot]);
+}
+
+bool TemplateManifest::matches(uint16_t slot, const String& hashHex) {
+    if (!has(slot) || hashHex.length() != TEMPLATE_HASH_SIZE * 2) return false;
+
+    for (uint8_t i = 0; i < TEMPLATE_HASH_SIZE; i++) {
+        uint8_t value = (uint8_t)strtoul(hashHex.substring(i * 2, i * 2 + 2).c_str(), nullptr, 16);
+        if (value != _hashes[slot][i]) return false;
+    }
+    return true;
+}
+
+void TemplateManifest::set(uint16_t slot, const uint8_t* templateData, uint16_t templateSize) {
+    if (slot == 0 || slot >= MEMBER_CACHE_SLOTS) return;
+
+    uint8_t hash[TEMPLATE_HASH_SIZE];
+    computeHash(templateData, templateSize, hash);
+    if (memcmp(_hashes[slot], hash, sizeof(hash)) != 0) {
+        memcpy(_hashes[slot], hash, sizeof(hash));
+        _dirty = true;
+    }
+}
+
+void TemplateManifest::erase(uint16_t slot) {
+    if (!has(slot)) return;
+
+    memset(_hashes[slot], 0, TEMPLATE_HASH_SIZE);
+    _dirty = true;
+    save();  // Slot sắp bị ghi → không để hash cũ sót lại trên flash
+}
+
+void TemplateManifest::clear() {
+    memset(_hashes, 0, sizeof(_hashes));
+    _dirty = true;
+    save();
+}
+
+uint16_t TemplateManifest::size() {
+    uint16_t count = 0;
+    for (uint16_t slot = 1; slot < MEMBER_CACHE_SLOTS; slot++) {
+        if (!isEmpty(_hashes[slot])) count++;
+    }
+    return count;
+}
@@ -0,0 +1,66 @@
+#ifndef TEMPLATE_MANIFEST_H
+#define TEMPLATE_MANIFEST_H
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include "member-cache.h"
+
+#define TEMPLATE_MANIFEST_FILE "/template-manifest.bin"
+#define TEMPLATE_HASH_SIZE 8  // 64 bit đầu của SHA-256 (đủ để phát hiện thay đổi)
+
+/**
+ * TemplateManifest - Hash nội dung template đang nằm trên từng slot sensor
+ *
+ * Chức năng:
+ * - Lưu hash (SHA-256 rút gọn, hex 16 ký tự) cho mỗi slot, RAM + LittleFS
+ * - So với field template_hash trong Directus → sync_all chỉ truyền
+ *   template mới / đã thay đổi
+ * - Entry chỉ được ghi khi biết chắc nội dung trên sensor (sau upload / UpChar),
+ *   bị xóa trước mọi thao tác ghi slot → manifest có thể thiếu nhưng không sai
+ */
+class TemplateManifest {
+public:
+    TemplateManifest();
+
+    /**
+     * Load manifest từ flash (LittleFS đã được MemberCache mount)
+     */
+    bool begin();
+
+    /**
+     * Slot đang giữ template có hash này không
+     * @param hashHex Hash dạng hex (từ Directus)
+     */
+    bool matches(uint16_t slot, const String& hashHex);
+    bool has(uint16_t slot);
+
+    /**
+     * Ghi hash của template vừa nằm trên slot (chỉ RAM, gọi save() để lưu)
+     */
+    void set(uint16_t slot, const uint8_t* templateData, uint16_t templateSize);
+
+    /**
+     * Xóa entry và ghi flash ngay nếu slot có entry
+     */
+    void erase(uint16_t slot);
+    void clear();
+
+    bool save();
+    uint16_t size();
+
+    /**
+     * Hash hex của template (giá trị gửi lên Directus field template_hash)
+     */
+    static String hashHex(const uint8_t* templateData, uint16_t templateSize);
+
+private:
+    uint8_t _hashes[MEMBER_CACHE_SLOTS][TEMPLATE_HASH_SIZE];  // Toàn 0 = chưa biết
+    bool _initialized;
+    bool _dirty;
+
+    static void computeHash(const uint8_t* templateData, uint16_t templateSize,
+                            uint8_t out[TEMPLATE_HASH_SIZE]);
+    static bool isEmpty(const uint8_t hash[TEMPLATE_HASH_SIZE]);
+};
+
+#endif
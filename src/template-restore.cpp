@@ -0,0 +1,226 @@
+#include "template-restore.h"
+#include "slot-manager.h"
+#include "template-manifest.h"
+
+TemplateRestorer::TemplateRestorer(RestoreSource* source, RestoreSensor* sensor) :
+    _source(source),
+    _sensor(sensor),
+    _ring(nullptr),
+    _listed(false),
+    _skipped(0),
+    _aborted(false),
+    _freeSlots(nullptr),
+    _readySlots(nullptr)
+{
+}
+
+void TemplateRestorer::setProgressCallback(RestoreProgressCallback callback) {
+    _progress = callback;
+}
+
+RestoreStats TemplateRestorer::restore(const String& deviceMac, bool prune) {
+    RestoreStats stats;
+    memset(&stats, 0, sizeof(stats));
+
+    _ring = new Slot[RESTORE_RING_SLOTS];
+    _deviceMac = deviceMac;
+    _listed = false;
+    _skipped = 0;
+    _aborted = false;
+    memset(_seen, 0, sizeof(_seen));
+    _freeSlots = xQueueCreate(RESTORE_RING_SLOTS, sizeof(int8_t));
+    _readySlots = xQueueCreate(RESTORE_RING_SLOTS + 1, sizeof(int8_t));
+
+    if (!_freeSlots || !_readySlots) {
+        Serial.println("[RESTORE] ✗ Cannot create pipeline queues");
+        if (_freeSlots) vQueueDelete(_freeSlots);
+        if (_readySlots) vQueueDelete(_readySlots);
+        delete[] _ring;
+        _ring = nullptr;
+        return stats;
+    }
+
+    for (int8_t i = 0; i < RESTORE_RING_SLOTS; i++) {
+        xQueueSend(_freeSlots, &i, 0);
+    }
+
+    unsigned long start = millis();
+
+    TaskHandle_t producer = nullptr;
+    if (xTaskCreatePinnedToCore(TemplateRestorer::producerEntry, "restore",
+                                RESTORE_TASK_STACK, this, RESTORE_TASK_PRIORITY,
+                                &producer, RESTORE_TASK_CORE) != pdPASS) {
+        Serial.println("[RESTORE] ✗ Cannot start download task");
+        vQueueDelete(_freeSlots);
+        vQueueDelete(_readySlots);
+        delete[] _ring;
+        _ring = nullptr;
+        return stats;
+    }
+
+    Serial.printf("[RESTORE] Restoring templates (pipeline, %d buffers, page %d)\n",
+                  RESTORE_RING_SLOTS, RESTORE_MANIFEST_PAGE_SIZE);
+
+    // Consumer: upload slot đã tải xong, trả slot lại cho producer
+    while (true) {
+        int8_t index;
+        xQueueReceive(_readySlots, &index, portMAX_DELAY);
+        if (index < 0) break;  // Producer đã xử lý hết danh sách
+
+        if (_aborted) {
+            // Đã hủy: trả buffer cho producer tới khi nó dừng, không ghi sensor nữa
+            xQueueSend(_freeSlots, &index, portMAX_DELAY);
+            continue;
+        }
+
+        Slot& slot = _ring[index];
+        stats.total++;
+        stats.downloadMs += slot.downloadMs;
+
+        if (!slot.ok) {
+            stats.failed++;
+            Serial.printf("[RESTORE] [%d] ✗ Download failed\n", stats.total);
+        } else {
+            unsigned long uploadStart = millis();
+            bool uploaded = _sensor->uploadModel(slot.localId, slot.data, slot.size);
+            stats.uploadMs += millis() - uploadStart;
+
+            if (uploaded) {
+                stats.bytesTransferred += slot.size;
+                if (SlotManager* slots = _source->getSlotManager()) {
+                    slots->markLocal(slot.localId, slot.fingerprintId);
+                }
+                stats.synced++;
+                Serial.printf("[RESTORE] [%d] ✓ ID #%d\n", stats.total, slot.localId);
+            } else {
+                stats.failed++;
+                Serial.printf("[RESTORE] [%d] ✗ Upload ID #%d failed\n",
+                              stats.total, slot.localId);
+            }
+        }
+
+        if (_progress) {
+            RestoreStats progress = stats;
+            progress.skipped = _skipped;
+            if (!_progress(progress)) {
+                _aborted = true;
+                Serial.println("[RESTORE] ⚠ Aborted, waiting for download task to stop");
+            }
+        }
+
+        xQueueSend(_freeSlots, &index, portMAX_DELAY);
+    }
+
+    stats.elapsedMs = millis() - start;
+    stats.listed = _listed;
+    stats.aborted = _aborted;
+    stats.skipped = _skipped;
+    stats.total += _skipped;
+    stats.bytesSkipped = (unsigned long)_skipped * R307_TEMPLATE_SIZE;
+
+    // Chỉ prune khi đã duyệt đủ danh sách (list lỗi giữa chừng → không biết slot nào còn active)
+    if (prune && _listed) {
+        stats.deleted = pruneInactive();
+    }
+    if (TemplateManifest* manifest = _sensor->getManifest()) {
+        manifest->save();
+    }
+
+    // Sentinel được gửi sau lần ghi ring cuối → an toàn giải phóng
+    vQueueDelete(_freeSlots);
+    vQueueDelete(_readySlots);
+    delete[] _ring;
+    _ring = nullptr;
+    _freeSlots = nullptr;
+    _readySlots = nullptr;
+
+    Serial.printf("[PERF] Restore %d/%d (%d skipped, %d deleted): %lu ms "
+                  "(download %lu ms, upload %lu ms, %lu bytes sent, %lu bytes skipped)\n",
+                  stats.synced, stats.total, stats.skipped, stats.deleted, stats.elapsedMs,
+                  stats.downloadMs, stats.uploadMs, stats.bytesTransferred, stats.bytesSkipped);
+    return stats;
+}
+
+void TemplateRestorer::produce() {
+    MemberCache* cache = _source->getMemberCache();
+    TemplateManifest* manifest = _sensor->getManifest();
+    bool diff = _sensor->hasIndexTable();
+    String cachedFp, memberId;
+
+    // Manifest nhỏ (không có template_data): đủ để diff trước khi tải template
+    int listed = _source->forEachFingerprint(_deviceMac, "id,finger_print_id,template_hash",
+                                               "&filter[status][_eq]=active",
+                                               [&](JsonObject fp) {
+        if (_aborted) return false;
+
+        uint16_t localId = fp["finger_print_id"] | 0;
+        if (localId > 0 && localId < MEMBER_CACHE_SLOTS) {
+            _seen[localId >> 3] |= (1 << (localId & 7));
+        }
+
+        // Consumer chỉ ghi slot của item trước đó, không trùng slot đang kiểm tra
+        if (diff && localId > 0 && _sensor->isSlotUsed(localId)) {
+            const char* hash = fp["template_hash"] | "";
+            bool unchanged = hash[0] != '\0'
+                ? (manifest && manifest->matches(localId, hash))
+                : (cache && cache->lookup(localId, cachedFp, memberId) &&
+                   cachedFp == (fp["id"] | ""));
+            if (unchanged) {
+                _skipped++;
+                return true;
+            }
+        }
+
+        int8_t index;
+        xQueueReceive(_freeSlots, &index, portMAX_DELAY);
+
+        Slot& slot = _ring[index];
+        strlcpy(slot.fingerprintId, fp["id"] | "", sizeof(slot.fingerprintId));
+        unsigned long downloadStart = millis();
+        slot.ok = _source->downloadFingerprintTemplate(slot.fingerprintId, slot.data,
+                                                         &slot.size, &slot.localId);
+        slot.downloadMs = millis() - downloadStart;
+
+        xQueueSend(_readySlots, &index, portMAX_DELAY);
+        return true;
+    }, RESTORE_MANIFEST_PAGE_SIZE);
+    _listed = listed >= 0 && !_aborted;  // Danh sách chưa duyệt hết → không prune
+
+    int8_t sentinel = -1;
+    xQueueSend(_readySlots, &sentinel, portMAX_DELAY);
+}
+
+int TemplateRestorer::pruneInactive() {
+    MemberCache* cache = _source->getMemberCache();
+    TemplateManifest* manifest = _sensor->getManifest();
+    SlotManager* slots = _source->getSlotManager();
+    uint16_t capacity = _sensor->getCapacity();
+    if (capacity > MEMBER_CACHE_SLOTS) capacity = MEMBER_CACHE_SLOTS;
+
+    String cachedFp, memberId;
+    int deleted = 0;
+    for (uint16_t slot = 1; slot < capacity; slot++) {
+        if (!_sensor->isSlotUsed(slot) || (_seen[slot >> 3] & (1 << (slot & 7)))) continue;
+        if (slots && slots->isManaged(slot)) continue;  // Template preload, không thuộc device
+
+        // Chỉ xóa slot biết là từ Directus; template enroll local chưa sync thì giữ lại
+        bool known = (cache && cache->lookup(slot, cachedFp, memberId)) ||
+                     (manifest && manifest->has(slot));
+        if (!known) continue;
+
+        if (_sensor->deleteFingerprint(slot)) {
+            if (cache) cache->erase(slot);
+            if (slots) slots->release(slot);
+            deleted++;
+            Serial.printf("[RESTORE] Pruned inactive slot #%d\n", slot);
+        }
+    }
+
+    if (cache && deleted > 0) cache->save();
+    return deleted;
+}
+
+void TemplateRestorer::producerEntry(void* param) {
+    static_cast<TemplateRestorer*>(param)->produce();
+    vTaskDelete(nullptr);
+}
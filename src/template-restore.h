@@ -0,0 +1,139 @@
+#ifndef TEMPLATE_RESTORE_H
+#define TEMPLATE_RESTORE_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <functional>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+#include "r307-protocol.h"
+#include "member-cache.h"
+
+#define RESTORE_RING_SLOTS 3           // Số template buffer dùng chung giữa 2 stage
+#define RESTORE_TASK_STACK 8192        // HTTP + JSON + base64 decode
+#define RESTORE_TASK_PRIORITY 1
+#define RESTORE_TASK_CORE 0            // Core network
+#define RESTORE_MANIFEST_PAGE_SIZE 250 // Trang manifest (id, finger_print_id, template_hash)
+
+class SlotManager;
+class TemplateManifest;
+
+// Callback cho từng record khi duyệt theo trang, trả về false để dừng
+typedef std::function<bool(JsonObject)> FingerprintRecordCallback;
+
+/**
+ * RestoreSource / RestoreSensor - Các thao tác restore cần từ CMS và sensor
+ *
+ * DirectusClient / FingerprintHandler implement trên Directus + R307 thật,
+ * test/test-restore-sim.cpp dùng nguồn và sensor giả lập có độ trễ cấu hình được
+ * để đo pipeline không cần server / phần cứng.
+ */
+class RestoreSource {
+public:
+    virtual ~RestoreSource() {}
+
+    virtual int forEachFingerprint(const String& deviceMac, const char* fields,
+                                   const String& query, FingerprintRecordCallback callback,
+                                   int pageSize) = 0;
+    virtual bool downloadFingerprintTemplate(const String& fingerprintId, uint8_t* templateBuffer,
+                                             uint16_t* templateSize,
+                                             uint16_t* fingerprintIdLocal) = 0;
+    virtual MemberCache* getMemberCache() = 0;   // Có thể nullptr
+    virtual SlotManager* getSlotManager() = 0;   // Có thể nullptr
+};
+
+class RestoreSensor {
+public:
+    virtual ~RestoreSensor() {}
+
+    virtual bool uploadModel(uint16_t id, uint8_t* templateBuffer, uint16_t templateSize) = 0;
+    virtual bool deleteFingerprint(uint16_t id) = 0;
+    virtual bool hasIndexTable() = 0;
+    virtual bool isSlotUsed(uint16_t id) = 0;
+    virtual uint16_t getCapacity() = 0;
+    virtual TemplateManifest* getManifest() = 0; // Có thể nullptr
+};
+
+// Kết quả restore (trả về cho sync_all / menu restore)
+struct RestoreStats {
+    bool listed;               // false nếu list Directus lỗi giữa chừng
+    int total;
+    int synced;
+    int failed;
+    int skipped;               // Đã nằm đúng slot trên sensor (hash / member cache khớp)
+    int deleted;               // Slot không còn active trong Directus đã bị xóa (prune)
+    bool aborted;              // Dừng giữa chừng theo yêu cầu (progress callback trả false)
+    unsigned long bytesTransferred;  // Bytes template đã upload lên sensor
+    unsigned long bytesSkipped;      // Bytes template không cần tải / upload
+    unsigned long downloadMs;  // Tổng thời gian stage download + decode
+    unsigned long uploadMs;    // Tổng thời gian stage DownChar + Store
+    unsigned long elapsedMs;   // Thời gian thực (≈ max của 2 stage khi pipeline chạy tốt)
+};
+
+// Gọi sau mỗi template đã xử lý; trả false để dừng restore
+typedef std::function<bool(const RestoreStats& progress)> RestoreProgressCallback;
+
+/**
+ * TemplateRestorer - Restore hàng loạt template từ Directus xuống R307
+ *
+ * Pipeline 2 stage dùng ring RESTORE_RING_SLOTS buffer 512 bytes:
+ * - Producer task (core 0): duyệt danh sách theo trang, HTTP GET + base64 decode
+ *   template tiếp theo
+ * - Consumer (task gọi restore()): DownChar + Store template hiện tại lên sensor
+ * → Tổng thời gian bị chặn bởi stage chậm hơn thay vì tổng 2 stage
+ *
+ * Diff trước khi tải (chỉ từ manifest: id, finger_print_id, template_hash):
+ * - Record có template_hash: bỏ qua nếu slot đang dùng và TemplateManifest khớp hash
+ * - Record cũ chưa có hash: bỏ qua nếu member cache map slot tới đúng UUID
+ * - prune = true: xóa slot do Directus quản lý nhưng không còn active
+ */
+class TemplateRestorer {
+public:
+    TemplateRestorer(RestoreSource* source, RestoreSensor* sensor);
+
+    /**
+     * Restore mọi fingerprint active của device (blocking cho tới khi xong)
+     * Danh sách được đọc theo trang, không tải toàn bộ vào RAM
+     * @param deviceMac MAC address
+     * @param prune Xóa slot không còn trong danh sách active (chỉ khi list đủ)
+     * @return Thống kê restore
+     */
+    RestoreStats restore(const String& deviceMac, bool prune = false);
+
+    /**
+     * Báo tiến độ / cho phép hủy (sync_all qua MQTT). Dừng giữa chừng → không prune
+     */
+    void setProgressCallback(RestoreProgressCallback callback);
+
+private:
+    struct Slot {
+        uint8_t data[R307_TEMPLATE_SIZE];
+        uint16_t size;
+        uint16_t localId;
+        char fingerprintId[37];
+        bool ok;
+        unsigned long downloadMs;
+    };
+
+    RestoreSource* _source;
+    RestoreSensor* _sensor;
+
+    // Trạng thái của lần restore đang chạy (producer task đọc)
+    Slot* _ring;
+    String _deviceMac;
+    bool _listed;
+    int _skipped;
+    volatile bool _aborted;
+    RestoreProgressCallback _progress;
+    uint8_t _seen[(MEMBER_CACHE_SLOTS + 7) / 8];  // Slot có trong danh sách active
+
+    QueueHandle_t _freeSlots;   // Index slot trống → producer
+    QueueHandle_t _readySlots;  // Index slot đã tải xong → consumer (-1 = hết)
+
+    int pruneInactive();
+    void produce();
+    static void producerEntry(void* param);
+};
+
+#endif
@@ -0,0 +1,172 @@
+#!/usr/bin/env python3
+"""
+Stub Directus REST server (HTTP/1.1) để đo firmware khi server chậm, không cần Directus thật.
+
+Chạy:  python3 test/directus-http-stub.py [port] [delay-ms]   (mặc định 8055, 0 ms)
+Trỏ DIRECTUS_URL trong config.h tới http://<IP máy này>:<port>.
+
+Trả lời các endpoint firmware dùng trên scan path:
+  GET  /items/fingerprint_devices?filter...  → 1 device cố định
+  POST /items/fingerprint_devices            → tạo device
+  POST /items/attendance                     → nhận 1 record hoặc array (batch offline queue)
+  GET  /items/<khác>                         → {"data": []}
+
+Mọi request /items/... bị giữ lại <delay-ms> trước khi trả lời.
+Connection được giữ (keep-alive) tới khi client đóng, hoặc server tự đóng sau
+<idle-ms> không có request (giả lập idle timeout của Directus / reverse proxy).
+Test sketch đổi cấu hình / đọc thống kê qua:
+  GET /stub/delay?ms=<n>       → đặt độ trễ
+  GET /stub/idle-close?ms=<n>  → đóng connection idle sau n ms (0 = không đóng)
+  GET /stub/stats              → {"requests", "attendance", "connections", "delay_ms", "idle_close_ms"}
+  GET /stub/reset              → xóa thống kê
+
+Lệnh stdin: delay <ms> | idle-close <ms> | stats | reset
+"""
+
+import json
+import sys
+import threading
+import time
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+from urllib.parse import parse_qs, urlparse
+
+DEVICE_ID = "0b7c9a52-2d1e-4f3a-9c8b-5e6d7f8a9b0c"
+
+state = {"delay_ms": 0, "idle_close_ms": 0, "requests": 0, "attendance": 0, "connections": 0}
+lock = threading.Lock()
+
+
+def reset_stats():
+    with lock:
+        state["requests"] = 0
+        state["attendance"] = 0
+        state["connections"] = 0
+
+
+def snapshot():
+    with lock:
+        return dict(state)
+
+
+class Handler(BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"  # Content-Length luôn có → client giữ được connection
+
+    def setup(self):
+        # Mỗi handler = 1 TCP connection; timeout socket = idle timeout giữa các request
+        with lock:
+            state["connections"] += 1
+            idle = state["idle_close_ms"]
+        self.timeout = idle / 1000.0 if idle else None
+        super().setup()
+
+    def log_message(self, fmt, *args):
+        pass
+
+    def reply(self, code, body):
+        data = json.dumps(body).encode()
+        self.send_response(code)
+        self.send_header("Content-Type", "application/json")
+        self.send_header("Content-Length", str(len(data)))
+        self.end_headers()
+        self.wfile.write(data)
+
+    def read_body(self):
+        length = int(self.headers.get("Content-Length") or 0)
+        return self.rfile.read(length) if length else b""
+
+    def handle_stub(self, url):
+        query = parse_qs(url.query)
+        if url.path == "/stub/delay":
+            with lock:
+                state["delay_ms"] = int(query.get("ms", ["0"])[0])
+            print(f"[stub] delay = {state['delay_ms']} ms")
+        elif url.path == "/stub/idle-close":
+            with lock:
+                state["idle_close_ms"] = int(query.get("ms", ["0"])[0])
+            print(f"[stub] idle close = {state['idle_close_ms']} ms")
+        elif url.path == "/stub/reset":
+            reset_stats()
+        self.reply(200, snapshot())
+
+    def handle_items(self, method, url, body):
+        with lock:
+            state["requests"] += 1
+            delay = state["delay_ms"]
+        if delay:
+            time.sleep(delay / 1000.0)
+
+        if url.path.startswith("/items/fingerprint_devices"):
+            if method == "GET":
+                self.reply(200, {"data": [{"id": DEVICE_ID}]})
+            else:
+                self.reply(200, {"data": {"id": DEVICE_ID}})
+            return
+
+        if url.path == "/items/attendance" and method == "POST":
+            try:
+                payload = json.loads(body or b"{}")
+            except ValueError:
+                self.reply(400, {"errors": [{"message": "invalid JSON"}]})
+                return
+            records = payload if isinstance(payload, list) else [payload]
+            with lock:
+                state["attendance"] += len(records)
+                total = state["attendance"]
+            print(f"[stub] attendance +{len(records)} (total {total}, delay {delay} ms)")
+            self.reply(200, {"data": records})
+            return
+
+        self.reply(200, {"data": []})
+
+    def dispatch(self, method):
+        url = urlparse(self.path)
+        body = self.read_body()
+        if url.path.startswith("/stub/"):
+            self.handle_stub(url)
+        else:
+            self.handle_items(method, url, body)
+
+    def do_GET(self):
+        self.dispatch("GET")
+
+    def do_POST(self):
+        self.dispatch("POST")
+
+    def do_PATCH(self):
+        self.dispatch("PATCH")
+
+
+def read_commands():
+    for line in sys.stdin:
+        parts = line.split()
+        if not parts:
+            continue
+        if parts[0] == "delay" and len(parts) == 2:
+            with lock:
+                state["delay_ms"] = int(parts[1])
+        elif parts[0] == "idle-close" and len(parts) == 2:
+            with lock:
+                state["idle_close_ms"] = int(parts[1])
+        elif parts[0] == "reset":
+            reset_stats()
+        elif parts[0] != "stats":
+            print(__doc__)
+            continue
+        print(f"[stub] {snapshot()}")
+
+
+def main():
+    port = int(sys.argv[1]) if len(sys.argv) > 1 else 8055
+    if len(sys.argv) > 2:
+        state["delay_ms"] = int(sys.argv[2])
+
+    server = ThreadingHTTPServer(("0.0.0.0", port), Handler)
+    server.daemon_threads = True
+    print(f"[stub] Directus REST stub on :{port} (delay {state['delay_ms']} ms)")
+
+    threading.Thread(target=read_commands, daemon=True).start()
+    server.serve_forever()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,171 @@
+#!/usr/bin/env python3
+"""
+Stub Directus WebSocket server để test RealtimeClient không cần Directus thật.
+
+Chạy:  python3 test/directus-ws-stub.py [port]   (mặc định 8055)
+Trỏ DIRECTUS_URL trong config.h tới http://<IP máy này>:<port>.
+
+Server trả lời auth / subscribe / ping như Directus realtime, rồi đọc lệnh từ stdin
+và đẩy event xuống mọi client đã subscribe:
+
+  update <fingerprint-uuid> <slot> <member-uuid> <status> [template_hash]
+  create <fingerprint-uuid> <slot> <member-uuid> <status> [template_hash]
+  delete <fingerprint-uuid>
+  member-delete <member-uuid>
+  member-update <member-uuid>
+  ping
+"""
+
+import base64
+import hashlib
+import json
+import socket
+import struct
+import sys
+import threading
+
+WS_GUID = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+
+clients = []   # (socket, {collection: uid})
+lock = threading.Lock()
+
+
+def send_frame(sock, text):
+    data = text.encode()
+    header = bytearray([0x81])  # FIN + text
+    if len(data) < 126:
+        header.append(len(data))
+    elif len(data) < 65536:
+        header.append(126)
+        header += struct.pack(">H", len(data))
+    else:
+        header.append(127)
+        header += struct.pack(">Q", len(data))
+    sock.sendall(bytes(header) + data)
+
+
+def recv_exact(sock, n):
+    buf = b""
+    while len(buf) < n:
+        chunk = sock.recv(n - len(buf))
+        if not chunk:
+            raise ConnectionError
+        buf += chunk
+    return buf
+
+
+def recv_frame(sock):
+    b1, b2 = recv_exact(sock, 2)
+    opcode = b1 & 0x0F
+    length = b2 & 0x7F
+    if length == 126:
+        length = struct.unpack(">H", recv_exact(sock, 2))[0]
+    elif length == 127:
+        length = struct.unpack(">Q", recv_exact(sock, 8))[0]
+    mask = recv_exact(sock, 4) if b2 & 0x80 else b"\0\0\0\0"
+    payload = bytes(b ^ mask[i % 4] for i, b in enumerate(recv_exact(sock, length)))
+    return opcode, payload
+
+
+def handshake(sock):
+    request = b""
+    while b"\r\n\r\n" not in request:
+        chunk = sock.recv(1024)
+        if not chunk:
+            raise ConnectionError
+        request += chunk
+    key = ""
+    for line in request.decode(errors="ignore").split("\r\n"):
+        if line.lower().startswith("sec-websocket-key:"):
+            key = line.split(":", 1)[1].strip()
+    accept = base64.b64encode(hashlib.sha1((key + WS_GUID).encode()).digest()).decode()
+    sock.sendall(("HTTP/1.1 101 Switching Protocols\r\n"
+                  "Upgrade: websocket\r\nConnection: Upgrade\r\n"
+                  "Sec-WebSocket-Accept: " + accept + "\r\n\r\n").encode())
+
+
+def serve_client(sock, addr):
+    subscriptions = {}
+    try:
+        handshake(sock)
+        print(f"[stub] {addr[0]} connected")
+        with lock:
+            clients.append((sock, subscriptions))
+        while True:
+            opcode, payload = recv_frame(sock)
+            if opcode == 0x8:  # close
+                break
+            if opcode == 0x9:  # ping frame → pong frame
+                sock.sendall(bytes([0x8A, len(payload)]) + payload)
+                continue
+            if opcode != 0x1:
+                continue
+
+            message = json.loads(payload)
+            print(f"[stub] <- {message}")
+            kind = message.get("type")
+            if kind == "auth":
+                send_frame(sock, json.dumps({"type": "auth", "status": "ok"}))
+            elif kind == "subscribe":
+                subscriptions[message["collection"]] = message.get("uid")
+                send_frame(sock, json.dumps({"type": "subscription", "event": "init",
+                                             "data": [], "uid": message.get("uid")}))
+    except (ConnectionError, OSError, ValueError):
+        pass
+    finally:
+        with lock:
+            clients[:] = [c for c in clients if c[0] is not sock]
+        sock.close()
+        print(f"[stub] {addr[0]} disconnected")
+
+
+def broadcast(collection, event, data):
+    with lock:
+        for sock, subscriptions in clients:
+            if collection in subscriptions:
+                send_frame(sock, json.dumps({"type": "subscription", "event": event,
+                                             "data": data, "uid": subscriptions[collection]}))
+
+
+def read_commands():
+    for line in sys.stdin:
+        parts = line.split()
+        if not parts:
+            continue
+        cmd = parts[0]
+        if cmd in ("create", "update") and len(parts) >= 5:
+            record = {"id": parts[1], "finger_print_id": int(parts[2]),
+                      "member_id": parts[3], "status": parts[4]}
+            if len(parts) > 5:
+                record["template_hash"] = parts[5]
+            broadcast("member_fingerprints", cmd, [record])
+        elif cmd == "delete" and len(parts) == 2:
+            broadcast("member_fingerprints", "delete", [parts[1]])
+        elif cmd == "member-delete" and len(parts) == 2:
+            broadcast("members", "delete", [parts[1]])
+        elif cmd == "member-update" and len(parts) == 2:
+            broadcast("members", "update", [{"id": parts[1]}])
+        elif cmd == "ping":
+            with lock:
+                for sock, _ in clients:
+                    send_frame(sock, json.dumps({"type": "ping"}))
+        else:
+            print(__doc__)
+
+
+def main():
+    port = int(sys.argv[1]) if len(sys.argv) > 1 else 8055
+    server = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    server.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    server.bind(("0.0.0.0", port))
+    server.listen()
+    print(f"[stub] Directus WebSocket stub on :{port}/websocket")
+
+    threading.Thread(target=read_commands, daemon=True).start()
+    while True:
+        sock, addr = server.accept()
+        threading.Thread(target=serve_client, args=(sock, addr), daemon=True).start()
+
+
+if __name__ == "__main__":
+    main()
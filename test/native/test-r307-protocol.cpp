@@ -0,0 +1,280 @@
+/*
+ * TEST CODEC PACKET R307 TRÊN MÁY (NATIVE)
+ * Mục đích: Kiểm tra r307EncodePacket / R307PacketParser không cần ESP32:
+ *           round-trip, byte rác trước header, frame bị cắt, sai checksum,
+ *           payload vượt buffer và fuzz byte ngẫu nhiên (chạy cùng ASan / UBSan)
+ * Dùng khi: Sửa r307-protocol.cpp (chạy bằng quick-test.sh, chọn 5, hoặc ctest)
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include "r307-protocol.h"
+
+#define FUZZ_ROUND_TRIPS 200000
+#define FUZZ_RANDOM_BYTES 2000000
+#define MAX_PAYLOAD 600             // > R307_TEMPLATE_SIZE để có cả packet lớn
+
+static int failures = 0;
+
+#define CHECK(cond, ...)                                         \
+  do {                                                           \
+    if (!(cond)) {                                               \
+      failures++;                                                \
+      printf("  ✗ %s:%d: %s — ", __FILE__, __LINE__, #cond);    \
+      printf(__VA_ARGS__);                                       \
+      printf("\n");                                              \
+    }                                                            \
+  } while (0)
+
+static uint32_t lcgState = 12345;
+
+static uint32_t lcgNext() {
+  lcgState = lcgState * 1664525UL + 1013904223UL;
+  return lcgState >> 8;
+}
+
+/**
+ * Đưa cả buffer vào parser, trả về kết quả khác NEED_MORE đầu tiên
+ * @param consumed Số byte đã đưa vào tới lúc có kết quả
+ */
+static R307ParseResult feedAll(R307PacketParser& parser, const uint8_t* data, size_t length,
+                               size_t* consumed = nullptr) {
+  for (size_t i = 0; i < length; i++) {
+    R307ParseResult result = parser.feed(data[i]);
+    if (result != R307_PARSE_NEED_MORE) {
+      if (consumed) *consumed = i + 1;
+      return result;
+    }
+  }
+  if (consumed) *consumed = length;
+  return R307_PARSE_NEED_MORE;
+}
+
+static void testEncodeCommand() {
+  printf("→ Encode command\n");
+
+  // GenImg mẫu trong datasheet: EF 01 FF FF FF FF 01 00 03 01 00 05
+  const uint8_t expected[] = {0xEF, 0x01, 0xFF, 0xFF, 0xFF, 0xFF, 0x01, 0x00, 0x03, 0x01, 0x00, 0x05};
+  uint8_t out[32];
+  size_t n = r307EncodeCommand(out, sizeof(out), R307_CMD_GENIMG, nullptr, 0);
+  CHECK(n == sizeof(expected), "length %zu", n);
+  CHECK(memcmp(out, expected, sizeof(expected)) == 0, "GenImg bytes khác datasheet");
+
+  // Buffer thiếu 1 byte → không ghi gì
+  n = r307EncodeCommand(out, sizeof(expected) - 1, R307_CMD_GENIMG, nullptr, 0);
+  CHECK(n == 0, "buffer thiếu vẫn encode %zu byte", n);
+
+  // Params quá dài cho command
+  uint8_t params[20] = {0};
+  n = r307EncodeCommand(out, sizeof(out), R307_CMD_SEARCH, params, sizeof(params));
+  CHECK(n == 0, "params 20 byte vẫn encode %zu byte", n);
+}
+
+static void testRoundTrip() {
+  printf("→ Round-trip %d packet ngẫu nhiên\n", FUZZ_ROUND_TRIPS);
+
+  static uint8_t data[MAX_PAYLOAD];
+  static uint8_t frame[MAX_PAYLOAD + R307_FRAME_OVERHEAD];
+  static uint8_t payload[MAX_PAYLOAD];
+  const uint8_t pids[] = {R307_PID_COMMAND, R307_PID_DATA, R307_PID_ACK, R307_PID_END_DATA};
+
+  R307PacketParser parser;
+  parser.setPayloadBuffer(payload, sizeof(payload));
+
+  for (int i = 0; i < FUZZ_ROUND_TRIPS && failures == 0; i++) {
+    uint16_t length = lcgNext() % (MAX_PAYLOAD + 1);
+    uint8_t pid = pids[lcgNext() % 4];
+    uint32_t address = (lcgNext() & 1) ? R307_DEFAULT_ADDRESS : (lcgNext() << 8 | lcgNext());
+    for (uint16_t j = 0; j < length; j++) data[j] = lcgNext();
+
+    size_t n = r307EncodePacket(frame, sizeof(frame), pid, data, length, address);
+    CHECK(n == (size_t)length + R307_FRAME_OVERHEAD, "length %u → %zu", length, n);
+
+    size_t consumed = 0;
+    R307ParseResult result = feedAll(parser, frame, n, &consumed);
+    CHECK(result == R307_PARSE_PACKET, "round-trip %d: result %d", i, result);
+    CHECK(consumed == n, "packet kết thúc ở byte %zu / %zu", consumed, n);
+    CHECK(parser.pid() == pid, "pid %u != %u", parser.pid(), pid);
+    CHECK(parser.address() == address, "address %08X != %08X", parser.address(), address);
+    CHECK(parser.payloadLength() == length, "payload %u != %u", parser.payloadLength(), length);
+    CHECK(memcmp(parser.payload(), data, length) == 0, "payload khác ở round-trip %d", i);
+  }
+
+  // ACK code
+  const uint8_t ack[] = {0x00, 0x12};
+  size_t n = r307EncodePacket(frame, sizeof(frame), R307_PID_ACK, ack, sizeof(ack));
+  CHECK(feedAll(parser, frame, n) == R307_PARSE_PACKET, "ACK không parse được");
+  CHECK(parser.ackCode() == 0x00, "ackCode %02X", parser.ackCode());
+  n = r307EncodePacket(frame, sizeof(frame), R307_PID_DATA, ack, sizeof(ack));
+  CHECK(feedAll(parser, frame, n) == R307_PARSE_PACKET, "data packet không parse được");
+  CHECK(parser.ackCode() == 0xFF, "data packet có ackCode %02X", parser.ackCode());
+}
+
+static void testGarbagePrefix() {
+  printf("→ Byte rác trước header\n");
+
+  static uint8_t stream[64 + R307_TEMPLATE_SIZE + R307_FRAME_OVERHEAD];
+  static uint8_t data[R307_TEMPLATE_SIZE];
+  static uint8_t payload[R307_TEMPLATE_SIZE];
+  R307PacketParser parser;
+  parser.setPayloadBuffer(payload, sizeof(payload));
+
+  for (int i = 0; i < 20000 && failures == 0; i++) {
+    // Rác không chứa 0xEF 0x01 (nếu có thì đó là header thật, parser không thể phân biệt),
+    // nhưng hay kết thúc bằng 0xEF để kiểm tra "EF EF 01"
+    size_t garbage = lcgNext() % 64;
+    for (size_t j = 0; j < garbage; j++) {
+      uint8_t b = (lcgNext() % 4 == 0) ? 0xEF : lcgNext();
+      if (b == 0x01 && j > 0 && stream[j - 1] == 0xEF) b = 0x02;
+      stream[j] = b;
+    }
+
+    uint16_t length = lcgNext() % (R307_TEMPLATE_SIZE + 1);
+    for (uint16_t j = 0; j < length; j++) data[j] = lcgNext();
+    size_t n = r307EncodePacket(stream + garbage, sizeof(stream) - garbage,
+                                R307_PID_DATA, data, length);
+
+    parser.reset();
+    size_t consumed = 0;
+    R307ParseResult result = feedAll(parser, stream, garbage + n, &consumed);
+    CHECK(result == R307_PARSE_PACKET, "garbage %zu byte: result %d", garbage, result);
+    CHECK(consumed == garbage + n, "kết thúc ở byte %zu / %zu", consumed, garbage + n);
+    CHECK(parser.payloadLength() == length && memcmp(parser.payload(), data, length) == 0,
+          "payload sai sau %zu byte rác", garbage);
+  }
+}
+
+static void testTruncatedFrame() {
+  printf("→ Frame bị cắt\n");
+
+  uint8_t data[R307_TEMPLATE_SIZE];
+  uint8_t frame[R307_TEMPLATE_SIZE + R307_FRAME_OVERHEAD];
+  uint8_t payload[R307_TEMPLATE_SIZE];
+  for (size_t j = 0; j < sizeof(data); j++) data[j] = lcgNext();
+  size_t n = r307EncodePacket(frame, sizeof(frame), R307_PID_DATA, data, sizeof(data));
+
+  R307PacketParser parser;
+  parser.setPayloadBuffer(payload, sizeof(payload));
+
+  // Mọi độ dài cắt: không bao giờ báo packet hoàn chỉnh
+  for (size_t cut = 0; cut < n; cut++) {
+    parser.reset();
+    CHECK(feedAll(parser, frame, cut) == R307_PARSE_NEED_MORE, "cắt ở %zu vẫn có kết quả", cut);
+
+    // Timeout ở caller → reset() → packet kế tiếp parse bình thường
+    parser.reset();
+    CHECK(feedAll(parser, frame, n) == R307_PARSE_PACKET, "sau reset ở %zu không parse được", cut);
+  }
+
+  // Frame cắt rồi frame mới không reset: parser không được ghi quá buffer,
+  // và sau khi bỏ frame hỏng phải bắt lại được frame kế tiếp
+  for (size_t cut = 1; cut < n && failures == 0; cut += 7) {
+    parser.reset();
+    feedAll(parser, frame, cut);
+    bool recovered = false;
+    for (int attempt = 0; attempt < 3 && !recovered; attempt++) {
+      recovered = feedAll(parser, frame, n) == R307_PARSE_PACKET &&
+                  parser.payloadLength() == sizeof(data) &&
+                  memcmp(parser.payload(), data, sizeof(data)) == 0;
+    }
+    CHECK(recovered, "không bắt lại được frame sau khi cắt ở %zu", cut);
+  }
+}
+
+static void testCorruptFrames() {
+  printf("→ Sai checksum / payload vượt buffer / length hỏng\n");
+
+  uint8_t frame[64];
+  uint8_t payload[8];
+  const uint8_t data[] = {0x00, 0x01, 0x02, 0x03};
+  size_t n = r307EncodePacket(frame, sizeof(frame), R307_PID_ACK, data, sizeof(data));
+
+  R307PacketParser parser;
+  parser.setPayloadBuffer(payload, sizeof(payload));
+
+  // Lật 1 bit ở mỗi byte sau header → không được trả PACKET với dữ liệu sai
+  for (size_t pos = 2; pos < n; pos++) {
+    for (uint8_t bit = 0; bit < 8; bit++) {
+      uint8_t corrupt[64];
+      memcpy(corrupt, frame, n);
+      corrupt[pos] ^= (1 << bit);
+      parser.reset();
+      R307ParseResult result = feedAll(parser, corrupt, n);
+      bool addressByte = pos >= 2 && pos < 6;  // Address không nằm trong checksum
+      if (addressByte) {
+        CHECK(result == R307_PARSE_PACKET, "lật bit address %zu: result %d", pos, result);
+      } else {
+        CHECK(result != R307_PARSE_PACKET, "lật bit %u ở byte %zu vẫn PACKET", bit, pos);
+      }
+    }
+  }
+
+  // Payload lớn hơn buffer → OVERFLOW, không ghi vào buffer
+  uint8_t big[32] = {0};
+  uint8_t guard[sizeof(payload)];
+  memset(payload, 0xAA, sizeof(payload));
+  memcpy(guard, payload, sizeof(payload));
+  n = r307EncodePacket(frame, sizeof(frame), R307_PID_DATA, big, sizeof(big));
+  parser.reset();
+  CHECK(feedAll(parser, frame, n) == R307_PARSE_OVERFLOW, "payload 32 byte vào buffer 8 byte");
+  CHECK(memcmp(payload, guard, sizeof(payload)) == 0, "OVERFLOW nhưng buffer bị ghi");
+
+  // Length < 2 (không đủ chỗ cho checksum) → bỏ frame, parse được frame sau
+  const uint8_t badLength[] = {0xEF, 0x01, 0xFF, 0xFF, 0xFF, 0xFF, 0x07, 0x00, 0x01};
+  n = r307EncodePacket(frame, sizeof(frame), R307_PID_ACK, data, sizeof(data));
+  parser.reset();
+  CHECK(feedAll(parser, badLength, sizeof(badLength)) == R307_PARSE_NEED_MORE, "length 1");
+  CHECK(feedAll(parser, frame, n) == R307_PARSE_PACKET, "không parse được frame sau length 1");
+
+  // Payload rỗng (length = 2)
+  n = r307EncodePacket(frame, sizeof(frame), R307_PID_ACK, nullptr, 0);
+  parser.reset();
+  CHECK(feedAll(parser, frame, n) == R307_PARSE_PACKET, "packet rỗng");
+  CHECK(parser.payloadLength() == 0 && parser.ackCode() == 0xFF, "packet rỗng có payload");
+}
+
+static void testRandomBytes() {
+  printf("→ Fuzz %d byte ngẫu nhiên\n", FUZZ_RANDOM_BYTES);
+
+  // Buffer nhỏ hơn max length để đi qua cả nhánh OVERFLOW; ASan bắt ghi quá buffer
+  uint8_t* payload = new uint8_t[64];
+  R307PacketParser parser;
+  parser.setPayloadBuffer(payload, 64);
+
+  unsigned long packets = 0, checksumErrors = 0, overflows = 0;
+  for (int i = 0; i < FUZZ_RANDOM_BYTES; i++) {
+    // Thiên về byte header để parser hay vào frame
+    uint32_t r = lcgNext();
+    uint8_t b = (r % 8 == 0) ? 0xEF : (r % 8 == 1) ? 0x01 : (r % 8 == 2) ? 0x00 : (uint8_t)(r >> 8);
+    switch (parser.feed(b)) {
+      case R307_PARSE_PACKET:
+        packets++;
+        CHECK(parser.payloadLength() <= 64, "payload %u > buffer", parser.payloadLength());
+        break;
+      case R307_PARSE_CHECKSUM_ERROR: checksumErrors++; break;
+      case R307_PARSE_OVERFLOW: overflows++; break;
+      default: break;
+    }
+  }
+  delete[] payload;
+  printf("  %lu packet, %lu sai checksum, %lu overflow\n", packets, checksumErrors, overflows);
+}
+
+int main() {
+  printf("=== R307 protocol (native) ===\n");
+
+  testEncodeCommand();
+  testRoundTrip();
+  testGarbagePrefix();
+  testTruncatedFrame();
+  testCorruptFrames();
+  testRandomBytes();
+
+  if (failures > 0) {
+    printf("✗ %d lỗi\n", failures);
+    return 1;
+  }
+  printf("✓ Tất cả test đều qua\n");
+  return 0;
+}
@@ -0,0 +1,352 @@
+/*
+ * TEST UPCHAR VỚI R307 GIẢ LẬP TRÊN MÁY (NATIVE)
+ * Mục đích: Chạy luồng downloadModel() (UpChar → ACK → data packets → R307DataReceiver)
+ *           với sensor giả lập: mọi packet size 32/64/128/256, thời gian truyền trên
+ *           UART 57600, và lỗi: sai checksum, mất byte, sai PID, thừa data, mất packet,
+ *           sensor từ chối, byte rác giữa các packet, fuzz lật bit
+ * Dùng khi: Sửa R307DataReceiver / FingerprintHandler::downloadModel()
+ *           (chạy bằng quick-test.sh, chọn 5, hoặc ctest)
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include "r307-protocol.h"
+
+#define SIM_BAUD 57600
+#define SIM_BITS_PER_BYTE 10        // 8N1
+#define SIM_STREAM_MAX 4096
+#define SIM_ACK_PAYLOAD 64
+#define SIM_CODE_UPLOAD_FAIL 0x0D   // R307: lỗi upload template (CharBuffer rỗng)
+#define FUZZ_ITERATIONS 20000
+
+static int failures = 0;
+
+#define CHECK(cond, ...)                                         \
+  do {                                                           \
+    if (!(cond)) {                                               \
+      failures++;                                                \
+      printf("  ✗ %s:%d: %s — ", __FILE__, __LINE__, #cond);    \
+      printf(__VA_ARGS__);                                       \
+      printf("\n");                                              \
+    }                                                            \
+  } while (0)
+
+static uint32_t lcgState = 54321;
+
+static uint32_t lcgNext() {
+  lcgState = lcgState * 1664525UL + 1013904223UL;
+  return lcgState >> 8;
+}
+
+// Lỗi sensor giả lập chèn vào packet thứ faultPacket (0 = packet data đầu tiên)
+enum SimFault {
+  FAULT_NONE,
+  FAULT_CHECKSUM,     // Checksum sai
+  FAULT_TRUNCATE,     // Dừng gửi giữa packet (UART mất byte → timeout)
+  FAULT_WRONG_PID,    // Gửi ACK thay vì DATA
+  FAULT_EXTRA_DATA,   // Gửi thêm 1 DATA packet trước END_DATA (> 512 byte)
+  FAULT_DROP_PACKET,  // Bỏ hẳn 1 packet (header nhiễu → parser không thấy)
+  FAULT_GARBAGE       // Byte rác (không chứa header) trước mỗi packet
+};
+
+/**
+ * R307 giả lập phía sensor: nhận command frame, trả về byte stream
+ * ACK + data packets đúng như sensor gửi lên UART
+ */
+struct SimSensor {
+  uint8_t charBuffer[3][R307_TEMPLATE_SIZE];  // CharBuffer 1 / 2 (index 0 bỏ trống)
+  bool filled[3];
+  uint16_t packetSize;
+  SimFault fault;
+  uint16_t faultPacket;
+
+  uint8_t stream[SIM_STREAM_MAX];
+  size_t length;
+
+  void reset(uint16_t size) {
+    memset(filled, 0, sizeof(filled));
+    packetSize = size;
+    fault = FAULT_NONE;
+    faultPacket = 0;
+    length = 0;
+  }
+
+  void fill(uint8_t slot) {
+    for (size_t i = 0; i < R307_TEMPLATE_SIZE; i++) charBuffer[slot][i] = lcgNext();
+    filled[slot] = true;
+  }
+
+  void emit(uint8_t pid, const uint8_t* data, uint16_t size) {
+    length += r307EncodePacket(stream + length, sizeof(stream) - length, pid, data, size);
+  }
+
+  void ack(uint8_t code) {
+    emit(R307_PID_ACK, &code, 1);
+  }
+
+  void handle(const uint8_t* command, size_t commandLength) {
+    length = 0;
+    uint8_t payload[16];
+    R307PacketParser parser;
+    parser.setPayloadBuffer(payload, sizeof(payload));
+
+    R307ParseResult result = R307_PARSE_NEED_MORE;
+    for (size_t i = 0; i < commandLength && result == R307_PARSE_NEED_MORE; i++) {
+      result = parser.feed(command[i]);
+    }
+    if (result != R307_PARSE_PACKET || parser.pid() != R307_PID_COMMAND ||
+        parser.payloadLength() != 2 || payload[0] != R307_CMD_UPCHAR) {
+      ack(0x01);  // Lỗi nhận packet
+      return;
+    }
+
+    uint8_t slot = payload[1];
+    if (slot < 1 || slot > 2 || !filled[slot]) {
+      ack(SIM_CODE_UPLOAD_FAIL);
+      return;
+    }
+    ack(0x00);
+
+    const uint8_t* data = charBuffer[slot];
+    uint16_t packets = R307_TEMPLATE_SIZE / packetSize;
+    for (uint16_t k = 0; k < packets; k++) {
+      uint8_t pid = (k == packets - 1) ? R307_PID_END_DATA : R307_PID_DATA;
+      const uint8_t* chunk = data + k * packetSize;
+
+      if (fault == FAULT_GARBAGE) {
+        uint8_t noise = lcgNext() % 16;
+        for (uint8_t j = 0; j < noise; j++) stream[length++] = (lcgNext() % 2) ? 0xEF : 0x55;
+      }
+      if (k == faultPacket) {
+        if (fault == FAULT_DROP_PACKET) continue;
+        if (fault == FAULT_EXTRA_DATA && pid == R307_PID_END_DATA) {
+          emit(R307_PID_DATA, chunk, packetSize);
+        }
+        if (fault == FAULT_WRONG_PID) pid = R307_PID_ACK;
+      }
+
+      size_t start = length;
+      emit(pid, chunk, packetSize);
+
+      if (k == faultPacket && fault == FAULT_CHECKSUM) stream[length - 1] ^= 0x01;
+      if (k == faultPacket && fault == FAULT_TRUNCATE) {
+        length = start + (length - start) / 2;
+        return;  // Sensor im lặng → host timeout
+      }
+    }
+  }
+};
+
+// Kết quả 1 lần download phía host
+struct SimDownload {
+  bool acked;
+  uint8_t ackCode;
+  R307DataStatus status;
+  uint16_t received;
+  uint16_t packets;
+  size_t wireBytes;    // Byte trên UART cả 2 chiều
+  double wireMs;       // Thời gian truyền ở SIM_BAUD
+};
+
+/**
+ * Cùng trình tự với FingerprintHandler::downloadModel(): gửi UpChar, chờ ACK,
+ * rồi đưa byte vào R307DataReceiver. Hết stream = hết thời gian chờ (receivePacket
+ * trả NEED_MORE)
+ */
+static SimDownload simDownload(SimSensor& sensor, uint8_t slot, uint8_t* buffer) {
+  SimDownload out = {};
+  uint8_t command[32];
+  size_t commandLength = r307EncodeCommand(command, sizeof(command), R307_CMD_UPCHAR, &slot, 1);
+  sensor.handle(command, commandLength);
+
+  size_t pos = 0;
+  uint8_t ackPayload[SIM_ACK_PAYLOAD];
+  R307PacketParser ackParser;
+  ackParser.setPayloadBuffer(ackPayload, sizeof(ackPayload));
+  R307ParseResult result = R307_PARSE_NEED_MORE;
+  while (pos < sensor.length && result == R307_PARSE_NEED_MORE) {
+    result = ackParser.feed(sensor.stream[pos++]);
+  }
+  out.acked = result == R307_PARSE_PACKET && ackParser.pid() == R307_PID_ACK;
+  out.ackCode = ackParser.ackCode();
+
+  if (out.acked && out.ackCode == 0x00) {
+    R307DataReceiver receiver(buffer, R307_TEMPLATE_SIZE);
+    while (true) {
+      result = R307_PARSE_NEED_MORE;
+      while (pos < sensor.length && result == R307_PARSE_NEED_MORE) {
+        result = receiver.parser().feed(sensor.stream[pos++]);
+      }
+      out.status = receiver.onPacket(result);
+      if (out.status != R307_DATA_MORE) break;
+    }
+    out.received = receiver.received();
+    out.packets = receiver.packets();
+  }
+
+  out.wireBytes = commandLength + pos;
+  out.wireMs = out.wireBytes * SIM_BITS_PER_BYTE * 1000.0 / SIM_BAUD;
+  return out;
+}
+
+static const uint16_t PACKET_SIZES[] = {32, 64, 128, 256};
+
+static void testDownload() {
+  printf("→ Download template, packet size 32/64/128/256, CharBuffer 1 và 2\n");
+
+  // Cấp phát đúng R307_TEMPLATE_SIZE: ghi quá buffer → ASan báo lỗi
+  uint8_t* buffer = new uint8_t[R307_TEMPLATE_SIZE];
+  static SimSensor sensor;
+
+  for (uint16_t size : PACKET_SIZES) {
+    sensor.reset(size);
+    sensor.fill(1);
+    sensor.fill(2);
+    for (uint8_t slot = 1; slot <= 2; slot++) {
+      memset(buffer, 0, R307_TEMPLATE_SIZE);
+      SimDownload d = simDownload(sensor, slot, buffer);
+      CHECK(d.acked && d.ackCode == 0x00, "size %u slot %u: ACK %02X", size, slot, d.ackCode);
+      CHECK(d.status == R307_DATA_DONE, "size %u slot %u: status %d", size, slot, d.status);
+      CHECK(d.received == R307_TEMPLATE_SIZE, "size %u: %u byte", size, d.received);
+      CHECK(d.packets == R307_TEMPLATE_SIZE / size, "size %u: %u packet", size, d.packets);
+      CHECK(memcmp(buffer, sensor.charBuffer[slot], R307_TEMPLATE_SIZE) == 0,
+            "size %u slot %u: template khác CharBuffer", size, slot);
+      if (slot == 1) {
+        printf("  packet %3u byte: %2u packet, %4zu byte trên UART, %.1f ms @ %d baud\n",
+               size, d.packets, d.wireBytes, d.wireMs, SIM_BAUD);
+      }
+    }
+  }
+
+  // CharBuffer rỗng → sensor từ chối, host không đọc data
+  sensor.reset(128);
+  SimDownload d = simDownload(sensor, 1, buffer);
+  CHECK(d.acked && d.ackCode == SIM_CODE_UPLOAD_FAIL, "CharBuffer rỗng: ACK %02X", d.ackCode);
+  CHECK(d.received == 0, "CharBuffer rỗng nhưng nhận %u byte", d.received);
+
+  delete[] buffer;
+}
+
+static void testFaults() {
+  printf("→ Lỗi ở từng packet: checksum, mất byte, sai PID, thừa data, mất packet, rác\n");
+
+  struct Expect {
+    SimFault fault;
+    R307DataStatus status;
+    const char* name;
+  };
+  const Expect expects[] = {
+    {FAULT_CHECKSUM, R307_DATA_CHECKSUM_ERROR, "checksum"},
+    {FAULT_TRUNCATE, R307_DATA_TIMEOUT, "mất byte"},
+    {FAULT_WRONG_PID, R307_DATA_BAD_PID, "sai PID"},
+    {FAULT_DROP_PACKET, R307_DATA_INCOMPLETE, "mất packet"},
+  };
+
+  uint8_t* buffer = new uint8_t[R307_TEMPLATE_SIZE];
+  static SimSensor sensor;
+
+  for (uint16_t size : PACKET_SIZES) {
+    uint16_t packets = R307_TEMPLATE_SIZE / size;
+    for (const Expect& e : expects) {
+      for (uint16_t k = 0; k < packets; k++) {
+        sensor.reset(size);
+        sensor.fill(1);
+        sensor.fault = e.fault;
+        sensor.faultPacket = k;
+        SimDownload d = simDownload(sensor, 1, buffer);
+
+        // Mất packet cuối (END_DATA) → không có gì kết thúc chuỗi → timeout
+        R307DataStatus expected = (e.fault == FAULT_DROP_PACKET && k == packets - 1)
+            ? R307_DATA_TIMEOUT : e.status;
+        CHECK(d.status == expected, "%s size %u packet %u: status %d (cần %d)",
+              e.name, size, k, d.status, expected);
+        CHECK(d.status == R307_DATA_DONE || d.received <= R307_TEMPLATE_SIZE,
+              "%s: received %u", e.name, d.received);
+      }
+    }
+
+    // Sensor gửi thừa 1 packet → OVERFLOW, không ghi quá buffer (ASan)
+    sensor.reset(size);
+    sensor.fill(1);
+    sensor.fault = FAULT_EXTRA_DATA;
+    sensor.faultPacket = packets - 1;
+    SimDownload d = simDownload(sensor, 1, buffer);
+    CHECK(d.status == R307_DATA_OVERFLOW, "thừa data size %u: status %d", size, d.status);
+
+    // Byte rác giữa các packet (nhiễu UART) → parser bỏ qua, template vẫn đúng
+    sensor.reset(size);
+    sensor.fill(1);
+    sensor.fault = FAULT_GARBAGE;
+    d = simDownload(sensor, 1, buffer);
+    CHECK(d.status == R307_DATA_DONE &&
+          memcmp(buffer, sensor.charBuffer[1], R307_TEMPLATE_SIZE) == 0,
+          "rác size %u: status %d", size, d.status);
+  }
+
+  delete[] buffer;
+}
+
+static void testBitFlips() {
+  printf("→ Fuzz %d lần lật 1 bit trong stream data\n", FUZZ_ITERATIONS);
+
+  uint8_t* buffer = new uint8_t[R307_TEMPLATE_SIZE];
+  static SimSensor sensor;
+  unsigned long done = 0, rejected = 0;
+
+  for (int i = 0; i < FUZZ_ITERATIONS && failures == 0; i++) {
+    uint16_t size = PACKET_SIZES[lcgNext() % 4];
+    sensor.reset(size);
+    sensor.fill(1);
+
+    // Sinh stream chuẩn, lật 1 bit sau ACK (12 byte đầu), rồi phát lại stream đó
+    uint8_t command[32];
+    uint8_t slot = 1;
+    size_t commandLength = r307EncodeCommand(command, sizeof(command), R307_CMD_UPCHAR, &slot, 1);
+    sensor.handle(command, commandLength);
+    const size_t ackLength = 1 + R307_FRAME_OVERHEAD;
+    size_t pos = ackLength + lcgNext() % (sensor.length - ackLength);
+    uint8_t flipped = sensor.stream[pos] ^ (1 << (lcgNext() % 8));
+
+    R307DataReceiver receiver(buffer, R307_TEMPLATE_SIZE);
+    size_t p = ackLength;
+    R307DataStatus status;
+    while (true) {
+      R307ParseResult result = R307_PARSE_NEED_MORE;
+      while (p < sensor.length && result == R307_PARSE_NEED_MORE) {
+        uint8_t b = (p == pos) ? flipped : sensor.stream[p];
+        p++;
+        result = receiver.parser().feed(b);
+      }
+      status = receiver.onPacket(result);
+      if (status != R307_DATA_MORE) break;
+    }
+
+    // Không bao giờ được nhận template sai mà báo thành công
+    if (status == R307_DATA_DONE) {
+      done++;
+      CHECK(receiver.received() == R307_TEMPLATE_SIZE &&
+            memcmp(buffer, sensor.charBuffer[1], R307_TEMPLATE_SIZE) == 0,
+            "lật bit byte %zu (size %u) vẫn DONE với template sai", pos, size);
+    } else {
+      rejected++;
+    }
+  }
+  delete[] buffer;
+  printf("  %lu DONE (bit ở address, template đúng), %lu bị từ chối\n", done, rejected);
+}
+
+int main() {
+  printf("=== UpChar với R307 giả lập (native) ===\n");
+
+  testDownload();
+  testFaults();
+  testBitFlips();
+
+  if (failures > 0) {
+    printf("✗ %d lỗi\n", failures);
+    return 1;
+  }
+  printf("✓ Tất cả test đều qua\n");
+  return 0;
+}
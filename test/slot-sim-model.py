@@ -0,0 +1,143 @@
+#!/usr/bin/env python3
+"""
+Mô hình Python của test/test-slot-sim.cpp: ước lượng hit rate slot cache không cần ESP32.
+
+Chạy:  python3 test/slot-sim-model.py
+
+Replay cùng lịch check-in (cùng LCG, cùng seed, 2.500 member, 14 ngày) với bản chép tay
+của chính sách SlotManager::preload() + chooseVictim():
+  - Mỗi giờ: member check-in trong SLOT_PRELOAD_DAYS ngày, mới nhất trước, tối đa
+    SLOT_PRELOAD_RECENT_MAX member, bỏ member đã nằm trên sensor, nạp tối đa SLOT_PRELOAD_MAX
+  - Slot trống trước, không thì evict slot có lastHit cũ nhất nếu cũ hơn lần check-in
+    của member; không có → dừng
+  - Scan: hit → lastHit = giờ scan
+In hit rate tuần 2 so với sensor giữ cố định template enroll tại device (code cũ).
+
+Chỉ là mô hình để so với số sketch in ra trên board: không đọc slot-manager.cpp,
+sửa chính sách ở firmware thì phải sửa cả ở đây.
+"""
+
+SIM_MEMBERS = 2500
+SIM_DAYS = 14
+SIM_START = 1791158400          # 2026-10-05 00:00 (thứ Hai)
+SIM_SEED = 20261005
+DAY_SECONDS = 86400
+
+REGULAR_PCT, CASUAL_PCT = 20, 50
+REGULAR_PERMILLE, CASUAL_PERMILLE, RARE_PERMILLE = 714, 143, 36
+
+PRELOAD_INTERVAL = 3600         # SLOT_PRELOAD_INTERVAL_MS / 1000
+PRELOAD_MAX = 10                # SLOT_PRELOAD_MAX
+PRELOAD_DAYS = 7                # SLOT_PRELOAD_DAYS
+PRELOAD_RECENT_MAX = 100        # SLOT_PRELOAD_RECENT_MAX
+
+CAPACITIES = (1000, 500)
+
+
+class Lcg:
+    """Cùng LCG với lcgNext() / lcgRange() trong sketch."""
+
+    def __init__(self, seed):
+        self.state = seed
+
+    def next(self):
+        self.state = (self.state * 1664525 + 1013904223) & 0xFFFFFFFF
+        return self.state >> 8
+
+    def range(self, lo, hi):
+        return lo + self.next() % (hi - lo + 1)
+
+
+def run(capacity):
+    lcg = Lcg(SIM_SEED)
+    permille = []
+    for _ in range(SIM_MEMBERS):
+        roll = lcg.range(0, 99)
+        permille.append(REGULAR_PERMILLE if roll < REGULAR_PCT
+                        else CASUAL_PERMILLE if roll < REGULAR_PCT + CASUAL_PCT
+                        else RARE_PERMILLE)
+
+    last_check_in = [0] * SIM_MEMBERS
+    local_count = capacity - 1
+
+    # Trạng thái đầu: sensor đầy template enroll tại device (member 0..capacity-2)
+    occupant = {slot: slot - 1 for slot in range(1, local_count + 1)}
+    slot_of = {member: slot for slot, member in occupant.items()}
+    last_hit = {slot: 0 for slot in occupant}
+
+    weeks = [dict(visits=0, hits=0, static=0, loads=0, evictions=0) for _ in range(2)]
+
+    def preload(now, week):
+        since = now - PRELOAD_DAYS * DAY_SECONDS
+        recent = [m for m in range(SIM_MEMBERS) if last_check_in[m] and last_check_in[m] >= since]
+        recent.sort(key=lambda m: -last_check_in[m])
+        loaded = 0
+        for member in recent[:PRELOAD_RECENT_MAX]:
+            if loaded >= PRELOAD_MAX:
+                break
+            if member in slot_of:
+                continue
+            free = [slot for slot in range(1, capacity) if slot not in occupant]
+            if free:
+                victim, evicting = free[0], False
+            else:
+                victim = min(range(1, capacity), key=lambda slot: (last_hit[slot], slot))
+                if last_hit[victim] >= last_check_in[member]:
+                    break   # Không slot nào lạnh hơn member này
+                evicting = True
+                del slot_of[occupant[victim]]
+            occupant[victim] = member
+            slot_of[member] = victim
+            last_hit[victim] = last_check_in[member]
+            week["loads"] += 1
+            week["evictions"] += evicting
+            loaded += 1
+
+    for day in range(SIM_DAYS):
+        week = weeks[day // 7]
+        day_start = SIM_START + day * DAY_SECONDS
+
+        # Lịch check-in 1 ngày: sáng 6-9h (40%) hoặc tối 17-21h (60%)
+        visits = []
+        for member in range(SIM_MEMBERS):
+            if lcg.range(0, 999) >= permille[member]:
+                continue
+            offset = (lcg.range(6 * 3600, 9 * 3600 - 1) if lcg.range(0, 99) < 40
+                      else lcg.range(17 * 3600, 21 * 3600 - 1))
+            visits.append((day_start + offset, member))
+        visits.sort(key=lambda visit: visit[0])
+
+        next_preload = day_start
+        for i in range(len(visits) + 1):
+            t = visits[i][0] if i < len(visits) else day_start + DAY_SECONDS
+            while next_preload <= t and next_preload < day_start + DAY_SECONDS:
+                preload(next_preload, week)
+                next_preload += PRELOAD_INTERVAL
+            if i == len(visits):
+                break
+
+            member = visits[i][1]
+            week["visits"] += 1
+            if member in slot_of:
+                week["hits"] += 1
+                last_hit[slot_of[member]] = t
+            if member < local_count:
+                week["static"] += 1
+            last_check_in[member] = t
+
+    return weeks
+
+
+def main():
+    for capacity in CAPACITIES:
+        for number, week in enumerate(run(capacity), 1):
+            print("Capacity %4d, tuần %d: %5d check-in, hit %5.1f%% (cố định %5.1f%%), "
+                  "load %4d, evict %4d" % (
+                      capacity, number, week["visits"],
+                      100.0 * week["hits"] / week["visits"],
+                      100.0 * week["static"] / week["visits"],
+                      week["loads"], week["evictions"]))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,181 @@
+/*
+ * TEST ĐỘ TRỄ ACCESS DECISION KHI SERVER CHẬM
+ * Mục đích: Đo thời gian verifyFingerprint() (member cache hit → LED/buzzer) khi log
+ *           attendance đồng bộ (code cũ) và qua AttendanceLogger, với độ trễ server
+ *           0 / 1000 / 3000 ms, và kiểm tra không mất record (kể cả khi spill)
+ * Dùng khi: Sửa attendance-logger.cpp / DirectusClient::verifyFingerprint()
+ *           (chạy bằng quick-test.sh, chọn 7)
+ *
+ * Cần: python3 test/directus-http-stub.py trên máy cùng mạng,
+ *      DIRECTUS_URL trong config.h trỏ tới stub, WIFI_SSID / WIFI_PASSWORD đúng
+ * ⚠ Xóa record offline queue trên thiết bị trước khi chạy
+ */
+
+#include <Arduino.h>
+#include "wifi-manager.h"
+#include "http-client.h"
+#include "offline-queue.h"
+#include "member-cache.h"
+#include "directus-client.h"
+#include "attendance-logger.h"
+
+#define SIM_SLOT 42
+#define SIM_FINGERPRINT_UUID "5d2f8e1a-7b3c-4d9e-a1f0-2b4c6d8e0f12"
+#define SIM_MEMBER_UUID "9a8b7c6d-5e4f-4a3b-8c2d-1e0f9a8b7c6d"
+#define SIM_CONFIDENCE 120
+#define SIM_SCAN_GAP_MS 200         // Người sau đặt tay ngay khi người trước xong
+#define SIM_MAX_SCANS 32
+#define SIM_MAX_DECISION_MS 50      // Async: decision không được chờ HTTP
+#define SIM_DRAIN_TIMEOUT_MS 120000 // Chờ stub nhận đủ record sau mỗi kịch bản
+
+struct Scenario {
+  const char* name;
+  bool async;
+  uint32_t serverDelayMs;
+  uint8_t scans;
+};
+
+const Scenario SCENARIOS[] = {
+  {"Đồng bộ (code cũ), server 0 ms", false, 0, 10},
+  {"Đồng bộ (code cũ), server 1000 ms", false, 1000, 10},
+  {"Đồng bộ (code cũ), server 3000 ms", false, 3000, 5},
+  {"Async logger, server 0 ms", true, 0, 10},
+  {"Async logger, server 1000 ms", true, 1000, 10},
+  {"Async logger, server 3000 ms", true, 3000, 10},
+  // Vượt ATTENDANCE_QUEUE_LENGTH khi server chậm → spill xuống OfflineQueue
+  {"Async logger, server 3000 ms, 32 scan liên tiếp (spill)", true, 3000, SIM_MAX_SCANS},
+};
+
+WiFiManager wifi;
+HTTPClientManager http;
+OfflineQueue offlineQueue;
+MemberCache memberCache;
+DirectusClient directus(&http, &wifi, &offlineQueue, &memberCache);
+AttendanceLogger logger(&directus, &offlineQueue);
+
+uint32_t latencies[SIM_MAX_SCANS];
+int passed = 0;
+int failed = 0;
+
+// Gọi endpoint điều khiển của stub, trả về số attendance stub đã nhận (-1 nếu lỗi)
+long stubCall(const String& path) {
+  JsonDocument doc;
+  String url = String(DIRECTUS_URL) + path;
+  if (http.getJSON(url.c_str(), doc) != 200) return -1;
+  return doc["attendance"] | -1L;
+}
+
+uint32_t nearestRank(uint8_t count, uint8_t pct) {
+  if (count == 0) return 0;
+  uint16_t rank = (count * pct + 99) / 100;
+  return latencies[rank - 1];
+}
+
+void runScenario(const Scenario& sc) {
+  Serial.printf("\n→ %s\n", sc.name);
+
+  directus.setAttendanceLogger(sc.async ? &logger : nullptr);
+  stubCall("/stub/reset");
+  stubCall("/stub/delay?ms=" + String(sc.serverDelayMs));
+  uint32_t spilledBefore = logger.getSpilledCount();
+
+  String memberId;
+  for (uint8_t i = 0; i < sc.scans; i++) {
+    unsigned long start = millis();
+    bool access = directus.verifyFingerprint(wifi.getMACAddress(), SIM_SLOT, "",
+                                             SIM_CONFIDENCE, memberId);
+    latencies[i] = millis() - start;
+    if (!access) Serial.println("  ⚠ access denied (member cache?)");
+    delay(SIM_SCAN_GAP_MS);
+  }
+  uint32_t spilled = logger.getSpilledCount() - spilledBefore;
+
+  // Chờ logger task gửi hết; record spill nằm trong OfflineQueue → flush như khi có mạng
+  unsigned long waitStart = millis();
+  long received = 0;
+  while (millis() - waitStart < SIM_DRAIN_TIMEOUT_MS) {
+    if (logger.getPendingCount() == 0 && offlineQueue.getPendingCount() > 0) {
+      offlineQueue.flush(&http, DIRECTUS_URL);
+    }
+    received = stubCall("/stub/stats");
+    if (received >= sc.scans) break;
+    delay(500);
+  }
+  unsigned long drainMs = millis() - waitStart;
+  stubCall("/stub/delay?ms=0");
+
+  // Sắp xếp tăng dần để lấy p50 / max
+  for (uint8_t i = 1; i < sc.scans; i++) {
+    uint32_t value = latencies[i];
+    int j = i - 1;
+    while (j >= 0 && latencies[j] > value) {
+      latencies[j + 1] = latencies[j];
+      j--;
+    }
+    latencies[j + 1] = value;
+  }
+  uint32_t p50 = nearestRank(sc.scans, 50);
+  uint32_t maxMs = latencies[sc.scans - 1];
+
+  Serial.printf("  decision p50=%lums max=%lums | stub nhận %ld/%d record sau %lums, spill=%lu\n",
+                (unsigned long)p50, (unsigned long)maxMs, received, sc.scans, drainMs,
+                (unsigned long)spilled);
+
+  if (!sc.async) {
+    Serial.println("  (mốc so sánh)");
+    return;
+  }
+
+  bool ok = maxMs <= SIM_MAX_DECISION_MS && received == sc.scans;
+  if (ok) {
+    passed++;
+    Serial.println("  ✓ PASS");
+  } else {
+    failed++;
+    Serial.printf("  ✗ FAIL (cần max <= %dms và stub nhận đủ %d record)\n",
+                  SIM_MAX_DECISION_MS, sc.scans);
+  }
+}
+
+void setup()
+{
+  Serial.begin(115200);
+  delay(2000);
+
+  Serial.println("\n╔═══════════════════════════════════╗");
+  Serial.println("║  TEST ĐỘ TRỄ ACCESS DECISION      ║");
+  Serial.println("╚═══════════════════════════════════╝");
+
+  if (!wifi.connect()) {
+    Serial.println("✗ WiFi không kết nối được");
+    return;
+  }
+  offlineQueue.begin();
+  offlineQueue.clear();
+  memberCache.begin();
+  // Chỉ trong RAM (không save) → không đụng member cache thật trên flash
+  memberCache.put(SIM_SLOT, SIM_FINGERPRINT_UUID, SIM_MEMBER_UUID, MEMBER_ACTIVE);
+
+  if (stubCall("/stub/reset") < 0) {
+    Serial.printf("✗ Không gọi được stub tại %s (chạy test/directus-http-stub.py)\n", DIRECTUS_URL);
+    return;
+  }
+  String deviceId = directus.registerDevice(wifi.getMACAddress(), "ESP32-LATENCY-TEST",
+                                            wifi.getIPAddress());
+  if (!logger.begin(deviceId)) {
+    Serial.println("✗ Logger init failed");
+    return;
+  }
+
+  for (const Scenario& sc : SCENARIOS) {
+    runScenario(sc);
+  }
+  directus.setAttendanceLogger(nullptr);
+
+  Serial.printf("\n=== Kết quả: %d PASS, %d FAIL ===\n", passed, failed);
+}
+
+void loop()
+{
+  delay(1000);
+}
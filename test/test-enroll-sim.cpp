@@ -0,0 +1,268 @@
+/*
+ * TEST ENROLL STATE MACHINE VỚI SENSOR GIẢ LẬP
+ * Mục đích: Chạy toàn bộ luồng EnrollSession (ảnh gốc → nhấc tay → ảnh so khớp ... → store)
+ *           không cần R307: multi-capture, timeout, cancel, vân tay không khớp, trùng slot
+ * Dùng khi: Sửa enroll-session.cpp / command-handler.cpp (chạy bằng quick-test.sh, chọn 3)
+ */
+
+#include <Arduino.h>
+#include <Adafruit_Fingerprint.h>
+#include "enroll-session.h"
+
+#define SIM_FINGER_TIMEOUT_MS 1500
+#define SIM_LIFT_TIMEOUT_MS 1000
+#define SIM_MAX_STEP_MS 50     // step() không được chặn sensor task lâu hơn mức này
+#define SIM_ENROLL_ID 7
+#define SIM_POOR -1            // Capture lỗi image2Tz (ảnh kém)
+
+// Ngón tay có / không có trên sensor trong ms
+struct FingerPhase {
+  bool present;
+  unsigned long ms;
+};
+
+/**
+ * Sensor giả lập: mỗi lần đặt tay (capture) có điểm Match định sẵn so với ảnh gốc
+ * CharBuffer chỉ lưu số thứ tự capture → kiểm tra được model tạo từ cặp nào
+ */
+class SimulatedSensor : public EnrollSensor {
+public:
+  const FingerPhase* phases;
+  uint8_t phaseCount;
+  bool cycle;               // true: lặp lại script (đặt / nhấc tay liên tục)
+  const int* scores;        // Điểm của từng capture (index 0 = capture 1)
+  uint8_t scoreCount;
+  unsigned long startedAt;
+  uint8_t modelResult;
+  int storedId;
+  uint8_t led;
+  uint8_t captureIndex;     // Capture hiện tại trong ImageBuffer
+  bool freshImage;
+  uint8_t buffers[3];       // CharBuffer1 / 2 → capture index
+  uint8_t modelPair;        // Capture trong CharBuffer2 khi createModel
+  uint16_t residentSlot;    // Slot đã có cùng ngón tay trong database (0 = không có)
+
+  void reset(const FingerPhase* script, uint8_t count, bool repeat,
+             const int* captureScores, uint8_t captureCount, uint8_t model,
+             uint16_t resident) {
+    phases = script;
+    phaseCount = count;
+    cycle = repeat;
+    scores = captureScores;
+    scoreCount = captureCount;
+    startedAt = millis();
+    modelResult = model;
+    storedId = -1;
+    led = 0;
+    captureIndex = 0;
+    freshImage = false;
+    memset(buffers, 0, sizeof(buffers));
+    modelPair = 0;
+    residentSlot = resident;
+  }
+
+  bool fingerPresent() {
+    unsigned long elapsed = millis() - startedAt;
+    if (cycle) {
+      unsigned long total = 0;
+      for (uint8_t i = 0; i < phaseCount; i++) total += phases[i].ms;
+      elapsed %= total;
+    }
+    for (uint8_t i = 0; i < phaseCount - 1; i++) {
+      if (elapsed < phases[i].ms) return phases[i].present;
+      elapsed -= phases[i].ms;
+    }
+    return phases[phaseCount - 1].present;
+  }
+
+  int scoreOf(uint8_t capture) {
+    if (capture == 0 || capture > scoreCount) return 0;
+    return scores[capture - 1];
+  }
+
+  uint8_t getImage() override {
+    if (!fingerPresent()) return FINGERPRINT_NOFINGER;
+    freshImage = true;
+    return FINGERPRINT_OK;
+  }
+
+  uint8_t image2Tz(uint8_t charBuffer) override {
+    if (freshImage) {
+      captureIndex++;
+      freshImage = false;
+    }
+    if (scoreOf(captureIndex) == SIM_POOR) return FINGERPRINT_IMAGEMESS;
+    buffers[charBuffer] = captureIndex;
+    return FINGERPRINT_OK;
+  }
+
+  uint8_t match(uint16_t* score) override {
+    int value = scoreOf(buffers[2]);
+    *score = value > 0 ? value : 0;
+    return value > 0 ? FINGERPRINT_OK : FINGERPRINT_NOMATCH;
+  }
+
+  uint8_t createModel() override {
+    modelPair = buffers[2];
+    return modelResult;
+  }
+
+  uint8_t search(uint16_t* id, uint16_t* score) override {
+    *id = residentSlot;
+    *score = residentSlot ? 150 : 0;
+    return residentSlot ? FINGERPRINT_OK : FINGERPRINT_NOTFOUND;
+  }
+
+  uint8_t storeModel(uint16_t id) override {
+    storedId = id;
+    return FINGERPRINT_OK;
+  }
+
+  void setLed(uint8_t color) override {
+    led = color;
+  }
+
+  bool saveCharBuffer(uint8_t charBuffer, uint8_t* data, uint16_t* size) override {
+    data[0] = buffers[charBuffer];
+    *size = 1;
+    return true;
+  }
+
+  bool loadCharBuffer(uint8_t charBuffer, const uint8_t* data, uint16_t size) override {
+    buffers[charBuffer] = data[0];
+    return true;
+  }
+};
+
+SimulatedSensor sensor;
+int passed = 0;
+int failed = 0;
+
+// Người dùng làm đúng: đặt tay, nhấc tay, đặt lại ... (lặp)
+const FingerPhase TAPPING[] = {{false, 300}, {true, 300}};
+const FingerPhase NEVER_PLACED[] = {{false, 0}};
+const FingerPhase NEVER_LIFTED[] = {{true, 0}};
+
+struct Scenario {
+  const char* name;
+  const FingerPhase* phases;
+  uint8_t phaseCount;
+  bool cycle;
+  const int* scores;
+  uint8_t scoreCount;
+  uint8_t captures;         // Số lần đặt tay tối đa của session
+  uint8_t modelResult;
+  EnrollState cancelAt;     // ENROLL_IDLE = không cancel
+  EnrollState expected;
+  int expectedStored;
+  uint8_t expectedPair;     // Capture trong CharBuffer2 khi tạo model (0 = không kiểm tra)
+  uint8_t expectedCaptures; // Số lần đặt tay thực tế (0 = không kiểm tra)
+  uint16_t residentSlot;    // Ngón tay đã có ở slot này (0 = chưa đăng ký)
+  bool replaceExisting;
+};
+
+void runScenario(const Scenario& sc) {
+  Serial.printf("\n→ %s\n", sc.name);
+  sensor.reset(sc.phases, sc.phaseCount, sc.cycle, sc.scores, sc.scoreCount, sc.modelResult,
+               sc.residentSlot);
+
+  EnrollSession session(&sensor);
+  session.setTimeouts(SIM_FINGER_TIMEOUT_MS, SIM_LIFT_TIMEOUT_MS);
+  session.start(SIM_ENROLL_ID, sc.captures, sc.replaceExisting);
+
+  unsigned long maxStepMs = 0;
+  unsigned long startedAt = millis();
+  while (session.isActive() && millis() - startedAt < 10000) {
+    if (sc.cancelAt != ENROLL_IDLE && session.getState() == sc.cancelAt) {
+      session.cancel();
+      break;
+    }
+    unsigned long stepStart = millis();
+    session.step();
+    maxStepMs = max(maxStepMs, millis() - stepStart);
+    delay(10);
+  }
+
+  EnrollState state = session.getState();
+  const EnrollStats& stats = session.getStats();
+  bool ok = state == sc.expected &&
+            sensor.storedId == sc.expectedStored &&
+            sensor.led == 0 &&
+            maxStepMs <= SIM_MAX_STEP_MS &&
+            (sc.expectedPair == 0 || sensor.modelPair == sc.expectedPair) &&
+            (sc.expectedCaptures == 0 || stats.captures == sc.expectedCaptures) &&
+            // Search khớp chính slot đang enroll (update) không phải duplicate
+            session.getDuplicateId() == (sc.residentSlot == SIM_ENROLL_ID ? 0 : sc.residentSlot);
+
+  Serial.printf("  state=%s error=\"%s\" stored=%d pair=%d captures=%d/%d "
+                "poor=%d mismatch=%d best=%d max_step=%lums\n",
+                EnrollSession::stateName(state), session.getError(), sensor.storedId,
+                sensor.modelPair, stats.captures, stats.maxCaptures,
+                stats.rejectedQuality, stats.rejectedMatch, stats.bestScore, maxStepMs);
+  if (ok) {
+    passed++;
+    Serial.println("  ✓ PASS");
+  } else {
+    failed++;
+    Serial.printf("  ✗ FAIL (expected %s, stored=%d)\n",
+                  EnrollSession::stateName(sc.expected), sc.expectedStored);
+  }
+}
+
+// Điểm Match của từng capture so với ảnh gốc (capture 1 là ảnh gốc)
+const int PAIR_OK[] = {0, 80};
+const int PAIR_BAD[] = {0, 10};
+const int KEEP_BEST[] = {0, 60, 90, 70};
+const int EARLY_STOP[] = {0, 120, 80, 80};
+const int SKIP_POOR[] = {0, SIM_POOR, 80};
+const int ALL_POOR[] = {SIM_POOR, SIM_POOR, SIM_POOR};
+
+const Scenario SCENARIOS[] = {
+  {"2 lần: đăng ký thành công", TAPPING, 2, true, PAIR_OK, 2, 2,
+   FINGERPRINT_OK, ENROLL_IDLE, ENROLL_DONE, SIM_ENROLL_ID, 2, 2},
+  {"Không đặt tay → timeout capture_1", NEVER_PLACED, 1, false, PAIR_OK, 2, 2,
+   FINGERPRINT_OK, ENROLL_IDLE, ENROLL_TIMEOUT, -1, 0, 0},
+  {"Không nhấc tay → timeout lift", NEVER_LIFTED, 1, false, PAIR_OK, 2, 2,
+   FINGERPRINT_OK, ENROLL_IDLE, ENROLL_TIMEOUT, -1, 0, 0},
+  {"2 lần: điểm Match thấp → failed", TAPPING, 2, true, PAIR_BAD, 2, 2,
+   FINGERPRINT_OK, ENROLL_IDLE, ENROLL_FAILED, -1, 0, 2},
+  {"createModel không khớp → failed", TAPPING, 2, true, PAIR_OK, 2, 2,
+   FINGERPRINT_ENROLLMISMATCH, ENROLL_IDLE, ENROLL_FAILED, -1, 0, 2},
+  {"Cancel khi chờ nhấc tay", NEVER_LIFTED, 1, false, PAIR_OK, 2, 2,
+   FINGERPRINT_OK, ENROLL_LIFT, ENROLL_CANCELLED, -1, 0, 0},
+  {"4 lần: model từ ảnh điểm cao nhất (lần 3)", TAPPING, 2, true, KEEP_BEST, 4, 4,
+   FINGERPRINT_OK, ENROLL_IDLE, ENROLL_DONE, SIM_ENROLL_ID, 3, 4},
+  {"4 lần: dừng sớm khi đạt điểm tốt", TAPPING, 2, true, EARLY_STOP, 4, 4,
+   FINGERPRINT_OK, ENROLL_IDLE, ENROLL_DONE, SIM_ENROLL_ID, 2, 2},
+  {"3 lần: loại ảnh kém, dùng ảnh tiếp theo", TAPPING, 2, true, SKIP_POOR, 3, 3,
+   FINGERPRINT_OK, ENROLL_IDLE, ENROLL_DONE, SIM_ENROLL_ID, 3, 3},
+  {"3 lần: toàn ảnh kém → failed", TAPPING, 2, true, ALL_POOR, 3, 3,
+   FINGERPRINT_OK, ENROLL_IDLE, ENROLL_FAILED, -1, 0, 2},
+  {"Ngón tay đã có ở slot 42 → duplicate, không lưu", TAPPING, 2, true, PAIR_OK, 2, 2,
+   FINGERPRINT_OK, ENROLL_IDLE, ENROLL_DUPLICATE, -1, 2, 2, 42, false},
+  {"Trùng slot 42 + replace_existing → vẫn lưu", TAPPING, 2, true, PAIR_OK, 2, 2,
+   FINGERPRINT_OK, ENROLL_IDLE, ENROLL_DONE, SIM_ENROLL_ID, 2, 2, 42, true},
+  {"Update: template cũ còn ở chính slot → lưu đè", TAPPING, 2, true, PAIR_OK, 2, 2,
+   FINGERPRINT_OK, ENROLL_IDLE, ENROLL_DONE, SIM_ENROLL_ID, 2, 2, SIM_ENROLL_ID, false},
+};
+
+void setup()
+{
+  Serial.begin(115200);
+  delay(2000);
+
+  Serial.println("\n╔═══════════════════════════════════╗");
+  Serial.println("║  TEST ENROLL STATE MACHINE (SIM)  ║");
+  Serial.println("╚═══════════════════════════════════╝");
+
+  for (const Scenario& sc : SCENARIOS) {
+    runScenario(sc);
+  }
+
+  Serial.printf("\n=== Kết quả: %d PASS, %d FAIL ===\n", passed, failed);
+}
+
+void loop()
+{
+  delay(1000);
+}
@@ -0,0 +1,164 @@
+/*
+ * BENCHMARK HTTP KEEP-ALIVE TỚI STUB DIRECTUS
+ * Mục đích: Đo latency từng request (avg / p50 / p99) của HTTPClientManager khi mở
+ *           TCP mới mỗi request (code cũ) và khi giữ connection keep-alive, đếm số
+ *           connection server thực sự nhận; kiểm tra tự reconnect khi server đóng
+ *           connection idle
+ * Dùng khi: Sửa http-client.cpp / HTTP_KEEP_ALIVE (chạy bằng quick-test.sh, chọn 8)
+ *
+ * Cần: python3 test/directus-http-stub.py trên máy cùng mạng,
+ *      DIRECTUS_URL trong config.h trỏ tới stub, WIFI_SSID / WIFI_PASSWORD đúng
+ */
+
+#include <Arduino.h>
+#include "wifi-manager.h"
+#include "http-client.h"
+
+#define SIM_REQUESTS 50
+#define SIM_GET_PATH "/items/members?limit=1"
+#define SIM_POST_PATH "/items/attendance"
+#define SIM_IDLE_CLOSE_MS 500       // Stub đóng connection idle sau 500 ms
+#define SIM_IDLE_GAP_MS 1000        // → mọi request trong kịch bản idle gặp connection đã đóng
+
+struct Scenario {
+  const char* name;
+  bool keepAlive;
+  bool post;
+  uint32_t gapMs;          // Nghỉ giữa các request
+  uint32_t idleCloseMs;    // 0 = stub không đóng connection
+};
+
+const Scenario SCENARIOS[] = {
+  {"GET, mỗi request 1 connection (code cũ)", false, false, 0, 0},
+  {"GET, keep-alive", true, false, 0, 0},
+  {"POST, mỗi request 1 connection (code cũ)", false, true, 0, 0},
+  {"POST, keep-alive", true, true, 0, 0},
+  {"GET, keep-alive, server đóng connection idle", true, false, SIM_IDLE_GAP_MS, SIM_IDLE_CLOSE_MS},
+};
+
+WiFiManager wifi;
+HTTPClientManager http;      // Client đang đo
+HTTPClientManager control;   // Gọi /stub/... (không keep-alive, không lẫn vào thống kê)
+
+uint32_t latencies[SIM_REQUESTS];
+uint32_t baselineP50[2];     // p50 code cũ theo [post]
+int passed = 0;
+int failed = 0;
+
+long stubCall(const String& path, const char* field) {
+  JsonDocument doc;
+  String url = String(DIRECTUS_URL) + path;
+  if (control.getJSON(url.c_str(), doc) != 200) return -1;
+  return doc[field] | -1L;
+}
+
+uint32_t nearestRank(uint16_t count, uint8_t pct) {
+  if (count == 0) return 0;
+  uint16_t rank = (count * pct + 99) / 100;
+  return latencies[rank - 1];
+}
+
+void runScenario(const Scenario& sc) {
+  Serial.printf("\n→ %s\n", sc.name);
+
+  http.setKeepAlive(false);  // Đóng connection cũ → kịch bản nào cũng bắt đầu từ 0
+  http.setKeepAlive(sc.keepAlive);
+  stubCall("/stub/idle-close?ms=" + String(sc.idleCloseMs), "connections");
+  stubCall("/stub/reset", "connections");
+  HTTPConnectionStats before = http.getStats();
+
+  String url = String(DIRECTUS_URL) + (sc.post ? SIM_POST_PATH : SIM_GET_PATH);
+  String payload = "{\"member_id\":\"9a8b7c6d-5e4f-4a3b-8c2d-1e0f9a8b7c6d\",\"access_granted\":true}";
+  uint16_t ok = 0;
+  uint64_t total = 0;
+
+  for (uint16_t i = 0; i < SIM_REQUESTS; i++) {
+    String response;
+    unsigned long start = millis();
+    int code = sc.post ? http.post(url.c_str(), payload, response)
+                       : http.get(url.c_str(), response);
+    latencies[i] = millis() - start;
+    total += latencies[i];
+    if (code == 200) ok++;
+    if (sc.gapMs) delay(sc.gapMs);
+  }
+
+  HTTPConnectionStats after = http.getStats();
+  // Lệnh /stub/stats của control mở thêm 1 connection
+  long connections = stubCall("/stub/stats", "connections") - 1;
+  stubCall("/stub/idle-close?ms=0", "connections");
+
+  for (uint16_t i = 1; i < SIM_REQUESTS; i++) {
+    uint32_t value = latencies[i];
+    int j = i - 1;
+    while (j >= 0 && latencies[j] > value) {
+      latencies[j + 1] = latencies[j];
+      j--;
+    }
+    latencies[j + 1] = value;
+  }
+  uint32_t p50 = nearestRank(SIM_REQUESTS, 50);
+  uint32_t p99 = nearestRank(SIM_REQUESTS, 99);
+
+  Serial.printf("  ok=%d/%d avg=%lums p50=%lums p99=%lums | server nhận %ld connection\n",
+                ok, SIM_REQUESTS, (unsigned long)(total / SIM_REQUESTS),
+                (unsigned long)p50, (unsigned long)p99, connections);
+  Serial.printf("  client: reused=%lu new=%lu staleRetries=%lu\n",
+                (unsigned long)(after.reused - before.reused),
+                (unsigned long)(after.newConnections - before.newConnections),
+                (unsigned long)(after.staleRetries - before.staleRetries));
+
+  if (!sc.keepAlive) {
+    baselineP50[sc.post] = p50;
+    Serial.println("  (mốc so sánh)");
+    return;
+  }
+
+  bool pass;
+  if (sc.idleCloseMs) {
+    // Server đóng giữa mọi request: không request nào được lỗi
+    pass = ok == SIM_REQUESTS;
+  } else {
+    pass = ok == SIM_REQUESTS && connections <= 1 && p50 < baselineP50[sc.post];
+  }
+  if (pass) {
+    passed++;
+    Serial.println("  ✓ PASS");
+  } else {
+    failed++;
+    Serial.println(sc.idleCloseMs
+        ? "  ✗ FAIL (cần mọi request trả 200)"
+        : "  ✗ FAIL (cần mọi request 200, 1 connection, p50 thấp hơn code cũ)");
+  }
+}
+
+void setup()
+{
+  Serial.begin(115200);
+  delay(2000);
+
+  Serial.println("\n╔═══════════════════════════════════╗");
+  Serial.println("║  BENCHMARK HTTP KEEP-ALIVE        ║");
+  Serial.println("╚═══════════════════════════════════╝");
+
+  if (!wifi.connect()) {
+    Serial.println("✗ WiFi không kết nối được");
+    return;
+  }
+  control.setKeepAlive(false);
+  if (stubCall("/stub/reset", "connections") < 0) {
+    Serial.printf("✗ Không gọi được stub tại %s (chạy test/directus-http-stub.py)\n", DIRECTUS_URL);
+    return;
+  }
+
+  for (const Scenario& sc : SCENARIOS) {
+    runScenario(sc);
+  }
+
+  Serial.printf("\n=== Kết quả: %d PASS, %d FAIL ===\n", passed, failed);
+}
+
+void loop()
+{
+  delay(1000);
+}
@@ -0,0 +1,361 @@
+/*
+ * BENCHMARK OFFLINE QUEUE: SEGMENT LOG vs MỖI RECORD 1 FILE (CODE CŨ)
+ * Mục đích: Đo enqueue / count / drain (dequeue + pop) và dung lượng LittleFS
+ *           của OfflineQueue (segment append-only) so với queue cũ /queue/NNNNNN.json
+ *           ở 100, 1.000 và 10.000 record, trên LittleFS thật của ESP32; kiểm tra
+ *           recover() sau reboot không bỏ sót record (drain rỗng → reboot → nhiều segment)
+ * Dùng khi: Sửa offline-queue.cpp hoặc QUEUE_SEGMENT_ENTRIES / QUEUE_CHECKPOINT_INTERVAL
+ *           (chạy bằng quick-test.sh, chọn 6)
+ *
+ * ⚠ Xóa toàn bộ /queue trên thiết bị (record offline chưa gửi sẽ mất)
+ *
+ * Queue cũ mỗi thao tác quét cả thư mục → 10.000 record cần ~N²/2 lần đọc
+ * directory entry và vượt dung lượng partition. Queue cũ dừng khi hết
+ * SIM_LEGACY_BUDGET_MS hoặc LittleFS đầy; kết quả in số record đạt được
+ * và chi phí / record ở 100 record đầu vs 100 record cuối (đường tăng O(n))
+ */
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <ArduinoJson.h>
+#include <vector>
+#include "offline-queue.h"
+
+#define SIM_LEGACY_DIR "/bench-legacy"   // Không dùng /queue: OfflineQueue sẽ migrate file cũ
+#define SIM_LEGACY_BUDGET_MS 300000      // Thời gian tối đa mỗi pha của queue cũ
+#define SIM_WINDOW 100                   // Cửa sổ đo chi phí đầu / cuối
+#define SIM_ENDPOINT "/items/attendance"
+
+const uint32_t SIZES[] = {100, 1000, 10000};
+
+// Kết quả một lần chạy (1 implementation, 1 kích thước)
+struct BenchResult {
+  uint32_t target;
+  uint32_t enqueued;        // Số record enqueue được (queue cũ có thể dừng sớm)
+  uint32_t stored;          // getPendingCount() sau khi enqueue
+  uint32_t enqueueMs;
+  uint32_t firstWindowUs;   // Trung bình / record, SIM_WINDOW record đầu
+  uint32_t lastWindowUs;    // Trung bình / record, SIM_WINDOW record cuối
+  uint32_t countUs;
+  uint32_t drained;
+  uint32_t drainMs;
+  uint32_t usedBytes;       // LittleFS.usedBytes() tăng thêm khi queue đầy nhất
+  const char* stopReason;   // nullptr = chạy đủ
+};
+
+int passed = 0;
+int failed = 0;
+
+String makePayload(uint32_t i) {
+  JsonDocument doc;
+  doc["member_id"] = "6f1c2b9e-3a4d-4e5f-8a7b-0c1d2e3f4a5b";
+  doc["device_id"] = "a1b2c3d4-e5f6-4789-abcd-ef0123456789";
+  doc["fingerprint_id"] = (int)(i % 1000) + 1;
+  doc["confidence"] = 120;
+  doc["check_in_time"] = "2026-10-16T07:30:00";
+  String out;
+  serializeJson(doc, out);
+  return out;
+}
+
+/**
+ * Queue cũ (baseline), giữ nguyên thuật toán: 1 file JSON / record,
+ * tên file = số thứ tự, mọi thao tác đều quét cả thư mục.
+ * Bỏ giới hạn MAX_QUEUE_SIZE=100 cũ để so sánh ở cùng kích thước
+ */
+class LegacyQueue {
+public:
+  void begin() {
+    if (!LittleFS.exists(SIM_LEGACY_DIR)) LittleFS.mkdir(SIM_LEGACY_DIR);
+  }
+
+  bool enqueue(const String& endpoint, const String& method, const String& payload) {
+    JsonDocument doc;
+    doc["endpoint"] = endpoint;
+    doc["method"] = method;
+    doc["payload"] = payload;
+    doc["timestamp"] = millis() / 1000;
+    doc["retries"] = 0;
+
+    File file = LittleFS.open(nextFilename(), "w");
+    if (!file) return false;
+    size_t written = serializeJson(doc, file);
+    file.close();
+    return written > 0;
+  }
+
+  // dequeue() + remove() như vòng flush() cũ
+  bool dequeueAndRemove(QueueEntry& entry) {
+    String filename = oldestFilename();
+    if (filename.length() == 0) return false;
+
+    File file = LittleFS.open(filename, "r");
+    if (!file) return false;
+    JsonDocument doc;
+    DeserializationError error = deserializeJson(doc, file);
+    file.close();
+    if (!error) {
+      entry.endpoint = doc["endpoint"].as<String>();
+      entry.payload = doc["payload"].as<String>();
+    }
+    return LittleFS.remove(filename);
+  }
+
+  int getPendingCount() {
+    int count = 0;
+    File root = LittleFS.open(SIM_LEGACY_DIR);
+    if (!root) return 0;
+    File file = root.openNextFile();
+    while (file) {
+      if (!file.isDirectory()) count++;
+      file = root.openNextFile();
+    }
+    return count;
+  }
+
+  // Xóa theo danh sách (không quét lại thư mục cho từng file)
+  void clear() {
+    std::vector<String> paths;
+    File root = LittleFS.open(SIM_LEGACY_DIR);
+    if (!root) return;
+    File file = root.openNextFile();
+    while (file) {
+      paths.push_back(String(SIM_LEGACY_DIR) + "/" + file.name());
+      file = root.openNextFile();
+    }
+    root.close();
+    for (const String& path : paths) LittleFS.remove(path);
+  }
+
+private:
+  String nextFilename() {
+    int maxNum = 0;
+    File root = LittleFS.open(SIM_LEGACY_DIR);
+    if (root) {
+      File file = root.openNextFile();
+      while (file) {
+        int num = String(file.name()).toInt();
+        if (num > maxNum) maxNum = num;
+        file = root.openNextFile();
+      }
+    }
+    char filename[40];
+    snprintf(filename, sizeof(filename), "%s/%06d.json", SIM_LEGACY_DIR, maxNum + 1);
+    return String(filename);
+  }
+
+  String oldestFilename() {
+    int minNum = INT_MAX;
+    String oldest = "";
+    File root = LittleFS.open(SIM_LEGACY_DIR);
+    if (!root) return "";
+    File file = root.openNextFile();
+    while (file) {
+      String name = file.name();
+      int num = name.toInt();
+      if (num < minNum) {
+        minNum = num;
+        oldest = String(SIM_LEGACY_DIR) + "/" + name;
+      }
+      file = root.openNextFile();
+    }
+    return oldest;
+  }
+};
+
+OfflineQueue segmentQueue;
+LegacyQueue legacyQueue;
+
+/**
+ * Enqueue tới target record, đo từng record để lấy chi phí cửa sổ đầu / cuối
+ * legacy=true: dừng khi hết SIM_LEGACY_BUDGET_MS hoặc ghi lỗi (LittleFS đầy)
+ */
+void runEnqueue(bool legacy, BenchResult& r) {
+  size_t usedBefore = LittleFS.usedBytes();
+  uint64_t firstSum = 0;
+  uint32_t lastTimes[SIM_WINDOW];
+  unsigned long start = millis();
+
+  for (uint32_t i = 0; i < r.target; i++) {
+    String payload = makePayload(i);
+    unsigned long t0 = micros();
+    bool ok = legacy ? legacyQueue.enqueue(SIM_ENDPOINT, "POST", payload)
+                     : segmentQueue.enqueue(SIM_ENDPOINT, "POST", payload);
+    uint32_t us = micros() - t0;
+
+    if (!ok) {
+      r.stopReason = "ghi lỗi (LittleFS đầy)";
+      break;
+    }
+    if (i < SIM_WINDOW) firstSum += us;
+    lastTimes[r.enqueued % SIM_WINDOW] = us;
+    r.enqueued++;
+
+    if (legacy && millis() - start > SIM_LEGACY_BUDGET_MS) {
+      r.stopReason = "hết thời gian";
+      break;
+    }
+    if (r.enqueued % 500 == 0) delay(1);  // Nhường idle task (watchdog)
+  }
+  r.enqueueMs = millis() - start;
+  r.usedBytes = LittleFS.usedBytes() - usedBefore;
+
+  uint32_t window = r.enqueued < SIM_WINDOW ? r.enqueued : SIM_WINDOW;
+  uint64_t lastSum = 0;
+  for (uint32_t i = 0; i < window; i++) lastSum += lastTimes[i];
+  r.firstWindowUs = window ? firstSum / window : 0;
+  r.lastWindowUs = window ? lastSum / window : 0;
+
+  unsigned long t0 = micros();
+  r.stored = legacy ? legacyQueue.getPendingCount() : segmentQueue.getPendingCount();
+  r.countUs = micros() - t0;
+}
+
+void runDrain(bool legacy, BenchResult& r) {
+  unsigned long start = millis();
+  QueueEntry entry;
+  while (true) {
+    bool ok;
+    if (legacy) {
+      ok = legacyQueue.dequeueAndRemove(entry);
+    } else {
+      ok = segmentQueue.dequeue(entry) && segmentQueue.pop();
+    }
+    if (!ok) break;
+    r.drained++;
+
+    if (legacy && millis() - start > SIM_LEGACY_BUDGET_MS) {
+      r.stopReason = r.stopReason ? r.stopReason : "hết thời gian (drain)";
+      break;
+    }
+    if (r.drained % 500 == 0) delay(1);
+  }
+  r.drainMs = millis() - start;
+}
+
+BenchResult runBench(bool legacy, uint32_t target) {
+  BenchResult r = {};
+  r.target = target;
+  if (legacy) legacyQueue.clear(); else segmentQueue.clear();
+
+  runEnqueue(legacy, r);
+  runDrain(legacy, r);
+  if (legacy) legacyQueue.clear();
+
+  Serial.printf("  %-8s N=%-5lu enqueued=%lu stored=%lu enqueue=%lums (%lu → %lu us/record)\n",
+                legacy ? "cũ" : "segment", (unsigned long)target,
+                (unsigned long)r.enqueued, (unsigned long)r.stored,
+                (unsigned long)r.enqueueMs, (unsigned long)r.firstWindowUs,
+                (unsigned long)r.lastWindowUs);
+  Serial.printf("           count=%luus drain=%lu records / %lums flash=%lu bytes%s%s\n",
+                (unsigned long)r.countUs, (unsigned long)r.drained,
+                (unsigned long)r.drainMs, (unsigned long)r.usedBytes,
+                r.stopReason ? " — dừng: " : "", r.stopReason ? r.stopReason : "");
+  return r;
+}
+
+void check(bool ok, const char* what) {
+  if (ok) {
+    passed++;
+    Serial.printf("  ✓ PASS %s\n", what);
+  } else {
+    failed++;
+    Serial.printf("  ✗ FAIL %s\n", what);
+  }
+}
+
+int countSegmentFiles() {
+  int count = 0;
+  File root = LittleFS.open(QUEUE_DIR);
+  if (!root) return 0;
+  File file = root.openNextFile();
+  while (file) {
+    if (String(file.name()).startsWith("seg-")) count++;
+    file = root.openNextFile();
+  }
+  return count;
+}
+
+/**
+ * Drain tới rỗng → reboot → enqueue nhiều segment → reboot: checkpoint của lần drain
+ * trước không được trỏ vào segment mới (bỏ sót record, đọc giữa dòng)
+ * Reboot = OfflineQueue mới + begin() → recover() đọc lại thư mục và checkpoint
+ */
+void runRecoverTest() {
+  const uint32_t n = QUEUE_SEGMENT_ENTRIES * 3 + 10;
+  Serial.printf("\n→ Recover: drain rỗng → reboot → %lu record → reboot\n", (unsigned long)n);
+
+  segmentQueue.clear();
+  QueueEntry entry;
+  for (uint32_t i = 0; i < 5; i++) segmentQueue.enqueue(SIM_ENDPOINT, "POST", makePayload(i));
+  while (segmentQueue.dequeue(entry) && segmentQueue.pop()) {}
+
+  OfflineQueue* rebooted = new OfflineQueue();
+  rebooted->begin();
+  bool emptyOk = rebooted->getPendingCount() == 0;
+  for (uint32_t i = 0; i < n; i++) rebooted->enqueue(SIM_ENDPOINT, "POST", makePayload(i));
+  delete rebooted;
+
+  rebooted = new OfflineQueue();
+  rebooted->begin();
+  uint32_t pending = rebooted->getPendingCount();
+  uint32_t inOrder = 0;
+  while (rebooted->dequeue(entry)) {
+    if (entry.payload == makePayload(inOrder)) inOrder++;
+    rebooted->pop();
+  }
+  int leftover = countSegmentFiles();
+  delete rebooted;
+
+  Serial.printf("  pending sau reboot=%lu/%lu, drain đúng thứ tự=%lu, segment còn lại=%d\n",
+                (unsigned long)pending, (unsigned long)n, (unsigned long)inOrder, leftover);
+  check(emptyOk && pending == n && inOrder == n && leftover == 0,
+        "recover: không mất record, không sót segment sau reboot");
+
+  segmentQueue.clear();
+}
+
+void setup()
+{
+  Serial.begin(115200);
+  delay(2000);
+
+  Serial.println("\n╔═══════════════════════════════════╗");
+  Serial.println("║  BENCHMARK OFFLINE QUEUE          ║");
+  Serial.println("╚═══════════════════════════════════╝");
+
+  if (!segmentQueue.begin()) {
+    Serial.println("✗ LittleFS mount failed");
+    return;
+  }
+  legacyQueue.begin();
+  Serial.printf("LittleFS: %lu / %lu bytes đã dùng, MAX_QUEUE_SIZE=%d, segment=%d record\n",
+                (unsigned long)LittleFS.usedBytes(), (unsigned long)LittleFS.totalBytes(),
+                MAX_QUEUE_SIZE, QUEUE_SEGMENT_ENTRIES);
+
+  for (uint32_t n : SIZES) {
+    Serial.printf("\n→ %lu record\n", (unsigned long)n);
+    BenchResult seg = runBench(false, n);
+    BenchResult old = runBench(true, n);
+
+    // Vượt MAX_QUEUE_SIZE → record cũ nhất bị bỏ, queue giữ đúng MAX_QUEUE_SIZE
+    uint32_t expected = n < MAX_QUEUE_SIZE ? n : MAX_QUEUE_SIZE;
+    check(seg.enqueued == n && seg.stored == expected && seg.drained == expected,
+          "segment: giữ đúng số record, drain hết");
+    // O(1): chi phí / record không tăng theo kích thước queue
+    check(seg.lastWindowUs <= seg.firstWindowUs * 2 + 1000, "segment: enqueue không tăng theo N");
+    check(seg.countUs < 1000, "segment: count < 1 ms");
+    if (n >= 1000 && old.enqueued >= SIM_WINDOW) {
+      check(seg.lastWindowUs < old.lastWindowUs, "segment: enqueue nhanh hơn queue cũ");
+    }
+  }
+
+  runRecoverTest();
+
+  Serial.printf("\n=== Kết quả: %d PASS, %d FAIL ===\n", passed, failed);
+}
+
+void loop()
+{
+  delay(1000);
+}
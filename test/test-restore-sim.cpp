@@ -0,0 +1,192 @@
+/*
+ * BENCHMARK RESTORE TEMPLATE VỚI SERVER + SENSOR GIẢ LẬP
+ * Mục đích: Đo thời gian restore 127 và 1.000 template của TemplateRestorer (pipeline
+ *           download ‖ upload) so với chạy tuần tự như code cũ (GET → decode → DownChar
+ *           → Store → delay), với độ trễ server / sensor cấu hình được, và kiểm tra ring
+ *           buffer không giao nhầm template giữa 2 stage
+ * Dùng khi: Sửa template-restore.cpp / RESTORE_RING_SLOTS (chạy bằng quick-test.sh, chọn 9)
+ *           Không cần WiFi, Directus hay R307. Chạy hết ~15 phút
+ */
+
+#include <Arduino.h>
+#include "template-restore.h"
+
+#define SIM_SENSOR_MS 150      // DownChar ~100 ms trên UART 57600 (test-upchar-sim) + Store
+#define SIM_PAGE_MS 200        // 1 trang manifest (RESTORE_MANIFEST_PAGE_SIZE record)
+#define SIM_LEGACY_DELAY_MS 100  // delay() giữa các template của code cũ
+#define SIM_SLACK_PCT 5        // Sai số cho phép so với stage chậm hơn
+
+struct Scenario {
+  uint16_t templates;
+  uint32_t serverMs;     // HTTP GET + base64 decode 1 template
+  bool legacy;           // Đo thêm chạy tuần tự (mốc so sánh)
+};
+
+const Scenario SCENARIOS[] = {
+  {127, 100, true},      // Sensor chậm hơn server
+  {127, 250, true},      // Server chậm hơn sensor
+  {1000, 100, true},
+  {1000, 250, false},
+};
+
+// Template giả lập: nội dung suy ra từ ID → sensor kiểm tra được template đúng slot
+void fillTemplate(uint16_t id, uint8_t* data) {
+  for (uint16_t j = 0; j < R307_TEMPLATE_SIZE; j++) data[j] = (uint8_t)(id * 31 + j);
+}
+
+bool checkTemplate(uint16_t id, const uint8_t* data) {
+  for (uint16_t j = 0; j < R307_TEMPLATE_SIZE; j++) {
+    if (data[j] != (uint8_t)(id * 31 + j)) return false;
+  }
+  return true;
+}
+
+/**
+ * Directus giả lập: danh sách fingerprint 1..templates, mỗi trang và mỗi template
+ * tốn thời gian như request thật
+ */
+class SimSource : public RestoreSource {
+public:
+  uint16_t templates;
+  uint32_t serverMs;
+
+  int forEachFingerprint(const String& deviceMac, const char* fields, const String& query,
+                         FingerprintRecordCallback callback, int pageSize) override {
+    for (uint16_t id = 1; id <= templates; id++) {
+      if ((id - 1) % pageSize == 0) delay(SIM_PAGE_MS);
+
+      JsonDocument doc;
+      doc["id"] = String("sim-") + id;
+      doc["finger_print_id"] = id;
+      if (!callback(doc.as<JsonObject>())) return id;
+    }
+    return templates;
+  }
+
+  bool downloadFingerprintTemplate(const String& fingerprintId, uint8_t* templateBuffer,
+                                   uint16_t* templateSize, uint16_t* fingerprintIdLocal) override {
+    delay(serverMs);
+    uint16_t id = fingerprintId.substring(4).toInt();
+    fillTemplate(id, templateBuffer);
+    *templateSize = R307_TEMPLATE_SIZE;
+    *fingerprintIdLocal = id;
+    return true;
+  }
+
+  MemberCache* getMemberCache() override { return nullptr; }
+  SlotManager* getSlotManager() override { return nullptr; }
+};
+
+// R307 giả lập: DownChar + Store tốn SIM_SENSOR_MS, đếm template sai nội dung
+class SimSensor : public RestoreSensor {
+public:
+  uint16_t stored;
+  uint16_t corrupt;
+
+  bool uploadModel(uint16_t id, uint8_t* templateBuffer, uint16_t templateSize) override {
+    delay(SIM_SENSOR_MS);
+    if (templateSize != R307_TEMPLATE_SIZE || !checkTemplate(id, templateBuffer)) {
+      corrupt++;
+      return false;
+    }
+    stored++;
+    return true;
+  }
+
+  bool deleteFingerprint(uint16_t id) override { return true; }
+  bool hasIndexTable() override { return false; }  // Không diff → restore toàn bộ
+  bool isSlotUsed(uint16_t id) override { return false; }
+  uint16_t getCapacity() override { return MEMBER_CACHE_SLOTS; }
+  TemplateManifest* getManifest() override { return nullptr; }
+};
+
+SimSource source;
+SimSensor sensor;
+int passed = 0;
+int failed = 0;
+
+// Code cũ: từng template GET → decode → DownChar → Store → delay, không chồng lấn
+unsigned long runLegacy() {
+  uint8_t data[R307_TEMPLATE_SIZE];
+  unsigned long start = millis();
+  source.forEachFingerprint("", "", "", [&](JsonObject fp) {
+    uint16_t size, localId;
+    if (source.downloadFingerprintTemplate(fp["id"] | "", data, &size, &localId)) {
+      sensor.uploadModel(localId, data, size);
+    }
+    delay(SIM_LEGACY_DELAY_MS);
+    return true;
+  }, RESTORE_MANIFEST_PAGE_SIZE);
+  return millis() - start;
+}
+
+void runScenario(const Scenario& sc) {
+  Serial.printf("\n→ %d template, server %lums, sensor %dms\n",
+                sc.templates, (unsigned long)sc.serverMs, SIM_SENSOR_MS);
+  source.templates = sc.templates;
+  source.serverMs = sc.serverMs;
+
+  unsigned long legacyMs = 0;
+  if (sc.legacy) {
+    sensor.stored = 0;
+    sensor.corrupt = 0;
+    legacyMs = runLegacy();
+    Serial.printf("  Tuần tự (code cũ): %lums (%lums / template)\n",
+                  legacyMs, legacyMs / sc.templates);
+  }
+
+  sensor.stored = 0;
+  sensor.corrupt = 0;
+  TemplateRestorer restorer(&source, &sensor);
+  RestoreStats stats = restorer.restore("", false);
+
+  unsigned long slowest = stats.downloadMs > stats.uploadMs ? stats.downloadMs : stats.uploadMs;
+  unsigned long listMs = (unsigned long)((sc.templates + RESTORE_MANIFEST_PAGE_SIZE - 1) /
+                                         RESTORE_MANIFEST_PAGE_SIZE) * SIM_PAGE_MS;
+  // Stage chậm hơn + 1 template của stage kia (đầu / cuối pipeline) + list trang
+  unsigned long bound = slowest * (100 + SIM_SLACK_PCT) / 100 + sc.serverMs + SIM_SENSOR_MS + listMs;
+
+  Serial.printf("  Pipeline: %lums (%lums / template) | download %lums, upload %lums\n",
+                stats.elapsedMs, stats.elapsedMs / sc.templates,
+                stats.downloadMs, stats.uploadMs);
+  Serial.printf("  synced=%d/%d failed=%d sai nội dung=%d | giới hạn %lums",
+                stats.synced, stats.total, stats.failed, sensor.corrupt, bound);
+  if (legacyMs) {
+    Serial.printf(" | nhanh hơn code cũ %.2fx", (float)legacyMs / stats.elapsedMs);
+  }
+  Serial.println();
+
+  bool ok = stats.synced == sc.templates && sensor.corrupt == 0 &&
+            stats.elapsedMs <= bound && (!legacyMs || stats.elapsedMs < legacyMs);
+  if (ok) {
+    passed++;
+    Serial.println("  ✓ PASS");
+  } else {
+    failed++;
+    Serial.println("  ✗ FAIL (cần đủ template, không sai nội dung, "
+                   "thời gian ≈ stage chậm hơn và nhanh hơn code cũ)");
+  }
+}
+
+void setup()
+{
+  Serial.begin(115200);
+  delay(2000);
+
+  Serial.println("\n╔═══════════════════════════════════╗");
+  Serial.println("║  BENCHMARK RESTORE (SIM)          ║");
+  Serial.println("╚═══════════════════════════════════╝");
+  Serial.printf("Ring %d buffer, trang manifest %d record\n",
+                RESTORE_RING_SLOTS, RESTORE_MANIFEST_PAGE_SIZE);
+
+  for (const Scenario& sc : SCENARIOS) {
+    runScenario(sc);
+  }
+
+  Serial.printf("\n=== Kết quả: %d PASS, %d FAIL ===\n", passed, failed);
+}
+
+void loop()
+{
+  delay(1000);
+}
@@ -0,0 +1,215 @@
+/*
+ * TEST LỊCH POLL VÂN TAY VỚI ĐỒNG HỒ ẢO
+ * Mục đích: Đo time-to-detect (p50 / p99), số poll / phút và số ngón tay bị bỏ lỡ
+ *           của ScanScheduler so với poll cố định 1 giây (code cũ), không cần R307
+ * Dùng khi: Sửa scan-scheduler.cpp hoặc các SCAN_* trong config.h
+ *           (chạy bằng quick-test.sh, chọn 4)
+ */
+
+#include <Arduino.h>
+#include "scan-scheduler.h"
+
+#define SIM_FIXED_INTERVAL_MS 1000  // FINGERPRINT_CHECK_INTERVAL cũ
+#define SIM_TICK_MS 10              // Một vòng loop() khi chưa tới lúc poll
+#define SIM_POLL_MS 60              // getImage() trên UART 57600
+#define SIM_VERIFY_MS 400           // image2Tz + search + publish khi có ngón tay
+#define SIM_MAX_FINGERS 200
+#define SIM_BURST_SIZE 8            // Giờ vào ca: 8 người xếp hàng liên tiếp
+
+// Một lần đặt tay: lúc đặt và thời gian giữ
+struct Finger {
+  unsigned long placeAt;
+  unsigned long holdMs;
+};
+
+Finger fingers[SIM_MAX_FINGERS];
+uint16_t fingerCount = 0;
+unsigned long simEnd = 0;
+
+uint32_t lcgState;
+
+uint32_t lcgNext() {
+  lcgState = lcgState * 1664525UL + 1013904223UL;
+  return lcgState >> 8;
+}
+
+unsigned long lcgRange(unsigned long lo, unsigned long hi) {
+  return lo + lcgNext() % (hi - lo + 1);
+}
+
+/**
+ * Sinh lịch đặt tay cố định (cùng seed → mọi chế độ chạy cùng một kịch bản):
+ * từng đợt SIM_BURST_SIZE người cách nhau 2-5 s, giữa các đợt nghỉ 30 s - 5 phút
+ */
+void buildTraffic(uint32_t seed) {
+  lcgState = seed;
+  fingerCount = 0;
+  unsigned long t = 5000;
+  while (fingerCount + SIM_BURST_SIZE <= SIM_MAX_FINGERS) {
+    for (uint8_t i = 0; i < SIM_BURST_SIZE; i++) {
+      Finger& f = fingers[fingerCount++];
+      f.placeAt = t;
+      f.holdMs = lcgRange(700, 1500);
+      t += f.holdMs + lcgRange(2000, 5000);
+    }
+    t += lcgRange(30000, 300000);
+  }
+  simEnd = t;
+}
+
+enum SimMode {
+  SIM_FIXED,     // Poll mỗi 1 giây như code cũ
+  SIM_ADAPTIVE,  // ScanScheduler, ngoài giờ cao điểm
+  SIM_PEAK,      // ScanScheduler, trong giờ cao điểm
+  SIM_TOUCH      // ScanScheduler + ngắt chân Touch
+};
+
+struct Scenario {
+  const char* name;
+  SimMode mode;
+  unsigned long maxP99Ms;   // 0 = chỉ in kết quả (mốc so sánh)
+};
+
+uint32_t latencies[SIM_MAX_FINGERS];
+int passed = 0;
+int failed = 0;
+
+uint32_t nearestRank(uint16_t count, uint8_t pct) {
+  if (count == 0) return 0;
+  uint16_t rank = (count * pct + 99) / 100;
+  return latencies[rank - 1];
+}
+
+void runScenario(const Scenario& sc, uint32_t& fixedP50) {
+  Serial.printf("\n→ %s\n", sc.name);
+
+  ScanScheduler scheduler;
+  scheduler.setPeak(sc.mode == SIM_PEAK);
+  scheduler.setTouchEnabled(sc.mode == SIM_TOUCH);
+
+  unsigned long t = 0;
+  unsigned long lastPoll = 0;
+  bool polled = false;
+  uint32_t polls = 0;
+  uint16_t next = 0;        // Ngón tay tiếp theo chưa được phát hiện
+  uint16_t notified = 0;    // Ngón tay tiếp theo chưa phát ngắt Touch
+  uint16_t detected = 0;
+  uint16_t missed = 0;
+  uint32_t iterations = 0;
+
+  while (t < simEnd) {
+    // Nhấc tay trước khi được poll thấy → bỏ lỡ
+    while (next < fingerCount && t >= fingers[next].placeAt + fingers[next].holdMs) {
+      missed++;
+      next++;
+    }
+    if (sc.mode == SIM_TOUCH) {
+      while (notified < fingerCount && fingers[notified].placeAt <= t) {
+        scheduler.notifyTouch(fingers[notified].placeAt);
+        notified++;
+      }
+    }
+
+    bool due = sc.mode == SIM_FIXED
+        ? (!polled || t - lastPoll >= SIM_FIXED_INTERVAL_MS)
+        : scheduler.isDue(t);
+    if (!due) {
+      t += SIM_TICK_MS;
+    } else {
+      polls++;
+      polled = true;
+      lastPoll = t;
+
+      // Ngón tay mới đặt lên, hoặc ngón tay vừa phát hiện chưa nhấc ra
+      const Finger* f = next < fingerCount ? &fingers[next] : nullptr;
+      bool placed = f && t >= f->placeAt;
+      bool holding = next > 0 && t < fingers[next - 1].placeAt + fingers[next - 1].holdMs;
+      if (sc.mode != SIM_FIXED) scheduler.recordPoll(placed || holding, t);
+
+      if (placed) {
+        latencies[detected++] = t - f->placeAt;
+        next++;
+        t += SIM_VERIFY_MS;
+      } else {
+        t += SIM_POLL_MS;
+      }
+    }
+
+    // Vòng giả lập dài → nhường CPU cho idle task (watchdog)
+    if (++iterations % 50000 == 0) delay(1);
+  }
+  missed += fingerCount - next;
+
+  // Sắp xếp tăng dần để lấy p50 / p99 chính xác
+  for (uint16_t i = 1; i < detected; i++) {
+    uint32_t value = latencies[i];
+    int16_t j = i - 1;
+    while (j >= 0 && latencies[j] > value) {
+      latencies[j + 1] = latencies[j];
+      j--;
+    }
+    latencies[j + 1] = value;
+  }
+  uint32_t p50 = nearestRank(detected, 50);
+  uint32_t p99 = nearestRank(detected, 99);
+  float minutes = simEnd / 60000.0f;
+
+  Serial.printf("  detected=%d/%d missed=%d p50=%lums p99=%lums max=%lums polls/min=%.0f\n",
+                detected, fingerCount, missed, (unsigned long)p50, (unsigned long)p99,
+                (unsigned long)(detected ? latencies[detected - 1] : 0), polls / minutes);
+  if (sc.mode != SIM_FIXED) {
+    ScanStats stats = scheduler.getStats();
+    Serial.printf("  scheduler: detects=%lu p50=%lums p99=%lums (ước lượng trên thiết bị) mode=%s\n",
+                  (unsigned long)stats.detects, (unsigned long)stats.detectP50Ms,
+                  (unsigned long)stats.detectP99Ms, scheduler.getMode());
+  }
+
+  if (sc.mode == SIM_FIXED) {
+    fixedP50 = p50;
+    Serial.println("  (mốc so sánh)");
+    return;
+  }
+
+  bool ok = missed == 0 && p99 <= sc.maxP99Ms && p50 < fixedP50;
+  if (ok) {
+    passed++;
+    Serial.println("  ✓ PASS");
+  } else {
+    failed++;
+    Serial.printf("  ✗ FAIL (cần missed=0, p99 <= %lums, p50 < %lums)\n",
+                  sc.maxP99Ms, (unsigned long)fixedP50);
+  }
+}
+
+const Scenario SCENARIOS[] = {
+  {"Poll cố định 1 giây (code cũ)", SIM_FIXED, 0},
+  {"Thích ứng: fast → backoff tới idle", SIM_ADAPTIVE, SCAN_IDLE_INTERVAL_MS + SIM_POLL_MS + SIM_TICK_MS},
+  {"Thích ứng: giờ cao điểm", SIM_PEAK, SCAN_PEAK_INTERVAL_MS + SIM_POLL_MS + SIM_TICK_MS},
+  {"Thích ứng + ngắt chân Touch", SIM_TOUCH, SIM_POLL_MS + SIM_TICK_MS},
+};
+
+void setup()
+{
+  Serial.begin(115200);
+  delay(2000);
+
+  Serial.println("\n╔═══════════════════════════════════╗");
+  Serial.println("║  TEST LỊCH POLL VÂN TAY (SIM)     ║");
+  Serial.println("╚═══════════════════════════════════╝");
+
+  buildTraffic(12345);
+  Serial.printf("Kịch bản: %d lần đặt tay trong %lu phút (ảo)\n",
+                fingerCount, simEnd / 60000);
+
+  uint32_t fixedP50 = 0;
+  for (const Scenario& sc : SCENARIOS) {
+    runScenario(sc, fixedP50);
+  }
+
+  Serial.printf("\n=== Kết quả: %d PASS, %d FAIL ===\n", passed, failed);
+}
+
+void loop()
+{
+  delay(1000);
+}
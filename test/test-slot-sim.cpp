@@ -0,0 +1,349 @@
+/*
+ * TEST SLOT CACHE (LRU + PRELOAD) VỚI 2 TUẦN CHECK-IN GIẢ LẬP
+ * Mục đích: Replay check-in của ~2.500 member branch qua SlotManager thật (sensor giả lập,
+ *           đồng hồ ảo), preload mỗi giờ qua SlotManager::preload() như preloadRecentMembers(),
+ *           báo hit rate / miss / load / eviction theo ngày và theo tuần, so với sensor
+ *           giữ cố định các template enroll tại device (code cũ)
+ * Dùng khi: Sửa slot-manager.cpp / SLOT_PRELOAD_* (chạy bằng quick-test.sh, chọn 10)
+ *           Không cần WiFi, Directus hay R307
+ *
+ * test/slot-sim-model.py: mô hình Python cùng lịch check-in + chính sách, chạy trên máy
+ * để ước lượng trước số sketch này in ra.
+ *
+ * Member cache / slot table chỉ nằm trong RAM (không begin() → không save()),
+ * không đụng dữ liệu thật trên flash. Đồng hồ hệ thống bị đặt sang 10/2026.
+ */
+
+#include <Arduino.h>
+#include <algorithm>
+#include <sys/time.h>
+#include "slot-manager.h"
+
+#define SIM_MEMBERS 2500
+#define SIM_DAYS 14                 // Tuần 1 làm nóng cache, tuần 2 = trạng thái ổn định
+#define SIM_START 1791158400UL      // 2026-10-05 00:00 (thứ Hai)
+#define SIM_SEED 20261005UL
+#define SIM_DAY_SECONDS 86400UL
+
+// Tần suất tập (xác suất check-in mỗi ngày, phần nghìn)
+#define SIM_REGULAR_PCT 20          // 20% tập ~5 buổi / tuần
+#define SIM_CASUAL_PCT 50           // 50% tập ~1 buổi / tuần
+#define SIM_REGULAR_PERMILLE 714
+#define SIM_CASUAL_PERMILLE 143
+#define SIM_RARE_PERMILLE 36        // Còn lại ~1 buổi / 4 tuần
+
+struct Scenario {
+  uint16_t capacity;               // Slot 1..capacity-1 dùng được
+};
+
+const Scenario SCENARIOS[] = {
+  {1000},                          // R307 thật
+  {500},                           // Cache chật: eviction nhiều
+};
+
+struct Visit {
+  uint32_t time;
+  uint16_t member;
+};
+
+uint16_t dailyPermille[SIM_MEMBERS];
+uint32_t lastCheckIn[SIM_MEMBERS];  // Attendance của branch (0 = chưa check-in)
+Visit visits[SIM_MEMBERS];          // Tối đa 1 lần check-in / member / ngày
+bool seen[SIM_MEMBERS];
+MemberCache memberCache;
+int passed = 0;
+int failed = 0;
+
+uint32_t lcgState;
+
+uint32_t lcgNext() {
+  lcgState = lcgState * 1664525UL + 1013904223UL;
+  return lcgState >> 8;
+}
+
+uint32_t lcgRange(uint32_t lo, uint32_t hi) {
+  return lo + lcgNext() % (hi - lo + 1);
+}
+
+String fingerprintUuid(uint16_t member) {
+  char buf[37];
+  snprintf(buf, sizeof(buf), "f0000000-0000-4000-8000-%012u", member);
+  return String(buf);
+}
+
+String memberUuid(uint16_t member) {
+  char buf[37];
+  snprintf(buf, sizeof(buf), "a0000000-0000-4000-8000-%012u", member);
+  return String(buf);
+}
+
+void setClock(uint32_t t) {
+  struct timeval tv = {(time_t)t, 0};
+  settimeofday(&tv, nullptr);
+}
+
+// R307 giả lập: chỉ giữ bitmap slot đã có template, đếm số lần DownChar + Store
+class SimSensor : public SlotSensor {
+public:
+  uint16_t capacity;
+  bool used[MEMBER_CACHE_SLOTS];
+  uint32_t uploads;
+
+  void reset(uint16_t cap) {
+    capacity = cap;
+    memset(used, 0, sizeof(used));
+    uploads = 0;
+  }
+
+  uint16_t getCapacity() override { return capacity; }
+
+  uint16_t findFreeSlot(uint16_t from = 1) override {
+    for (uint16_t slot = from; slot < capacity; slot++) {
+      if (!used[slot]) return slot;
+    }
+    return 0;
+  }
+
+  bool hasIndexTable() override { return true; }
+
+  bool uploadModel(uint16_t id, uint8_t* templateBuffer, uint16_t templateSize) override {
+    if (id == 0 || id >= capacity || templateSize != R307_TEMPLATE_SIZE) return false;
+    used[id] = true;
+    uploads++;
+    return true;
+  }
+};
+
+SimSensor sensor;
+
+/**
+ * Attendance giả lập cho SlotManager::preload() (cùng chính sách với
+ * DirectusClient::preloadRecentMembers()): mọi member check-in trong SLOT_PRELOAD_DAYS ngày,
+ * template nạp thẳng bằng makeResident()
+ */
+class SimPreloadSource : public PreloadSource {
+public:
+  SlotManager* slots;
+  uint32_t now;
+
+  bool listRecentMembers(std::vector<PreloadMember>& members) override {
+    uint32_t since = now - SLOT_PRELOAD_DAYS * SIM_DAY_SECONDS;
+    for (uint16_t m = 0; m < SIM_MEMBERS; m++) {
+      if (lastCheckIn[m] != 0 && lastCheckIn[m] >= since) {
+        members.push_back({memberUuid(m), "", lastCheckIn[m]});
+      }
+    }
+    return true;
+  }
+
+  bool resolveFingerprints(std::vector<PreloadMember>& members, size_t first,
+                           size_t last) override {
+    for (size_t i = first; i < last; i++) {
+      members[i].fingerprintId = fingerprintUuid(members[i].memberId.substring(24).toInt());
+    }
+    return true;
+  }
+
+  bool loadTemplates(const std::vector<const PreloadMember*>& members, int& loaded) override {
+    for (const PreloadMember* member : members) {
+      if (slots->makeResident(member->fingerprintId, member->memberId, templateBuffer,
+                              R307_TEMPLATE_SIZE, member->lastActive) == 0) {
+        return false;
+      }
+      loaded++;
+    }
+    return true;
+  }
+
+private:
+  uint8_t templateBuffer[R307_TEMPLATE_SIZE] = {0};
+};
+
+SimPreloadSource preloadSource;
+
+// Lịch check-in 1 ngày: sáng 6-9h (40%) hoặc tối 17-21h (60%), sắp theo giờ
+uint16_t buildDay(uint32_t dayStart) {
+  uint16_t count = 0;
+  for (uint16_t m = 0; m < SIM_MEMBERS; m++) {
+    if (lcgRange(0, 999) >= dailyPermille[m]) continue;
+    uint32_t offset = lcgRange(0, 99) < 40 ? lcgRange(6 * 3600, 9 * 3600 - 1)
+                                           : lcgRange(17 * 3600, 21 * 3600 - 1);
+    visits[count++] = {dayStart + offset, m};
+  }
+  std::sort(visits, visits + count, [](const Visit& a, const Visit& b) {
+    return a.time < b.time;
+  });
+  return count;
+}
+
+// Mỗi member chỉ nằm ở tối đa 1 slot, số slot có template không vượt capacity
+bool checkResidency(uint16_t* resident) {
+  memset(seen, 0, sizeof(seen));
+  *resident = 0;
+  String fpId, memberId;
+  for (uint16_t slot = 1; slot < MEMBER_CACHE_SLOTS; slot++) {
+    if (!memberCache.lookup(slot, fpId, memberId)) continue;
+    if (slot >= sensor.capacity || !sensor.used[slot]) return false;
+    uint16_t m = fpId.substring(24).toInt();
+    if (m >= SIM_MEMBERS || seen[m]) return false;
+    seen[m] = true;
+    (*resident)++;
+  }
+  return true;
+}
+
+struct WeekStats {
+  uint32_t visits;
+  uint32_t hits;
+  uint32_t misses;
+  uint32_t loads;
+  uint32_t evictions;
+  uint32_t staticHits;     // Code cũ: sensor chỉ giữ template enroll tại device
+  uint16_t distinct;
+};
+
+void runScenario(const Scenario& sc) {
+  Serial.printf("\n→ Capacity %d slot, %d member, %d ngày\n", sc.capacity, SIM_MEMBERS, SIM_DAYS);
+
+  // Cùng seed → mọi capacity replay cùng một lịch check-in
+  lcgState = SIM_SEED;
+  for (uint16_t m = 0; m < SIM_MEMBERS; m++) {
+    uint32_t roll = lcgRange(0, 99);
+    dailyPermille[m] = roll < SIM_REGULAR_PCT ? SIM_REGULAR_PERMILLE
+                     : roll < SIM_REGULAR_PCT + SIM_CASUAL_PCT ? SIM_CASUAL_PERMILLE
+                     : SIM_RARE_PERMILLE;
+    lastCheckIn[m] = 0;
+  }
+  memset(seen, 0, sizeof(seen));
+
+  // Trạng thái đầu: sensor đầy template enroll tại device (member 0..capacity-2)
+  sensor.reset(sc.capacity);
+  memberCache.clear();
+  uint16_t localCount = sc.capacity - 1;
+  for (uint16_t slot = 1; slot <= localCount; slot++) {
+    memberCache.put(slot, fingerprintUuid(slot - 1), memberUuid(slot - 1), MEMBER_ACTIVE);
+    sensor.used[slot] = true;
+  }
+  SlotManager* slots = new SlotManager(&sensor, &memberCache);
+  preloadSource.slots = slots;
+
+  WeekStats weeks[2];
+  memset(weeks, 0, sizeof(weeks));
+  SlotStats weekStart = slots->getStats();
+  bool countsOk = true;
+
+  for (uint16_t day = 0; day < SIM_DAYS; day++) {
+    WeekStats& week = weeks[day / 7];
+    uint32_t dayStart = SIM_START + day * SIM_DAY_SECONDS;
+    uint16_t count = buildDay(dayStart);
+    SlotStats before = slots->getStats();
+    uint32_t nextPreload = dayStart;
+    uint32_t staticHits = 0;
+
+    for (uint16_t i = 0; i <= count; i++) {
+      uint32_t t = i < count ? visits[i].time : dayStart + SIM_DAY_SECONDS;
+      while (nextPreload <= t && nextPreload < dayStart + SIM_DAY_SECONDS) {
+        setClock(nextPreload);
+        preloadSource.now = nextPreload;
+        slots->preload(preloadSource, SLOT_PRELOAD_MAX);
+        nextPreload += SLOT_PRELOAD_INTERVAL_MS / 1000;
+      }
+      if (i == count) break;
+
+      // Scan: match → hit; không match → miss, nhân viên check-in tay (vẫn có attendance)
+      uint16_t m = visits[i].member;
+      setClock(t);
+      uint16_t slot = slots->findResident(fingerprintUuid(m));
+      if (slot != 0) {
+        slots->recordHit(slot);
+      } else {
+        slots->recordMiss();
+      }
+      if (m < localCount) staticHits++;
+      if (!seen[m]) {
+        seen[m] = true;
+        week.distinct++;
+      }
+      lastCheckIn[m] = t;
+    }
+
+    const SlotStats& after = slots->getStats();
+    uint32_t hits = after.hits - before.hits;
+    uint32_t misses = after.misses - before.misses;
+    if (hits + misses != count) countsOk = false;
+    week.visits += count;
+    week.staticHits += staticHits;
+
+    Serial.printf("  Ngày %2d: %3d check-in, hit %5.1f%% (cố định %5.1f%%), load %3lu, evict %3lu\n",
+                  day + 1, count, count ? 100.0f * hits / count : 0.0f,
+                  count ? 100.0f * staticHits / count : 0.0f,
+                  (unsigned long)(after.loads - before.loads),
+                  (unsigned long)(after.evictions - before.evictions));
+
+    if (day % 7 == 6) {
+      week.hits = after.hits - weekStart.hits;
+      week.misses = after.misses - weekStart.misses;
+      week.loads = after.loads - weekStart.loads;
+      week.evictions = after.evictions - weekStart.evictions;
+      weekStart = after;
+      memset(seen, 0, sizeof(seen));
+    }
+  }
+
+  for (uint8_t w = 0; w < 2; w++) {
+    const WeekStats& week = weeks[w];
+    Serial.printf("  Tuần %d: %lu check-in (%d member), hit %.1f%% (cố định %.1f%%), "
+                  "miss %lu, load %lu, evict %lu\n",
+                  w + 1, (unsigned long)week.visits, week.distinct,
+                  100.0f * week.hits / week.visits, 100.0f * week.staticHits / week.visits,
+                  (unsigned long)week.misses, (unsigned long)week.loads,
+                  (unsigned long)week.evictions);
+  }
+
+  uint16_t resident;
+  bool residencyOk = checkResidency(&resident);
+  const SlotStats& total = slots->getStats();
+  Serial.printf("  Resident %d/%d, sensor upload %lu = load %lu\n", resident, sc.capacity - 1,
+                (unsigned long)sensor.uploads, (unsigned long)total.loads);
+
+  // Tuần 2 (đã nóng) phải tốt hơn code cũ; cache nhỏ hơn số member tập/tuần thì phải evict
+  const WeekStats& steady = weeks[1];
+  bool ok = countsOk && residencyOk && sensor.uploads == total.loads &&
+            steady.hits > steady.staticHits &&
+            (steady.distinct < sc.capacity - 1 || steady.evictions > 0);
+  if (ok) {
+    passed++;
+    Serial.println("  ✓ PASS");
+  } else {
+    failed++;
+    Serial.println("  ✗ FAIL (cần hit + miss = check-in, mỗi member tối đa 1 slot, "
+                   "hit tuần 2 cao hơn sensor cố định, có eviction khi cache chật)");
+  }
+
+  delete slots;
+  memberCache.clear();
+}
+
+void setup()
+{
+  Serial.begin(115200);
+  delay(2000);
+
+  Serial.println("\n╔═══════════════════════════════════╗");
+  Serial.println("║  TEST SLOT CACHE (SIM)            ║");
+  Serial.println("╚═══════════════════════════════════╝");
+  Serial.printf("Preload mỗi %lus, tối đa %d template, member check-in trong %d ngày\n",
+                (unsigned long)(SLOT_PRELOAD_INTERVAL_MS / 1000), SLOT_PRELOAD_MAX,
+                SLOT_PRELOAD_DAYS);
+
+  for (const Scenario& sc : SCENARIOS) {
+    runScenario(sc);
+  }
+
+  Serial.printf("\n=== Kết quả: %d PASS, %d FAIL ===\n", passed, failed);
+}
+
+void loop()
+{
+  delay(1000);
+}